@@ -0,0 +1,127 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bench_history.c
+ * * * * * * * * * * * * * * * * * * *
+ * Measures reverse search through a
+ *  large generated history file: the
+ *  first search for text that is not
+ *  there, which indexes every block,
+ *  then searches with the index built
+ *  bench_history [-n entries] [-j results.json]
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../include/bcsh_history.h"
+
+#define DEFAULT_ENTRIES 2000000
+
+/**
+ * The words the generated entries are made of
+ */
+static char* commands[] = {
+    "ls -l", "git status", "git commit -m", "make -j8", "cd ..", "grep -rn", "vim", "ssh build",
+    "docker run --rm", "kubectl get pods -n", "cat", "tail -f /var/log/app", "python3 manage.py"
+};
+
+#define NUM_COMMANDS (sizeof(commands) / sizeof(commands[0]))
+
+/**
+ * What is searched for: common words, rare ones, one that is never there, and one too
+ *  short for the index
+ */
+static char* queries[] = {"git", "kubectl get pods -n deploy", "file-123456 ", "no such command", "cd"};
+
+#define NUM_QUERIES (sizeof(queries) / sizeof(queries[0]))
+
+static double now_seconds(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char** argv){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    char path[] = "/tmp/bench_history_XXXXXX";
+    long entries = DEFAULT_ENTRIES;
+    char* json_path = NULL;
+    FILE* json = NULL;
+    FILE* file;
+    double start;
+    double first;
+    double elapsed;
+    long found;
+    long i;
+    int fd;
+    int q;
+
+    for(i = 1; i < argc; i++){
+        if(strcmp(argv[i], "-n") == 0 && i + 1 < argc){
+            entries = atol(argv[++i]);
+        }else if(strcmp(argv[i], "-j") == 0 && i + 1 < argc){
+            json_path = argv[++i];
+        }
+    }
+
+    /********************************************************************
+    Write the history the way sessions would have
+    ********************************************************************/
+    fd = mkstemp(path);
+    if(fd == -1 || (file = fdopen(fd, "w")) == NULL){
+        perror("bench_history : Could not create history file ");
+        return EXIT_FAILURE;
+    }
+    srand(1);
+    for(i = 0; i < entries; i++){
+        fprintf(file, "%s %s-%d team%d\n", commands[rand() % NUM_COMMANDS],
+                (i % 1000 == 0) ? "deploy" : "file", rand() % 1000000, rand() % 50);
+    }
+    fclose(file);
+
+    if(history_open(path) == -1){
+        unlink(path);
+        return EXIT_FAILURE;
+    }
+    fprintf(stdout, "%ld entries\n", history_count());
+
+    start = now_seconds();
+    history_search("never there", history_count());
+    first = now_seconds() - start;
+    fprintf(stdout, "%-28s %10.3f ms (builds the index)\n", "first search", first * 1e3);
+
+    if(json_path != NULL){
+        json = fopen(json_path, "w");
+        if(json == NULL){
+            perror("bench_history : Could not open results file ");
+        }else{
+            fprintf(json, "{\"entries\":%ld,\"first_search_ms\":%.3f,\"queries\":[", entries, first * 1e3);
+        }
+    }
+
+    for(q = 0; q < (int)NUM_QUERIES; q++){
+        start = now_seconds();
+        found = history_search(queries[q], history_count());
+        elapsed = now_seconds() - start;
+        fprintf(stdout, "%-28s %10.3f ms -> %ld\n", queries[q], elapsed * 1e3, found + 1);
+        if(json != NULL){
+            fprintf(json, "%s{\"text\":\"%s\",\"ms\":%.3f,\"found\":%ld}", (q > 0) ? "," : "", queries[q], elapsed * 1e3, found + 1);
+        }
+    }
+
+    if(json != NULL){
+        fprintf(json, "]}\n");
+        fclose(json);
+    }
+    unlink(path);
+    return EXIT_SUCCESS;
+}
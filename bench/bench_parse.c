@@ -0,0 +1,155 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bench_parse.c
+ * * * * * * * * * * * * * * * * * * *
+ * Measures how fast parse_line() gets
+ *  through long generated command lines
+ *  and checks that it stays linear
+ *  bench_parse [-j results.json]
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../include/bcsh_arena.h"
+#include "../include/bcsh_parser.h"
+
+#define BENCH_REPEATS 5
+
+/**
+ * The words the generated lines are made of. They cover plain words, both kinds of
+ *  quotes, escapes, pipes, lists and redirections.
+ */
+static char* pieces[] = {
+    "ls", "-l", "'single quoted'", "\"double \\\"quoted\\\"\"", "esc\\ aped", "|",
+    "grep", "x", "2>&1", "&&", "echo", ">>", "out.txt", ";", "cat", "<", "in.txt", "||"
+};
+
+#define NUM_PIECES (sizeof(pieces) / sizeof(pieces[0]))
+
+static double now_seconds(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Builds a line of roughly num_tokens tokens that always parses
+ * @return A malloced line, its length is stored in length
+ */
+static char* generate_line(size_t num_tokens, size_t* length){
+    size_t capacity = num_tokens * 24 + 64;
+    char* line = malloc(capacity);
+    size_t used = 0;
+    size_t i;
+
+    if(line == NULL){
+        fprintf(stderr, "bench_parse : Could not allocate space for line\n");
+        exit(EXIT_FAILURE);
+    }
+    for(i = 0; i < num_tokens; i++){
+        used += sprintf(line + used, "%s ", pieces[i % NUM_PIECES]);
+    }
+    used += sprintf(line + used, "end\n");
+    *length = used;
+    return line;
+}
+
+int main(int argc, char** argv){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    size_t sizes[] = {1000, 10000, 100000, 200000, 400000};
+    size_t num_sizes = sizeof(sizes) / sizeof(sizes[0]);
+    size_t length;
+    size_t i;
+    int repeat;
+    char* original;
+    char* line;
+    struct pipeline* list;
+    double start;
+    double best;
+    double elapsed;
+    double ns_per_token;
+    double first_ns_per_token = 0;
+    double worst_ratio = 0;
+    FILE* json = NULL;
+
+    /********************************************************************
+    -j writes the results as JSON as well, for make bench
+    ********************************************************************/
+    if(argc == 3 && strcmp(argv[1], "-j") == 0){
+        json = fopen(argv[2], "w");
+        if(json == NULL){
+            perror("bench_parse : Could not open JSON output ");
+            return EXIT_FAILURE;
+        }
+        fprintf(json, "{\"sizes\":[");
+    }
+
+    printf("%10s %12s %12s %12s %10s\n", "tokens", "bytes", "seconds", "ns/token", "MB/s");
+
+    for(i = 0; i < num_sizes; i++){
+        original = generate_line(sizes[i], &length);
+        line = malloc(length + 1);
+        if(line == NULL){
+            fprintf(stderr, "bench_parse : Could not allocate space for line\n");
+            return EXIT_FAILURE;
+        }
+
+        /********************************************************************
+        parse_line() modifies the line, so it gets a fresh copy each time.
+            The best of a few runs is kept.
+        ********************************************************************/
+        best = 0;
+        for(repeat = 0; repeat < BENCH_REPEATS; repeat++){
+            memcpy(line, original, length + 1);
+            start = now_seconds();
+            if(parse_line(line, &list) != 0){
+                fprintf(stderr, "bench_parse : generated line did not parse\n");
+                return EXIT_FAILURE;
+            }
+            elapsed = now_seconds() - start;
+            arena_reset(&line_arena);
+            if(repeat == 0 || elapsed < best){
+                best = elapsed;
+            }
+        }
+
+        ns_per_token = best * 1e9 / sizes[i];
+        printf("%10zu %12zu %12.6f %12.1f %10.1f\n",
+               sizes[i], length, best, ns_per_token, length / best / 1e6);
+        if(json != NULL){
+            fprintf(json, "%s{\"tokens\":%zu,\"bytes\":%zu,\"seconds\":%.9f,\"ns_per_token\":%.2f,\"mb_per_s\":%.2f}",
+                    (i > 0) ? "," : "", sizes[i], length, best, ns_per_token, length / best / 1e6);
+        }
+
+        if(i == 0){
+            first_ns_per_token = ns_per_token;
+        }else if(ns_per_token / first_ns_per_token > worst_ratio){
+            worst_ratio = ns_per_token / first_ns_per_token;
+        }
+
+        free(line);
+        free(original);
+    }
+
+    /********************************************************************
+    A linear parser costs the same per token at every size. Allow for
+        cache effects on the larger lines.
+    ********************************************************************/
+    printf("worst ns/token ratio against %zu tokens: %.2f (%s)\n", sizes[0], worst_ratio,
+           worst_ratio < 3.0 ? "linear" : "NOT LINEAR");
+    if(json != NULL){
+        fprintf(json, "],\"worst_ratio\":%.3f,\"linear\":%s}\n", worst_ratio, worst_ratio < 3.0 ? "true" : "false");
+        fclose(json);
+    }
+
+    return (worst_ratio < 3.0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,236 @@
+#!/bin/sh
+#
+# Brennan Couturier
+#
+# bench_script.sh
+#
+# Compares bcsh against dash and bash (or the shells given in $SHELLS)
+#  on the hot paths of a shell:
+#   - startup to first exec: sh -c /bin/true, repeated
+#   - main loop overhead: a long script of lines that do not fork
+#   - fork/exec latency: a script of /bin/true lines
+#   - pipeline setup and teardown: /bin/true | ... | /bin/true with
+#     2 to 1000 stages
+#   - byte throughput through a long pipeline of cat
+#   - the same with a file of CAT_MB (1 GiB) through cat, as the shell
+#     runs it (bcsh's cat is internal and lets the kernel move the
+#     bytes) and through /bin/cat
+#   - pathname expansion of a few patterns in a directory of GLOB_FILES
+#     (100000) entries
+#   - command substitution: SUBSTITUTIONS (100000) lines of x=$(echo hi),
+#     which bcsh runs without forking, and as many of x=$(/bin/echo hi)
+#   - control flow, in ns per iteration of LOOP_ITERATIONS (1000000):
+#     an empty for loop, one running an if, one running a case, and one
+#     calling a function; then a function that shifts its SHIFT_ARGS
+#     (100000) arguments away in a while loop
+#
+# The table goes to stdout. With $BENCH_JSON set, the results are also
+#  written there as JSON, together with the parser results from
+#  $PARSE_JSON (written by bench_parse -j), the history search results
+#  from $HISTORY_JSON (written by bench_history -j), the launch times
+#  from $SPAWN_JSON (written by bench_spawn -j) and the requests per
+#  second of bcsh --serve from $SERVE_JSON (written by bench_serve -j),
+#  so runs can be compared.
+#
+
+BCSH=${BCSH:-../bin/bcsh}
+SHELLS=${SHELLS:-"$BCSH dash bash"}
+STARTUP_RUNS=${STARTUP_RUNS:-500}
+SCRIPT_LINES=${SCRIPT_LINES:-200000}
+EXEC_LINES=${EXEC_LINES:-2000}
+PIPELINE_STAGES=${PIPELINE_STAGES:-"2 10 100 1000"}
+PIPELINE_WORK=${PIPELINE_WORK:-2000}
+THROUGHPUT_MB=${THROUGHPUT_MB:-256}
+THROUGHPUT_STAGES=${THROUGHPUT_STAGES:-8}
+CAT_MB=${CAT_MB:-1024}
+GLOB_FILES=${GLOB_FILES:-100000}
+SUBSTITUTIONS=${SUBSTITUTIONS:-100000}
+LOOP_ITERATIONS=${LOOP_ITERATIONS:-1000000}
+SHIFT_ARGS=${SHIFT_ARGS:-100000}
+WORKDIR=$(mktemp -d)
+trap 'rm -rf "$WORKDIR"' EXIT
+
+now_ns(){
+    date +%s%N
+}
+
+# Runs a script with the shell given, and prints how long it took in ns
+time_script(){
+    start=$(now_ns)
+    "$1" "$2" > /dev/null
+    echo $(( $(now_ns) - start ))
+}
+
+# Lines that every shell runs without forking
+i=0
+while [ $i -lt $SCRIPT_LINES ]; do
+    echo "cd . ; # comment $i"
+    i=$((i + 1))
+done > "$WORKDIR/lines.sh"
+
+i=0
+while [ $i -lt $EXEC_LINES ]; do
+    echo "/bin/true"
+    i=$((i + 1))
+done > "$WORKDIR/exec.sh"
+
+# One script per pipeline length, each running about PIPELINE_WORK stages
+for stages in $PIPELINE_STAGES; do
+    line=/bin/true
+    i=1
+    while [ $i -lt $stages ]; do
+        line="$line | /bin/true"
+        i=$((i + 1))
+    done
+    runs=$((PIPELINE_WORK / stages))
+    [ $runs -lt 2 ] && runs=2
+    i=0
+    while [ $i -lt $runs ]; do
+        echo "$line"
+        i=$((i + 1))
+    done > "$WORKDIR/pipeline_$stages.sh"
+done
+
+line="head -c ${THROUGHPUT_MB}M /dev/zero"
+i=0
+while [ $i -lt $THROUGHPUT_STAGES ]; do
+    line="$line | cat"
+    i=$((i + 1))
+done
+echo "$line | wc -c" > "$WORKDIR/throughput.sh"
+
+# A file read through a pipeline of cat, once with whatever cat the
+#  shell finds and once with /bin/cat
+head -c ${CAT_MB}M /dev/zero > "$WORKDIR/cat_input"
+for cat in cat /bin/cat; do
+    line="$cat $WORKDIR/cat_input"
+    i=1
+    while [ $i -lt $THROUGHPUT_STAGES ]; do
+        line="$line | $cat"
+        i=$((i + 1))
+    done
+    echo "$line > /dev/null"
+done > "$WORKDIR/cat_both.sh"
+head -n 1 "$WORKDIR/cat_both.sh" > "$WORKDIR/cat.sh"
+tail -n 1 "$WORKDIR/cat_both.sh" > "$WORKDIR/bin_cat.sh"
+
+# A big directory, globbed for everything, a suffix, a prefix and a
+#  pattern that has to run the matcher
+mkdir "$WORKDIR/glob"
+(cd "$WORKDIR/glob" && seq -f "f%06g.txt" "$GLOB_FILES" | xargs touch)
+for pattern in '*' '*.txt' 'f0001*' '*1?3*'; do
+    echo "echo $WORKDIR/glob/$pattern"
+done > "$WORKDIR/glob.sh"
+
+# Substitutions of an internal command, then of an external one
+i=0
+while [ $i -lt $SUBSTITUTIONS ]; do
+    echo 'x=$(echo hi)'
+    i=$((i + 1))
+done > "$WORKDIR/subst.sh"
+sed 's|echo|/bin/echo|' "$WORKDIR/subst.sh" > "$WORKDIR/subst_external.sh"
+
+# Loops that run the same parsed body over and over
+echo 'for i in $(seq '$LOOP_ITERATIONS'); do :; done' > "$WORKDIR/loop_for.sh"
+echo 'for i in $(seq '$LOOP_ITERATIONS'); do if [ $i = 0 ]; then :; fi; done' > "$WORKDIR/loop_if.sh"
+echo 'for i in $(seq '$LOOP_ITERATIONS'); do case $i in *5) : ;; esac; done' > "$WORKDIR/loop_case.sh"
+echo 'f(){ :; }; for i in $(seq '$LOOP_ITERATIONS'); do f $i; done' > "$WORKDIR/loop_call.sh"
+echo 'f(){ while [ $# -gt 0 ]; do shift; done; }; f $(seq '$SHIFT_ARGS')' > "$WORKDIR/loop_shift.sh"
+
+printf "%-10s %12s %12s %12s %12s %12s %12s %12s %12s %12s %12s %12s %12s %12s %12s %12s" "shell" "startup (us)" "lines/s" "ns/line" "exec (us)" "MB/s" "cat MB/s" "/bin/cat MB/s" "glob (ms)" "subst (us)" "ext subst (us)" \
+    "for (ns)" "if (ns)" "case (ns)" "call (ns)" "shift (ns)"
+for stages in $PIPELINE_STAGES; do
+    printf " %12s" "pipe$stages (us)"
+done
+printf "\n"
+
+shells_json=""
+for sh in $SHELLS; do
+    name=$(basename "$sh")
+    if ! command -v "$sh" > /dev/null 2>&1; then
+        printf "%-10s %12s\n" "$name" "not installed"
+        continue
+    fi
+
+    start=$(now_ns)
+    i=0
+    while [ $i -lt $STARTUP_RUNS ]; do
+        "$sh" -c /bin/true
+        i=$((i + 1))
+    done
+    startup_us=$(( ($(now_ns) - start) / STARTUP_RUNS / 1000 ))
+
+    elapsed=$(time_script "$sh" "$WORKDIR/lines.sh")
+    lines_per_s=$(( SCRIPT_LINES * 1000000000 / elapsed ))
+    ns_per_line=$(( elapsed / SCRIPT_LINES ))
+
+    elapsed=$(time_script "$sh" "$WORKDIR/exec.sh")
+    exec_us=$(( elapsed / EXEC_LINES / 1000 ))
+
+    elapsed=$(time_script "$sh" "$WORKDIR/throughput.sh")
+    mb_per_s=$(( THROUGHPUT_MB * 1000000000 / elapsed ))
+
+    elapsed=$(time_script "$sh" "$WORKDIR/cat.sh")
+    cat_mb_per_s=$(( CAT_MB * 1000000000 / elapsed ))
+
+    elapsed=$(time_script "$sh" "$WORKDIR/bin_cat.sh")
+    bin_cat_mb_per_s=$(( CAT_MB * 1000000000 / elapsed ))
+
+    elapsed=$(time_script "$sh" "$WORKDIR/glob.sh")
+    glob_ms=$(( elapsed / 1000000 ))
+
+    elapsed=$(time_script "$sh" "$WORKDIR/subst.sh")
+    subst_ns=$(( elapsed / SUBSTITUTIONS ))
+    elapsed=$(time_script "$sh" "$WORKDIR/subst_external.sh")
+    subst_external_ns=$(( elapsed / SUBSTITUTIONS ))
+
+    loops=""
+    loops_json=""
+    for loop in for if case call; do
+        elapsed=$(time_script "$sh" "$WORKDIR/loop_$loop.sh")
+        loops="$loops $(( elapsed / LOOP_ITERATIONS ))"
+        loops_json="$loops_json,\"${loop}_ns\":$(( elapsed / LOOP_ITERATIONS ))"
+    done
+    elapsed=$(time_script "$sh" "$WORKDIR/loop_shift.sh")
+    loops="$loops $(( elapsed / SHIFT_ARGS ))"
+    loops_json="$loops_json,\"shift_ns\":$(( elapsed / SHIFT_ARGS ))"
+
+    printf "%-10s %12s %12s %12s %12s %12s %12s %12s %12s %12s %12s %12s %12s %12s %12s %12s" "$name" "$startup_us" "$lines_per_s" "$ns_per_line" "$exec_us" "$mb_per_s" "$cat_mb_per_s" "$bin_cat_mb_per_s" "$glob_ms" \
+        "$((subst_ns / 1000)).$(( (subst_ns / 100) % 10 ))" "$((subst_external_ns / 1000))" $loops
+
+    pipelines_json=""
+    for stages in $PIPELINE_STAGES; do
+        runs=$(wc -l < "$WORKDIR/pipeline_$stages.sh")
+        elapsed=$(time_script "$sh" "$WORKDIR/pipeline_$stages.sh")
+        pipeline_us=$(( elapsed / runs / 1000 ))
+        stage_us=$(( elapsed / runs / stages / 1000 ))
+        printf " %12s" "$pipeline_us"
+        pipelines_json="$pipelines_json${pipelines_json:+,}{\"stages\":$stages,\"runs\":$runs,\"us_per_pipeline\":$pipeline_us,\"us_per_stage\":$stage_us}"
+    done
+    printf "\n"
+
+    shells_json="$shells_json${shells_json:+,}\"$name\":{\"startup_us\":$startup_us,\"lines_per_s\":$lines_per_s,\"ns_per_line\":$ns_per_line,\"exec_us\":$exec_us,\"throughput_mb_per_s\":$mb_per_s,\"cat_mb_per_s\":$cat_mb_per_s,\"bin_cat_mb_per_s\":$bin_cat_mb_per_s,\"glob_ms\":$glob_ms,\"substitution_ns\":$subst_ns,\"external_substitution_ns\":$subst_external_ns,\"loops\":{${loops_json#,}},\"pipelines\":[$pipelines_json]}"
+done
+
+if [ -n "$BENCH_JSON" ]; then
+    parse_json=null
+    if [ -n "$PARSE_JSON" ] && [ -f "$PARSE_JSON" ]; then
+        parse_json=$(cat "$PARSE_JSON")
+    fi
+    history_json=null
+    if [ -n "$HISTORY_JSON" ] && [ -f "$HISTORY_JSON" ]; then
+        history_json=$(cat "$HISTORY_JSON")
+    fi
+    spawn_json=null
+    if [ -n "$SPAWN_JSON" ] && [ -f "$SPAWN_JSON" ]; then
+        spawn_json=$(cat "$SPAWN_JSON")
+    fi
+    serve_json=null
+    if [ -n "$SERVE_JSON" ] && [ -f "$SERVE_JSON" ]; then
+        serve_json=$(cat "$SERVE_JSON")
+    fi
+    printf '{"date":"%s","host":"%s","cpus":%s,"parse":%s,"history":%s,"spawn":%s,"serve":%s,"shells":{%s}}\n' \
+        "$(date -u +%Y-%m-%dT%H:%M:%SZ)" "$(uname -srm)" "$(getconf _NPROCESSORS_ONLN)" \
+        "$parse_json" "$history_json" "$spawn_json" "$serve_json" "$shells_json" > "$BENCH_JSON"
+    echo "results written to $BENCH_JSON"
+fi
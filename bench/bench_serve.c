@@ -0,0 +1,220 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bench_serve.c
+ * * * * * * * * * * * * * * * * * * *
+ * Measures how many requests per second
+ *  bcsh --serve runs, over one connection
+ *  and over several at once, against a
+ *  fresh sh -c (and bcsh -c) per command
+ *  bench_serve [-b bcsh] [-n requests]
+ *              [-c connections] [-j results.json]
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "../include/bcsh_serve.h"
+
+#define DEFAULT_REQUESTS 2000
+
+#define DEFAULT_CONNECTIONS 4
+
+#define MAX_CONNECTIONS 64
+
+extern char** environ;
+
+/**
+ * The commands each way runs: one the shell runs itself, and one it launches
+ */
+static char* commands[] = {"true", "/bin/true"};
+
+#define NUM_COMMANDS (sizeof(commands) / sizeof(commands[0]))
+
+static double now_seconds(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Runs a command requests times with a fresh shell each time
+ * @return Requests per second, 0 if one failed
+ */
+static double fresh_shell(char* shell, char* command, long requests, int* fds){
+    char* argv[] = {shell, "-c", command, NULL};
+    posix_spawn_file_actions_t actions;
+    double start = now_seconds();
+    pid_t pid;
+    int status;
+    long i;
+
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[0], 0);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], 1);
+    for(i = 0; i < requests; i++){
+        if(posix_spawnp(&pid, shell, &actions, NULL, argv, environ) != 0
+           || waitpid(pid, &status, 0) != pid || status != 0){
+            posix_spawn_file_actions_destroy(&actions);
+            return 0;
+        }
+    }
+    posix_spawn_file_actions_destroy(&actions);
+    return requests / (now_seconds() - start);
+}
+
+/**
+ * Sends a command requests times over num_sockets connections at once, each sending
+ *  its next request as soon as it has the status of the last
+ * @return Requests per second, 0 if one failed
+ */
+static double served(int* sockets, int num_sockets, char* command, long requests, int* fds){
+    struct pollfd polled[MAX_CONNECTIONS];
+    double start = now_seconds();
+    long sent = 0;
+    long done = 0;
+    int status;
+    int i;
+
+    for(i = 0; i < num_sockets && sent < requests; i++, sent++){
+        if(client_send(sockets[i], command, environ, fds) == -1){
+            return 0;
+        }
+        polled[i].fd = sockets[i];
+        polled[i].events = POLLIN;
+    }
+    while(done < requests){
+        if(poll(polled, num_sockets, -1) == -1){
+            return 0;
+        }
+        for(i = 0; i < num_sockets; i++){
+            if(!(polled[i].revents & POLLIN)){
+                continue;
+            }
+            if(client_status(sockets[i], &status) == -1 || status != 0){
+                return 0;
+            }
+            done++;
+            if(sent < requests){
+                if(client_send(sockets[i], command, environ, fds) == -1){
+                    return 0;
+                }
+                sent++;
+            }else{
+                polled[i].fd = -1;
+            }
+        }
+    }
+    return requests / (now_seconds() - start);
+}
+
+int main(int argc, char** argv){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    char* bcsh = "../bin/bcsh";
+    char path[64];
+    char* server_argv[] = {NULL, "--serve", path, NULL};
+    long requests = DEFAULT_REQUESTS;
+    int num_connections = DEFAULT_CONNECTIONS;
+    int sockets[MAX_CONNECTIONS];
+    char* json_path = NULL;
+    FILE* json = NULL;
+    double rates[4];
+    int fds[3];
+    pid_t server;
+    long i;
+    int c;
+
+    for(i = 1; i < argc; i++){
+        if(strcmp(argv[i], "-b") == 0 && i + 1 < argc){
+            bcsh = argv[++i];
+        }else if(strcmp(argv[i], "-n") == 0 && i + 1 < argc){
+            requests = atol(argv[++i]);
+        }else if(strcmp(argv[i], "-c") == 0 && i + 1 < argc){
+            num_connections = atoi(argv[++i]);
+        }else if(strcmp(argv[i], "-j") == 0 && i + 1 < argc){
+            json_path = argv[++i];
+        }
+    }
+    if(num_connections < 1 || num_connections > MAX_CONNECTIONS){
+        num_connections = DEFAULT_CONNECTIONS;
+    }
+
+    /********************************************************************
+    Start the server, and wait until it takes connections
+    ********************************************************************/
+    snprintf(path, sizeof(path), "/tmp/bench_serve_%d.sock", (int) getpid());
+    server_argv[0] = bcsh;
+    if(posix_spawn(&server, bcsh, NULL, NULL, server_argv, environ) != 0){
+        perror("bench_serve : Could not start the server ");
+        return EXIT_FAILURE;
+    }
+    for(i = 0; i < 200 && (sockets[0] = client_connect(path)) == -1; i++){
+        usleep(10000);
+    }
+    if(sockets[0] == -1){
+        fprintf(stderr, "bench_serve : The server did not come up at %s\n", path);
+        kill(server, SIGTERM);
+        return EXIT_FAILURE;
+    }
+    for(c = 1; c < num_connections; c++){
+        sockets[c] = client_connect(path);
+        if(sockets[c] == -1){
+            perror("bench_serve : Could not connect ");
+            kill(server, SIGTERM);
+            return EXIT_FAILURE;
+        }
+    }
+
+    fds[0] = open("/dev/null", O_RDONLY);
+    fds[1] = open("/dev/null", O_WRONLY);
+    fds[2] = STDERR_FILENO;
+
+    if(json_path != NULL){
+        json = fopen(json_path, "w");
+        if(json == NULL){
+            perror("bench_serve : Could not open results file ");
+        }else{
+            fprintf(json, "{\"requests\":%ld,\"connections\":%d,\"commands\":[", requests, num_connections);
+        }
+    }
+
+    fprintf(stdout, "%-12s %12s %12s %12s %12s   (requests per second)\n", "command", "sh -c", "bcsh -c",
+            "serve", "serve x");
+    for(c = 0; c < (int)NUM_COMMANDS; c++){
+        rates[0] = fresh_shell("sh", commands[c], requests, fds);
+        rates[1] = fresh_shell(bcsh, commands[c], requests, fds);
+        rates[2] = served(sockets, 1, commands[c], requests, fds);
+        rates[3] = served(sockets, num_connections, commands[c], requests, fds);
+        fprintf(stdout, "%-12s %12.0f %12.0f %12.0f %12.0f\n", commands[c], rates[0], rates[1], rates[2], rates[3]);
+        if(json != NULL){
+            fprintf(json, "%s{\"command\":\"%s\",\"sh_c_per_s\":%.0f,\"bcsh_c_per_s\":%.0f,\"serve_per_s\":%.0f,"
+                    "\"serve_concurrent_per_s\":%.0f}", (c > 0) ? "," : "", commands[c], rates[0], rates[1],
+                    rates[2], rates[3]);
+        }
+    }
+    fprintf(stdout, "(serve x runs over %d connections at once)\n", num_connections);
+
+    if(json != NULL){
+        fprintf(json, "]}\n");
+        fclose(json);
+    }
+    for(c = 0; c < num_connections; c++){
+        close(sockets[c]);
+    }
+    kill(server, SIGTERM);
+    waitpid(server, NULL, 0);
+    return EXIT_SUCCESS;
+}
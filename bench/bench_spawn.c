@@ -0,0 +1,192 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bench_spawn.c
+ * * * * * * * * * * * * * * * * * * *
+ * Measures how long launching /bin/true
+ *  and waiting for it takes as the
+ *  process grows to 10 MiB, 100 MiB and
+ *  1 GiB: with fork() and execve(), with
+ *  posix_spawn(), and through the spawn
+ *  helper forked while it was small
+ *  bench_spawn [-n runs] [-j results.json]
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <spawn.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "../include/bcsh_zygote.h"
+
+#define DEFAULT_RUNS 200
+
+extern char** environ;
+
+/**
+ * The sizes the process is grown to, in MiB
+ */
+static long sizes[] = {10, 100, 1024};
+
+#define NUM_SIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+#define NUM_BACKENDS 3
+
+static char* backends[NUM_BACKENDS] = {"fork", "posix_spawn", "zygote"};
+
+static char* command[] = {"/bin/true", NULL};
+
+static double now_seconds(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Gives the resident size of the process in MiB
+ */
+static long rss_mib(){
+    long pages = 0;
+    FILE* statm = fopen("/proc/self/statm", "r");
+
+    if(statm != NULL){
+        if(fscanf(statm, "%*s %ld", &pages) != 1){
+            pages = 0;
+        }
+        fclose(statm);
+    }
+    return pages * sysconf(_SC_PAGESIZE) / (1024 * 1024);
+}
+
+/**
+ * Launches the command once with a backend and waits for it
+ * @return 0 on success, -1 on failure
+ */
+static int launch(int backend){
+    struct zygote_fd fds[3] = {{0, 0}, {1, 1}, {2, 2}};
+    pid_t pid;
+    int status;
+
+    if(backend == 0){
+        pid = fork();
+        if(pid == 0){
+            execve(command[0], command, environ);
+            _exit(127);
+        }
+        if(pid == -1){
+            return -1;
+        }
+    }else if(backend == 1){
+        if(posix_spawn(&pid, command[0], NULL, NULL, command, environ) != 0){
+            return -1;
+        }
+    }else if(zygote_spawn(command[0], command, environ, fds, 3, -1, 0, &pid) != 0){
+        return -1;
+    }
+    return (waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0) ? 0 : -1;
+}
+
+int main(int argc, char** argv){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    long runs = DEFAULT_RUNS;
+    char* json_path = NULL;
+    FILE* json = NULL;
+    char* memory;
+    size_t mapped = 0;
+    size_t wanted;
+    double start;
+    double us[NUM_BACKENDS];
+    long i;
+    int s;
+    int b;
+
+    for(i = 1; i < argc; i++){
+        if(strcmp(argv[i], "-n") == 0 && i + 1 < argc){
+            runs = atol(argv[++i]);
+        }else if(strcmp(argv[i], "-j") == 0 && i + 1 < argc){
+            json_path = argv[++i];
+        }
+    }
+
+    /********************************************************************
+    The helper is forked first, while the process is small, as the shell
+        does at startup
+    ********************************************************************/
+    if(zygote_start(-1) == -1){
+        return EXIT_FAILURE;
+    }
+
+    /********************************************************************
+    Reserve the largest size, then touch more of it for each size. Huge
+        pages are turned off, as a shell's memory is a heap of small
+        allocations, not one block.
+    ********************************************************************/
+    memory = mmap(NULL, sizes[NUM_SIZES - 1] << 20, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(memory == MAP_FAILED){
+        perror("bench_spawn : Could not map memory ");
+        return EXIT_FAILURE;
+    }
+    madvise(memory, sizes[NUM_SIZES - 1] << 20, MADV_NOHUGEPAGE);
+
+    if(json_path != NULL){
+        json = fopen(json_path, "w");
+        if(json == NULL){
+            perror("bench_spawn : Could not open results file ");
+        }else{
+            fprintf(json, "{\"runs\":%ld,\"sizes\":[", runs);
+        }
+    }
+
+    fprintf(stdout, "%-10s", "rss");
+    for(b = 0; b < NUM_BACKENDS; b++){
+        fprintf(stdout, " %14s", backends[b]);
+    }
+    fprintf(stdout, "   (us per launch and wait of %s)\n", command[0]);
+
+    for(s = 0; s < (int)NUM_SIZES; s++){
+        wanted = (size_t) sizes[s] << 20;
+        memset(memory + mapped, 1, wanted - mapped);
+        mapped = wanted;
+
+        for(b = 0; b < NUM_BACKENDS; b++){
+            launch(b); //Warm up
+            start = now_seconds();
+            for(i = 0; i < runs; i++){
+                if(launch(b) == -1){
+                    fprintf(stderr, "bench_spawn : %s could not launch %s\n", backends[b], command[0]);
+                    return EXIT_FAILURE;
+                }
+            }
+            us[b] = (now_seconds() - start) * 1e6 / runs;
+        }
+
+        fprintf(stdout, "%6ld MiB", rss_mib());
+        for(b = 0; b < NUM_BACKENDS; b++){
+            fprintf(stdout, " %11.1f us", us[b]);
+        }
+        fprintf(stdout, "\n");
+        if(json != NULL){
+            fprintf(json, "%s{\"mib\":%ld,\"rss_mib\":%ld", (s > 0) ? "," : "", sizes[s], rss_mib());
+            for(b = 0; b < NUM_BACKENDS; b++){
+                fprintf(json, ",\"%s_us\":%.1f", backends[b], us[b]);
+            }
+            fprintf(json, "}");
+        }
+    }
+
+    if(json != NULL){
+        fprintf(json, "]}\n");
+        fclose(json);
+    }
+    munmap(memory, mapped);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,65 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh_arena.h
+ * * * * * * * * * * * * * * * * * * *
+ * A bump allocator for memory that only
+ *  lives as long as one command line
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#ifndef BCSH_ARENA_H
+#define BCSH_ARENA_H
+
+#include <stddef.h>
+
+struct arena_chunk {
+    struct arena_chunk* next;
+    size_t size;
+    size_t used;
+    char data[];
+};
+
+struct arena {
+    struct arena_chunk* head;
+    struct arena_chunk* current;
+    size_t allocated; //Bytes handed out since the last reset
+    size_t high_water; //Most bytes ever handed out between two resets
+    unsigned long chunk_mallocs; //Number of times the arena itself called malloc()
+};
+
+/**
+ * A point in an arena to come back to, see arena_rewind()
+ */
+struct arena_mark {
+    struct arena_chunk* chunk;
+    size_t used;
+    size_t allocated;
+};
+
+extern struct arena line_arena;
+
+void* arena_alloc(struct arena* arena, size_t size);
+
+void* arena_realloc(struct arena* arena, void* old, size_t old_size, size_t new_size);
+
+char* arena_strdup(struct arena* arena, const char* string);
+
+void arena_mark(struct arena* arena, struct arena_mark* mark);
+
+void arena_rewind(struct arena* arena, struct arena_mark* mark);
+
+void arena_reset(struct arena* arena);
+
+void arena_release(struct arena* arena);
+
+struct alloc_stats {
+    int enabled; //0 unless bcsh was built with BCSH_ALLOC_STATS
+    unsigned long mallocs; //Calls to malloc(), calloc() and realloc()
+    unsigned long frees;
+};
+
+void get_alloc_stats(struct alloc_stats* stats);
+
+#endif
@@ -0,0 +1,35 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh_builtins.h
+ * * * * * * * * * * * * * * * * * * *
+ * The hash function of the perfect hash
+ *  table that finds internal commands.
+ *  The table itself is generated from
+ *  bcsh_builtins.def at build time by
+ *  tools/gen_builtin_hash.c.
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#ifndef BCSH_BUILTINS_H
+#define BCSH_BUILTINS_H
+
+/**
+ * FNV-1a, starting from a seed the generator picked so that no two internal commands
+ *  land in the same slot. The multiplications only carry bits upwards, so the high bits
+ *  are folded into the low ones the table is indexed with.
+ */
+static inline unsigned int builtin_hash(const char* name, unsigned int seed){
+    unsigned int hash = 2166136261u ^ seed;
+
+    while(*name != '\0'){
+        hash ^= (unsigned char)*name++;
+        hash *= 16777619u;
+    }
+    return hash ^ (hash >> 15);
+}
+
+int find_internal_command(char* name);
+
+#endif
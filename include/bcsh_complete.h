@@ -0,0 +1,29 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh_complete.h
+ * * * * * * * * * * * * * * * * * * *
+ * Completion of command names and
+ *  paths for the line editor
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#ifndef BCSH_COMPLETE_H
+#define BCSH_COMPLETE_H
+
+#include <stddef.h>
+
+/**
+ * What a word can be completed to: whole words, sorted, each replacing the word that was
+ *  completed. Directories end with a /. Only valid until the next completion.
+ */
+struct completions {
+    char** words;
+    size_t count;
+    size_t common; //Length of the prefix all the words share
+};
+
+struct completions* complete_word(char* word, int command);
+
+#endif
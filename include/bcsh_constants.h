@@ -8,16 +8,136 @@
  * * * * * * * * * * * * * * * * * * *
  */
 
-#define INITIAL_TOKEN_BUFFER 25
-
 #define MAX_TOKENS 100
 
 #define INITIAL_PATH_LENGTH 100
 
-#define NUM_INTERNAL_COMMANDS 4
-
 extern char* internal_command_names[];
 
 extern int (*internal_commands[]) ();
 
-#define TOKEN_DELIM " \t\n"
+#define ARENA_CHUNK_SIZE 16384
+
+#define ARENA_ALIGNMENT 16
+
+#define INPUT_BLOCK_SIZE 65536
+
+#define INPUT_LINE_READ_SIZE 1024 //Room kept free for each read of a line from a terminal without the line editor
+
+#define MAX_JOBS 256
+
+#define JOB_INLINE_PROCESSES 8 //Pipelines with up to this many stages do not malloc
+
+#define DEFAULT_PROMPT "%d%% " //The working directory followed by %, see prompt_set_format()
+
+#define VCS_BRANCH_LENGTH 256
+
+#define PROMPT_READ_SIZE 4096
+
+#define PROMPT_VCS_INTERVAL 5000000000ULL //Nanoseconds a prompt is shown before git status runs again for it
+
+#define PARALLEL_MAX_SLOTS 128 //Every running parallel job takes a slot of the job table, so this stays below MAX_JOBS
+
+#define PARALLEL_READ_SIZE 4096 //Room made in a job's output buffer before each read
+
+#define HEREDOC_PIPE_SIZE 4096 //Here-documents up to this size are fed through a pipe (it never blocks: a pipe holds at least a page), bigger ones through a memfd
+
+#define COPY_BLOCK_SIZE 131072 //cat, tee and cp copy through a buffer this big when the kernel cannot copy for them
+
+#define COPY_CALL_SIZE 0x7ffff000 //The most one copy_file_range(), splice() or sendfile() call moves
+
+#define PIPE_MAX_SIZE_DEFAULT 1048576 //The largest pipe an unprivileged process can ask for, when /proc/sys/fs/pipe-max-size cannot be read
+
+#define HISTORY_FILE_NAME ".bcsh_history" //In $HOME, unless $BCSH_HISTFILE says otherwise
+
+#define HISTORY_INITIAL_ENTRIES 1024
+
+#define HISTORY_BLOCK_ENTRIES 16 //The history is indexed by blocks of this many entries
+
+#define HISTORY_BLOCK_BITS_LOG2 11 //Each block has a bitmap of 2^11 bits of the trigrams in it
+
+#define HISTORY_BLOCK_BITS (1 << HISTORY_BLOCK_BITS_LOG2)
+
+#define HISTORY_SEARCH_TRIGRAMS 32 //Longer text only has its first trigrams looked up
+
+#define HISTORY_SEARCH_RESULTS 20 //history -s prints this many matches at most
+
+#define DIR_READ_SIZE 65536 //Directories are read with getdents64() this many bytes at a time
+
+#define DIR_INITIAL_NAMES 4096
+
+#define DIR_INITIAL_ENTRIES 256
+
+#define COMPLETE_DIR_CACHE 8 //Directories whose entries path completion keeps until they change
+
+#define COMPLETE_INITIAL_NAMES 64
+
+#define COMPLETE_INITIAL_TEXT 4096
+
+#define COMPLETE_EVENTS_SIZE 4096 //inotify events about $PATH are read this many bytes at a time
+
+#define GLOB_FIXED_LENGTH 32 //Longest prefix or suffix of a glob pattern compared with memcmp() before matching
+
+#define GLOB_INITIAL_WORDS 64
+
+#define GLOB_INITIAL_PATH 256
+
+#define EDITOR_INITIAL_LINE 256
+
+#define EDITOR_DEFAULT_COLUMNS 80 //When the terminal does not say how wide it is
+
+#define EDITOR_LIST_ASK 100 //Asks before listing more completions than this
+
+#define EDITOR_SEARCH_LENGTH 256 //Longest text ctrl-r searches for
+
+#define EDITOR_ESCAPE_TIMEOUT 50000000 //Nanoseconds to wait for the rest of an escape sequence; a lone escape is dropped after it
+
+#define EVENTS_MAX_WATCHES 8 //Descriptors the event loop watches besides the input, the signalfd and its timer
+
+#define EVENTS_BATCH 8 //Events taken from epoll_wait() and signals from the signalfd at once
+
+#define SUBSTITUTION_READ_SIZE 4096 //Room kept free for each read of the output of a substitution; the buffer doubles to keep it
+
+#define ZYGOTE_MAX_FDS 16 //Descriptors a command launched by the spawn helper can be given; one with more is launched with posix_spawn()
+
+#define ZYGOTE_CHUNK 65536 //Bytes of argv and envp sent to the spawn helper per message
+
+#define SERVE_MAX_IN_FLIGHT 64 //Requests bcsh --serve runs at once when $BCSH_SERVE_MAX does not say; the others wait
+
+#define SERVE_CHUNK 65536 //Bytes of a request's command and environment per message
+
+#define SAVED_FD_MIN 10 //Internal commands with redirections run in the shell, which keeps its own descriptors from this one up meanwhile
+
+#define TRACE_RING_SIZE 32768 //Trace events kept, a power of two; the oldest are overwritten
+
+#define TRACE_DETAIL_LENGTH 40 //Bytes of a command name kept with a trace event
+
+#define HASH_TABLE_SIZE 64
+
+#define VARS_INITIAL_CAPACITY 128 //Slots of the variable table, a power of two; it doubles when three quarters are used
+
+#define HASH_NEGATIVE_TTL 5 //Seconds before a "command not found" result is retried
+
+#define EXIT_NOT_FOUND 127 //Exit status of a command that could not be found
+
+#define EXIT_NOT_EXECUTABLE 126 //Exit status of a command that was found but could not be executed
+
+#define EXIT_SYNTAX_ERROR 2 //Exit status of a line that could not be parsed
+
+#define EXIT_TIMED_OUT 124 //Exit status of a pipeline that timeout stopped
+
+#define DEFAULT_PATH "/usr/local/bin:/usr/bin:/bin"
+
+#define SPAWN_BACKEND_FORK 0
+
+#define SPAWN_BACKEND_POSIX_SPAWN 1
+
+#define SPAWN_BACKEND_ZYGOTE 2
+
+#ifdef BCSH_SPAWN_FORK
+#define DEFAULT_SPAWN_BACKEND SPAWN_BACKEND_FORK
+#elif defined(BCSH_SPAWN_ZYGOTE)
+#define DEFAULT_SPAWN_BACKEND SPAWN_BACKEND_ZYGOTE
+#else
+#define DEFAULT_SPAWN_BACKEND SPAWN_BACKEND_POSIX_SPAWN
+#endif
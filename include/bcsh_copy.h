@@ -0,0 +1,27 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh_copy.h
+ * * * * * * * * * * * * * * * * * * *
+ * Moving bytes between descriptors
+ *  inside the kernel, for cat, tee
+ *  and cp
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#ifndef BCSH_COPY_H
+#define BCSH_COPY_H
+
+/**
+ * Which part of a copy failed, so the caller can say which file it was about
+ */
+#define COPY_OK 0
+#define COPY_READ_ERROR 1
+#define COPY_WRITE_ERROR 2
+
+int copy_fd(int in, int out);
+
+int tee_fds(int in, int* outs, int num_outs, int* failed);
+
+#endif
@@ -0,0 +1,59 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh_dir.h
+ * * * * * * * * * * * * * * * * * * *
+ * Reading whole directories in large
+ *  batches with getdents64()
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#ifndef BCSH_DIR_H
+#define BCSH_DIR_H
+
+#include <stddef.h>
+
+/**
+ * The entries of a directory, without . and .. . The names are packed one after the
+ *  other in names, each preceded by its d_type byte and followed by a null terminator, so
+ *  a listing is three allocations however many entries it has.
+ */
+struct dir_listing {
+    char* names;
+    size_t size; //Bytes of names in use
+    size_t capacity;
+    size_t* offsets; //Where the name of each entry starts in names
+    size_t count;
+    size_t offsets_capacity;
+};
+
+typedef void (*dir_visitor)(char* name, size_t length, unsigned char type, void* context);
+
+int dir_each(int fd, dir_visitor visit, void* context);
+
+int dir_read(int fd, struct dir_listing* listing);
+
+int dir_read_path(char* path, struct dir_listing* listing);
+
+void dir_sort(struct dir_listing* listing);
+
+size_t dir_find(struct dir_listing* listing, char* name);
+
+void dir_free(struct dir_listing* listing);
+
+/**
+ * The name of an entry
+ */
+static inline char* dir_name(struct dir_listing* listing, size_t index){
+    return listing->names + listing->offsets[index];
+}
+
+/**
+ * The d_type of an entry (DT_DIR, DT_REG, DT_LNK, DT_UNKNOWN...)
+ */
+static inline unsigned char dir_type(struct dir_listing* listing, size_t index){
+    return listing->names[listing->offsets[index] - 1];
+}
+
+#endif
@@ -0,0 +1,20 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh_editor.h
+ * * * * * * * * * * * * * * * * * * *
+ * The line editor of interactive shells
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#ifndef BCSH_EDITOR_H
+#define BCSH_EDITOR_H
+
+int editor_available();
+
+char* editor_read_line(char* prompt, char* (*wake)(char* prompt));
+
+int editor_resized(int signum);
+
+#endif
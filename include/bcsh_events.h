@@ -0,0 +1,38 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh_events.h
+ * * * * * * * * * * * * * * * * * * *
+ * The event loop the shell waits in
+ *  for input: one epoll set with the
+ *  terminal, a signalfd and any other
+ *  descriptor that has something to say
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#ifndef BCSH_EVENTS_H
+#define BCSH_EVENTS_H
+
+/**
+ * What the callbacks of events give back, and what events_wait() returns
+ */
+#define EVENT_QUIET 0 //Handled, waiting goes on
+#define EVENT_WAKE 1 //Something changed that the reader has to show (a job notification, the prompt, the size of the terminal)
+#define EVENT_INTERRUPT 2 //The line being read is dropped, as with ctrl-c
+#define EVENT_READY 3 //The input can be read
+#define EVENT_TIMEOUT 4 //The time given to events_wait() ran out
+
+int events_watch(int fd, int (*ready)(int fd));
+
+void events_unwatch(int fd);
+
+int events_timer(int (*ready)(int fd));
+
+void events_arm(int fd, unsigned long long deadline);
+
+void events_on_signal(int signum, int (*handler)(int signum));
+
+int events_wait(int fd, unsigned long long timeout);
+
+#endif
@@ -8,6 +8,72 @@
  * * * * * * * * * * * * * * * * * * *
  */
 
-int execute_command(char** tokens);
+#include <sys/types.h>
 
-int execute_piped_commands(char*** prepared_commands);
+#include "bcsh_parser.h"
+
+/**
+ * What a break, continue or return asks of the loops and functions it is in
+ */
+#define JUMP_NONE 0
+#define JUMP_BREAK 1
+#define JUMP_CONTINUE 2
+#define JUMP_RETURN 3
+
+/**
+ * One redirection of a command, ready to be applied: the file is already open
+ */
+struct redirect_action {
+    int fd; //The descriptor of the command being redirected
+    int source; //The descriptor copied onto it, -1 to close it
+    int opened; //source was opened by the shell for this command, and is closed once it is launched
+};
+
+/**
+ * How a child is set up before it runs its command
+ */
+struct child_setup {
+    int in_fd; //The descriptor to use as stdin, -1 to keep the shell's
+    int out_fd; //The descriptor to use as stdout, -1 to keep the shell's
+    int err_fd; //The descriptor to use as stderr, -1 to keep the shell's
+    int* close_fds; //A -1 terminated list of descriptors the child must close
+    pid_t pgid; //-1 to stay in the shell's process group, 0 to lead a new one, or the group to join
+    int foreground; //Give the terminal to the child's process group
+    struct redirect_action* redirects; //Applied in order, after the pipe descriptors are in place
+    int num_redirects;
+    char** envp; //The environment of the command, NULL for the one of the exported variables
+};
+
+extern int spawn_backend;
+
+extern int last_status;
+
+extern int exit_requested;
+
+extern long default_pipe_size;
+
+extern int pending_jump;
+
+extern int jump_levels;
+
+extern int loop_depth;
+
+extern int function_depth;
+
+int select_spawn_backend(char* name);
+
+pid_t launch_external(char** argv, struct child_setup* setup);
+
+int execute_command(struct command* command);
+
+int execute_external(char** argv);
+
+int execute_piped_commands(struct pipeline* pipeline);
+
+int execute_timed(struct pipeline* pipeline);
+
+int execute_timeout(struct pipeline* pipeline);
+
+int execute_list(struct pipeline* list);
+
+char* execute_substitution(char* text);
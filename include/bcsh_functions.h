@@ -0,0 +1,34 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh_functions.h
+ * * * * * * * * * * * * * * * * * * *
+ * Shell functions, kept parsed
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#ifndef BCSH_FUNCTIONS_H
+#define BCSH_FUNCTIONS_H
+
+#include "bcsh_arena.h"
+#include "bcsh_parser.h"
+
+struct function {
+    char* name;
+    struct command* body; //A compound command, in the function's own arena
+    struct arena arena;
+    int calls; //Calls of the function that are running
+    int replaced; //It was defined again, and goes away once its last call returns
+    struct function* next;
+};
+
+void function_define(char* name, struct command* body);
+
+struct function* function_find(char* name);
+
+void function_hold(struct function* function);
+
+void function_release(struct function* function);
+
+#endif
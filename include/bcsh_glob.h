@@ -0,0 +1,26 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh_glob.h
+ * * * * * * * * * * * * * * * * * * *
+ * Expansion of the words of a command:
+ *  $ references, then *, ? and [...],
+ *  and the patterns of case
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#ifndef BCSH_GLOB_H
+#define BCSH_GLOB_H
+
+#include "bcsh_parser.h"
+
+struct command* expand_command(struct command* command);
+
+char* expand_string(char* expansion);
+
+char** expand_words(char** list, char** expansions, int num_list, int* count);
+
+int pattern_matches(char* string, char* pattern, char* expansion);
+
+#endif
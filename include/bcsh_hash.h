@@ -0,0 +1,20 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh_hash.h
+ * * * * * * * * * * * * * * * * * * *
+ * The command hash table, which maps
+ *  command names to absolute paths
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+char* hash_lookup(char* command);
+
+char* hash_resolve(char* command);
+
+void hash_remove(char* command);
+
+void hash_clear();
+
+void hash_print();
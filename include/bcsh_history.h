@@ -0,0 +1,29 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh_history.h
+ * * * * * * * * * * * * * * * * * * *
+ * The command history, shared by every
+ *  session through an append-only file
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#ifndef BCSH_HISTORY_H
+#define BCSH_HISTORY_H
+
+#include <stddef.h>
+
+void history_init();
+
+int history_open(char* path);
+
+void history_add(char* line);
+
+long history_count();
+
+char* history_entry(long index, size_t* length);
+
+long history_search(char* text, long before);
+
+#endif
@@ -16,3 +16,51 @@ int exit_internal(char** tokens);
 int fg_internal(char** tokens);
 
 int bg_internal(char** tokens);
+
+int hash_internal(char** tokens);
+
+int memstat_internal(char** tokens);
+
+int jobs_internal(char** tokens);
+
+int wait_internal(char** tokens);
+
+int parallel_internal(char** tokens);
+
+int echo_internal(char** tokens);
+
+int true_internal(char** tokens);
+
+int false_internal(char** tokens);
+
+int test_internal(char** tokens);
+
+int printf_internal(char** tokens);
+
+int pwd_internal(char** tokens);
+
+int cat_internal(char** tokens);
+
+int tee_internal(char** tokens);
+
+int cp_internal(char** tokens);
+
+int prompt_internal(char** tokens);
+
+int set_internal(char** tokens);
+
+int history_internal(char** tokens);
+
+int export_internal(char** tokens);
+
+int unset_internal(char** tokens);
+
+int return_internal(char** tokens);
+
+int break_internal(char** tokens);
+
+int continue_internal(char** tokens);
+
+int shift_internal(char** tokens);
+
+int trace_internal(char** tokens);
@@ -9,4 +9,36 @@
  * * * * * * * * * * * * * * * * * * *
  */
 
-char* read_line_stdin();
+#ifndef BCSH_IO_H
+#define BCSH_IO_H
+
+#include <stddef.h>
+
+/**
+ * Where a non-interactive shell reads its commands from: a script file, the string given
+ *  to -c, or stdin when it is not a terminal. Lines are handed out in place, pointing into
+ *  buffer, and are only valid until the next line is read.
+ */
+struct input_source {
+    int fd; //-1 if everything is already in buffer
+    char* buffer;
+    size_t size; //Bytes of buffer holding input
+    size_t capacity; //Bytes allocated for buffer, when it is not mapped
+    size_t pos; //Where the next line starts
+    int mapped; //buffer is an mmap() of the whole file
+    int sync_offset; //Keep the file offset of fd just past the lines handed out
+};
+
+char* read_line_stdin(char* prompt, char* (*wake)(char* prompt));
+
+int open_input_file(struct input_source* source, char* path);
+
+int open_input_fd(struct input_source* source, int fd);
+
+void open_input_string(struct input_source* source, char* string);
+
+char* read_line_source(struct input_source* source);
+
+void close_input(struct input_source* source);
+
+#endif
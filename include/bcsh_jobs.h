@@ -0,0 +1,120 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh_jobs.h
+ * * * * * * * * * * * * * * * * * * *
+ * The job table: every pipeline that
+ *  runs outside the shell is a job with
+ *  its own process group
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#ifndef BCSH_JOBS_H
+#define BCSH_JOBS_H
+
+#include <signal.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+
+#include "bcsh_constants.h"
+#include "bcsh_parser.h"
+
+#define JOB_FREE 0
+#define JOB_RUNNING 1
+#define JOB_STOPPED 2
+#define JOB_DONE 3
+
+struct process {
+    pid_t pid;
+    int state; //JOB_RUNNING, JOB_STOPPED or JOB_DONE
+    int status; //Filled in by wait4()
+    struct rusage usage; //Resources used, filled in by wait4() once the process is done
+    struct timespec started; //When it was launched
+    struct timespec ended; //When it was reaped
+    int exit_order; //1 for the first process of the job to end, and so on
+    int pidfd; //Refers to the process until it is reaped, for jobs with a time limit; -1 otherwise
+    unsigned long long bytes_read; //Bytes it read and wrote, from /proc/pid/io under set -o pipestats
+    unsigned long long bytes_written;
+    long long blocked_ns; //Time it was neither running nor waiting for a CPU: blocked on a pipe, or other I/O
+};
+
+struct job {
+    int id; //The n in %n
+    int state;
+    int background;
+    int notified; //The user was told about the current state
+    int keep; //job_wait() leaves the job in the table once it is done, for time
+    pid_t pgid; //0 until the first process is added, or if there is no job control
+    char* command; //Malloced description for jobs, NULL until it is needed
+    char* text; //What the job runs, as it was written (not null terminated), only valid during the line that started it
+    size_t text_length;
+    struct process* processes;
+    int num_processes;
+    int num_ended;
+    int capacity;
+    unsigned long long deadline; //CLOCK_MONOTONIC nanoseconds when the job's time is up, 0 if it has no limit
+    int limit_signal; //Sent to the processes still running then
+    unsigned long long kill_after; //Nanoseconds to wait before following up with SIGKILL, 0 for never
+    int timed_out; //The time was up before the job ended
+    struct process inline_processes[JOB_INLINE_PROCESSES]; //Used by small pipelines, so they do not malloc
+};
+
+extern int job_control;
+
+extern int terminal_fd;
+
+extern pid_t shell_pgid;
+
+extern pid_t last_background_pid;
+
+extern int pipe_stats;
+
+extern int job_interrupted;
+
+void jobs_init(int interactive);
+
+void block_sigchld(sigset_t* old_mask);
+
+void restore_sigmask(sigset_t* old_mask);
+
+void reset_child_signals();
+
+struct job* job_create(char* text, size_t text_length, int background);
+
+void job_add_process(struct job* job, pid_t pid);
+
+void job_describe(struct job* job);
+
+void job_set_limit(struct job* job, unsigned long long duration, int signal, unsigned long long kill_after);
+
+void job_record_status(pid_t pid, int status, struct rusage* usage);
+
+void job_record_stats(pid_t pid);
+
+int job_wait(struct job* job, sigset_t* old_mask);
+
+int job_continue(struct job* job, int foreground);
+
+int job_status(struct job* job);
+
+void job_free(struct job* job);
+
+void job_print(struct job* job, int show_pids);
+
+void jobs_notify();
+
+int jobs_count_unnotified();
+
+struct job* job_find(char* spec);
+
+struct job* job_next(struct job* job);
+
+int jobs_count_active();
+
+int jobs_count_stopped();
+
+void jobs_hangup();
+
+#endif
@@ -0,0 +1,14 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh_parallel.h
+ * * * * * * * * * * * * * * * * * * *
+ * Runs one command per argument, many
+ *  at a time, for the parallel command
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+int default_parallel_slots();
+
+int run_parallel(char** command, char** args, long num_args, int slots, int quiet);
@@ -0,0 +1,134 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh_parser.h
+ * * * * * * * * * * * * * * * * * * *
+ * The command line parser and the tree
+ *  of command lists, pipelines, commands,
+ *  compound commands and redirections it
+ *  produces
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#ifndef BCSH_PARSER_H
+#define BCSH_PARSER_H
+
+#include <stddef.h>
+
+/**
+ * Redirection types
+ */
+#define REDIR_IN 0 //n<file
+#define REDIR_OUT 1 //n>file
+#define REDIR_APPEND 2 //n>>file
+#define REDIR_DUP_IN 3 //n<&m
+#define REDIR_DUP_OUT 4 //n>&m
+#define REDIR_HEREDOC 5 //n<<word, with the body read from the lines that follow
+#define REDIR_HEREDOC_STRIP 6 //n<<-word, with leading tabs removed from the body
+#define REDIR_HERESTRING 7 //n<<<word, the word and a newline
+
+/**
+ * How a pipeline is joined to the one after it
+ */
+#define CONNECT_END 0 //Last pipeline of the line, or followed by ;
+#define CONNECT_AND 1 //&&
+#define CONNECT_OR 2 //||
+
+/**
+ * Compound command types
+ */
+#define COMPOUND_BRACE 0 //{ list; }
+#define COMPOUND_SUBSHELL 1 //( list ), run in a copy of the shell
+#define COMPOUND_IF 2 //if list; then list; [elif list; then list;]... [else list;] fi
+#define COMPOUND_WHILE 3 //while list; do list; done
+#define COMPOUND_UNTIL 4 //until list; do list; done
+#define COMPOUND_FOR 5 //for name [in word...]; do list; done
+#define COMPOUND_CASE 6 //case word in [(]pattern[|pattern]...) list;; ... esac
+#define COMPOUND_FUNCTION 7 //name() compound-command, which defines the function when it runs
+
+/**
+ * What parse_line() gives back for input that stops in the middle of a command (an open
+ *  quote, an if without its fi, a here-document without its delimiter...), which more
+ *  lines can complete
+ */
+#define PARSE_INCOMPLETE 1
+
+/**
+ * What marks a $ reference in the expansion of a word, see expand_command()
+ */
+#define EXPAND_VARIABLE '\001' //Followed by the name of a variable and EXPAND_END
+#define EXPAND_QUOTED_VARIABLE '\002' //The same, inside double quotes: its value is not split or globbed
+#define EXPAND_COMMAND '\003' //Followed by the command of a substitution and EXPAND_END
+#define EXPAND_QUOTED_COMMAND '\004'
+#define EXPAND_END '\005'
+
+struct redirection {
+    int type;
+    int fd; //The descriptor being redirected
+    char* target; //The file name, the descriptor to copy for REDIR_DUP_* (- to close), or the delimiter of a here-document
+    char* expansion; //How to expand target when the command runs, NULL if it is used as it is
+    char* body; //What a here-document or here-string feeds the command
+    size_t length; //Bytes in body
+    struct redirection* next;
+};
+
+struct command {
+    char** assignments; //The NAME=value words in front of the command name; argv follows them
+    int num_assignments;
+    char** argv; //Null terminated, the words point into the line
+    int argc;
+    char** expansions; //How to expand each word, assignments first (NULL for plain words), NULL if there are none
+    struct redirection* redirections;
+    struct compound* compound; //The compound command this is, NULL for a simple command (argv is empty otherwise)
+    long pipe_size; //The capacity asked for the pipe to the next stage with |[size], 0 for the default
+    struct command* next; //The next stage of the pipeline
+};
+
+struct pipeline {
+    struct command* commands;
+    int num_commands;
+    int connector;
+    int background; //Ended with &
+    char* text; //How it was written, for jobs, not null terminated (NULL for an elif)
+    size_t text_length;
+    struct pipeline* next;
+};
+
+/**
+ * One item of a case command: its patterns and the list run when one matches
+ */
+struct case_item {
+    char** patterns;
+    char** expansions; //How to expand each pattern (see word_expansion()), NULL if none needs it
+    int num_patterns;
+    struct pipeline* body;
+    struct case_item* next;
+};
+
+/**
+ * A compound command. It is parsed once and run as many times as its loop, or its
+ *  function, needs: nothing in it is changed when it runs, words are expanded into copies.
+ */
+struct compound {
+    int type;
+    struct pipeline* condition; //Of if, while and until
+    struct pipeline* body; //What if (then), while, until and for run, and the list of { } and ( )
+    struct pipeline* else_body; //The else of an if; an elif is an if of its own here
+    char* name; //The variable of for, the name of a function
+    char** words; //The words of for, NULL without in (it goes through "$@"); the word of case
+    char** expansions; //How to expand each of words, NULL if none needs it
+    int num_words;
+    struct case_item* items;
+    struct command* function; //The compound command that is the body of a function
+};
+
+int parse_line(char* line, struct pipeline** list);
+
+int line_may_continue(char* line);
+
+int line_may_complete(char* line);
+
+char* command_name(struct command* command);
+
+#endif
@@ -0,0 +1,15 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh_prompt.h
+ * * * * * * * * * * * * * * * * * * *
+ * The prompt engine
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+void prompt_set_format(char* format);
+
+char* prompt_get_format();
+
+char* prompt_render();
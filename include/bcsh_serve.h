@@ -0,0 +1,52 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh_serve.h
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh --serve, which runs the commands
+ *  it is sent over a Unix socket, and
+ *  the client of bcsh --connect
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#ifndef BCSH_SERVE_H
+#define BCSH_SERVE_H
+
+#include <stddef.h>
+
+/**
+ * The descriptors sent with every request: its stdin, stdout and stderr, then its
+ *  working directory
+ */
+#define SERVE_NUM_FDS 4
+
+/**
+ * A request. The command, then envc variables, each null terminated, follow in
+ *  messages of at most SERVE_CHUNK bytes.
+ */
+struct serve_request {
+    size_t length; //Bytes of the strings that follow
+    int envc;
+};
+
+/**
+ * The answer, once the command is done
+ */
+struct serve_reply {
+    int status;
+};
+
+char* serve(char* path, int max_in_flight);
+
+void serve_finish(int status);
+
+int client_connect(char* path);
+
+int client_send(int socket, char* command, char** envp, int* fds);
+
+int client_status(int socket, int* status);
+
+int client_run(char* path, char* command);
+
+#endif
@@ -9,3 +9,13 @@
  */
 
 void signal_handler(int signum);
+
+void sigchld_handler(int signum);
+
+void catch_signal(int signum, void (*handler)(int signum));
+
+int sigchld_event(int signum);
+
+int sigint_event(int signum);
+
+int ignore_event(int signum);
@@ -0,0 +1,56 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh_time.h
+ * * * * * * * * * * * * * * * * * * *
+ * The time keyword: resource usage of
+ *  a pipeline and of each of its stages
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#ifndef BCSH_TIME_H
+#define BCSH_TIME_H
+
+#include <time.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+
+#include "bcsh_jobs.h"
+
+/**
+ * Output formats of time
+ */
+#define TIME_FORMAT_HUMAN 0 //time
+#define TIME_FORMAT_POSIX 1 //time -p
+#define TIME_FORMAT_JSON 2 //time -j
+
+struct time_stage {
+    char* name; //The command of the stage
+    pid_t pid;
+    int status; //Filled in by wait4()
+    struct rusage usage;
+    double real; //Seconds from its launch until it ended
+    int exit_order; //1 for the first stage to end, and so on
+};
+
+struct time_report {
+    int format;
+    struct timespec start;
+    struct rusage shell_start; //The shell's own usage, for internal commands that run inside it
+    struct time_stage* stages; //Allocated from the line arena
+    int num_stages;
+    int capacity;
+};
+
+int time_options(struct command* command, int* format);
+
+void time_start(struct time_report* report, int format);
+
+void time_add_stage(struct time_report* report, char* name, pid_t pid);
+
+void time_collect(struct time_report* report, struct job* job);
+
+void time_finish(struct time_report* report, int status);
+
+#endif
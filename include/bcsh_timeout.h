@@ -0,0 +1,25 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh_timeout.h
+ * * * * * * * * * * * * * * * * * * *
+ * The timeout keyword: a wall clock
+ *  limit on a whole pipeline
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#ifndef BCSH_TIMEOUT_H
+#define BCSH_TIMEOUT_H
+
+#include "bcsh_parser.h"
+
+struct timeout_limit {
+    unsigned long long duration; //Nanoseconds the pipeline may run
+    int signal; //Sent to every stage still running when the time is up
+    unsigned long long kill_after; //Nanoseconds after which SIGKILL follows, 0 for never
+};
+
+int timeout_options(struct command* command, struct timeout_limit* limit);
+
+#endif
@@ -0,0 +1,62 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh_trace.h
+ * * * * * * * * * * * * * * * * * * *
+ * Execution tracing into an in-memory
+ *  ring of timestamped events
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#ifndef BCSH_TRACE_H
+#define BCSH_TRACE_H
+
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "bcsh_constants.h"
+
+/**
+ * Event phases, as the Chrome trace-event format names them
+ */
+#define TRACE_BEGIN 'B'
+#define TRACE_END 'E'
+#define TRACE_INSTANT 'i'
+
+/**
+ * Formats the ring can be written in
+ */
+#define TRACE_FORMAT_JSON 0 //{"events":[...]}, with nanosecond timestamps
+#define TRACE_FORMAT_CHROME 1 //{"traceEvents":[...]}, for chrome://tracing and Perfetto
+
+struct trace_event {
+    unsigned long long ns; //CLOCK_MONOTONIC
+    const char* name; //A string that lives as long as the shell
+    pid_t pid; //The process the event is about: the shell, or a child for spawn, exec and exit
+    int phase;
+    long value; //The exit status for exit and the end of a command, the stages of a pipeline
+    char detail[TRACE_DETAIL_LENGTH]; //The command, cut short, empty if there is none
+};
+
+extern int trace_enabled;
+
+unsigned long long trace_now();
+
+void trace_record(unsigned long long ns, int phase, const char* name, pid_t pid, long value, const char* detail);
+
+void trace_start();
+
+void trace_stop();
+
+void trace_clear();
+
+unsigned long trace_count(unsigned long* dropped);
+
+void trace_write(FILE* out, int format);
+
+void trace_init(char* setting);
+
+void trace_finish();
+
+#endif
@@ -8,10 +8,14 @@
  * * * * * * * * * * * * * * * * * * *
  */
 
-void get_cwd_direct();
+extern unsigned long cwd_generation;
 
-char** get_tokens(char* line);
+void cwd_init();
 
-int has_pipes(char** tokens);
+char* get_cwd();
 
-char*** prepare_commands(char** tokens);
+char* get_oldpwd();
+
+int change_directory(char* target, int physical);
+
+long parse_size(char* text);
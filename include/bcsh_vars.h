@@ -0,0 +1,45 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh_vars.h
+ * * * * * * * * * * * * * * * * * * *
+ * Shell variables, and the environment
+ *  built from the exported ones
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#ifndef BCSH_VARS_H
+#define BCSH_VARS_H
+
+#include <stddef.h>
+
+extern char* shell_name;
+
+extern char** positional_params;
+
+extern int num_positional_params;
+
+void vars_init(char** envp);
+
+char* var_get(char* name);
+
+void var_set(char* name, size_t name_length, char* value, int export);
+
+void var_export(char* name);
+
+void var_unset(char* name);
+
+void vars_unset_exported();
+
+int var_assign(char* assignment, int export);
+
+size_t var_name_length(char* text);
+
+char** var_environ();
+
+char** var_environ_with(char** assignments, int num_assignments);
+
+void var_print_exported();
+
+#endif
@@ -0,0 +1,37 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh_zygote.h
+ * * * * * * * * * * * * * * * * * * *
+ * The spawn helper, a small copy of the
+ *  shell forked at startup that launches
+ *  external commands for it
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#ifndef BCSH_ZYGOTE_H
+#define BCSH_ZYGOTE_H
+
+#include <sys/types.h>
+
+#define ZYGOTE_UNAVAILABLE -2 //zygote_spawn() could not reach the helper; the command was not launched
+
+/**
+ * One descriptor of a command launched by the helper
+ */
+struct zygote_fd {
+    int target; //The descriptor of the command
+    int source; //The descriptor of the caller copied onto it, -1 to close it
+};
+
+int zygote_start(int terminal);
+
+int zygote_running();
+
+void zygote_detach();
+
+int zygote_spawn(char* path, char** argv, char** envp, struct zygote_fd* fds, int num_fds,
+                 pid_t pgid, int foreground, pid_t* pid);
+
+#endif
@@ -0,0 +1,248 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh_arena.c
+ * * * * * * * * * * * * * * * * * * *
+ * The per-line bump allocator and the
+ *  malloc()/free() counters are here
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/bcsh_constants.h"
+#include "../include/bcsh_arena.h"
+
+/**
+ * Everything allocated while reading, tokenizing and running one command line comes
+ *  from here. main() resets it once the line is done.
+ */
+struct arena line_arena;
+
+/**
+ * Adds a chunk big enough for size bytes to the end of the arena's chunk list
+ * @return The new chunk. Exits if it could not be allocated.
+ */
+static struct arena_chunk* arena_grow(struct arena* arena, size_t size){
+    struct arena_chunk* chunk;
+    size_t chunk_size = ARENA_CHUNK_SIZE;
+
+    while(chunk_size < size){
+        chunk_size *= 2;
+    }
+
+    chunk = malloc(sizeof(struct arena_chunk) + chunk_size);
+    if(chunk == NULL){
+        fprintf(stderr, "Error in arena_grow() : Could not allocate space for arena chunk\n");
+        exit(EXIT_FAILURE);
+    }
+    arena->chunk_mallocs++;
+    chunk->next = NULL;
+    chunk->size = chunk_size;
+    chunk->used = 0;
+
+    if(arena->current == NULL){
+        arena->head = chunk;
+    }else{
+        chunk->next = arena->current->next;
+        arena->current->next = chunk;
+    }
+    return chunk;
+}
+
+/**
+ * Hands out size bytes from the arena, aligned for any type. The memory stays valid until
+ *  the arena is reset.
+ * @return A pointer to the memory. Exits if the arena could not grow.
+ */
+void* arena_alloc(struct arena* arena, size_t size){
+    struct arena_chunk* chunk = arena->current;
+    void* memory;
+
+    size = (size + ARENA_ALIGNMENT - 1) & ~((size_t) ARENA_ALIGNMENT - 1);
+
+    /********************************************************************
+    Move on to the next chunk (kept from before the last reset, or a
+        new one) if the current one is full
+    ********************************************************************/
+    while(chunk == NULL || chunk->size - chunk->used < size){
+        if(chunk != NULL && chunk->next != NULL){
+            chunk = chunk->next;
+            chunk->used = 0;
+        }else{
+            chunk = arena_grow(arena, size);
+        }
+        arena->current = chunk;
+    }
+
+    memory = chunk->data + chunk->used;
+    chunk->used += size;
+    arena->allocated += size;
+    if(arena->allocated > arena->high_water){
+        arena->high_water = arena->allocated;
+    }
+    return memory;
+}
+
+/**
+ * Grows an allocation made from the arena. The most recent allocation is grown in place
+ *  when the chunk has room, otherwise the contents are copied to fresh arena memory.
+ * @return A pointer to at least new_size bytes holding the old contents
+ */
+void* arena_realloc(struct arena* arena, void* old, size_t old_size, size_t new_size){
+    struct arena_chunk* chunk = arena->current;
+    size_t old_aligned = (old_size + ARENA_ALIGNMENT - 1) & ~((size_t) ARENA_ALIGNMENT - 1);
+    size_t new_aligned = (new_size + ARENA_ALIGNMENT - 1) & ~((size_t) ARENA_ALIGNMENT - 1);
+    void* memory;
+
+    if(old != NULL && chunk != NULL && (char*) old + old_aligned == chunk->data + chunk->used
+       && chunk->size - chunk->used >= new_aligned - old_aligned){
+        chunk->used += new_aligned - old_aligned;
+        arena->allocated += new_aligned - old_aligned;
+        if(arena->allocated > arena->high_water){
+            arena->high_water = arena->allocated;
+        }
+        return old;
+    }
+
+    memory = arena_alloc(arena, new_size);
+    if(old != NULL){
+        memcpy(memory, old, old_size);
+    }
+    return memory;
+}
+
+/**
+ * Copies a string into the arena
+ */
+char* arena_strdup(struct arena* arena, const char* string){
+    size_t length = strlen(string) + 1;
+    char* copy = arena_alloc(arena, length);
+    memcpy(copy, string, length);
+    return copy;
+}
+
+/**
+ * Remembers how much of the arena is in use, so that what is allocated after this can be
+ *  given back with arena_rewind()
+ */
+void arena_mark(struct arena* arena, struct arena_mark* mark){
+    mark->chunk = arena->current;
+    mark->used = (arena->current != NULL) ? arena->current->used : 0;
+    mark->allocated = arena->allocated;
+}
+
+/**
+ * Makes the memory handed out since a mark available again, keeping what came before it.
+ *  The chunks after the marked one stay in the list and are reused. Loops rewind after
+ *  each iteration, so running a loop body any number of times takes the memory of one.
+ */
+void arena_rewind(struct arena* arena, struct arena_mark* mark){
+    if(mark->chunk == NULL){
+        arena->current = arena->head;
+        if(arena->head != NULL){
+            arena->head->used = 0;
+        }
+    }else{
+        arena->current = mark->chunk;
+        mark->chunk->used = mark->used;
+    }
+    arena->allocated = mark->allocated;
+}
+
+/**
+ * Makes all the memory handed out by the arena available again. If the last line needed
+ *  more than one chunk, the chunks are replaced by a single one big enough for all of it,
+ *  so that a line of the same size never needs to call malloc() again.
+ */
+void arena_reset(struct arena* arena){
+    size_t total = 0;
+    struct arena_chunk* chunk;
+
+    if(arena->head != NULL && arena->head->next != NULL){
+        for(chunk = arena->head; chunk != NULL; chunk = chunk->next){
+            total += chunk->size;
+        }
+        arena_release(arena);
+        arena_grow(arena, total);
+    }
+
+    if(arena->head != NULL){
+        arena->head->used = 0;
+    }
+    arena->current = arena->head;
+    arena->allocated = 0;
+}
+
+/**
+ * Gives every chunk of the arena back to the system
+ */
+void arena_release(struct arena* arena){
+    struct arena_chunk* chunk = arena->head;
+    struct arena_chunk* next;
+
+    while(chunk != NULL){
+        next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    arena->head = NULL;
+    arena->current = NULL;
+    arena->allocated = 0;
+}
+
+#ifdef BCSH_ALLOC_STATS
+
+/**
+ * Counting wrappers around glibc's allocator. Defining these in the executable replaces
+ *  malloc() and friends for the whole process (including calls made inside libc), so the
+ *  counters see every allocation the shell makes.
+ */
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* pointer, size_t size);
+extern void __libc_free(void* pointer);
+
+static unsigned long malloc_calls = 0;
+static unsigned long free_calls = 0;
+
+void* malloc(size_t size){
+    malloc_calls++;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size){
+    malloc_calls++;
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* pointer, size_t size){
+    malloc_calls++;
+    return __libc_realloc(pointer, size);
+}
+
+void free(void* pointer){
+    if(pointer != NULL){
+        free_calls++;
+    }
+    __libc_free(pointer);
+}
+
+void get_alloc_stats(struct alloc_stats* stats){
+    stats->enabled = 1;
+    stats->mallocs = malloc_calls;
+    stats->frees = free_calls;
+}
+
+#else
+
+void get_alloc_stats(struct alloc_stats* stats){
+    stats->enabled = 0;
+    stats->mallocs = 0;
+    stats->frees = 0;
+}
+
+#endif
@@ -0,0 +1,201 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh_client.c
+ * * * * * * * * * * * * * * * * * * *
+ * The client side of bcsh --serve: it
+ *  sends a command with the caller's
+ *  descriptors, working directory and
+ *  environment, and gets its exit status
+ *  back. bcsh --connect uses it; nothing
+ *  else of the shell is needed, so the
+ *  benchmarks link it on its own.
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "../include/bcsh_constants.h"
+#include "../include/bcsh_serve.h"
+
+extern char** environ;
+
+/**
+ * Connects to a server
+ * @return The socket, -1 if the server cannot be reached
+ */
+int client_connect(char* path){
+    struct sockaddr_un address;
+    int fd;
+
+    if(strlen(path) >= sizeof(address.sun_path)){
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if(fd == -1){
+        return -1;
+    }
+    if(connect(fd, (struct sockaddr*) &address, sizeof(address)) == -1){
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Adds a string to the strings being sent, sending them once SERVE_CHUNK bytes are
+ *  waiting
+ * @param chunk Where the strings wait, and how much of it is used
+ * @return 0 on success, -1 if the server is gone
+ */
+static int send_string(int socket, char* chunk, size_t* used, char* string){
+    size_t length = strlen(string) + 1;
+    size_t part;
+
+    while(length > 0){
+        part = SERVE_CHUNK - *used;
+        if(part > length){
+            part = length;
+        }
+        memcpy(chunk + *used, string, part);
+        *used += part;
+        string += part;
+        length -= part;
+        if(*used == SERVE_CHUNK){
+            if(send(socket, chunk, *used, MSG_NOSIGNAL) == -1){
+                return -1;
+            }
+            *used = 0;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Sends a request. Its status comes with client_status(), after which the connection
+ *  can take another one.
+ * @param envp The variables exported to the command
+ * @param fds The stdin, stdout and stderr of the command; it runs in the caller's
+ *  working directory
+ * @return 0 on success, -1 if the server is gone
+ */
+int client_send(int socket, char* command, char** envp, int* fds){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    static char* chunk = NULL;
+    struct serve_request request;
+    struct msghdr message;
+    struct iovec vector;
+    struct cmsghdr* control;
+    union {
+        struct cmsghdr header;
+        char buffer[CMSG_SPACE(SERVE_NUM_FDS * sizeof(int))];
+    } fd_buffer;
+    int sent[SERVE_NUM_FDS];
+    size_t used = 0;
+    ssize_t length;
+    int i;
+
+    if(chunk == NULL){
+        chunk = malloc(SERVE_CHUNK);
+        if(chunk == NULL){
+            fprintf(stderr, "Error in client_send() : Could not allocate space for the request\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    memcpy(sent, fds, 3 * sizeof(int));
+    sent[3] = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if(sent[3] == -1){
+        return -1;
+    }
+    request.length = strlen(command) + 1;
+    for(request.envc = 0; envp[request.envc] != NULL; request.envc++){
+        request.length += strlen(envp[request.envc]) + 1;
+    }
+
+    memset(&message, 0, sizeof(message));
+    memset(&fd_buffer, 0, sizeof(fd_buffer));
+    vector.iov_base = &request;
+    vector.iov_len = sizeof(request);
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = fd_buffer.buffer;
+    message.msg_controllen = sizeof(fd_buffer.buffer);
+    control = CMSG_FIRSTHDR(&message);
+    control->cmsg_level = SOL_SOCKET;
+    control->cmsg_type = SCM_RIGHTS;
+    control->cmsg_len = CMSG_LEN(SERVE_NUM_FDS * sizeof(int));
+    memcpy(CMSG_DATA(control), sent, SERVE_NUM_FDS * sizeof(int));
+
+    length = sendmsg(socket, &message, MSG_NOSIGNAL);
+    close(sent[3]);
+    if(length == -1 || send_string(socket, chunk, &used, command) == -1){
+        return -1;
+    }
+    for(i = 0; i < request.envc; i++){
+        if(send_string(socket, chunk, &used, envp[i]) == -1){
+            return -1;
+        }
+    }
+    if(used > 0 && send(socket, chunk, used, MSG_NOSIGNAL) == -1){
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Waits for the exit status of the request sent last
+ * @return 0 on success, -1 if the server closed the connection first
+ */
+int client_status(int socket, int* status){
+    struct serve_reply reply;
+    ssize_t length;
+
+    do{
+        length = recv(socket, &reply, sizeof(reply), 0);
+    }while(length == -1 && errno == EINTR);
+    if(length != sizeof(reply)){
+        return -1;
+    }
+    *status = reply.status;
+    return 0;
+}
+
+/**
+ * bcsh --connect socket 'commands': has a server run the commands with this process'
+ *  descriptors, working directory and environment
+ * @return Their exit status
+ */
+int client_run(char* path, char* command){
+    int fds[3] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+    int status;
+    int fd;
+
+    fd = client_connect(path);
+    if(fd == -1){
+        fprintf(stderr, "bcsh: --connect: %s: %s\n", path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if(client_send(fd, command, environ, fds) == -1 || client_status(fd, &status) == -1){
+        fprintf(stderr, "bcsh: --connect: %s: the server closed the connection\n", path);
+        return EXIT_FAILURE;
+    }
+    close(fd);
+    return status;
+}
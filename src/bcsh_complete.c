@@ -0,0 +1,658 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh_complete.c
+ * * * * * * * * * * * * * * * * * * *
+ * Completion for the line editor. The
+ *  executables in $PATH are indexed once
+ *  and inotify tells which ones come and
+ *  go; other directories are read with
+ *  getdents64() and kept in a small
+ *  cache until they change
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#include "../include/bcsh_constants.h"
+#include "../include/bcsh_builtin_table.h"
+#include "../include/bcsh_dir.h"
+#include "../include/bcsh_complete.h"
+#include "../include/bcsh_vars.h"
+#include "../include/bcsh_events.h"
+
+/**
+ * A directory of $PATH and the executables in it, sorted by name
+ */
+struct path_dir {
+    char* path;
+    int watch; //inotify watch descriptor, -1 if it could not be watched
+    int stale; //Read it again before the next completion
+    char** names; //Malloced
+    size_t count;
+    size_t capacity;
+};
+
+/**
+ * What the watch on a directory of $PATH reports: entries coming, going, and changing
+ *  mode, and the directory itself going away
+ */
+#define PATH_WATCH_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB \
+                           | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+/**
+ * The executable index: one sorted list per directory of $PATH, so that inotify events,
+ *  which name a directory and an entry, can be applied to it exactly. A completion looks
+ *  the prefix up in each list and merges what it finds.
+ */
+static struct path_dir* path_dirs = NULL;
+static int num_path_dirs = 0;
+static char* indexed_path_variable = NULL; //The $PATH the index was built from
+static int inotify_fd = -1;
+
+/**
+ * A directory read for path completion, kept until its modification time changes
+ */
+struct cached_dir {
+    char* path; //NULL if the slot is free
+    dev_t device;
+    ino_t inode;
+    struct timespec modified;
+    unsigned long used; //When it was last used, to find the least recently used slot
+    struct dir_listing listing; //Sorted
+};
+
+static struct cached_dir dir_cache[COMPLETE_DIR_CACHE];
+static unsigned long dir_cache_clock = 0;
+
+/**
+ * The answer to the last completion: the words are packed in text and words points into
+ *  it once they are all there
+ */
+static struct completions result = {NULL, 0, 0};
+static size_t words_capacity = 0;
+static char* text = NULL;
+static size_t text_size = 0;
+static size_t text_capacity = 0;
+static size_t* word_offsets = NULL;
+
+/**
+ * Builds dir/name in a buffer that is reused from call to call
+ */
+static char* join_path(char* dir, char* name){
+    static char* path = NULL;
+    static size_t capacity = 0;
+    size_t length = strlen(dir) + strlen(name) + 2;
+    char* grown;
+
+    if(length > capacity){
+        grown = realloc(path, length);
+        if(grown == NULL){
+            fprintf(stderr, "Error in join_path() : Could not allocate space for path\n");
+            exit(EXIT_FAILURE);
+        }
+        path = grown;
+        capacity = length;
+    }
+    sprintf(path, "%s/%s", dir, name);
+    return path;
+}
+
+/**
+ * Checks if dir/name is an executable regular file, the way the shell would run it
+ */
+static int is_executable(char* dir, char* name){
+    struct stat file_stat;
+    char* path = join_path(dir, name);
+
+    return access(path, X_OK) == 0 && stat(path, &file_stat) == 0 && S_ISREG(file_stat.st_mode);
+}
+
+/**
+ * Finds where a name is, or would be, in the sorted list of a directory of $PATH
+ */
+static size_t path_dir_find(struct path_dir* dir, char* name){
+    size_t low = 0;
+    size_t high = dir->count;
+    size_t middle;
+
+    while(low < high){
+        middle = low + (high - low) / 2;
+        if(strcmp(dir->names[middle], name) < 0){
+            low = middle + 1;
+        }else{
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/**
+ * Adds a copy of a name at the end of the list of a directory of $PATH
+ */
+static void path_dir_append(struct path_dir* dir, char* name){
+    char** names;
+
+    if(dir->count == dir->capacity){
+        dir->capacity = (dir->capacity == 0) ? COMPLETE_INITIAL_NAMES : dir->capacity * 2;
+        names = realloc(dir->names, dir->capacity * sizeof(char*));
+        if(names == NULL){
+            fprintf(stderr, "Error in path_dir_append() : Could not reallocate space for names\n");
+            exit(EXIT_FAILURE);
+        }
+        dir->names = names;
+    }
+    dir->names[dir->count] = strdup(name);
+    if(dir->names[dir->count] == NULL){
+        fprintf(stderr, "Error in path_dir_append() : Could not allocate space for name\n");
+        exit(EXIT_FAILURE);
+    }
+    dir->count++;
+}
+
+/**
+ * Adds an executable to a directory of $PATH, keeping the list sorted
+ */
+static void path_dir_insert(struct path_dir* dir, char* name){
+    size_t index = path_dir_find(dir, name);
+
+    if(index < dir->count && strcmp(dir->names[index], name) == 0){
+        return;
+    }
+    path_dir_append(dir, name);
+    name = dir->names[dir->count - 1];
+    memmove(dir->names + index + 1, dir->names + index, (dir->count - 1 - index) * sizeof(char*));
+    dir->names[index] = name;
+}
+
+/**
+ * Removes an executable from a directory of $PATH, if it is there
+ */
+static void path_dir_remove(struct path_dir* dir, char* name){
+    size_t index = path_dir_find(dir, name);
+
+    if(index < dir->count && strcmp(dir->names[index], name) == 0){
+        free(dir->names[index]);
+        dir->count--;
+        memmove(dir->names + index, dir->names + index + 1, (dir->count - index) * sizeof(char*));
+    }
+}
+
+/**
+ * Orders two names, for qsort()
+ */
+static int compare_names(const void* a, const void* b){
+    return strcmp(*(char**)a, *(char**)b);
+}
+
+/**
+ * Reads the executables of a directory of $PATH again. A directory that does not exist
+ *  just has none.
+ */
+static void path_dir_scan(struct path_dir* dir){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    static struct dir_listing listing;
+    unsigned char type;
+    size_t i;
+
+    for(i = 0; i < dir->count; i++){
+        free(dir->names[i]);
+    }
+    dir->count = 0;
+
+    /********************************************************************
+    Watch it first, so nothing that changes while it is read is missed.
+        A directory that cannot be watched (it does not exist yet, or
+        there are no watches left) is read again every time.
+    ********************************************************************/
+    if(dir->watch == -1 && inotify_fd != -1){
+        dir->watch = inotify_add_watch(inotify_fd, dir->path, PATH_WATCH_EVENTS);
+    }
+    dir->stale = (dir->watch == -1);
+
+    if(dir_read_path(dir->path, &listing) == -1){
+        return;
+    }
+
+    /********************************************************************
+    Add every executable, then sort once
+    ********************************************************************/
+    for(i = 0; i < listing.count; i++){
+        type = dir_type(&listing, i);
+        if((type == DT_REG || type == DT_LNK || type == DT_UNKNOWN)
+           && is_executable(dir->path, dir_name(&listing, i))){
+            path_dir_append(dir, dir_name(&listing, i));
+        }
+    }
+    qsort(dir->names, dir->count, sizeof(char*), compare_names);
+}
+
+/**
+ * Throws the whole index away
+ */
+static void index_clear(){
+    int i;
+    size_t j;
+
+    for(i = 0; i < num_path_dirs; i++){
+        for(j = 0; j < path_dirs[i].count; j++){
+            free(path_dirs[i].names[j]);
+        }
+        free(path_dirs[i].names);
+        free(path_dirs[i].path);
+    }
+    free(path_dirs);
+    path_dirs = NULL;
+    num_path_dirs = 0;
+
+    if(inotify_fd != -1){
+        events_unwatch(inotify_fd);
+        close(inotify_fd); //Removes every watch with it
+        inotify_fd = -1;
+    }
+}
+
+static int index_changed(int fd);
+
+/**
+ * Sets up the index for a value of $PATH: one list per directory, each with a watch
+ *  on it. They are only read by index_refresh().
+ */
+static void index_build(char* path_variable){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    char* copy = strdup(path_variable);
+    char* dir;
+    char* rest;
+    int i;
+
+    index_clear();
+    free(indexed_path_variable);
+    indexed_path_variable = strdup(path_variable);
+    if(copy == NULL || indexed_path_variable == NULL){
+        fprintf(stderr, "Error in index_build() : Could not allocate space for PATH\n");
+        exit(EXIT_FAILURE);
+    }
+
+    path_dirs = malloc((strlen(path_variable) / 2 + 1) * sizeof(struct path_dir));
+    if(path_dirs == NULL){
+        fprintf(stderr, "Error in index_build() : Could not allocate space for PATH\n");
+        exit(EXIT_FAILURE);
+    }
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(inotify_fd != -1){
+        events_watch(inotify_fd, index_changed);
+    }
+
+    /********************************************************************
+    A directory listed twice is only indexed once. An empty entry means
+        the working directory, whose commands the shell does not look up
+        without a /, so it is left out.
+    ********************************************************************/
+    for(dir = strtok_r(copy, ":", &rest); dir != NULL; dir = strtok_r(NULL, ":", &rest)){
+        for(i = 0; i < num_path_dirs && strcmp(path_dirs[i].path, dir) != 0; i++);
+        if(i < num_path_dirs){
+            continue;
+        }
+
+        path_dirs[num_path_dirs].path = strdup(dir);
+        if(path_dirs[num_path_dirs].path == NULL){
+            fprintf(stderr, "Error in index_build() : Could not allocate space for PATH\n");
+            exit(EXIT_FAILURE);
+        }
+        path_dirs[num_path_dirs].watch = -1;
+        path_dirs[num_path_dirs].stale = 1;
+        path_dirs[num_path_dirs].names = NULL;
+        path_dirs[num_path_dirs].count = 0;
+        path_dirs[num_path_dirs].capacity = 0;
+        num_path_dirs++;
+    }
+    free(copy);
+}
+
+/**
+ * Applies what inotify saw since the last completion: an executable that appeared or
+ *  was made executable is added, one that went away or lost its x bits is removed. When
+ *  events were lost, or a directory itself went away, it is read again.
+ */
+static void index_apply_events(){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    char events[COMPLETE_EVENTS_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct inotify_event* event;
+    ssize_t bytes_read;
+    ssize_t position;
+    int i;
+
+    if(inotify_fd == -1){
+        return;
+    }
+
+    while((bytes_read = read(inotify_fd, events, sizeof(events))) > 0){
+        for(position = 0; position < bytes_read; position += sizeof(struct inotify_event) + event->len){
+            event = (struct inotify_event*)(events + position);
+
+            if(event->mask & IN_Q_OVERFLOW){
+                for(i = 0; i < num_path_dirs; i++){
+                    path_dirs[i].stale = 1;
+                }
+                continue;
+            }
+            for(i = 0; i < num_path_dirs && path_dirs[i].watch != event->wd; i++);
+            if(i == num_path_dirs){
+                continue;
+            }
+
+            if(event->mask & IN_IGNORED){
+                path_dirs[i].watch = -1; //It went away, it gets a new watch if it comes back
+                path_dirs[i].stale = 1;
+            }else if(event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)){
+                path_dirs[i].stale = 1;
+            }else if(path_dirs[i].stale || event->len == 0){
+                continue;
+            }else if(event->mask & (IN_DELETE | IN_MOVED_FROM)){
+                path_dir_remove(&path_dirs[i], event->name);
+            }else if(is_executable(path_dirs[i].path, event->name)){
+                path_dir_insert(&path_dirs[i], event->name);
+            }else{
+                path_dir_remove(&path_dirs[i], event->name);
+            }
+        }
+    }
+}
+
+/**
+ * Applies the events of inotify as they come while the shell waits for input, so its
+ *  queue does not overflow (and force the directories to be read again) however long
+ *  the shell waits between two completions
+ */
+static int index_changed(int fd){
+    (void) fd;
+    index_apply_events();
+    return EVENT_QUIET;
+}
+
+/**
+ * Brings the index up to date: rebuilt if $PATH changed, otherwise only changed by what
+ *  inotify reported
+ */
+static void index_refresh(){
+    char* path_variable = var_get("PATH");
+    int i;
+
+    if(path_variable == NULL){
+        path_variable = DEFAULT_PATH;
+    }
+    if(indexed_path_variable == NULL || strcmp(indexed_path_variable, path_variable) != 0){
+        index_build(path_variable);
+    }else{
+        index_apply_events();
+    }
+
+    for(i = 0; i < num_path_dirs; i++){
+        if(path_dirs[i].stale){
+            path_dir_scan(&path_dirs[i]);
+        }
+    }
+}
+
+/**
+ * Empties the result of the last completion
+ */
+static void result_reset(){
+    text_size = 0;
+    result.count = 0;
+    result.common = 0;
+}
+
+/**
+ * Adds a word to the result, as prefix followed by name, and a / if asked
+ */
+static void result_add(char* prefix, size_t prefix_length, char* name, int slash){
+    size_t length = prefix_length + strlen(name) + slash + 1;
+    size_t* offsets;
+    char* grown;
+
+    while(text_size + length > text_capacity){
+        text_capacity = (text_capacity == 0) ? COMPLETE_INITIAL_TEXT : text_capacity * 2;
+        grown = realloc(text, text_capacity);
+        if(grown == NULL){
+            fprintf(stderr, "Error in result_add() : Could not reallocate space for completions\n");
+            exit(EXIT_FAILURE);
+        }
+        text = grown;
+    }
+    if(result.count == words_capacity){
+        words_capacity = (words_capacity == 0) ? COMPLETE_INITIAL_NAMES : words_capacity * 2;
+        offsets = realloc(word_offsets, words_capacity * sizeof(size_t));
+        if(offsets == NULL){
+            fprintf(stderr, "Error in result_add() : Could not reallocate space for completions\n");
+            exit(EXIT_FAILURE);
+        }
+        word_offsets = offsets;
+    }
+
+    word_offsets[result.count++] = text_size;
+    memcpy(text + text_size, prefix, prefix_length);
+    strcpy(text + text_size + prefix_length, name);
+    if(slash){
+        strcpy(text + text_size + length - 2, "/");
+    }
+    text_size += length;
+}
+
+/**
+ * Turns the offsets of the words into pointers, sorted and without duplicates, and works
+ *  out the prefix they share
+ */
+static struct completions* result_finish(int sort){
+    char** words;
+    size_t i;
+    size_t kept;
+
+    if(result.count > 0){
+        words = realloc(result.words, result.count * sizeof(char*));
+        if(words == NULL){
+            fprintf(stderr, "Error in result_finish() : Could not reallocate space for completions\n");
+            exit(EXIT_FAILURE);
+        }
+        result.words = words;
+    }
+    for(i = 0; i < result.count; i++){
+        result.words[i] = text + word_offsets[i];
+    }
+    if(sort){
+        qsort(result.words, result.count, sizeof(char*), compare_names);
+    }
+
+    for(i = 0, kept = 0; i < result.count; i++){
+        if(kept == 0 || strcmp(result.words[kept - 1], result.words[i]) != 0){
+            result.words[kept++] = result.words[i];
+        }
+    }
+    result.count = kept;
+
+    if(result.count > 0){
+        result.common = strlen(result.words[0]);
+        for(i = 1; i < result.count; i++){
+            while(strncmp(result.words[0], result.words[i], result.common) != 0){
+                result.common--;
+            }
+        }
+    }
+    return &result;
+}
+
+/**
+ * Completes a command name: the internal commands and the executables of $PATH that
+ *  start with the word
+ */
+static struct completions* complete_command(char* word){
+    size_t length = strlen(word);
+    size_t index;
+    int i;
+
+    index_refresh();
+    for(i = 0; i < NUM_INTERNAL_COMMANDS; i++){
+        if(strncmp(internal_command_names[i], word, length) == 0){
+            result_add("", 0, internal_command_names[i], 0);
+        }
+    }
+    for(i = 0; i < num_path_dirs; i++){
+        for(index = path_dir_find(&path_dirs[i], word); index < path_dirs[i].count
+            && strncmp(path_dirs[i].names[index], word, length) == 0; index++){
+            result_add("", 0, path_dirs[i].names[index], 0);
+        }
+    }
+    return result_finish(1);
+}
+
+/**
+ * Gives the sorted entries of a directory, from the cache if it did not change since it
+ *  was read
+ * @return The listing, NULL if the directory cannot be read
+ */
+static struct dir_listing* cached_listing(char* path){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct cached_dir* slot = NULL;
+    struct stat dir_stat;
+    int i;
+
+    if(stat(path, &dir_stat) == -1 || !S_ISDIR(dir_stat.st_mode)){
+        return NULL;
+    }
+
+    for(i = 0; i < COMPLETE_DIR_CACHE; i++){
+        if(dir_cache[i].path != NULL && strcmp(dir_cache[i].path, path) == 0){
+            slot = &dir_cache[i];
+            break;
+        }
+        if(slot == NULL || dir_cache[i].used < slot->used){
+            slot = &dir_cache[i];
+        }
+    }
+    slot->used = ++dir_cache_clock;
+
+    if(slot->path != NULL && strcmp(slot->path, path) == 0 && slot->device == dir_stat.st_dev
+       && slot->inode == dir_stat.st_ino && slot->modified.tv_sec == dir_stat.st_mtim.tv_sec
+       && slot->modified.tv_nsec == dir_stat.st_mtim.tv_nsec){
+        return &slot->listing;
+    }
+
+    /********************************************************************
+    Read it again into the slot, which keeps its buffers
+    ********************************************************************/
+    free(slot->path);
+    slot->path = NULL;
+    if(dir_read_path(path, &slot->listing) == -1){
+        return NULL;
+    }
+    dir_sort(&slot->listing);
+    slot->path = strdup(path);
+    if(slot->path == NULL){
+        fprintf(stderr, "Error in cached_listing() : Could not allocate space for path\n");
+        exit(EXIT_FAILURE);
+    }
+    slot->device = dir_stat.st_dev;
+    slot->inode = dir_stat.st_ino;
+    slot->modified = dir_stat.st_mtim;
+    return &slot->listing;
+}
+
+/**
+ * Completes a path: the entries of its directory that start with its last component.
+ *  Hidden entries only show up when that component starts with a dot, and ~/ stands
+ *  for $HOME.
+ */
+static struct completions* complete_path(char* word){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct dir_listing* listing;
+    struct stat entry_stat;
+    char* slash = strrchr(word, '/');
+    char* base = (slash == NULL) ? word : slash + 1;
+    size_t prefix_length = base - word;
+    size_t base_length = strlen(base);
+    char* dir;
+    char* home;
+    char* name;
+    unsigned char type;
+    size_t index;
+    int is_dir;
+
+    /********************************************************************
+    Work out which directory to read
+    ********************************************************************/
+    if(slash == NULL){
+        dir = strdup(".");
+    }else if(slash == word){
+        dir = strdup("/");
+    }else if(word[0] == '~' && word[1] == '/' && (home = var_get("HOME")) != NULL){
+        dir = malloc(strlen(home) + prefix_length);
+        if(dir != NULL){
+            sprintf(dir, "%s%.*s", home, (int)(prefix_length - 2), word + 1);
+        }
+    }else{
+        dir = strndup(word, prefix_length - 1);
+    }
+    if(dir == NULL){
+        fprintf(stderr, "Error in complete_path() : Could not allocate space for path\n");
+        exit(EXIT_FAILURE);
+    }
+
+    listing = cached_listing(dir);
+    if(listing != NULL){
+        for(index = dir_find(listing, base); index < listing->count
+            && strncmp(dir_name(listing, index), base, base_length) == 0; index++){
+            name = dir_name(listing, index);
+            if(name[0] == '.' && base[0] != '.'){
+                continue;
+            }
+
+            type = dir_type(listing, index);
+            is_dir = (type == DT_DIR);
+            if(type == DT_LNK || type == DT_UNKNOWN){
+                is_dir = stat(join_path(dir, name), &entry_stat) == 0 && S_ISDIR(entry_stat.st_mode);
+            }
+            result_add(word, prefix_length, name, is_dir);
+        }
+    }
+
+    free(dir);
+    return result_finish(0);
+}
+
+/**
+ * Completes a word of the command line
+ * @param word The word as typed so far, without quotes or escapes
+ * @param command Whether the word is where a command name goes
+ * @return What it can be completed to, only valid until the next call
+ */
+struct completions* complete_word(char* word, int command){
+    result_reset();
+    if(command && strchr(word, '/') == NULL){
+        return complete_command(word);
+    }
+    return complete_path(word);
+}
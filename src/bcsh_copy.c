@@ -0,0 +1,378 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh_copy.c
+ * * * * * * * * * * * * * * * * * * *
+ * Moving bytes between descriptors
+ *  inside the kernel, for cat, tee
+ *  and cp: copy_file_range() between
+ *  files, splice() and tee() to and
+ *  from pipes, sendfile() from files,
+ *  and read()/write() when none apply
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/sendfile.h>
+
+#include "../include/bcsh_constants.h"
+#include "../include/bcsh_copy.h"
+
+/**
+ * How copy_fd() moves the bytes, from the fastest to the one that always works
+ */
+#define METHOD_COPY_RANGE 0 //copy_file_range(), file to file, may share extents
+#define METHOD_SPLICE 1 //splice(), when one side is a pipe
+#define METHOD_SENDFILE 2 //sendfile(), from a file to anything
+#define METHOD_READ_WRITE 3
+
+/**
+ * The buffer of the read()/write() fallback, allocated the first time it is needed
+ */
+static char* copy_buffer = NULL;
+
+/**
+ * Checks if a failed kernel copy means "not for these descriptors" (a terminal, an
+ *  O_APPEND file, two file systems, an old kernel) rather than a real I/O error
+ */
+static int unsupported(int err){
+    return err == EINVAL || err == ENOSYS || err == EXDEV || err == EOPNOTSUPP
+           || err == EBADF || err == ESPIPE || err == EAGAIN;
+}
+
+/**
+ * Returns the buffer of the read()/write() fallback, NULL if it cannot be allocated
+ */
+static char* get_copy_buffer(){
+    if(copy_buffer == NULL){
+        copy_buffer = malloc(COPY_BLOCK_SIZE);
+        if(copy_buffer == NULL){
+            fprintf(stderr, "Error in get_copy_buffer() : Could not allocate space for buffer\n");
+        }
+    }
+    return copy_buffer;
+}
+
+/**
+ * Writes all of a buffer to a descriptor
+ * @return 0 on success, -1 (with errno set) on failure
+ */
+static int write_all(int fd, char* buffer, size_t length){
+    ssize_t written;
+
+    while(length > 0){
+        written = write(fd, buffer, length);
+        if(written == -1){
+            if(errno == EINTR){
+                continue;
+            }
+            return -1;
+        }
+        buffer += written;
+        length -= written;
+    }
+    return 0;
+}
+
+/**
+ * Copies everything left in one descriptor to another with read() and write()
+ * @return COPY_OK, COPY_READ_ERROR or COPY_WRITE_ERROR, with errno set
+ */
+static int copy_read_write(int in, int out){
+    char* buffer = get_copy_buffer();
+    ssize_t bytes_read;
+
+    if(buffer == NULL){
+        errno = ENOMEM;
+        return COPY_READ_ERROR;
+    }
+    while(1){
+        bytes_read = read(in, buffer, COPY_BLOCK_SIZE);
+        if(bytes_read == 0){
+            return COPY_OK;
+        }
+        if(bytes_read == -1){
+            if(errno == EINTR){
+                continue;
+            }
+            return COPY_READ_ERROR;
+        }
+        if(write_all(out, buffer, bytes_read) == -1){
+            return COPY_WRITE_ERROR;
+        }
+    }
+}
+
+/**
+ * Copies everything left in one descriptor to another, from their current offsets,
+ *  without the bytes going through the shell when the kernel can do it: between two
+ *  files with copy_file_range(), to or from a pipe with splice(), from a file to
+ *  anything else with sendfile(). A method the descriptors do not support is noticed on
+ *  its first call and the next one is tried, down to read() and write().
+ * @return COPY_OK, COPY_READ_ERROR or COPY_WRITE_ERROR, with errno set
+ */
+int copy_fd(int in, int out){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct stat in_stat;
+    struct stat out_stat;
+    int method;
+    ssize_t copied;
+
+    if(fstat(in, &in_stat) == -1){
+        return COPY_READ_ERROR;
+    }
+    if(fstat(out, &out_stat) == -1){
+        return COPY_WRITE_ERROR;
+    }
+
+    if(S_ISREG(in_stat.st_mode) && S_ISREG(out_stat.st_mode)){
+        method = METHOD_COPY_RANGE;
+    }else if(S_ISFIFO(in_stat.st_mode) || S_ISFIFO(out_stat.st_mode)){
+        method = METHOD_SPLICE;
+    }else if(S_ISREG(in_stat.st_mode) || S_ISBLK(in_stat.st_mode)){
+        method = METHOD_SENDFILE;
+    }else{
+        method = METHOD_READ_WRITE;
+    }
+
+    while(method != METHOD_READ_WRITE){
+        if(method == METHOD_COPY_RANGE){
+            copied = copy_file_range(in, NULL, out, NULL, COPY_CALL_SIZE, 0);
+        }else if(method == METHOD_SPLICE){
+            copied = splice(in, NULL, out, NULL, COPY_CALL_SIZE, SPLICE_F_MOVE | SPLICE_F_MORE);
+        }else{
+            copied = sendfile(out, in, NULL, COPY_CALL_SIZE);
+        }
+
+        if(copied == 0){
+            return COPY_OK;
+        }
+        if(copied > 0 || errno == EINTR){
+            continue;
+        }
+
+        /********************************************************************
+        Fall back to the next method. Whatever was already copied moved
+            the file offsets, so it carries on from there. A real error
+            shows up again with read() and write(), which tell which side
+            it is on.
+        ********************************************************************/
+        if(method == METHOD_COPY_RANGE && unsupported(errno)){
+            method = METHOD_SENDFILE;
+        }else{
+            method = METHOD_READ_WRITE;
+        }
+    }
+
+    return copy_read_write(in, out);
+}
+
+/**
+ * Reads and throws away bytes from a pipe, to keep a tee in step when one output failed
+ */
+static void discard(int fd, size_t length){
+    char* buffer = get_copy_buffer();
+    ssize_t bytes_read;
+
+    while(length > 0 && buffer != NULL){
+        bytes_read = read(fd, buffer, (length < COPY_BLOCK_SIZE) ? length : COPY_BLOCK_SIZE);
+        if(bytes_read > 0){
+            length -= bytes_read;
+        }else if(bytes_read == 0 || errno != EINTR){
+            return;
+        }
+    }
+}
+
+/**
+ * Moves exactly length bytes out of a pipe into a file with splice()
+ * @return 0 on success, -1 (with errno set) on failure, the rest still being in the pipe
+ */
+static int splice_exactly(int in, int out, size_t* length){
+    ssize_t moved;
+
+    while(*length > 0){
+        moved = splice(in, NULL, out, NULL, *length, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if(moved > 0){
+            *length -= moved;
+        }else if(moved == 0){
+            errno = EIO;
+            return -1;
+        }else if(errno != EINTR){
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Checks if tee_fds() can copy without the bytes going through the shell: stdin and
+ *  stdout are pipes, and the files are regular files that are not O_APPEND, which
+ *  splice() refuses
+ */
+static int can_tee_in_kernel(int in, int* outs, int num_outs){
+    struct stat file_stat;
+    int i;
+
+    if(num_outs < 2 || fstat(in, &file_stat) == -1 || !S_ISFIFO(file_stat.st_mode)){
+        return 0;
+    }
+    if(fstat(outs[0], &file_stat) == -1 || !S_ISFIFO(file_stat.st_mode)){
+        return 0;
+    }
+    for(i = 1; i < num_outs; i++){
+        if(fstat(outs[i], &file_stat) == -1 || !S_ISREG(file_stat.st_mode)
+           || (fcntl(outs[i], F_GETFL) & O_APPEND)){
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * The kernel side of tee_fds(). Each round, tee() copies what is waiting in stdin to
+ *  stdout without consuming it, which sets how many bytes the round moves. Every file
+ *  but the last gets its own copy through a private pipe (tee() then splice()), and the
+ *  last one consumes the bytes from stdin with splice().
+ * @return COPY_OK, COPY_READ_ERROR, or -1 if stdout failed before anything was consumed,
+ *  in which case the caller carries on with read() and write()
+ */
+static int tee_in_kernel(int in, int* outs, int num_outs, int* failed){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    int scratch[2];
+    ssize_t round;
+    ssize_t copied;
+    size_t length;
+    int i;
+
+    /********************************************************************
+    The private pipe has to hold all that stdin can, so a tee() into it
+        always copies the whole round
+    ********************************************************************/
+    if(pipe2(scratch, O_CLOEXEC) == -1){
+        return -1;
+    }
+    if(fcntl(scratch[1], F_SETPIPE_SZ, fcntl(in, F_GETPIPE_SZ)) == -1){
+        close(scratch[0]);
+        close(scratch[1]);
+        return -1;
+    }
+
+    while(1){
+        round = tee(in, outs[0], COPY_CALL_SIZE, 0);
+        if(round == -1 && errno == EINTR){
+            continue;
+        }
+        if(round <= 0){
+            break;
+        }
+
+        for(i = 1; i < num_outs - 1; i++){
+            if(failed[i] != 0){
+                continue;
+            }
+            copied = tee(in, scratch[1], round, 0);
+            length = (copied > 0) ? copied : 0;
+            if(copied != round){
+                failed[i] = (copied == -1) ? errno : EIO;
+            }else if(splice_exactly(scratch[0], outs[i], &length) == -1){
+                failed[i] = errno;
+            }
+            discard(scratch[0], length);
+        }
+
+        length = round;
+        if(failed[num_outs - 1] == 0 && splice_exactly(in, outs[num_outs - 1], &length) == -1){
+            failed[num_outs - 1] = errno;
+        }
+        discard(in, length);
+    }
+
+    close(scratch[0]);
+    close(scratch[1]);
+    if(round == -1){
+        failed[0] = errno;
+        return -1;
+    }
+    return COPY_OK;
+}
+
+/**
+ * Copies everything left in a descriptor to several others, as tee does: outs[0] is
+ *  stdout and the rest are files. When stdin and stdout are pipes and the files support
+ *  splice(), the bytes never go through the shell; otherwise they are read in large
+ *  blocks and written to every output. An output that fails is left out from then on.
+ * @param failed Set to the errno of each output that failed, 0 for the others
+ * @return COPY_OK, or COPY_READ_ERROR if reading failed (errno set)
+ */
+int tee_fds(int in, int* outs, int num_outs, int* failed){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    char* buffer;
+    ssize_t bytes_read;
+    int i;
+
+    for(i = 0; i < num_outs; i++){
+        failed[i] = 0;
+    }
+
+    /********************************************************************
+    With no files, tee is cat
+    ********************************************************************/
+    if(num_outs == 1){
+        i = copy_fd(in, outs[0]);
+        if(i == COPY_WRITE_ERROR){
+            failed[0] = errno;
+            return COPY_OK;
+        }
+        return i;
+    }
+
+    if(can_tee_in_kernel(in, outs, num_outs)){
+        i = tee_in_kernel(in, outs, num_outs, failed);
+        if(i != -1){
+            return i;
+        }
+        if(unsupported(failed[0])){
+            failed[0] = 0; //Not a real error, stdout gets the rest too
+        }
+    }
+
+    buffer = get_copy_buffer();
+    if(buffer == NULL){
+        errno = ENOMEM;
+        return COPY_READ_ERROR;
+    }
+    while(1){
+        bytes_read = read(in, buffer, COPY_BLOCK_SIZE);
+        if(bytes_read == 0){
+            return COPY_OK;
+        }
+        if(bytes_read == -1){
+            if(errno == EINTR){
+                continue;
+            }
+            return COPY_READ_ERROR;
+        }
+        for(i = 0; i < num_outs; i++){
+            if(failed[i] == 0 && write_all(outs[i], buffer, bytes_read) == -1){
+                failed[i] = errno;
+            }
+        }
+    }
+}
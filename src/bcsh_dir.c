@@ -0,0 +1,190 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh_dir.c
+ * * * * * * * * * * * * * * * * * * *
+ * Reading whole directories: entries
+ *  come from getdents64() a large batch
+ *  at a time, straight into one packed
+ *  buffer of names
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+
+#include "../include/bcsh_constants.h"
+#include "../include/bcsh_dir.h"
+
+/**
+ * The buffer getdents64() fills, allocated the first time a directory is read
+ */
+static char* dents_buffer = NULL;
+
+/**
+ * Makes room for length more bytes of names and one more entry
+ */
+static void dir_reserve(struct dir_listing* listing, size_t length){
+    char* names;
+    size_t* offsets;
+
+    if(listing->size + length > listing->capacity){
+        while(listing->size + length > listing->capacity){
+            listing->capacity = (listing->capacity == 0) ? DIR_INITIAL_NAMES : listing->capacity * 2;
+        }
+        names = realloc(listing->names, listing->capacity);
+        if(names == NULL){
+            fprintf(stderr, "Error in dir_reserve() : Could not reallocate space for names\n");
+            exit(EXIT_FAILURE);
+        }
+        listing->names = names;
+    }
+    if(listing->count == listing->offsets_capacity){
+        listing->offsets_capacity = (listing->offsets_capacity == 0) ? DIR_INITIAL_ENTRIES : listing->offsets_capacity * 2;
+        offsets = realloc(listing->offsets, listing->offsets_capacity * sizeof(size_t));
+        if(offsets == NULL){
+            fprintf(stderr, "Error in dir_reserve() : Could not reallocate space for entries\n");
+            exit(EXIT_FAILURE);
+        }
+        listing->offsets = offsets;
+    }
+}
+
+/**
+ * Calls visit on every entry of an open directory, straight from the buffer getdents64()
+ *  filled, so entries the caller does not want are never copied. It cannot be used from
+ *  inside visit, which shares that buffer.
+ * @param visit Given each name (not . or ..), its length and its d_type
+ * @return 0 on success, -1 (with errno set) on failure
+ */
+int dir_each(int fd, dir_visitor visit, void* context){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct dirent64* entry;
+    ssize_t bytes_read;
+    ssize_t position;
+
+    if(dents_buffer == NULL){
+        dents_buffer = malloc(DIR_READ_SIZE);
+        if(dents_buffer == NULL){
+            fprintf(stderr, "Error in dir_each() : Could not allocate space for entries\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    while(1){
+        bytes_read = getdents64(fd, dents_buffer, DIR_READ_SIZE);
+        if(bytes_read == -1 && errno == EINTR){
+            continue;
+        }
+        if(bytes_read <= 0){
+            return (bytes_read == 0) ? 0 : -1;
+        }
+
+        for(position = 0; position < bytes_read; position += entry->d_reclen){
+            entry = (struct dirent64*)(dents_buffer + position);
+            if(entry->d_name[0] == '.' && (entry->d_name[1] == '\0'
+               || (entry->d_name[1] == '.' && entry->d_name[2] == '\0'))){
+                continue;
+            }
+            visit(entry->d_name, strlen(entry->d_name), entry->d_type, context);
+        }
+    }
+}
+
+/**
+ * Adds an entry to a listing, for dir_read()
+ */
+static void add_entry(char* name, size_t length, unsigned char type, void* context){
+    struct dir_listing* listing = context;
+
+    dir_reserve(listing, length + 2);
+    listing->names[listing->size] = type;
+    listing->offsets[listing->count++] = listing->size + 1;
+    memcpy(listing->names + listing->size + 1, name, length + 1);
+    listing->size += length + 2;
+}
+
+/**
+ * Reads every entry of an open directory into a listing, replacing what it held. The
+ *  listing keeps its buffers, so reading into the same one again does not allocate.
+ * @return 0 on success, -1 (with errno set) on failure
+ */
+int dir_read(int fd, struct dir_listing* listing){
+    listing->size = 0;
+    listing->count = 0;
+    return dir_each(fd, add_entry, listing);
+}
+
+/**
+ * Reads every entry of a directory into a listing
+ * @return 0 on success, -1 (with errno set) on failure
+ */
+int dir_read_path(char* path, struct dir_listing* listing){
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    int result;
+    int saved_errno;
+
+    if(fd == -1){
+        return -1;
+    }
+    result = dir_read(fd, listing);
+    saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+    return result;
+}
+
+/**
+ * Orders two entries by name, for qsort_r()
+ */
+static int compare_entries(const void* a, const void* b, void* names){
+    return strcmp((char*)names + *(size_t*)a, (char*)names + *(size_t*)b);
+}
+
+/**
+ * Sorts the entries of a listing by name, in byte order. Only the offsets move.
+ */
+void dir_sort(struct dir_listing* listing){
+    qsort_r(listing->offsets, listing->count, sizeof(size_t), compare_entries, listing->names);
+}
+
+/**
+ * Finds where a name is, or would be, in a sorted listing: the first entry that does not
+ *  sort before it. The entries starting with some prefix are the ones from there on.
+ */
+size_t dir_find(struct dir_listing* listing, char* name){
+    size_t low = 0;
+    size_t high = listing->count;
+    size_t middle;
+
+    while(low < high){
+        middle = low + (high - low) / 2;
+        if(strcmp(dir_name(listing, middle), name) < 0){
+            low = middle + 1;
+        }else{
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/**
+ * Releases what a listing holds
+ */
+void dir_free(struct dir_listing* listing){
+    free(listing->names);
+    free(listing->offsets);
+    listing->names = NULL;
+    listing->offsets = NULL;
+    listing->size = listing->capacity = 0;
+    listing->count = listing->offsets_capacity = 0;
+}
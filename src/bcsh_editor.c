@@ -0,0 +1,781 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh_editor.c
+ * * * * * * * * * * * * * * * * * * *
+ * The line editor: interactive lines
+ *  are read with the terminal in raw
+ *  mode, so they can be edited in place,
+ *  completed with tab and recalled from
+ *  the history. It waits for keys in the
+ *  event loop, redrawing the line when
+ *  something happens meanwhile.
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <signal.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include "../include/bcsh_constants.h"
+#include "../include/bcsh_history.h"
+#include "../include/bcsh_complete.h"
+#include "../include/bcsh_editor.h"
+#include "../include/bcsh_vars.h"
+#include "../include/bcsh_events.h"
+
+/**
+ * Keys that arrive as escape sequences, numbered past the bytes
+ */
+#define KEY_UP 256
+#define KEY_DOWN 257
+#define KEY_RIGHT 258
+#define KEY_LEFT 259
+#define KEY_HOME 260
+#define KEY_END 261
+#define KEY_DELETE 262
+#define KEY_UNKNOWN 263 //CTRL() comes from <termios.h>
+#define KEY_WAKE 264 //Not a key: something happened that has to be shown, see events_wait()
+#define KEY_INTERRUPT 265 //Not a key: the shell got SIGINT
+#define KEY_TIMEOUT -2 //No byte came in time
+
+/**
+ * The line being edited
+ */
+static struct {
+    char* buffer; //Not null terminated while it is edited
+    size_t length;
+    size_t capacity;
+    size_t cursor; //Byte offset of the cursor in buffer
+    char* prompt;
+    size_t cursor_row; //Rows between the first one of the prompt and the cursor
+    long history_position; //Entry shown, history_count() for the line being typed
+    char* saved; //The line being typed, while the history is shown instead
+    size_t saved_length;
+    size_t saved_capacity;
+} line = {NULL, 0, 0, 0, NULL, 0, 0, NULL, 0, 0};
+
+/**
+ * What goes to the terminal is gathered here and written at once, so a redraw does
+ *  not flicker
+ */
+static char* output = NULL;
+static size_t output_length = 0;
+static size_t output_capacity = 0;
+
+static struct termios saved_modes;
+
+/**
+ * The width of the terminal, read again after SIGWINCH, 0 until it is read
+ */
+static size_t columns = 0;
+
+/**
+ * Checks if lines can be read with the editor: stdin and stdout are a terminal that
+ *  understands cursor movements
+ */
+int editor_available(){
+    static int available = -1;
+    struct termios modes;
+    char* term;
+
+    if(available == -1){
+        term = var_get("TERM");
+        available = isatty(STDIN_FILENO) && isatty(STDOUT_FILENO) && tcgetattr(STDIN_FILENO, &modes) == 0
+                    && !(term != NULL && (strcmp(term, "dumb") == 0 || strcmp(term, "") == 0));
+    }
+    return available;
+}
+
+/**
+ * Grows a buffer so it holds at least needed bytes
+ */
+static void reserve(char** buffer, size_t* capacity, size_t needed){
+    char* grown;
+
+    if(needed <= *capacity){
+        return;
+    }
+    while(*capacity < needed){
+        *capacity = (*capacity == 0) ? EDITOR_INITIAL_LINE : *capacity * 2;
+    }
+    grown = realloc(*buffer, *capacity);
+    if(grown == NULL){
+        fprintf(stderr, "Error in reserve() : Could not reallocate space for line\n");
+        exit(EXIT_FAILURE);
+    }
+    *buffer = grown;
+}
+
+static void out_append(const char* text, size_t length){
+    reserve(&output, &output_capacity, output_length + length);
+    memcpy(output + output_length, text, length);
+    output_length += length;
+}
+
+static void out_printf(const char* format, ...){
+    char text[64];
+    va_list arguments;
+    int length;
+
+    va_start(arguments, format);
+    length = vsnprintf(text, sizeof(text), format, arguments);
+    va_end(arguments);
+    out_append(text, (length < (int)sizeof(text)) ? length : (int)sizeof(text) - 1);
+}
+
+static void out_flush(){
+    size_t written = 0;
+    ssize_t result;
+
+    while(written < output_length){
+        result = write(STDOUT_FILENO, output + written, output_length - written);
+        if(result == -1){
+            if(errno == EINTR){
+                continue;
+            }
+            break;
+        }
+        written += result;
+    }
+    output_length = 0;
+}
+
+/**
+ * How many columns some UTF-8 text takes: every byte but the continuation ones
+ */
+static size_t display_width(const char* text, size_t length){
+    size_t width = 0;
+    size_t i;
+
+    for(i = 0; i < length; i++){
+        if(((unsigned char)text[i] & 0xc0) != 0x80){
+            width++;
+        }
+    }
+    return width;
+}
+
+static size_t terminal_columns(){
+    struct winsize size;
+
+    if(columns == 0){
+        columns = (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == -1 || size.ws_col == 0) ? EDITOR_DEFAULT_COLUMNS : size.ws_col;
+    }
+    return columns;
+}
+
+/**
+ * Handles SIGWINCH from the event loop, see main(): the line is drawn again for the new
+ *  width
+ */
+int editor_resized(int signum){
+    (void) signum;
+    columns = 0;
+    return EVENT_WAKE;
+}
+
+/**
+ * The row the terminal leaves the cursor on after writing some columns: a row that is
+ *  exactly full keeps it on its last column until something else is written
+ */
+static size_t last_row(size_t width, size_t columns){
+    return (width > 0 && width % columns == 0) ? width / columns - 1 : width / columns;
+}
+
+/**
+ * Draws the prompt and the line again, over what was there, and puts the cursor back.
+ *  A line longer than the terminal wraps onto the next rows.
+ */
+static void refresh(){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    size_t prompt_width = display_width(line.prompt, strlen(line.prompt));
+    size_t total = prompt_width + display_width(line.buffer, line.length);
+    size_t position = prompt_width + display_width(line.buffer, line.cursor);
+    size_t columns = terminal_columns();
+    size_t end_row = last_row(total, columns);
+    size_t cursor_row = position / columns;
+
+    if(line.cursor_row > 0){
+        out_printf("\x1b[%zuA", line.cursor_row);
+    }
+    out_append("\r", 1);
+    out_append(line.prompt, strlen(line.prompt));
+    out_append(line.buffer, line.length);
+    out_append("\x1b[0J", 4);
+
+    /********************************************************************
+    With the cursor at the end of an exactly full row, start the next
+        row for it to be on
+    ********************************************************************/
+    if(position == total && total > 0 && total % columns == 0){
+        out_append("\r\n", 2);
+        end_row++;
+    }
+    if(end_row > cursor_row){
+        out_printf("\x1b[%zuA", end_row - cursor_row);
+    }
+    out_append("\r", 1);
+    if(position % columns > 0){
+        out_printf("\x1b[%zuC", position % columns);
+    }
+    line.cursor_row = cursor_row;
+    out_flush();
+}
+
+/**
+ * Moves the cursor to the start of the row under the line, to write something there
+ */
+static void move_below(){
+    size_t prompt_width = display_width(line.prompt, strlen(line.prompt));
+    size_t end_row = last_row(prompt_width + display_width(line.buffer, line.length), terminal_columns());
+
+    if(end_row > line.cursor_row){
+        out_printf("\x1b[%zuB", end_row - line.cursor_row);
+    }
+    out_append("\r\n", 2);
+    line.cursor_row = 0;
+}
+
+/**
+ * Removes the prompt and the line from the screen, leaving the cursor where the prompt
+ *  started, so something can be written there before they are drawn again
+ */
+static void erase(){
+    if(line.cursor_row > 0){
+        out_printf("\x1b[%zuA", line.cursor_row);
+    }
+    out_append("\r\x1b[0J", 5);
+    line.cursor_row = 0;
+    out_flush();
+}
+
+/**
+ * Replaces the whole line, with the cursor at its end
+ */
+static void line_set(const char* text, size_t length){
+    reserve(&line.buffer, &line.capacity, length + 2);
+    memcpy(line.buffer, text, length);
+    line.length = length;
+    line.cursor = length;
+}
+
+static void line_insert(const char* text, size_t length){
+    reserve(&line.buffer, &line.capacity, line.length + length + 2);
+    memmove(line.buffer + line.cursor + length, line.buffer + line.cursor, line.length - line.cursor);
+    memcpy(line.buffer + line.cursor, text, length);
+    line.length += length;
+    line.cursor += length;
+}
+
+/**
+ * Removes the bytes from start to end, leaving the cursor at start
+ */
+static void line_delete(size_t start, size_t end){
+    memmove(line.buffer + start, line.buffer + end, line.length - end);
+    line.length -= end - start;
+    line.cursor = start;
+}
+
+/**
+ * Where the character before or after an offset starts, stepping over a whole UTF-8
+ *  sequence
+ */
+static size_t previous_char(size_t offset){
+    do{
+        offset--;
+    }while(offset > 0 && ((unsigned char)line.buffer[offset] & 0xc0) == 0x80);
+    return offset;
+}
+
+static size_t next_char(size_t offset){
+    do{
+        offset++;
+    }while(offset < line.length && ((unsigned char)line.buffer[offset] & 0xc0) == 0x80);
+    return offset;
+}
+
+/**
+ * Reads one byte of input, -1 at end of input. Bytes are read one at a time, so what is
+ *  typed ahead stays in the terminal for the commands that read it. The wait happens in
+ *  the event loop.
+ * @param timeout Nanoseconds to wait at most, 0 for no limit
+ * @return The byte, -1 at end of input, KEY_TIMEOUT, or without a limit KEY_WAKE or
+ *  KEY_INTERRUPT if the loop said so before a byte came
+ */
+static int read_byte(unsigned long long timeout){
+    unsigned char byte;
+    ssize_t result;
+
+    do{
+        switch(events_wait(STDIN_FILENO, timeout)){
+            case EVENT_WAKE:
+                return KEY_WAKE;
+            case EVENT_INTERRUPT:
+                return KEY_INTERRUPT;
+            case EVENT_TIMEOUT:
+                return KEY_TIMEOUT;
+        }
+        result = read(STDIN_FILENO, &byte, 1);
+    }while(result == -1 && (errno == EINTR || errno == EAGAIN));
+    return (result == 1) ? byte : -1;
+}
+
+/**
+ * Reads a key, turning the escape sequences of the arrows, Home, End and Delete into
+ *  KEY_ codes. The rest of a sequence has to follow within EDITOR_ESCAPE_TIMEOUT, so a
+ *  lone escape does not swallow the next key.
+ */
+static int read_key(){
+    int byte = read_byte(0);
+    int number = 0;
+
+    if(byte != '\x1b'){
+        return byte;
+    }
+    byte = read_byte(EDITOR_ESCAPE_TIMEOUT);
+    if(byte == 'O'){
+        byte = read_byte(EDITOR_ESCAPE_TIMEOUT);
+        return (byte == 'H') ? KEY_HOME : (byte == 'F') ? KEY_END : KEY_UNKNOWN;
+    }
+    if(byte != '['){
+        return (byte == -1) ? -1 : KEY_UNKNOWN;
+    }
+
+    byte = read_byte(EDITOR_ESCAPE_TIMEOUT);
+    while(byte >= '0' && byte <= '9'){
+        number = number * 10 + byte - '0';
+        byte = read_byte(EDITOR_ESCAPE_TIMEOUT);
+    }
+    while(byte == ';' || (byte >= '0' && byte <= '9')){
+        byte = read_byte(EDITOR_ESCAPE_TIMEOUT); //Modifiers, as in ESC [ 1 ; 5 C
+    }
+    switch(byte){
+        case 'A': return KEY_UP;
+        case 'B': return KEY_DOWN;
+        case 'C': return KEY_RIGHT;
+        case 'D': return KEY_LEFT;
+        case 'H': return KEY_HOME;
+        case 'F': return KEY_END;
+        case '~':
+            if(number == 1 || number == 7){
+                return KEY_HOME;
+            }
+            if(number == 4 || number == 8){
+                return KEY_END;
+            }
+            return (number == 3) ? KEY_DELETE : KEY_UNKNOWN;
+        default:
+            return (byte == -1) ? -1 : KEY_UNKNOWN;
+    }
+}
+
+/**
+ * Shows another entry of the history, keeping what was being typed aside
+ * @param position The entry, history_count() to go back to what was being typed
+ */
+static void history_show(long position){
+    long count = history_count();
+    char* entry;
+    size_t length;
+
+    if(position < 0 || position > count){
+        out_append("\a", 1);
+        return;
+    }
+    if(line.history_position >= count){
+        reserve(&line.saved, &line.saved_capacity, line.length + 1);
+        memcpy(line.saved, line.buffer, line.length);
+        line.saved_length = line.length;
+    }
+
+    line.history_position = position;
+    if(position == count){
+        line_set(line.saved, line.saved_length);
+    }else{
+        entry = history_entry(position, &length);
+        line_set(entry, length);
+    }
+}
+
+/**
+ * Checks if a character has to be escaped to be part of a word
+ */
+static int is_special(char c){
+    return strchr(" \t\n\\'\"|&;<>()$`*?[]#{}!", c) != NULL;
+}
+
+/**
+ * Completes the word before the cursor. The part all the matches share is inserted;
+ *  when that is nothing and tab was pressed twice, the matches are listed under the line.
+ */
+static void complete(int listing){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct completions* matches;
+    char* word;
+    size_t start = line.cursor;
+    size_t before;
+    size_t length = 0;
+    size_t width = 0;
+    size_t per_row;
+    size_t i;
+    size_t j;
+    char* name;
+    int quoted = 0;
+    int command;
+    int answer;
+
+    /********************************************************************
+    Find where the word starts: after a separator that is not escaped
+    ********************************************************************/
+    while(start > 0 && !(strchr(" \t|&;<>()", line.buffer[start - 1]) != NULL
+                         && !(start > 1 && line.buffer[start - 2] == '\\'))){
+        start--;
+    }
+    for(before = start; before > 0 && (line.buffer[before - 1] == ' ' || line.buffer[before - 1] == '\t'); before--);
+    command = (before == 0 || strchr("|&;(", line.buffer[before - 1]) != NULL);
+
+    /********************************************************************
+    Take its quotes and escapes out
+    ********************************************************************/
+    word = malloc(line.cursor - start + 1);
+    if(word == NULL){
+        fprintf(stderr, "Error in complete() : Could not allocate space for word\n");
+        exit(EXIT_FAILURE);
+    }
+    for(i = start; i < line.cursor; i++){
+        if(line.buffer[i] == '\\' && i + 1 < line.cursor){
+            word[length++] = line.buffer[++i];
+        }else if(line.buffer[i] == '\'' || line.buffer[i] == '"'){
+            quoted = !quoted;
+        }else{
+            word[length++] = line.buffer[i];
+        }
+    }
+    word[length] = '\0';
+
+    matches = complete_word(word, command);
+    free(word);
+    if(matches->count == 0){
+        out_append("\a", 1);
+        return;
+    }
+
+    /********************************************************************
+    Insert what the matches share, escaped unless inside quotes, and a
+        space after a single match that is not a directory
+    ********************************************************************/
+    if(matches->common > length){
+        for(i = length; i < matches->common; i++){
+            if(!quoted && is_special(matches->words[0][i])){
+                line_insert("\\", 1);
+            }
+            line_insert(&matches->words[0][i], 1);
+        }
+        if(matches->count == 1 && matches->words[0][matches->common - 1] != '/'){
+            line_insert(quoted ? "\" " : " ", quoted ? 2 : 1);
+        }
+        return;
+    }
+    if(matches->count == 1){
+        return;
+    }
+    if(!listing){
+        out_append("\a", 1);
+        return;
+    }
+
+    /********************************************************************
+    List them, by their last component, in as many columns as fit
+    ********************************************************************/
+    move_below();
+    if(matches->count > EDITOR_LIST_ASK){
+        out_printf("Display all %zu possibilities? (y or n)", matches->count);
+        out_flush();
+        answer = read_key();
+        out_append("\r\n", 2);
+        if(answer != 'y' && answer != 'Y'){
+            return;
+        }
+    }
+
+    for(i = 0; i < matches->count; i++){
+        name = matches->words[i];
+        for(j = strlen(name); j > 1 && name[j - 2] != '/'; j--);
+        j = (j > 1) ? j - 1 : 0;
+        if(display_width(name + j, strlen(name + j)) > width){
+            width = display_width(name + j, strlen(name + j));
+        }
+    }
+    width += 2;
+    per_row = terminal_columns() / width;
+    if(per_row == 0){
+        per_row = 1;
+    }
+    for(i = 0; i < matches->count; i++){
+        name = matches->words[i];
+        for(j = strlen(name); j > 1 && name[j - 2] != '/'; j--);
+        j = (j > 1) ? j - 1 : 0;
+        out_append(name + j, strlen(name + j));
+        if(i % per_row == per_row - 1 || i == matches->count - 1){
+            out_append("\r\n", 2);
+        }else{
+            out_printf("%*s", (int)(width - display_width(name + j, strlen(name + j))), "");
+        }
+    }
+}
+
+/**
+ * Searches the history as the text is typed (ctrl-r). Each character narrows the search
+ *  to older entries that contain what was typed, ctrl-r goes to the next older match,
+ *  and ctrl-g puts the line back as it was.
+ * @return The key that ended the search, for the editor to handle; the line is the
+ *  match that was shown
+ */
+static int reverse_search(){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    char query[EDITOR_SEARCH_LENGTH];
+    char* search_prompt;
+    char* original = malloc(line.length + 1);
+    size_t original_length = line.length;
+    char* entry;
+    char* found;
+    size_t length;
+    size_t query_length = 0;
+    long match = history_count();
+    long result;
+    int key;
+
+    search_prompt = malloc(EDITOR_SEARCH_LENGTH + 32);
+    if(original == NULL || search_prompt == NULL){
+        fprintf(stderr, "Error in reverse_search() : Could not allocate space for search\n");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(original, line.buffer, line.length);
+    query[0] = '\0';
+
+    while(1){
+        sprintf(search_prompt, "(reverse-i-search)`%s': ", query);
+        line.prompt = search_prompt;
+        refresh();
+
+        key = read_key();
+        if(key == CTRL('r') || (key >= ' ' && key < 127 && query_length + 1 < EDITOR_SEARCH_LENGTH)
+           || key == 127 || key == CTRL('h')){
+            /********************************************************************
+            A new character keeps the match if it still matches, ctrl-r
+                looks further back, and a deleted character starts over
+            ********************************************************************/
+            if(key == 127 || key == CTRL('h')){
+                if(query_length > 0){
+                    query[--query_length] = '\0';
+                }
+                match = history_count();
+                result = (query_length > 0) ? history_search(query, match) : -1;
+            }else if(key == CTRL('r')){
+                result = (query_length > 0) ? history_search(query, match) : -1;
+            }else{
+                query[query_length++] = key;
+                query[query_length] = '\0';
+                result = history_search(query, match + 1);
+            }
+
+            if(result == -1){
+                out_append("\a", 1);
+                continue;
+            }
+            match = result;
+            entry = history_entry(match, &length);
+            line_set(entry, length);
+            found = memmem(entry, length, query, query_length);
+            line.cursor = found - entry;
+            continue;
+        }
+
+        if(key == CTRL('g') || key == CTRL('c')){
+            line_set(original, original_length);
+            key = KEY_UNKNOWN;
+        }
+        break;
+    }
+
+    free(original);
+    free(search_prompt);
+    return key;
+}
+
+/**
+ * Reads a line from the terminal, with the terminal in raw mode so it can be edited
+ *  while it is typed:
+ *      arrows, ctrl-b/f, home/end, ctrl-a/e    move around
+ *      backspace, delete, ctrl-d               delete a character (ctrl-d on an empty line is end of input)
+ *      ctrl-k, ctrl-u, ctrl-w                  delete to the end, to the start, the word before the cursor
+ *      up/down, ctrl-p/n                       go through the history
+ *      ctrl-r                                  search the history
+ *      tab                                     complete a command name or a path (twice lists the matches)
+ *      ctrl-c                                  drop the line, ctrl-l clears the screen
+ * Meanwhile the shell waits in the event loop. When something has to be shown (a job
+ *  that finished, a prompt that changed, a resized terminal), the line is erased, wake
+ *  runs, and the line is drawn again under what it wrote; SIGINT drops the line.
+ * @param prompt What to show before the line
+ * @param wake Writes what has to be shown and gives back the prompt to use from then on,
+ *  NULL to only draw the line again
+ * @return The line, ending with a newline, only valid until the next call; an empty
+ *  string if it was dropped with ctrl-c; NULL at end of input
+ */
+char* editor_read_line(char* prompt, char* (*wake)(char* prompt)){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct termios raw;
+    int key;
+    int last_key = 0;
+    char byte;
+    size_t start;
+
+    fflush(stdout);
+    if(tcgetattr(STDIN_FILENO, &saved_modes) == -1){
+        return NULL;
+    }
+    raw = saved_modes;
+    raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+    raw.c_cflag |= CS8;
+    raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
+
+    reserve(&line.buffer, &line.capacity, EDITOR_INITIAL_LINE);
+    line.length = 0;
+    line.cursor = 0;
+    line.cursor_row = 0;
+    line.prompt = prompt;
+    line.history_position = history_count();
+
+    while(1){
+        line.prompt = prompt;
+        refresh();
+        key = read_key();
+        if(key == CTRL('r')){
+            key = reverse_search();
+            line.prompt = prompt;
+        }
+
+        if(key == -1 || (key == CTRL('d') && line.length == 0)){
+            tcsetattr(STDIN_FILENO, TCSAFLUSH, &saved_modes);
+            return NULL;
+        }
+
+        switch(key){
+            case '\r':
+            case '\n':
+                line.cursor = line.length;
+                refresh();
+                move_below();
+                out_flush();
+                tcsetattr(STDIN_FILENO, TCSAFLUSH, &saved_modes);
+                line.buffer[line.length] = '\n';
+                line.buffer[line.length + 1] = '\0';
+                return line.buffer;
+            case '\t':
+                complete(last_key == '\t');
+                break;
+            case KEY_WAKE:
+                erase();
+                if(wake != NULL){
+                    prompt = wake(prompt);
+                    fflush(stdout);
+                }
+                break;
+            case CTRL('c'):
+            case KEY_INTERRUPT:
+                line.cursor = line.length;
+                refresh();
+                out_append("^C", 2);
+                move_below();
+                out_flush();
+                tcsetattr(STDIN_FILENO, TCSAFLUSH, &saved_modes);
+                line.buffer[0] = '\0';
+                return line.buffer;
+            case 127:
+            case CTRL('h'):
+                if(line.cursor > 0){
+                    line_delete(previous_char(line.cursor), line.cursor);
+                }
+                break;
+            case CTRL('d'):
+            case KEY_DELETE:
+                if(line.cursor < line.length){
+                    line_delete(line.cursor, next_char(line.cursor));
+                }
+                break;
+            case CTRL('b'):
+            case KEY_LEFT:
+                if(line.cursor > 0){
+                    line.cursor = previous_char(line.cursor);
+                }
+                break;
+            case CTRL('f'):
+            case KEY_RIGHT:
+                if(line.cursor < line.length){
+                    line.cursor = next_char(line.cursor);
+                }
+                break;
+            case CTRL('a'):
+            case KEY_HOME:
+                line.cursor = 0;
+                break;
+            case CTRL('e'):
+            case KEY_END:
+                line.cursor = line.length;
+                break;
+            case CTRL('k'):
+                line.length = line.cursor;
+                break;
+            case CTRL('u'):
+                line_delete(0, line.cursor);
+                break;
+            case CTRL('w'):
+                for(start = line.cursor; start > 0 && line.buffer[start - 1] == ' '; start--);
+                for(; start > 0 && line.buffer[start - 1] != ' '; start--);
+                line_delete(start, line.cursor);
+                break;
+            case CTRL('p'):
+            case KEY_UP:
+                history_show(line.history_position - 1);
+                break;
+            case CTRL('n'):
+            case KEY_DOWN:
+                history_show(line.history_position + 1);
+                break;
+            case CTRL('l'):
+                out_append("\x1b[H\x1b[2J", 7);
+                line.cursor_row = 0;
+                break;
+            default:
+                if(key >= ' ' && key < 256 && key != 127){
+                    byte = key;
+                    line_insert(&byte, 1); //Bytes of UTF-8 characters come one at a time
+                }
+                break;
+        }
+        last_key = key;
+    }
+}
@@ -0,0 +1,309 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh_events.c
+ * * * * * * * * * * * * * * * * * * *
+ * While the shell waits for input it
+ *  sleeps in one epoll_wait(), on the
+ *  terminal, a signalfd for the signals
+ *  it handles, timerfds and whatever
+ *  descriptors were given to it (the git
+ *  status of the prompt, the inotify of
+ *  completion). Children that exit, a
+ *  resized terminal, a timer or an answer
+ *  from git are handled as they happen,
+ *  in the shell's own context.
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+
+#include "../include/bcsh_constants.h"
+#include "../include/bcsh_events.h"
+
+struct watch {
+    int fd;
+    int (*ready)(int fd); //Called when fd can be read, gives back one of the EVENT_* values
+};
+
+static int epoll_fd = -1;
+
+/**
+ * The descriptors watched on behalf of other modules
+ */
+static struct watch watches[EVENTS_MAX_WATCHES];
+static int num_watches = 0;
+
+/**
+ * The signals handled through the loop, and what handles each. They are only blocked,
+ *  and so only go to the signalfd, while the shell waits in the loop; the rest of the
+ *  time their sigaction() handlers, if any, run as usual.
+ */
+static int signal_fd = -1;
+static sigset_t signals;
+static int (*signal_handlers[NSIG])(int signum);
+
+/**
+ * The deadline of events_wait(), armed only while it waits with a timeout
+ */
+static int timer_fd = -1;
+
+/**
+ * The input events_wait() was last asked about, which stays in the set
+ */
+static int input_fd = -1;
+
+/**
+ * What the callbacks said while the loop only waited for input with a timeout (the rest
+ *  of an escape sequence), given back by the next wait without one
+ */
+static int deferred = EVENT_QUIET;
+
+/**
+ * Adds a descriptor to the epoll set, to be told when it can be read
+ */
+static void add_fd(int fd){
+    struct epoll_event event;
+
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1){
+        perror("Error in add_fd() : epoll_ctl failed ");
+    }
+}
+
+/**
+ * Makes the epoll set and its timer the first time the loop is used
+ */
+static void events_init(){
+    if(epoll_fd != -1){
+        return;
+    }
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if(epoll_fd == -1){
+        perror("Error in events_init() : Could not create epoll set ");
+        exit(EXIT_FAILURE);
+    }
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if(timer_fd != -1){
+        add_fd(timer_fd);
+    }
+    sigemptyset(&signals);
+}
+
+/**
+ * Watches a descriptor while the shell waits for input
+ * @param ready Called when fd can be read; it has to read what is there, or stop
+ *  watching fd
+ * @return 0 on success, -1 if too many descriptors are watched already
+ */
+int events_watch(int fd, int (*ready)(int fd)){
+    events_init();
+    if(num_watches == EVENTS_MAX_WATCHES){
+        return -1;
+    }
+    add_fd(fd);
+    watches[num_watches].fd = fd;
+    watches[num_watches].ready = ready;
+    num_watches++;
+    return 0;
+}
+
+/**
+ * Stops watching a descriptor, which has to be done before closing it
+ */
+void events_unwatch(int fd){
+    int i;
+
+    for(i = 0; i < num_watches; i++){
+        if(watches[i].fd == fd){
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+            watches[i] = watches[--num_watches];
+            return;
+        }
+    }
+}
+
+/**
+ * Makes a timer. With ready, the loop watches it while the shell waits for input, and
+ *  calls ready once its time is up, which has to read it; without, the caller polls it
+ *  itself, as job_supervise() does while a job runs under a time limit.
+ * @return The timerfd, non-blocking, -1 if none could be made
+ */
+int events_timer(int (*ready)(int fd)){
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+
+    if(fd != -1 && ready != NULL && events_watch(fd, ready) == -1){
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Arms a timer of events_timer(), dropping any expiration it had not read yet
+ * @param deadline CLOCK_MONOTONIC nanoseconds when its time is up, 0 to disarm it
+ */
+void events_arm(int fd, unsigned long long deadline){
+    struct itimerspec value;
+
+    memset(&value, 0, sizeof(value));
+    value.it_value.tv_sec = deadline / 1000000000ULL;
+    value.it_value.tv_nsec = deadline % 1000000000ULL;
+    timerfd_settime(fd, TFD_TIMER_ABSTIME, &value, NULL);
+}
+
+/**
+ * Handles a signal through the loop from now on, while the shell waits for input
+ * @param handler Called with the signal, in the shell's context rather than in a signal
+ *  handler, so it can do anything; gives back one of the EVENT_* values
+ */
+void events_on_signal(int signum, int (*handler)(int signum)){
+    int fd;
+
+    events_init();
+    signal_handlers[signum] = handler;
+    sigaddset(&signals, signum);
+    fd = signalfd(signal_fd, &signals, SFD_CLOEXEC | SFD_NONBLOCK);
+    if(fd == -1){
+        perror("Error in events_on_signal() : Could not create signalfd ");
+        return;
+    }
+    if(signal_fd == -1){
+        signal_fd = fd;
+        add_fd(signal_fd);
+    }
+}
+
+/**
+ * Reads every signal waiting in the signalfd and hands each to its handler
+ * @return The strongest of what the handlers said
+ */
+static int read_signals(){
+    struct signalfd_siginfo info[EVENTS_BATCH];
+    ssize_t bytes_read;
+    size_t i;
+    int result = EVENT_QUIET;
+    int handled;
+
+    while((bytes_read = read(signal_fd, info, sizeof(info))) > 0){
+        for(i = 0; i < bytes_read / sizeof(struct signalfd_siginfo); i++){
+            if(info[i].ssi_signo < NSIG && signal_handlers[info[i].ssi_signo] != NULL){
+                handled = signal_handlers[info[i].ssi_signo](info[i].ssi_signo);
+                if(handled > result){
+                    result = handled;
+                }
+            }
+        }
+    }
+    return result;
+}
+
+/**
+ * Sleeps until fd can be read, handling everything else that happens meanwhile. The
+ *  descriptor is not made non-blocking, as it is shared with the commands the shell
+ *  runs; reads of it only follow EVENT_READY.
+ * @param fd The input, usually the terminal
+ * @param timeout Nanoseconds to wait at most, 0 for no limit. With a limit, only the
+ *  input or the end of the time ends the wait: what the callbacks say is kept for the
+ *  next wait without one.
+ * @return EVENT_READY when fd can be read (also if waiting failed, so the read reports
+ *  it), EVENT_TIMEOUT, or what a callback said: EVENT_WAKE or EVENT_INTERRUPT
+ */
+int events_wait(int fd, unsigned long long timeout){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct epoll_event events[EVENTS_BATCH];
+    struct itimerspec deadline;
+    sigset_t old_mask;
+    uint64_t expirations;
+    int result = EVENT_QUIET;
+    int ready = 0;
+    int expired = 0;
+    int handled;
+    int count;
+    int i;
+    int j;
+
+    events_init();
+    if(fd != input_fd){
+        if(input_fd != -1){
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, input_fd, NULL);
+        }
+        add_fd(fd);
+        input_fd = fd;
+    }
+    if(timeout == 0 && deferred != EVENT_QUIET){
+        result = deferred;
+        deferred = EVENT_QUIET;
+        return result;
+    }
+    if(timeout != 0){
+        memset(&deadline, 0, sizeof(deadline));
+        deadline.it_value.tv_sec = timeout / 1000000000ULL;
+        deadline.it_value.tv_nsec = timeout % 1000000000ULL;
+        timerfd_settime(timer_fd, 0, &deadline, NULL);
+    }
+
+    sigprocmask(SIG_BLOCK, &signals, &old_mask);
+    while(!ready && !expired && (timeout != 0 || result == EVENT_QUIET)){
+        count = epoll_wait(epoll_fd, events, EVENTS_BATCH, -1);
+        if(count == -1){
+            if(errno == EINTR){
+                continue;
+            }
+            ready = 1;
+            break;
+        }
+
+        for(i = 0; i < count; i++){
+            handled = EVENT_QUIET;
+            if(events[i].data.fd == input_fd){
+                ready = 1;
+            }else if(events[i].data.fd == timer_fd){
+                if(read(timer_fd, &expirations, sizeof(expirations)) > 0){
+                    expired = (timeout != 0);
+                }
+            }else if(events[i].data.fd == signal_fd){
+                handled = read_signals();
+            }else{
+                for(j = 0; j < num_watches && watches[j].fd != events[i].data.fd; j++);
+                if(j < num_watches){
+                    handled = watches[j].ready(watches[j].fd);
+                }
+            }
+            if(handled > result){
+                result = handled;
+            }
+        }
+    }
+    sigprocmask(SIG_SETMASK, &old_mask, NULL);
+
+    /********************************************************************
+    The input is told about once what the callbacks said was shown; it
+        is still there for the next wait
+    ********************************************************************/
+    if(timeout != 0){
+        if(!expired){
+            memset(&deadline, 0, sizeof(deadline));
+            timerfd_settime(timer_fd, 0, &deadline, NULL);
+        }
+        if(result > deferred){
+            deferred = result;
+        }
+        return ready ? EVENT_READY : EVENT_TIMEOUT;
+    }
+    return (result != EVENT_QUIET) ? result : EVENT_READY;
+}
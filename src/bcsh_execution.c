@@ -1,12 +1,12 @@
-
 /**
  * * * * * * * * * * * * * * * * * * *
  * Brennan Couturier
  * * * * * * * * * * * * * * * * * * *
  * bcsh_execution.c
  * * * * * * * * * * * * * * * * * * *
- * All the functions I will use for I/O
- *  are declared here
+ * Launches and runs commands: internal
+ *  commands, pipelines, compound
+ *  commands and functions
  * * * * * * * * * * * * * * * * * * *
  */
 
@@ -14,191 +14,1877 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
 #include <unistd.h>
 #include <sys/wait.h>
 #include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "../include/bcsh_constants.h"
 #include "../include/bcsh_internals.h"
+#include "../include/bcsh_builtins.h"
+#include "../include/bcsh_builtin_table.h"
+#include "../include/bcsh_hash.h"
+#include "../include/bcsh_parser.h"
+#include "../include/bcsh_jobs.h"
+#include "../include/bcsh_time.h"
+#include "../include/bcsh_timeout.h"
+#include "../include/bcsh_arena.h"
+#include "../include/bcsh_glob.h"
+#include "../include/bcsh_vars.h"
+#include "../include/bcsh_functions.h"
+#include "../include/bcsh_trace.h"
+#include "../include/bcsh_zygote.h"
+#include "../include/bcsh_execution.h"
 
 /**
- * This function takes a list of tokens and executes the commands they represent. It
- *  first checks if the first command is an internal one (cd or exit), before dealing
- *  with it accordingly.
- *  This function is used if there are no pipes in the input
- * @param tokens An array of string tokens representing commands and arguments
- * @return 0 if the shell can continue, 1 if we have to stop (got exit command, or something)
+ * The backend used to launch external commands: SPAWN_BACKEND_FORK,
+ *  SPAWN_BACKEND_POSIX_SPAWN or SPAWN_BACKEND_ZYGOTE. The default is picked at build time and can be changed at
+ *  runtime through $BCSH_SPAWN (see select_spawn_backend()).
+ */
+int spawn_backend = DEFAULT_SPAWN_BACKEND;
+
+/**
+ * The exit status of the last command that ran
+ */
+int last_status = 0;
+
+/**
+ * Set by the exit command once the shell has to stop
+ */
+int exit_requested = 0;
+
+/**
+ * The capacity given to the pipes of a pipeline, set with set -o pipesize; 0 leaves the
+ *  kernel's default (64 KiB). A pipe written |[size] gets its own.
+ */
+long default_pipe_size = 0;
+
+/**
+ * A break, continue or return that was run and not yet handled by the loop or function
+ *  it leaves: lists stop at it. jump_levels is the number of loops a break or continue
+ *  leaves. loop_depth counts the loops the command being run is in (within the current
+ *  function call), and function_depth the function calls.
+ */
+int pending_jump = JUMP_NONE;
+int jump_levels = 0;
+int loop_depth = 0;
+int function_depth = 0;
+
+/**
+ * Set in a copy of the shell forked to run an internal command in a pipeline
+ */
+static int in_forked_copy = 0;
+
+/**
+ * The report of the pipeline being run under time, NULL if it is not timed
+ */
+static struct time_report* time_report = NULL;
+
+/**
+ * The text of the pipeline being run, which the job of a single command is described
+ *  with if it stops
+ */
+static char* pipeline_text = NULL;
+static size_t pipeline_text_length = 0;
+
+/**
+ * The limit of the pipeline being run under timeout, NULL if it has none. It goes to
+ *  the first job the pipeline creates, and only to that one.
+ */
+static struct timeout_limit* timeout_limit = NULL;
+
+/**
+ * The memfd the output of internal commands run for a substitution goes to, created
+ *  the first time one runs, and whether a substitution ran while the words of the
+ *  current pipeline were expanded (its status is then the one of a line of assignments)
+ */
+static int capture_fd = -1;
+static int substitution_ran = 0;
+
+/**
+ * Selects the backend used to launch external commands by name
+ * @param name "fork", "posix_spawn" or "zygote"
+ * @return 0 if the backend was selected, -1 if the name is unknown
  */
-int execute_command(char** tokens){
+int select_spawn_backend(char* name){
+    if(strcmp(name, "fork") == 0){
+        spawn_backend = SPAWN_BACKEND_FORK;
+    }else if(strcmp(name, "posix_spawn") == 0 || strcmp(name, "spawn") == 0){
+        spawn_backend = SPAWN_BACKEND_POSIX_SPAWN;
+    }else if(strcmp(name, "zygote") == 0){
+        spawn_backend = SPAWN_BACKEND_ZYGOTE;
+    }else{
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Writes all of a buffer to a descriptor
+ * @return 0 on success, -1 on failure
+ */
+static int write_all(int fd, char* buffer, size_t length){
+    ssize_t written;
+
+    while(length > 0){
+        written = write(fd, buffer, length);
+        if(written == -1){
+            if(errno == EINTR){
+                continue;
+            }
+            return -1;
+        }
+        buffer += written;
+        length -= written;
+    }
+    return 0;
+}
+
+/**
+ * Makes a descriptor the body of a here-document or here-string can be read from,
+ *  without a temporary file or a process to write it. A small body is written into a
+ *  pipe, which holds it whole; a bigger one goes into a memfd, which lives in memory and
+ *  is read from the start like a file.
+ * @return The descriptor (close-on-exec), -1 on failure
+ */
+static int open_body(struct redirection* redirection){
 
     /********************************************************************
     Declare variables
     ********************************************************************/
-    char* command = tokens[0];
+    int fds[2];
+    int fd;
+
+    if(redirection->length <= HEREDOC_PIPE_SIZE){
+        if(pipe2(fds, O_CLOEXEC) == -1){
+            return -1;
+        }
+        if(write_all(fds[1], redirection->body, redirection->length) == -1){
+            close(fds[0]);
+            close(fds[1]);
+            return -1;
+        }
+        close(fds[1]);
+        return fds[0];
+    }
+
+    fd = memfd_create("bcsh-heredoc", MFD_CLOEXEC);
+    if(fd == -1){
+        return -1;
+    }
+    if(write_all(fd, redirection->body, redirection->length) == -1 || lseek(fd, 0, SEEK_SET) == -1){
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Closes the descriptors the shell opened for the redirections of a command
+ */
+static void close_redirections(struct redirect_action* actions, int num_actions){
     int i;
-    pid_t pid;
-    int status;
-    int return_code;
+
+    for(i = 0; i < num_actions; i++){
+        if(actions[i].opened){
+            close(actions[i].source);
+        }
+    }
+}
+
+/**
+ * Checks if one of the first num_actions redirections of a command sets up fd
+ */
+static int redirected_before(struct redirect_action* actions, int num_actions, int fd){
+    int i;
+
+    for(i = 0; i < num_actions; i++){
+        if(actions[i].fd == fd && actions[i].source != -1){
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Opens the files and here-documents of the redirections of a command, in the shell,
+ *  so that a missing file is reported before anything runs and the child only has to
+ *  dup2() them into place. Everything is opened close-on-exec, and above any descriptor
+ *  the command redirects, so that applying one redirection never clobbers the source of
+ *  another.
+ * @param actions Set to the redirections, ready to be applied, allocated from the line arena
+ * @return The number of actions, -1 (with an error printed) if a redirection failed
+ */
+static int open_redirections(struct command* command, struct redirect_action** actions){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct redirection* redirection;
+    struct redirect_action* action;
+    int num_actions = 0;
+    int max_fd = 2;
+    int fd;
+    int i;
+    char* end;
+
+    for(redirection = command->redirections; redirection != NULL; redirection = redirection->next){
+        num_actions++;
+        if(redirection->fd > max_fd){
+            max_fd = redirection->fd;
+        }
+    }
+    *actions = arena_alloc(&line_arena, num_actions * sizeof(struct redirect_action));
+
+    for(redirection = command->redirections, i = 0; redirection != NULL; redirection = redirection->next, i++){
+        action = &(*actions)[i];
+        action->fd = redirection->fd;
+        action->opened = 0;
+
+        switch(redirection->type){
+            case REDIR_IN:
+                fd = open(redirection->target, O_RDONLY | O_CLOEXEC);
+                break;
+            case REDIR_OUT:
+                fd = open(redirection->target, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+                break;
+            case REDIR_APPEND:
+                fd = open(redirection->target, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+                break;
+            case REDIR_DUP_IN:
+            case REDIR_DUP_OUT:
+                /********************************************************************
+                n>&m copies m as it is at this point: open in the shell, or
+                    set up by an earlier redirection of the command. n>&- closes n.
+                ********************************************************************/
+                if(strcmp(redirection->target, "-") == 0){
+                    action->source = -1;
+                    continue;
+                }
+                action->source = strtol(redirection->target, &end, 10);
+                if(*end != '\0' || end == redirection->target || action->source < 0
+                   || (fcntl(action->source, F_GETFD) == -1 && !redirected_before(*actions, i, action->source))){
+                    fprintf(stderr, "bcsh: %s: bad file descriptor\n", redirection->target);
+                    close_redirections(*actions, i);
+                    return -1;
+                }
+                continue;
+            default:
+                fd = open_body(redirection);
+                if(fd == -1){
+                    fprintf(stderr, "bcsh: cannot make here-document: %s\n", strerror(errno));
+                    close_redirections(*actions, i);
+                    return -1;
+                }
+                break;
+        }
+
+        if(fd == -1){
+            fprintf(stderr, "bcsh: %s: %s\n", redirection->target, strerror(errno));
+            close_redirections(*actions, i);
+            return -1;
+        }
+        if(fd <= max_fd){
+            action->source = fcntl(fd, F_DUPFD_CLOEXEC, max_fd + 1);
+            close(fd);
+            if(action->source == -1){
+                fprintf(stderr, "bcsh: %s: %s\n", redirection->target, strerror(errno));
+                close_redirections(*actions, i);
+                return -1;
+            }
+        }else{
+            action->source = fd;
+        }
+        action->opened = 1;
+    }
+
+    return num_actions;
+}
+
+/**
+ * Applies the redirections of a command to the calling process, in order
+ * @param saved If not NULL, set to a copy of each descriptor as it was before (-1 if it
+ *  was closed), for restore_redirections()
+ * @return 0 on success, -1 if a descriptor could not be copied
+ */
+static int apply_redirections(struct redirect_action* actions, int num_actions, int* saved){
+    int i;
+
+    for(i = 0; i < num_actions; i++){
+        if(saved != NULL){
+            saved[i] = fcntl(actions[i].fd, F_DUPFD_CLOEXEC, SAVED_FD_MIN);
+        }
+        if(actions[i].source == -1){
+            close(actions[i].fd);
+        }else if(actions[i].source != actions[i].fd && dup2(actions[i].source, actions[i].fd) == -1){
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Puts back the descriptors of the shell after an internal command ran with redirections
+ * @param num_actions The number of redirections that were applied
+ */
+static void restore_redirections(struct redirect_action* actions, int num_actions, int* saved){
+    int i;
+
+    fflush(stdout);
+    fflush(stderr);
+    for(i = num_actions - 1; i >= 0; i--){
+        if(saved[i] == -1){
+            close(actions[i].fd);
+        }else{
+            dup2(saved[i], actions[i].fd);
+            close(saved[i]);
+        }
+    }
+}
+
+/**
+ * Sets up a child the shell forked, following setup: its process group, the terminal,
+ *  its signals and its standard descriptors
+ */
+static void setup_forked_child(struct child_setup* setup){
+    int i;
+
+    zygote_detach();
+    if(setup->pgid != -1){
+        setpgid(0, setup->pgid);
+        if(setup->foreground){
+            tcsetpgrp(terminal_fd, getpgrp());
+        }
+    }
+    reset_child_signals();
+
+    if(setup->in_fd != -1){
+        dup2(setup->in_fd, 0);
+    }
+    if(setup->out_fd != -1){
+        dup2(setup->out_fd, 1);
+    }
+    if(setup->err_fd != -1){
+        dup2(setup->err_fd, 2);
+    }
+    for(i = 0; setup->close_fds[i] != -1; i++){
+        close(setup->close_fds[i]);
+    }
+    if(apply_redirections(setup->redirects, setup->num_redirects, NULL) == -1){
+        perror("bcsh: redirection failed ");
+        _exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * Launches path with fork() and execve(). The child reports a failed execve() back
+ *  through a close-on-exec pipe, so the parent knows whether the command really started.
+ * @param pid Set to the pid of the child
+ * @return 0 if the command was started, the errno of execve() if it failed, -1 if fork failed
+ */
+static int fork_exec(char* path, char** argv, char** envp, struct child_setup* setup, pid_t* pid){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    int report[2];
+    int exec_errno;
+    ssize_t bytes_read;
+
+    if(pipe2(report, O_CLOEXEC) == -1){
+        return errno;
+    }
+
+    *pid = fork();
+    if(*pid == 0){
+        //We're in child
+        close(report[0]);
+        setup_forked_child(setup);
+
+        execve(path, argv, envp);
+
+        //Only reached if execve failed, tell the parent why
+        exec_errno = errno;
+        if(write(report[1], &exec_errno, sizeof(exec_errno)) == -1){
+            perror("Error in fork_exec() : execve failed ");
+        }
+        _exit(EXIT_NOT_FOUND);
+    }
+
+    //We're in parent
+    close(report[1]);
+    if(*pid == -1){
+        close(report[0]);
+        return -1;
+    }
+
+    /********************************************************************
+    Put the child in its process group from this side too, so that it is
+        there no matter which of the two runs first
+    ********************************************************************/
+    if(setup->pgid != -1){
+        setpgid(*pid, (setup->pgid == 0) ? *pid : setup->pgid);
+    }
 
     /********************************************************************
-    Check if user entered an empty line
+    The read returns nothing once execve() succeeded and closed the
+        pipe, or the child's errno if it failed
     ********************************************************************/
-    if(command == NULL){
+    do{
+        bytes_read = read(report[0], &exec_errno, sizeof(exec_errno));
+    }while(bytes_read == -1 && errno == EINTR);
+    close(report[0]);
+
+    if(bytes_read != sizeof(exec_errno)){
         return 0;
     }
 
+    waitpid(*pid, NULL, 0);
+    return exec_errno;
+}
+
+/**
+ * Launches path with posix_spawn(). glibc implements it with clone(CLONE_VM|CLONE_VFORK),
+ *  so the shell's page tables are never copied, and it reports a failed exec directly.
+ *  The pipe plumbing is done by file actions in the child, and the process group,
+ *  terminal and signal setup by spawn attributes.
+ * @param pid Set to the pid of the child
+ * @return 0 if the command was started, the errno of the failure otherwise
+ */
+static int posix_spawn_exec(char* path, char** argv, char** envp, struct child_setup* setup, pid_t* pid){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_t* actions_ref = NULL;
+    posix_spawnattr_t attributes;
+    sigset_t signals;
+    short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+    int err;
+    int i;
+
     /********************************************************************
-    Check if program is an internal command (cd or exit)
+    Describe the dup2() and close() calls the child has to make. The
+        dup2() actions of the pipes must come first, as they may copy a
+        descriptor that is closed afterwards. The redirections come last,
+        so that 2>&1 copies the pipe when there is one.
     ********************************************************************/
-    for(i = 0; i < NUM_INTERNAL_COMMANDS; i++){
-        if(strncmp(command, internal_command_names[i], strlen(internal_command_names[i])) == 0){
-            return internal_commands[i](tokens); //This runs the function using its pointer, passing tokens as an argument
+    if(setup->in_fd != -1 || setup->out_fd != -1 || setup->err_fd != -1 || setup->close_fds[0] != -1
+       || setup->num_redirects > 0){
+        posix_spawn_file_actions_init(&actions);
+        if(setup->in_fd != -1){
+            posix_spawn_file_actions_adddup2(&actions, setup->in_fd, 0);
+        }
+        if(setup->out_fd != -1){
+            posix_spawn_file_actions_adddup2(&actions, setup->out_fd, 1);
+        }
+        if(setup->err_fd != -1){
+            posix_spawn_file_actions_adddup2(&actions, setup->err_fd, 2);
+        }
+        for(i = 0; setup->close_fds[i] != -1; i++){
+            posix_spawn_file_actions_addclose(&actions, setup->close_fds[i]);
         }
+        for(i = 0; i < setup->num_redirects; i++){
+            if(setup->redirects[i].source == -1){
+                posix_spawn_file_actions_addclose(&actions, setup->redirects[i].fd);
+            }else if(setup->redirects[i].source != setup->redirects[i].fd){
+                posix_spawn_file_actions_adddup2(&actions, setup->redirects[i].source, setup->redirects[i].fd);
+            }
+        }
+        actions_ref = &actions;
     }
 
     /********************************************************************
-    Otherwise, run the external command
-        If there is an error, abort but allow the user to continue using
-        the shell. Basically, we're always going to return 0. The internal
-        command exit is the only one that returns 1 (stop the shell).
+    The child starts with no signals blocked and with the default action
+        for every signal the shell ignores or catches
     ********************************************************************/
-    pid = fork();
-    if(pid == 0){
-        //We're in child
-        return_code = execvp(command, tokens);
-        if(return_code == -1){
-            perror("Error in execute_command() : execvp failed ");
-            exit(EXIT_FAILURE); //End the child process
+    posix_spawnattr_init(&attributes);
+    sigemptyset(&signals);
+    posix_spawnattr_setsigmask(&attributes, &signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGQUIT);
+    sigaddset(&signals, SIGTSTP);
+    sigaddset(&signals, SIGTTIN);
+    sigaddset(&signals, SIGTTOU);
+    sigaddset(&signals, SIGCHLD);
+    posix_spawnattr_setsigdefault(&attributes, &signals);
+
+    if(setup->pgid != -1){
+        flags |= POSIX_SPAWN_SETPGROUP;
+        posix_spawnattr_setpgroup(&attributes, setup->pgid);
+#ifdef POSIX_SPAWN_TCSETPGROUP
+        if(setup->foreground){
+            flags |= POSIX_SPAWN_TCSETPGROUP;
+            posix_spawnattr_tcsetpgrp_np(&attributes, terminal_fd);
         }
-    }else{
-        //We're in parent
-        if(pid == -1){
-            //Fork failed
-            perror("Error in execute_command() : fork failed ");
-            return EXIT_SUCCESS;
+#endif
+    }
+    posix_spawnattr_setflags(&attributes, flags);
+
+    err = posix_spawn(pid, path, actions_ref, &attributes, argv, envp);
+
+    posix_spawnattr_destroy(&attributes);
+    if(actions_ref != NULL){
+        posix_spawn_file_actions_destroy(actions_ref);
+    }
+
+    return err;
+}
+
+/**
+ * Finds the descriptor of the shell a descriptor of the command being set up is a copy
+ *  of so far
+ */
+static int zygote_source(struct zygote_fd* fds, int num_fds, int fd){
+    int i;
+
+    for(i = 0; i < num_fds; i++){
+        if(fds[i].target == fd){
+            return fds[i].source;
         }
-        waitpid(pid, &status, 0);
     }
+    return fd;
+}
+
+/**
+ * Sets a descriptor of the command being set up, as dup2() or close() would
+ * @param source The descriptor it becomes a copy of, -1 to close it
+ * @return The number of descriptors of the command
+ */
+static int zygote_assign(struct zygote_fd* fds, int num_fds, int fd, int source){
+    int i;
+
+    source = (source == -1) ? -1 : zygote_source(fds, num_fds, source);
+    for(i = 0; i < num_fds && fds[i].target != fd; i++);
+    fds[i].target = fd;
+    fds[i].source = source;
+    return (i == num_fds) ? num_fds + 1 : num_fds;
+}
+
+/**
+ * Launches path through the spawn helper (see bcsh_zygote.c), which only gets the
+ *  descriptors the command ends up with: the shell's standard ones, replaced by the
+ *  pipes, then the redirections. A command with more than ZYGOTE_MAX_FDS of them, or a
+ *  shell that lost its helper, launches with posix_spawn() instead.
+ * @param pid Set to the pid of the child
+ * @return 0 if the command was started, the errno of the failure otherwise
+ */
+static int zygote_exec(char* path, char** argv, char** envp, struct child_setup* setup, pid_t* pid){
+    struct zygote_fd fds[ZYGOTE_MAX_FDS];
+    int num_fds = 0;
+    int err;
+    int fd;
+    int i;
+    int j;
+
+    if(setup->num_redirects + 3 <= ZYGOTE_MAX_FDS){
+        for(fd = 0; fd < 3; fd++){
+            num_fds = zygote_assign(fds, num_fds, fd, (fcntl(fd, F_GETFD) == -1) ? -1 : fd);
+        }
+        if(setup->in_fd != -1){
+            num_fds = zygote_assign(fds, num_fds, 0, setup->in_fd);
+        }
+        if(setup->out_fd != -1){
+            num_fds = zygote_assign(fds, num_fds, 1, setup->out_fd);
+        }
+        if(setup->err_fd != -1){
+            num_fds = zygote_assign(fds, num_fds, 2, setup->err_fd);
+        }
+        for(i = 0; setup->close_fds[i] != -1; i++){
+            for(j = 0; j < num_fds && fds[j].target != setup->close_fds[i]; j++);
+            if(j < num_fds){
+                fds[j].source = -1;
+            }
+        }
+        for(i = 0; i < setup->num_redirects; i++){
+            num_fds = zygote_assign(fds, num_fds, setup->redirects[i].fd, setup->redirects[i].source);
+        }
 
-    return EXIT_SUCCESS;
+        err = zygote_spawn(path, argv, envp, fds, num_fds, setup->pgid, setup->foreground, pid);
+        if(err != ZYGOTE_UNAVAILABLE){
+            return err;
+        }
+    }
+    return posix_spawn_exec(path, argv, envp, setup, pid);
 }
 
 /**
- * If the input has pipes in it, this function will handle them, executing each command
- *  within this function (it does not use execute_command()).
+ * Starts an external command as a child of the shell, using the selected spawn backend.
+ *  The path of the command comes from the command hash table, so $PATH is not walked
+ *  again, and its environment is the one kept for the exported variables, so it is not
+ *  built again either. If a cached path stopped working, it is dropped from the table
+ *  and the command is resolved and launched once more.
+ * @param argv The null-terminated command and its arguments
+ * @param setup How to set up the child (descriptors, process group)
+ * @return The pid of the child, 0 if the command could not be run, -1 if fork failed
  */
-int execute_piped_commands(char*** prepared_commands){
+pid_t launch_external(char** argv, struct child_setup* setup){
 
     /********************************************************************
     Declare variables
     ********************************************************************/
-    int old_pipe[2];
-    int new_pipe[2];
-    int return_code;
-    int err;
+    char** envp = (setup->envp != NULL) ? setup->envp : var_environ();
+    char* path;
+    int err = 0;
+    int attempt;
     pid_t pid;
-    int num_commands = 0;
-    int status;
+    unsigned long long spawned = trace_enabled ? trace_now() : 0;
 
-    int i = 0;
-    int j;
-    while(prepared_commands[i] != NULL){
-        num_commands++;
+    /********************************************************************
+    Anything the shell wrote itself must come out before the child's
+        output
+    ********************************************************************/
+    fflush(stdout);
+
+    for(attempt = 0; attempt < 2; attempt++){
 
         /********************************************************************
-        If there is a next command, create a pipe using new_pipe
+        Find the command, without forking if it is known to be missing
         ********************************************************************/
-        if(prepared_commands[i + 1] != NULL){
-            err = pipe(new_pipe);
-            if(err == -1){
-                perror("Error in execute_piped_commands() : Could not create pipe ");
-                return EXIT_SUCCESS;
-            }
-        }
-
-
-        pid = fork();
-        if(pid == 0){
-            //We're in child
-            /********************************************************************
-            If there is a command before this, make this process read from pipe
-                Copy read end using dup2 and close both file descriptors
-                Use old_pipe
-            ********************************************************************/
-            if(i > 0){
-                dup2(old_pipe[0], 0);
-                close(old_pipe[0]);
-                close(old_pipe[1]);
-            }
-
-            /********************************************************************
-            If there is a command after this, make this process write to pipe
-                Copy write end using dup2 and close both file descriptors
-                Use new_pipe
-            ********************************************************************/
-            if(prepared_commands[i + 1] != NULL){
-                close(new_pipe[0]);
-                dup2(new_pipe[1], 1);
-                close(new_pipe[1]);
-            }
-
-            /********************************************************************
-            Execute command
-                If it is an internal command, execute it accordingly
-            ********************************************************************/
-            for(j = 0; j < NUM_INTERNAL_COMMANDS; j++){
-                if(strncmp(prepared_commands[i][0], internal_command_names[j], strlen(internal_command_names[j])) == 0){
-                    return internal_commands[j](prepared_commands);
-                }
-            }
-
-            return_code = execvp(prepared_commands[i][0], prepared_commands[i]);
-            if(return_code == -1){
-                perror("Error in execute_piped_commands() : execvp failed ");
-                exit(EXIT_FAILURE); //End the child process
-            }
+        path = hash_lookup(argv[0]);
+        if(path == NULL){
+            fprintf(stderr, "bcsh: %s: command not found\n", argv[0]);
+            last_status = EXIT_NOT_FOUND;
+            return 0;
+        }
 
+        if(spawn_backend == SPAWN_BACKEND_FORK){
+            err = fork_exec(path, argv, envp, setup, &pid);
+        }else if(spawn_backend == SPAWN_BACKEND_ZYGOTE){
+            err = zygote_exec(path, argv, envp, setup, &pid);
         }else{
-            //We're in parent
-            /********************************************************************
-            Check if fork failed
-            ********************************************************************/
-            if(pid == -1){
-                //Fork failed
-                perror("Error in execute_command() : fork failed ");
-                return EXIT_SUCCESS;
-            }
+            err = posix_spawn_exec(path, argv, envp, setup, &pid);
+        }
 
-            /********************************************************************
-            If there is a previous command, close old_pipe
-            ********************************************************************/
-            if(i > 0){
-                close(old_pipe[0]);
-                close(old_pipe[1]);
+        /********************************************************************
+        Every backend only returns once the child has run execve(), so
+            while tracing, the child's span starts when it was spawned
+            and it has exec'd now
+        ********************************************************************/
+        if(err == 0){
+            if(trace_enabled){
+                trace_record(spawned, TRACE_BEGIN, "spawn", pid, 0, argv[0]);
+                trace_record(trace_now(), TRACE_INSTANT, "exec", pid, 0, path);
             }
+            return pid;
+        }
+        if(err == -1){
+            perror("Error in launch_external() : fork failed ");
+            return -1;
+        }
 
-            /********************************************************************
-            If there is a next command, old_pipe = new_pipe
-            ********************************************************************/
-            if(prepared_commands[i + 1] != NULL){
-                old_pipe[0] = new_pipe[0];
-                old_pipe[1] = new_pipe[1];
-            }
+        hash_remove(argv[0]);
+        if(strchr(argv[0], '/') != NULL || (err != ENOENT && err != ENOTDIR)){
+            break;
         }
-        i++;
     }
 
-    if(i > 0){
-        close(old_pipe[0]);
-        close(old_pipe[1]);
+    fprintf(stderr, "bcsh: %s: %s\n", argv[0], strerror(err));
+    last_status = (err == ENOENT || err == ENOTDIR) ? EXIT_NOT_FOUND : EXIT_NOT_EXECUTABLE;
+    return 0;
+}
+
+static void run_in_shell(struct command* command, struct function* function, int builtin);
+
+/**
+ * Forks a copy of the shell that runs an internal command, a compound command or a
+ *  function, for those that are part of a pipeline, run in the background or in a
+ *  subshell. The assignments in front of it are exported in the child. A copy that runs
+ *  more than one command waits for its own children, so it keeps a SIGCHLD handler.
+ *  The job the command is a stage of is not one of the copy's own, so jobs in it only
+ *  lists the shell's other jobs.
+ * @param function The function to call, NULL if it is not one
+ * @param builtin The internal command to run, -1 if it is not one
+ * @param job The job the command is a stage of
+ * @return The pid of the child, -1 if fork failed
+ */
+static pid_t launch_internal(struct command* command, struct function* function, int builtin, struct job* job,
+                             struct child_setup* setup){
+    unsigned long long spawned = trace_enabled ? trace_now() : 0;
+    pid_t pid;
+    int i;
+
+    fflush(stdout);
+    pid = fork();
+    if(pid == 0){
+        //We're in child
+        job_free(job);
+        setup_forked_child(setup);
+        if(command->compound == NULL && function == NULL){
+            in_forked_copy = 1;
+        }else{
+            job_control = 0;
+            jobs_init(0);
+        }
+        for(i = 0; i < command->num_assignments; i++){
+            var_assign(command->assignments[i], 1);
+        }
+        run_in_shell(command, function, builtin);
+        fflush(stdout);
+        _exit(last_status);
     }
 
-    for(i = 0; i < num_commands; i++){
-        waitpid(-1, &status, WUNTRACED);
+    //We're in parent
+    if(pid > 0 && setup->pgid != -1){
+        setpgid(pid, (setup->pgid == 0) ? pid : setup->pgid);
+    }
+    if(pid > 0 && trace_enabled){
+        trace_record(spawned, TRACE_BEGIN, "spawn", pid, 0, command_name(command));
+    }
+    if(pid == -1){
+        perror("Error in launch_internal() : fork failed ");
     }
+    return pid;
+}
+
+/**
+ * Finds the internal command with the given name, with one hash and one string compare:
+ *  every internal command has a slot of its own in the generated table
+ * @return Its index in internal_commands, -1 if it is not an internal command
+ */
+int find_internal_command(char* name){
+    int builtin = builtin_hash_table[builtin_hash(name, BUILTIN_HASH_SEED) & (BUILTIN_HASH_SIZE - 1)];
 
+    if(builtin != -1 && strcmp(name, internal_command_names[builtin]) == 0){
+        return builtin;
+    }
+    return -1;
+}
 
+/**
+ * The largest capacity an unprivileged process can give a pipe, read once from
+ *  /proc/sys/fs/pipe-max-size
+ */
+static long pipe_max_size(){
+    static long max_size = 0;
+    char buffer[32];
+    ssize_t bytes_read;
+    int fd;
 
-    return EXIT_SUCCESS;
+    if(max_size == 0){
+        max_size = PIPE_MAX_SIZE_DEFAULT;
+        fd = open("/proc/sys/fs/pipe-max-size", O_RDONLY | O_CLOEXEC);
+        if(fd != -1){
+            bytes_read = read(fd, buffer, sizeof(buffer) - 1);
+            if(bytes_read > 0){
+                buffer[bytes_read] = '\0';
+                max_size = strtol(buffer, NULL, 10);
+            }
+            close(fd);
+        }
+    }
+    return max_size;
+}
 
+/**
+ * Gives a pipe the capacity asked for, up to pipe-max-size. The kernel rounds it up to a
+ *  power of two number of pages.
+ * @return The capacity the pipe ended up with
+ */
+static long set_pipe_capacity(int fd, long size){
+    long capacity;
+
+    if(size > pipe_max_size()){
+        size = pipe_max_size();
+    }
+    capacity = fcntl(fd, F_SETPIPE_SZ, size);
+    if(capacity == -1){
+        perror("bcsh: could not resize pipe ");
+        capacity = fcntl(fd, F_GETPIPE_SZ);
+    }
+    return capacity;
+}
+
+/**
+ * Prints, under set -o pipestats, what each stage of a pipeline that finished read and
+ *  wrote, how long it was blocked and how long it ran, and the capacity of the pipe it
+ *  wrote to
+ * @param names The command of each process of the job
+ * @param capacities The capacity of the pipe each process wrote to, 0 for the last stage
+ */
+static void print_pipe_stats(struct job* job, char** names, long* capacities){
+    struct process* process;
+    int i;
+
+    fflush(stdout);
+    for(i = 0; i < job->num_processes; i++){
+        process = &job->processes[i];
+        fprintf(stderr, "  [%d] %-12s read %-10llu wrote %-10llu blocked %.3fs cpu %.3fs",
+                i + 1, names[i], process->bytes_read, process->bytes_written, process->blocked_ns / 1e9,
+                process->usage.ru_utime.tv_sec + process->usage.ru_stime.tv_sec
+                + (process->usage.ru_utime.tv_usec + process->usage.ru_stime.tv_usec) / 1e6);
+        if(capacities[i] > 0){
+            fprintf(stderr, " pipe %ld", capacities[i]);
+        }
+        fputc('\n', stderr);
+    }
+}
+
+/**
+ * Hands a job that was kept after its wait (for time or set -o pipestats) over to the
+ *  time report, then frees it if it is done. SIGCHLD must be blocked.
+ */
+static void keep_for_time(struct job* job){
+    if(!job->keep){
+        return;
+    }
+    if(time_report != NULL){
+        time_collect(time_report, job);
+    }
+    job->keep = 0;
+    if(job->state == JOB_DONE){
+        job_free(job);
+    }
+}
+
+/**
+ * Hands the limit of the pipeline being run under timeout to its job, before any of its
+ *  processes is launched
+ */
+static void take_timeout_limit(struct job* job){
+    if(timeout_limit != NULL){
+        job_set_limit(job, timeout_limit->duration, timeout_limit->signal, timeout_limit->kill_after);
+        timeout_limit = NULL;
+    }
+}
+
+/**
+ * Launches an external command as a foreground job of its own and waits for it, setting
+ *  last_status. SIGCHLD stays blocked from the launch until the shell waits, so the
+ *  handler cannot reap the child before it is in the job table.
+ * @param setup How to set up the child; the descriptors of its redirections are closed
+ *  once it is launched
+ */
+static void run_foreground(struct command* command, struct child_setup* setup){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct job* job;
+    sigset_t old_mask;
+    pid_t pid;
+
+    block_sigchld(&old_mask);
+    job = job_create(pipeline_text, pipeline_text_length, 0);
+    if(job == NULL){
+        close_redirections(setup->redirects, setup->num_redirects);
+        last_status = EXIT_FAILURE;
+        restore_sigmask(&old_mask);
+        return;
+    }
+    take_timeout_limit(job);
+
+    /********************************************************************
+    A command under a time limit leads a process group of its own even
+        without job control, so the processes it starts get the signal
+        too when the time is up
+    ********************************************************************/
+    setup->pgid = (job_control || job->limit_signal != 0) ? 0 : -1;
+    setup->foreground = setup->foreground && job_control;
+    pid = launch_external(command->argv, setup);
+    close_redirections(setup->redirects, setup->num_redirects);
+    if(pid > 0){
+        job_add_process(job, pid);
+        if(time_report != NULL){
+            time_add_stage(time_report, command->argv[0], pid);
+            job->keep = 1;
+        }
+        last_status = job_wait(job, &old_mask);
+        keep_for_time(job);
+    }else{
+        job_free(job);
+    }
+
+    restore_sigmask(&old_mask);
+}
+
+/**
+ * Handles the break or continue, if any, that ended an iteration of a loop. One that
+ *  leaves more loops is passed on to the enclosing one.
+ * @return 1 if the loop goes on with its next iteration, 0 if it stops
+ */
+static int loop_continues(){
+    int jump = pending_jump;
+
+    if(job_interrupted){
+        return 0;
+    }
+    if(jump == JUMP_NONE){
+        return 1;
+    }
+    if(jump == JUMP_RETURN){
+        return 0;
+    }
+    if(jump_levels > 1){
+        jump_levels--;
+        return 0;
+    }
+    pending_jump = JUMP_NONE;
+    return jump == JUMP_CONTINUE;
+}
+
+/**
+ * Gives back the line arena memory an iteration of a loop used, so a loop of any length
+ *  runs in the memory of one iteration. Under time it is kept, as the report points
+ *  into it.
+ */
+static void end_iteration(struct arena_mark* mark){
+    if(time_report == NULL){
+        arena_rewind(&line_arena, mark);
+    }
+}
+
+/**
+ * Runs an if command: the condition, then the body or the else part. An elif is an if
+ *  in the else part.
+ */
+static void execute_if(struct compound* compound){
+    execute_list(compound->condition);
+    if(exit_requested || pending_jump != JUMP_NONE || job_interrupted){
+        return;
+    }
+    if(last_status == EXIT_SUCCESS){
+        execute_list(compound->body);
+    }else if(compound->else_body != NULL){
+        execute_list(compound->else_body);
+    }else{
+        last_status = EXIT_SUCCESS;
+    }
+}
+
+/**
+ * Runs a while or until loop, from the same tree on every iteration. Its status is the
+ *  one of the last body that ran, 0 if none did.
+ */
+static void execute_while(struct compound* compound){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct arena_mark mark;
+    int status = EXIT_SUCCESS;
+
+    loop_depth++;
+    arena_mark(&line_arena, &mark);
+    while(1){
+        execute_list(compound->condition);
+        if(exit_requested || pending_jump == JUMP_RETURN || job_interrupted){
+            break;
+        }
+        if(pending_jump == JUMP_NONE){
+            if((last_status == EXIT_SUCCESS) != (compound->type == COMPOUND_WHILE)){
+                break;
+            }
+            execute_list(compound->body);
+            status = last_status;
+        }
+        end_iteration(&mark);
+        if(exit_requested || !loop_continues()){
+            break;
+        }
+    }
+    loop_depth--;
+
+    if(!exit_requested && pending_jump != JUMP_RETURN){
+        last_status = status;
+    }
+}
+
+/**
+ * Runs a for loop. Its words are expanded once, before the first iteration; without
+ *  them it goes through the positional parameters.
+ */
+static void execute_for(struct compound* compound){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct arena_mark mark;
+    size_t name_length = strlen(compound->name);
+    char** words;
+    int count;
+    int i;
+
+    if(compound->words == NULL){
+        count = num_positional_params;
+        words = arena_alloc(&line_arena, (count + 1) * sizeof(char*));
+        memcpy(words, positional_params, count * sizeof(char*)); //shift in the body must not change the list
+    }else if(compound->expansions != NULL){
+        words = expand_words(compound->words, compound->expansions, compound->num_words, &count);
+    }else{
+        words = compound->words;
+        count = compound->num_words;
+    }
+
+    last_status = EXIT_SUCCESS;
+    loop_depth++;
+    arena_mark(&line_arena, &mark);
+    for(i = 0; i < count; i++){
+        var_set(compound->name, name_length, words[i], 0);
+        execute_list(compound->body);
+        end_iteration(&mark);
+        if(exit_requested || !loop_continues()){
+            break;
+        }
+    }
+    loop_depth--;
+}
+
+/**
+ * Runs a case command: the list of the first item with a pattern that matches the word
+ */
+static void execute_case(struct compound* compound){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct case_item* item;
+    char* subject = compound->words[0];
+    int i;
+
+    if(compound->expansions != NULL && compound->expansions[0] != NULL){
+        subject = expand_string(compound->expansions[0]);
+    }
+
+    last_status = EXIT_SUCCESS;
+    for(item = compound->items; item != NULL; item = item->next){
+        for(i = 0; i < item->num_patterns; i++){
+            if(pattern_matches(subject, item->patterns[i], (item->expansions != NULL) ? item->expansions[i] : NULL)){
+                execute_list(item->body);
+                return;
+            }
+        }
+    }
+}
+
+/**
+ * Runs a compound command in the shell. A subshell only gets here in the copy of the
+ *  shell forked for it.
+ */
+static void execute_compound(struct compound* compound){
+    switch(compound->type){
+        case COMPOUND_IF:
+            execute_if(compound);
+            break;
+        case COMPOUND_WHILE:
+        case COMPOUND_UNTIL:
+            execute_while(compound);
+            break;
+        case COMPOUND_FOR:
+            execute_for(compound);
+            break;
+        case COMPOUND_CASE:
+            execute_case(compound);
+            break;
+        case COMPOUND_FUNCTION:
+            function_define(compound->name, compound->function);
+            last_status = EXIT_SUCCESS;
+            break;
+        default:
+            execute_list(compound->body);
+            break;
+    }
+}
+
+/**
+ * Calls a function: its arguments become the positional parameters while its body runs,
+ *  and a return stops it. A break or continue cannot leave it for a loop around the call.
+ */
+static void call_function(struct function* function, struct command* command){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    char** saved_params = positional_params;
+    int saved_num_params = num_positional_params;
+    int saved_loop_depth = loop_depth;
+
+    positional_params = command->argv + 1;
+    num_positional_params = command->argc - 1;
+    loop_depth = 0;
+    function_depth++;
+    function_hold(function);
+
+    execute_command(expand_command(function->body));
+    pending_jump = JUMP_NONE;
+
+    function_release(function);
+    function_depth--;
+    loop_depth = saved_loop_depth;
+    positional_params = saved_params;
+    num_positional_params = saved_num_params;
+}
+
+/**
+ * Runs what does not need a process of its own: a compound command, a function or an
+ *  internal command, setting last_status
+ */
+static void run_in_shell(struct command* command, struct function* function, int builtin){
+    if(command->compound != NULL){
+        execute_compound(command->compound);
+    }else if(function != NULL){
+        call_function(function, command);
+    }else{
+        last_status = internal_commands[builtin](command->argv); //This runs the function using its pointer, passing the words as an argument
+    }
+}
+
+/**
+ * Runs a single foreground command that is not part of a pipeline. It first checks if the command is a compound command, a function or an internal command,
+ *  which run inside the shell, before launching it as an external command in a job of
+ *  its own and waiting for it.
+ * @param command The command to run
+ * @return 0 if the shell can continue, 1 if we have to stop (got exit command, or something)
+ */
+static int run_command(struct command* command){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct function* function = NULL;
+    int builtin = -1;
+    int* saved;
+    int no_fds[] = {-1};
+    struct child_setup setup = {-1, -1, -1, no_fds, -1, 1, NULL, 0, NULL};
+    struct pipeline subshell = {command, 1, CONNECT_END, 0, NULL};
+    int i;
+
+    /********************************************************************
+    A subshell runs in a copy of the shell, as a pipeline of one
+    ********************************************************************/
+    if(command->compound != NULL && command->compound->type == COMPOUND_SUBSHELL){
+        return execute_piped_commands(&subshell);
+    }
+
+    /********************************************************************
+    Open the files of the redirections first; if one fails, the command
+        does not run. A command with only redirections just opens them
+        (> file creates file).
+    ********************************************************************/
+    if(command->redirections != NULL){
+        setup.num_redirects = open_redirections(command, &setup.redirects);
+        if(setup.num_redirects == -1){
+            last_status = EXIT_FAILURE;
+            return 0;
+        }
+    }
+    if(command->argc == 0 && command->compound == NULL){
+        close_redirections(setup.redirects, setup.num_redirects);
+        for(i = 0; i < command->num_assignments; i++){
+            var_assign(command->assignments[i], 0);
+        }
+        if(!substitution_ran){
+            last_status = EXIT_SUCCESS;
+        }
+        return 0;
+    }
+
+    /********************************************************************
+    Check if program is a compound command, a function or an internal
+        command (cd or exit). With redirections, it runs with them
+        applied to the shell's own descriptors, which are put back
+        afterwards. Functions are only looked for once one is defined.
+    ********************************************************************/
+    if(command->compound != NULL || (function = function_find(command->argv[0])) != NULL
+       || (builtin = find_internal_command(command->argv[0])) != -1){
+        if(setup.num_redirects == 0){
+            run_in_shell(command, function, builtin);
+            return exit_requested;
+        }
+        saved = arena_alloc(&line_arena, setup.num_redirects * sizeof(int));
+        fflush(stdout);
+        if(apply_redirections(setup.redirects, setup.num_redirects, saved) == 0){
+            run_in_shell(command, function, builtin);
+        }else{
+            perror("bcsh: redirection failed ");
+            last_status = EXIT_FAILURE;
+        }
+        restore_redirections(setup.redirects, setup.num_redirects, saved);
+        close_redirections(setup.redirects, setup.num_redirects);
+        return exit_requested;
+    }
+
+    /********************************************************************
+    Otherwise, run the external command, with the assignments in front
+        of it added to its environment only. If there is an error, abort
+        but allow the user to continue using the shell. The internal
+        command exit is the only one that stops the shell.
+    ********************************************************************/
+    if(command->num_assignments > 0){
+        setup.envp = var_environ_with(command->assignments, command->num_assignments);
+    }
+    run_foreground(command, &setup);
+    return 0;
+}
+
+/**
+ * This function executes a single foreground command that is not part of a pipeline,
+ *  see run_command(). While tracing, the command is a span of its own, ending with its
+ *  status.
+ * @param command The command to run
+ * @return 0 if the shell can continue, 1 if we have to stop (got exit command, or something)
+ */
+int execute_command(struct command* command){
+    int done;
+
+    if(!trace_enabled){
+        return run_command(command);
+    }
+    trace_record(trace_now(), TRACE_BEGIN, "command", 0, 0, command_name(command));
+    done = run_command(command);
+    trace_record(trace_now(), TRACE_END, "command", 0, last_status, NULL);
+    return done;
+}
+
+/**
+ * Runs an external command for an internal one that cannot handle its arguments, like
+ *  cat -n. In a copy of the shell forked for a pipeline, the command replaces the copy;
+ *  in the shell itself, it runs as a foreground job of its own, with the descriptors the
+ *  internal command had.
+ * @param argv The null-terminated command and its arguments
+ * @return The exit status of the command
+ */
+int execute_external(char** argv){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct command* command;
+    char* path;
+    int no_fds[] = {-1};
+    struct child_setup setup = {-1, -1, -1, no_fds, -1, 1, NULL, 0, NULL};
+
+    if(in_forked_copy){
+        fflush(stdout);
+        path = hash_lookup(argv[0]);
+        if(path == NULL){
+            fprintf(stderr, "bcsh: %s: command not found\n", argv[0]);
+            return EXIT_NOT_FOUND;
+        }
+        execve(path, argv, var_environ());
+        fprintf(stderr, "bcsh: %s: %s\n", argv[0], strerror(errno));
+        return (errno == ENOENT) ? EXIT_NOT_FOUND : EXIT_NOT_EXECUTABLE;
+    }
+
+    command = arena_alloc(&line_arena, sizeof(struct command));
+    command->assignments = argv;
+    command->num_assignments = 0;
+    command->argv = argv;
+    for(command->argc = 0; argv[command->argc] != NULL; command->argc++);
+    command->expansions = NULL;
+    command->redirections = NULL;
+    command->compound = NULL;
+    command->next = NULL;
+
+    run_foreground(command, &setup);
+    return last_status;
+}
+
+/**
+ * Runs a pipeline, or a command that has to run in the background, executing each
+ *  command within this function (it does not use execute_command()).
+ *  All the commands are part of one job. The exit status of the pipeline is the one of
+ *  its last command.
+ * @param pipeline The pipeline to run
+ * @return 0, a pipeline never stops the shell
+ */
+static int run_pipeline(struct pipeline* pipeline){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct command* command;
+    struct function* function;
+    struct job* job;
+    struct child_setup setup;
+    sigset_t old_mask;
+    int old_pipe[2];
+    int new_pipe[2];
+    int close_fds[5];
+    int num_close;
+    int err;
+    int builtin;
+    int i;
+    pid_t pid;
+    int last_launched = 0;
+    long capacity = 0;
+    char** stage_names = NULL;
+    long* stage_capacities = NULL;
+
+    if(pipe_stats){
+        stage_names = arena_alloc(&line_arena, pipeline->num_commands * sizeof(char*));
+        stage_capacities = arena_alloc(&line_arena, pipeline->num_commands * sizeof(long));
+    }
+
+    block_sigchld(&old_mask);
+    job = job_create(pipeline->text, pipeline->text_length, pipeline->background);
+    if(job == NULL){
+        last_status = EXIT_FAILURE;
+        restore_sigmask(&old_mask);
+        return 0;
+    }
+    if(!pipeline->background){
+        take_timeout_limit(job);
+    }
+
+    last_status = EXIT_NOT_FOUND;
+
+    for(command = pipeline->commands; command != NULL; command = command->next){
+
+        /********************************************************************
+        If there is a next command, create a pipe using new_pipe. It is
+            close-on-exec, so no other command inherits it: only the two
+            it joins get it, as their stdout and stdin. It gets the
+            capacity asked with |[size] or set -o pipesize.
+        ********************************************************************/
+        capacity = 0;
+        if(command->next != NULL){
+            err = pipe2(new_pipe, O_CLOEXEC);
+            if(err == -1){
+                /********************************************************************
+                The pipeline cannot be completed: the stages already running
+                    are stopped, and reaped with the job below
+                ********************************************************************/
+                perror("Error in execute_piped_commands() : Could not create pipe ");
+                if(command != pipeline->commands){
+                    close(old_pipe[0]);
+                    close(old_pipe[1]);
+                }
+                for(i = 0; i < job->num_processes; i++){
+                    kill(job->processes[i].pid, SIGTERM);
+                    kill(job->processes[i].pid, SIGCONT);
+                }
+                last_status = EXIT_FAILURE;
+                break;
+            }
+            if(command->pipe_size > 0 || default_pipe_size > 0){
+                capacity = set_pipe_capacity(new_pipe[1], (command->pipe_size > 0) ? command->pipe_size : default_pipe_size);
+            }else if(pipe_stats){
+                capacity = fcntl(new_pipe[1], F_GETPIPE_SZ);
+            }
+        }
+
+        /********************************************************************
+        Each command reads from old_pipe if there is a command before this
+            one, and writes to new_pipe if there is one after it. Every other
+            pipe end is closed in the child.
+        ********************************************************************/
+        num_close = 0;
+        if(command != pipeline->commands){
+            close_fds[num_close++] = old_pipe[0];
+            close_fds[num_close++] = old_pipe[1];
+        }
+        if(command->next != NULL){
+            close_fds[num_close++] = new_pipe[0];
+            close_fds[num_close++] = new_pipe[1];
+        }
+        close_fds[num_close] = -1;
+
+        setup.in_fd = (command != pipeline->commands) ? old_pipe[0] : -1;
+        setup.out_fd = (command->next != NULL) ? new_pipe[1] : -1;
+        setup.err_fd = -1;
+        setup.close_fds = close_fds;
+        setup.pgid = (job_control || job->limit_signal != 0) ? job->pgid : -1;
+        setup.foreground = job_control && !pipeline->background && job->pgid == 0;
+        setup.redirects = NULL;
+        setup.num_redirects = 0;
+        setup.envp = (command->num_assignments > 0) ? var_environ_with(command->assignments, command->num_assignments) : NULL;
+        if(command->redirections != NULL){
+            setup.num_redirects = open_redirections(command, &setup.redirects);
+        }
+
+        /********************************************************************
+        Compound commands, functions and internal commands in a pipeline
+            run in a forked copy of the shell
+        ********************************************************************/
+        function = NULL;
+        builtin = -1;
+        if(command->argc > 0 && (function = function_find(command->argv[0])) == NULL){
+            builtin = find_internal_command(command->argv[0]);
+        }
+
+        if(setup.num_redirects == -1){
+            last_status = EXIT_FAILURE;
+            pid = 0;
+        }else if(command->argc == 0 && command->compound == NULL){
+            pid = 0;
+            if(command->next == NULL){
+                last_status = EXIT_SUCCESS;
+            }
+        }else if(command->compound == NULL && function == NULL && builtin == -1){
+            pid = launch_external(command->argv, &setup);
+        }else{
+            pid = launch_internal(command, function, builtin, job, &setup);
+        }
+        if(setup.num_redirects > 0){
+            close_redirections(setup.redirects, setup.num_redirects);
+        }
+
+        //We're in parent
+        if(pid > 0){
+            if(pipe_stats){
+                stage_names[job->num_processes] = command_name(command);
+                stage_capacities[job->num_processes] = capacity;
+            }
+            job_add_process(job, pid);
+            if(time_report != NULL){
+                time_add_stage(time_report, command_name(command), pid);
+            }
+        }
+        if(command->next == NULL){
+            last_launched = (pid > 0);
+        }
+
+        /********************************************************************
+        If there is a previous command, close old_pipe
+        ********************************************************************/
+        if(command != pipeline->commands){
+            close(old_pipe[0]);
+            close(old_pipe[1]);
+        }
+
+        /********************************************************************
+        If there is a next command, old_pipe = new_pipe
+        ********************************************************************/
+        if(command->next != NULL){
+            old_pipe[0] = new_pipe[0];
+            old_pipe[1] = new_pipe[1];
+        }
+    }
+
+    /********************************************************************
+    Background jobs are left running; the shell only reports them and
+        moves on. Foreground jobs are waited for, unless nothing could
+        be started.
+    ********************************************************************/
+    if(pipeline->background && job->num_processes > 0){
+        last_background_pid = job->processes[job->num_processes - 1].pid;
+        if(job_control){
+            fprintf(stdout, "[%d] %d\n", job->id, (int)last_background_pid);
+        }
+        last_status = EXIT_SUCCESS;
+    }else if(job->num_processes > 0){
+        job->keep = (time_report != NULL || pipe_stats);
+        err = job_wait(job, &old_mask);
+        if(pipe_stats && job->state == JOB_DONE){
+            print_pipe_stats(job, stage_names, stage_capacities);
+        }
+        keep_for_time(job);
+        if(last_launched){
+            last_status = err;
+        }
+    }else{
+        job_free(job);
+    }
+
+    restore_sigmask(&old_mask);
+    return 0;
+}
+
+/**
+ * If the input has pipes in it, or has to run in the background, this function will handle
+ *  it, see run_pipeline(). While tracing, the pipeline is a span of its own, ending with
+ *  its status.
+ * @param pipeline The pipeline to run
+ * @return 0, a pipeline never stops the shell
+ */
+int execute_piped_commands(struct pipeline* pipeline){
+    if(!trace_enabled){
+        return run_pipeline(pipeline);
+    }
+    trace_record(trace_now(), TRACE_BEGIN, "pipeline", 0, pipeline->num_commands, command_name(pipeline->commands));
+    run_pipeline(pipeline);
+    trace_record(trace_now(), TRACE_END, "pipeline", 0, last_status, NULL);
+    return 0;
+}
+
+/**
+ * This function runs a pipeline that starts with the time keyword, then reports the time
+ *  and resources it used. Background pipelines are run without a report.
+ * @param pipeline The pipeline to run, its first word being time
+ * @return 0 if the shell can continue, 1 if we have to stop
+ */
+int execute_timed(struct pipeline* pipeline){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct time_report report;
+    int format;
+    int done = 0;
+
+    if(time_options(pipeline->commands, &format) == -1){
+        last_status = EXIT_SYNTAX_ERROR;
+        return 0;
+    }
+
+    /********************************************************************
+    time on its own only times the shell doing nothing
+    ********************************************************************/
+    time_start(&report, format);
+    if(!pipeline->background){
+        time_report = &report;
+    }
+
+    if(pipeline->commands->argc == 0 && pipeline->num_commands == 1){
+        last_status = EXIT_SUCCESS;
+    }else if(pipeline->commands->argc > 0 && strcmp(pipeline->commands->argv[0], "timeout") == 0){
+        done = execute_timeout(pipeline);
+    }else if(pipeline->num_commands == 1 && !pipeline->background){
+        done = execute_command(pipeline->commands);
+    }else{
+        execute_piped_commands(pipeline);
+    }
+
+    if(time_report != NULL){
+        time_report = NULL;
+        time_finish(&report, last_status);
+    }
+
+    return done;
+}
+
+/**
+ * This function runs a pipeline that starts with the timeout keyword, stopping it if it
+ *  runs longer than the limit: every stage still running then gets the signal (SIGTERM
+ *  unless -s says otherwise), then SIGKILL if it is still there after -k, and the exit
+ *  status is EXIT_TIMED_OUT. The job table enforces the limit while the shell waits for
+ *  the pipeline, so background pipelines, like a duration of 0, have no limit. Internal
+ *  commands, compound commands and functions run in a copy of the shell, so they can be
+ *  stopped too.
+ * @param pipeline The pipeline to run, its first word being timeout
+ * @return 0, the shell never stops here
+ */
+int execute_timeout(struct pipeline* pipeline){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct timeout_limit limit;
+    struct command* command = pipeline->commands;
+
+    if(timeout_options(command, &limit) == -1){
+        last_status = EXIT_SYNTAX_ERROR;
+        return 0;
+    }
+
+    if(!pipeline->background && limit.duration > 0){
+        timeout_limit = &limit;
+    }
+    if(pipeline->num_commands == 1 && !pipeline->background && command->compound == NULL
+       && function_find(command->argv[0]) == NULL && find_internal_command(command->argv[0]) == -1){
+        execute_command(command);
+    }else{
+        execute_piped_commands(pipeline);
+    }
+    timeout_limit = NULL;
+
+    return 0;
+}
+
+/**
+ * This function runs every pipeline of a parsed command line in order. A pipeline after
+ *  && only runs if the one before it succeeded, and one after || only if it failed.
+ * @param list The first pipeline of the line
+ * @return 0 if the shell can continue, 1 if we have to stop
+ */
+int execute_list(struct pipeline* list){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct pipeline* pipeline = list;
+    struct pipeline expanded;
+    struct command* command;
+    struct command** tail;
+
+    while(pipeline != NULL){
+
+        /********************************************************************
+        Expand the words now rather than when the line was parsed, so they
+            see the variables and files the pipelines before this one set.
+            The pipeline runs from the expanded copy, leaving the tree as
+            it was for the next iteration of a loop or call of a function.
+        ********************************************************************/
+        substitution_ran = 0;
+        if(trace_enabled){
+            trace_record(trace_now(), TRACE_BEGIN, "expand", 0, pipeline->num_commands, NULL);
+        }
+        expanded = *pipeline;
+        tail = &expanded.commands;
+        for(command = pipeline->commands; command != NULL; command = command->next){
+            *tail = expand_command(command);
+            tail = &(*tail)->next;
+        }
+        *tail = NULL;
+        command = expanded.commands;
+        if(trace_enabled){
+            trace_record(trace_now(), TRACE_END, "expand", 0, 0, NULL);
+        }
+        pipeline_text = pipeline->text;
+        pipeline_text_length = pipeline->text_length;
+
+        /********************************************************************
+        Single foreground commands may be internal ones, compound commands
+            or functions that change the shell itself, so they do not get
+            the pipeline treatment
+        ********************************************************************/
+        if(command->argc > 0 && strcmp(command->argv[0], "time") == 0){
+            execute_timed(&expanded);
+        }else if(command->argc > 0 && strcmp(command->argv[0], "timeout") == 0){
+            execute_timeout(&expanded);
+        }else if(expanded.num_commands == 1 && !expanded.background){
+            execute_command(command);
+        }else{
+            execute_piped_commands(&expanded);
+        }
+        if(exit_requested){
+            return 1;
+        }
+        if(pending_jump != JUMP_NONE || job_interrupted){
+            return 0; //A break, continue, return or ctrl-c leaves the rest of the list
+        }
+
+        /********************************************************************
+        Skip the pipelines whose condition does not hold
+        ********************************************************************/
+        while(pipeline != NULL
+              && ((pipeline->connector == CONNECT_AND && last_status != 0)
+                  || (pipeline->connector == CONNECT_OR && last_status == 0))){
+            pipeline = pipeline->next;
+        }
+        if(pipeline != NULL){
+            pipeline = pipeline->next;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Checks if an internal command only writes its output, so a substitution can run it
+ *  in the shell itself: it changes nothing the shell keeps (unlike cd or exit)
+ */
+static int substitution_in_process(int builtin){
+    int (*function)() = internal_commands[builtin];
+
+    return function == echo_internal || function == printf_internal || function == pwd_internal
+           || function == true_internal || function == false_internal || function == test_internal
+           || function == cat_internal;
+}
+
+/**
+ * Runs an internal command with its stdout going to the capture memfd, then reads what
+ *  it wrote into the line arena. Nothing is forked.
+ * @return The output, NULL if stdout could not be redirected
+ */
+static char* capture_in_process(struct command* command, size_t* length){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct stat capture_stat;
+    char* output;
+    ssize_t bytes_read;
+    size_t done = 0;
+    int saved;
+
+    if(capture_fd == -1){
+        capture_fd = memfd_create("bcsh-substitution", MFD_CLOEXEC);
+        if(capture_fd == -1){
+            return NULL;
+        }
+    }
+
+    fflush(stdout);
+    saved = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, SAVED_FD_MIN);
+    if(saved == -1){
+        return NULL;
+    }
+    dup2(capture_fd, STDOUT_FILENO);
+    execute_command(command);
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+
+    /********************************************************************
+    Read it all back at once, and empty the memfd for the next one
+    ********************************************************************/
+    fstat(capture_fd, &capture_stat);
+    output = arena_alloc(&line_arena, capture_stat.st_size + 1);
+    while(done < (size_t)capture_stat.st_size){
+        bytes_read = pread(capture_fd, output + done, capture_stat.st_size - done, done);
+        if(bytes_read <= 0){
+            break;
+        }
+        done += bytes_read;
+    }
+    ftruncate(capture_fd, 0);
+    lseek(capture_fd, 0, SEEK_SET);
+
+    *length = done;
+    return output;
+}
+
+/**
+ * Starts what a substitution runs with its stdout going to out_fd: a single external
+ *  command is launched directly, anything else runs in a copy of the shell. SIGCHLD must
+ *  be blocked.
+ * @param command The expanded command of a list that is a single command, NULL otherwise
+ * @return The pid of the child, 0 if nothing could be started
+ */
+static pid_t launch_substitution(struct pipeline* list, struct command* command, int* fds, sigset_t* old_mask){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    int close_fds[] = {fds[0], -1};
+    struct child_setup setup = {-1, fds[1], -1, close_fds, -1, 0, NULL, 0, NULL};
+    unsigned long long spawned;
+    pid_t pid;
+
+    if(command != NULL && command->compound == NULL && command->argc > 0
+       && function_find(command->argv[0]) == NULL && find_internal_command(command->argv[0]) == -1){
+        if(command->redirections != NULL){
+            setup.num_redirects = open_redirections(command, &setup.redirects);
+            if(setup.num_redirects == -1){
+                last_status = EXIT_FAILURE;
+                return 0;
+            }
+        }
+        if(command->num_assignments > 0){
+            setup.envp = var_environ_with(command->assignments, command->num_assignments);
+        }
+        pid = launch_external(command->argv, &setup);
+        close_redirections(setup.redirects, setup.num_redirects);
+        return (pid > 0) ? pid : 0;
+    }
+
+    spawned = trace_enabled ? trace_now() : 0;
+    fflush(stdout);
+    pid = fork();
+    if(pid == 0){
+        //We're in child, a copy of the shell that runs the whole list
+        restore_sigmask(old_mask);
+        zygote_detach();
+        job_control = 0;
+        dup2(fds[1], STDOUT_FILENO);
+        if(command != NULL){
+            execute_command(command); //Already expanded
+        }else{
+            execute_list(list);
+        }
+        fflush(stdout);
+        _exit(last_status);
+    }
+    if(pid == -1){
+        perror("Error in launch_substitution() : fork failed ");
+        return 0;
+    }
+    if(trace_enabled){
+        trace_record(spawned, TRACE_BEGIN, "spawn", pid, 0, "substitution");
+    }
+    return pid;
+}
+
+/**
+ * This function runs the command of a substitution, $(command) or `command`, and gives
+ *  what it wrote, without its trailing newlines; last_status becomes its status. A
+ *  single internal command that only writes its output (echo, printf, pwd...) runs in
+ *  the shell, writing to a memfd, so $(pwd) never forks. Anything else writes to a pipe
+ *  that the shell reads into the line arena, growing the buffer in place.
+ * @param text The command, which is not modified
+ * @return The output, in the line arena
+ */
+char* execute_substitution(char* text){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct pipeline* list;
+    struct command* command = NULL;
+    sigset_t old_mask;
+    char* output = NULL;
+    size_t length = 0;
+    size_t capacity = 0;
+    ssize_t bytes_read;
+    int fds[2];
+    int status;
+    int builtin;
+    pid_t pid;
+
+    substitution_ran = 1;
+    status = parse_line(arena_strdup(&line_arena, text), &list);
+    if(status != 0){
+        if(status == PARSE_INCOMPLETE){
+            fprintf(stderr, "bcsh: syntax error: unexpected end of file\n");
+        }
+        last_status = EXIT_SYNTAX_ERROR;
+        return "";
+    }
+    if(list == NULL){
+        last_status = EXIT_SUCCESS;
+        return "";
+    }
+
+    /********************************************************************
+    A lone internal command that only writes runs right here
+    ********************************************************************/
+    if(list->next == NULL && list->num_commands == 1 && !list->background){
+        command = expand_command(list->commands);
+        if(command->compound == NULL && command->argc > 0 && function_find(command->argv[0]) == NULL
+           && (builtin = find_internal_command(command->argv[0])) != -1 && substitution_in_process(builtin)){
+            output = capture_in_process(command, &length);
+        }
+    }
+
+    /********************************************************************
+    Otherwise read its output from a pipe until every writer closed it
+    ********************************************************************/
+    if(output == NULL){
+        if(pipe2(fds, O_CLOEXEC) == -1){
+            perror("Error in execute_substitution() : Could not create pipe ");
+            last_status = EXIT_FAILURE;
+            return "";
+        }
+        block_sigchld(&old_mask);
+        pid = launch_substitution(list, command, fds, &old_mask);
+        close(fds[1]);
+
+        while(1){
+            if(capacity - length < SUBSTITUTION_READ_SIZE){
+                output = arena_realloc(&line_arena, output, capacity, (capacity == 0) ? SUBSTITUTION_READ_SIZE : capacity * 2);
+                capacity = (capacity == 0) ? SUBSTITUTION_READ_SIZE : capacity * 2;
+            }
+            bytes_read = read(fds[0], output + length, capacity - length - 1);
+            if(bytes_read == -1 && errno == EINTR){
+                continue;
+            }
+            if(bytes_read <= 0){
+                break;
+            }
+            length += bytes_read;
+        }
+        close(fds[0]);
+
+        if(pid > 0){
+            while(waitpid(pid, &status, 0) == -1 && errno == EINTR);
+            last_status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+            if(trace_enabled){
+                trace_record(trace_now(), TRACE_END, "exit", pid, last_status, NULL); //Reaped here, not by the handler
+            }
+        }
+        restore_sigmask(&old_mask);
+    }
+
+    while(length > 0 && output[length - 1] == '\n'){
+        length--;
+    }
+    output[length] = '\0';
+    return output;
 }
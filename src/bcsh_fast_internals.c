@@ -0,0 +1,926 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh_fast_internals.c
+ * * * * * * * * * * * * * * * * * * *
+ * In-process versions of the utilities
+ *  scripts call the most (echo, true,
+ *  false, test, printf, pwd and :), so
+ *  running them never forks, and of
+ *  cat, tee and cp, which let the
+ *  kernel move the bytes
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "../include/bcsh_constants.h"
+#include "../include/bcsh_internals.h"
+#include "../include/bcsh_utils.h"
+#include "../include/bcsh_arena.h"
+#include "../include/bcsh_copy.h"
+#include "../include/bcsh_execution.h"
+
+/**
+ * Prints one backslash escape of echo -e, printf formats and printf %b
+ * @param escape Points just after the backslash
+ * @param octal_zero 1 if octal escapes are written \0nnn (echo and %b), 0 for \nnn
+ * @param stop Set to 1 on \c, which ends all output
+ * @return The number of characters of the escape after the backslash
+ */
+static int print_escape(char* escape, int octal_zero, int* stop){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    int value = 0;
+    int length = 0;
+    int digit;
+
+    switch(*escape){
+        case 'a': putchar('\a'); return 1;
+        case 'b': putchar('\b'); return 1;
+        case 'e': putchar(27); return 1;
+        case 'f': putchar('\f'); return 1;
+        case 'n': putchar('\n'); return 1;
+        case 'r': putchar('\r'); return 1;
+        case 't': putchar('\t'); return 1;
+        case 'v': putchar('\v'); return 1;
+        case '\\': putchar('\\'); return 1;
+        case 'c': *stop = 1; return 1;
+        case 'x':
+            for(length = 1; length < 3; length++){
+                digit = escape[length];
+                if(digit >= '0' && digit <= '9'){
+                    value = value * 16 + digit - '0';
+                }else if((digit | 0x20) >= 'a' && (digit | 0x20) <= 'f'){
+                    value = value * 16 + (digit | 0x20) - 'a' + 10;
+                }else{
+                    break;
+                }
+            }
+            if(length == 1){
+                fputs("\\x", stdout);
+            }else{
+                putchar(value);
+            }
+            return length;
+        case '\0':
+            putchar('\\');
+            return 0;
+    }
+
+    /********************************************************************
+    Octal escapes have up to three digits, after a 0 for echo and %b
+    ********************************************************************/
+    if(*escape >= '0' && *escape <= '7'){
+        if(octal_zero && *escape == '0'){
+            length = 1;
+        }
+        for(digit = 0; digit < 3 && escape[length] >= '0' && escape[length] <= '7'; digit++){
+            value = value * 8 + escape[length++] - '0';
+        }
+        putchar(value);
+        return length;
+    }
+
+    putchar('\\');
+    putchar(*escape);
+    return 1;
+}
+
+/**
+ * Prints a string, handling backslash escapes the way echo -e and printf %b do
+ * @return 1 if the string ended the output with \c, 0 otherwise
+ */
+static int print_escaped(char* string){
+    int stop = 0;
+
+    for(; *string != '\0' && !stop; string++){
+        if(*string == '\\'){
+            string += print_escape(string + 1, 1, &stop);
+        }else{
+            putchar(*string);
+        }
+    }
+    return stop;
+}
+
+/**
+ * This function writes its arguments separated by spaces, followed by a newline.
+ *  echo -n leaves the newline out, echo -e handles backslash escapes (as in bash)
+ */
+int echo_internal(char** tokens){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    int newline = 1;
+    int escapes = 0;
+    int i = 1;
+    char* option;
+
+    /********************************************************************
+    Only words made of n, e and E are options
+    ********************************************************************/
+    for(; tokens[i] != NULL && tokens[i][0] == '-' && tokens[i][1] != '\0'; i++){
+        for(option = &tokens[i][1]; *option == 'n' || *option == 'e' || *option == 'E'; option++);
+        if(*option != '\0'){
+            break;
+        }
+        for(option = &tokens[i][1]; *option != '\0'; option++){
+            if(*option == 'n'){
+                newline = 0;
+            }else{
+                escapes = (*option == 'e');
+            }
+        }
+    }
+
+    for(; tokens[i] != NULL; i++){
+        if(escapes){
+            if(print_escaped(tokens[i])){
+                return EXIT_SUCCESS;
+            }
+        }else{
+            fputs(tokens[i], stdout);
+        }
+        if(tokens[i + 1] != NULL){
+            putchar(' ');
+        }
+    }
+    if(newline){
+        putchar('\n');
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * This function does nothing, successfully (true and :)
+ */
+int true_internal(char** tokens){
+    return EXIT_SUCCESS;
+}
+
+/**
+ * This function does nothing, and fails
+ */
+int false_internal(char** tokens){
+    return EXIT_FAILURE;
+}
+
+/**
+ * This function prints the current working directory: the logical one the shell keeps,
+ *  or with -P the physical one, with symbolic links resolved
+ */
+int pwd_internal(char** tokens){
+    char* path;
+
+    if(tokens[1] == NULL || strcmp(tokens[1], "-P") != 0){
+        puts(get_cwd());
+        return EXIT_SUCCESS;
+    }
+
+    path = getcwd(NULL, 0);
+    if(path == NULL){
+        perror("Error in pwd_internal ");
+        return EXIT_FAILURE;
+    }
+    puts(path);
+    free(path);
+    return EXIT_SUCCESS;
+}
+
+/****************************************************************************
+ * test and [
+ ****************************************************************************/
+
+/**
+ * Where test is in its arguments, and whether it hit an error
+ */
+struct test_state {
+    char** args;
+    int pos;
+    int end;
+    int error;
+};
+
+static int test_or(struct test_state* state);
+
+/**
+ * Turns an argument of an integer comparison into a number
+ */
+static long long test_number(struct test_state* state, char* word){
+    char* end;
+    long long value;
+
+    errno = 0;
+    value = strtoll(word, &end, 10);
+    while(*end == ' ' || *end == '\t'){
+        end++;
+    }
+    if(end == word || *end != '\0' || errno != 0){
+        fprintf(stderr, "bcsh: test: %s: integer expression expected\n", word);
+        state->error = 1;
+    }
+    return value;
+}
+
+static int is_binary_operator(char* word){
+    static char* operators[] = {"=", "==", "!=", "<", ">", "-eq", "-ne", "-lt", "-le", "-gt", "-ge",
+                                "-nt", "-ot", "-ef", NULL};
+    int i;
+
+    for(i = 0; operators[i] != NULL; i++){
+        if(strcmp(word, operators[i]) == 0){
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int is_unary_operator(char* word){
+    return word[0] == '-' && word[1] != '\0' && word[2] == '\0' && strchr("bcdefghknprsStuwxzLOG", word[1]) != NULL;
+}
+
+/**
+ * Evaluates word operator word
+ */
+static int test_binary(struct test_state* state, char* left, char* operator, char* right){
+    struct stat left_stat;
+    struct stat right_stat;
+    int left_exists;
+    int right_exists;
+
+    if(operator[0] != '-'){
+        if(strcmp(operator, "=") == 0 || strcmp(operator, "==") == 0){
+            return strcmp(left, right) == 0;
+        }else if(strcmp(operator, "!=") == 0){
+            return strcmp(left, right) != 0;
+        }else if(strcmp(operator, "<") == 0){
+            return strcmp(left, right) < 0;
+        }
+        return strcmp(left, right) > 0;
+    }
+
+    /********************************************************************
+    File comparisons
+    ********************************************************************/
+    if(operator[1] == 'n' || operator[1] == 'o' || (operator[1] == 'e' && operator[2] == 'f')){
+        left_exists = (stat(left, &left_stat) == 0);
+        right_exists = (stat(right, &right_stat) == 0);
+        if(operator[1] == 'n'){
+            return left_exists && (!right_exists || left_stat.st_mtim.tv_sec > right_stat.st_mtim.tv_sec
+                   || (left_stat.st_mtim.tv_sec == right_stat.st_mtim.tv_sec && left_stat.st_mtim.tv_nsec > right_stat.st_mtim.tv_nsec));
+        }
+        if(operator[1] == 'o'){
+            return right_exists && (!left_exists || left_stat.st_mtim.tv_sec < right_stat.st_mtim.tv_sec
+                   || (left_stat.st_mtim.tv_sec == right_stat.st_mtim.tv_sec && left_stat.st_mtim.tv_nsec < right_stat.st_mtim.tv_nsec));
+        }
+        return left_exists && right_exists && left_stat.st_dev == right_stat.st_dev && left_stat.st_ino == right_stat.st_ino;
+    }
+
+    /********************************************************************
+    Integer comparisons
+    ********************************************************************/
+    if(strcmp(operator, "-eq") == 0){
+        return test_number(state, left) == test_number(state, right);
+    }else if(strcmp(operator, "-ne") == 0){
+        return test_number(state, left) != test_number(state, right);
+    }else if(strcmp(operator, "-lt") == 0){
+        return test_number(state, left) < test_number(state, right);
+    }else if(strcmp(operator, "-le") == 0){
+        return test_number(state, left) <= test_number(state, right);
+    }else if(strcmp(operator, "-gt") == 0){
+        return test_number(state, left) > test_number(state, right);
+    }
+    return test_number(state, left) >= test_number(state, right);
+}
+
+/**
+ * Evaluates -operator word
+ */
+static int test_unary(char operator, char* word){
+    struct stat info;
+
+    switch(operator){
+        case 'z': return word[0] == '\0';
+        case 'n': return word[0] != '\0';
+        case 't': return isatty(atoi(word));
+        case 'r': return access(word, R_OK) == 0;
+        case 'w': return access(word, W_OK) == 0;
+        case 'x': return access(word, X_OK) == 0;
+        case 'h':
+        case 'L': return lstat(word, &info) == 0 && S_ISLNK(info.st_mode);
+    }
+
+    if(stat(word, &info) == -1){
+        return 0;
+    }
+    switch(operator){
+        case 'b': return S_ISBLK(info.st_mode);
+        case 'c': return S_ISCHR(info.st_mode);
+        case 'd': return S_ISDIR(info.st_mode);
+        case 'f': return S_ISREG(info.st_mode);
+        case 'g': return (info.st_mode & S_ISGID) != 0;
+        case 'k': return (info.st_mode & S_ISVTX) != 0;
+        case 'p': return S_ISFIFO(info.st_mode);
+        case 's': return info.st_size > 0;
+        case 'S': return S_ISSOCK(info.st_mode);
+        case 'u': return (info.st_mode & S_ISUID) != 0;
+        case 'O': return info.st_uid == geteuid();
+        case 'G': return info.st_gid == getegid();
+    }
+    return 1; //-e
+}
+
+/**
+ * primary := ( expression ) | word operator word | -operator word | word
+ */
+static int test_primary(struct test_state* state){
+    char** args = state->args;
+    int pos = state->pos;
+    int result;
+
+    if(pos >= state->end){
+        fprintf(stderr, "bcsh: test: argument expected\n");
+        state->error = 1;
+        return 0;
+    }
+
+    /********************************************************************
+    A binary operator in the middle wins, so that test -n = -n compares
+    ********************************************************************/
+    if(pos + 2 < state->end && is_binary_operator(args[pos + 1])){
+        state->pos += 3;
+        return test_binary(state, args[pos], args[pos + 1], args[pos + 2]);
+    }
+
+    if(strcmp(args[pos], "(") == 0 && pos + 1 < state->end){
+        state->pos++;
+        result = test_or(state);
+        if(state->pos >= state->end || strcmp(args[state->pos], ")") != 0){
+            fprintf(stderr, "bcsh: test: ')' expected\n");
+            state->error = 1;
+            return 0;
+        }
+        state->pos++;
+        return result;
+    }
+
+    if(is_unary_operator(args[pos]) && pos + 1 < state->end){
+        state->pos += 2;
+        return test_unary(args[pos][1], args[pos + 1]);
+    }
+
+    state->pos++;
+    return args[pos][0] != '\0';
+}
+
+/**
+ * not := ! not | primary
+ */
+static int test_not(struct test_state* state){
+    if(strcmp(state->args[state->pos], "!") == 0 && state->pos + 1 < state->end){
+        state->pos++;
+        return !test_not(state);
+    }
+    return test_primary(state);
+}
+
+/**
+ * and := not [-a and]
+ */
+static int test_and(struct test_state* state){
+    int result = test_not(state);
+
+    while(state->pos < state->end && strcmp(state->args[state->pos], "-a") == 0){
+        state->pos++;
+        result = test_not(state) && result;
+    }
+    return result;
+}
+
+/**
+ * or := and [-o or]
+ */
+static int test_or(struct test_state* state){
+    int result = test_and(state);
+
+    while(state->pos < state->end && strcmp(state->args[state->pos], "-o") == 0){
+        state->pos++;
+        result = test_and(state) || result;
+    }
+    return result;
+}
+
+/**
+ * This function evaluates a conditional expression (test and [), as in POSIX: file tests
+ *  (-e -f -d -r -w -x -s -L ...), string tests (-z -n = != < >), integer comparisons
+ *  (-eq -ne -lt -le -gt -ge), file comparisons (-nt -ot -ef), !, -a, -o and parentheses.
+ * @return 0 if the expression is true, 1 if it is false, 2 on an error
+ */
+int test_internal(char** tokens){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct test_state state;
+    int result;
+
+    state.args = &tokens[1];
+    state.pos = 0;
+    state.end = 0;
+    state.error = 0;
+    while(state.args[state.end] != NULL){
+        state.end++;
+    }
+
+    /********************************************************************
+    [ must be closed by ]
+    ********************************************************************/
+    if(strcmp(tokens[0], "[") == 0){
+        if(state.end == 0 || strcmp(state.args[state.end - 1], "]") != 0){
+            fprintf(stderr, "bcsh: [: missing ]\n");
+            return 2;
+        }
+        state.end--;
+    }
+
+    if(state.end == 0){
+        return EXIT_FAILURE;
+    }
+
+    result = test_or(&state);
+    if(!state.error && state.pos < state.end){
+        fprintf(stderr, "bcsh: test: %s: unexpected argument\n", state.args[state.pos]);
+        state.error = 1;
+    }
+    if(state.error){
+        return 2;
+    }
+    return result ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/****************************************************************************
+ * printf
+ ****************************************************************************/
+
+/**
+ * Turns an argument of a numeric conversion into a number. 'c and "c give the value of
+ *  the character c.
+ * @param failed Set to 1 if the argument is not a number
+ */
+static long long printf_number(char* word, int* failed){
+    char* end;
+    long long value;
+
+    if(word[0] == '\'' || word[0] == '"'){
+        return (unsigned char)word[1];
+    }
+    errno = 0;
+    value = strtoll(word, &end, 0);
+    if(end == word || *end != '\0' || errno != 0){
+        //Numbers above LLONG_MAX are still fine for %u and %x
+        errno = 0;
+        value = (long long)strtoull(word, &end, 0);
+        if(end == word || *end != '\0' || errno != 0){
+            fprintf(stderr, "bcsh: printf: %s: invalid number\n", word);
+            *failed = 1;
+        }
+    }
+    return value;
+}
+
+/**
+ * This function prints its arguments according to a format, as in POSIX printf: %d %i
+ *  %u %o %x %X %c %s %b %f %e %g %a %% with flags, width and precision (* takes them from
+ *  the arguments), and backslash escapes. The format is reused until every argument was
+ *  printed.
+ * @return 0, or 1 if an argument was not a valid number
+ */
+int printf_internal(char** tokens){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    char spec[64];
+    char* format;
+    char* start;
+    char* arg;
+    int next = 2;
+    int spec_length;
+    int failed = 0;
+    int stop = 0;
+    int star;
+    int stars[2];
+    int num_stars;
+    char conversion;
+
+    if(tokens[1] == NULL){
+        fprintf(stderr, "bcsh: printf: usage: printf format [arguments]\n");
+        return 2;
+    }
+
+    do{
+        for(format = tokens[1]; *format != '\0' && !stop; format++){
+            if(*format == '\\'){
+                format += print_escape(format + 1, 0, &stop);
+                continue;
+            }
+            if(*format != '%'){
+                putchar(*format);
+                continue;
+            }
+            if(format[1] == '%'){
+                putchar('%');
+                format++;
+                continue;
+            }
+
+            /********************************************************************
+            Copy the conversion specification, taking * widths and
+                precisions from the arguments
+            ********************************************************************/
+            start = format++;
+            num_stars = 0;
+            while(*format != '\0' && strchr("-+ #0123456789.*", *format) != NULL){
+                if(*format == '*'){
+                    star = (tokens[next] != NULL) ? (int)printf_number(tokens[next++], &failed) : 0;
+                    if(num_stars < 2){
+                        stars[num_stars++] = star;
+                    }
+                }
+                format++;
+            }
+            conversion = *format;
+            spec_length = format - start + 1;
+            if(conversion == '\0' || spec_length > (int)sizeof(spec) - 4){
+                fprintf(stderr, "bcsh: printf: %s: invalid format\n", start);
+                return EXIT_FAILURE;
+            }
+
+            arg = (tokens[next] != NULL) ? tokens[next++] : NULL;
+
+            switch(conversion){
+                case 'd':
+                case 'i':
+                    memcpy(spec, start, spec_length - 1);
+                    strcpy(spec + spec_length - 1, "lld");
+                    break;
+                case 'u':
+                case 'o':
+                case 'x':
+                case 'X':
+                    memcpy(spec, start, spec_length - 1);
+                    spec[spec_length - 1] = 'l';
+                    spec[spec_length] = 'l';
+                    spec[spec_length + 1] = conversion;
+                    spec[spec_length + 2] = '\0';
+                    break;
+                default:
+                    memcpy(spec, start, spec_length);
+                    spec[spec_length] = '\0';
+            }
+
+            switch(conversion){
+                case 'd':
+                case 'i':
+                case 'u':
+                case 'o':
+                case 'x':
+                case 'X':
+                    if(num_stars == 2){
+                        printf(spec, stars[0], stars[1], (arg != NULL) ? printf_number(arg, &failed) : 0LL);
+                    }else if(num_stars == 1){
+                        printf(spec, stars[0], (arg != NULL) ? printf_number(arg, &failed) : 0LL);
+                    }else{
+                        printf(spec, (arg != NULL) ? printf_number(arg, &failed) : 0LL);
+                    }
+                    break;
+                case 'f':
+                case 'F':
+                case 'e':
+                case 'E':
+                case 'g':
+                case 'G':
+                case 'a':
+                case 'A':
+                    if(num_stars == 2){
+                        printf(spec, stars[0], stars[1], (arg != NULL) ? strtod(arg, NULL) : 0.0);
+                    }else if(num_stars == 1){
+                        printf(spec, stars[0], (arg != NULL) ? strtod(arg, NULL) : 0.0);
+                    }else{
+                        printf(spec, (arg != NULL) ? strtod(arg, NULL) : 0.0);
+                    }
+                    break;
+                case 'c':
+                    if(arg != NULL && arg[0] != '\0'){
+                        putchar(arg[0]);
+                    }
+                    break;
+                case 's':
+                    if(num_stars == 2){
+                        printf(spec, stars[0], stars[1], (arg != NULL) ? arg : "");
+                    }else if(num_stars == 1){
+                        printf(spec, stars[0], (arg != NULL) ? arg : "");
+                    }else{
+                        printf(spec, (arg != NULL) ? arg : "");
+                    }
+                    break;
+                case 'b':
+                    if(arg != NULL){
+                        stop = print_escaped(arg);
+                    }
+                    break;
+                default:
+                    fprintf(stderr, "bcsh: printf: %%%c: invalid conversion\n", conversion);
+                    return EXIT_FAILURE;
+            }
+        }
+    }while(!stop && next > 2 && tokens[next] != NULL);
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/****************************************************************************
+ * cat, tee and cp
+ ****************************************************************************/
+
+/**
+ * Checks if a descriptor is the same regular file as another one, like cat f >> f
+ */
+static int same_file(int fd, struct stat* other){
+    struct stat file_stat;
+
+    return fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode)
+           && file_stat.st_dev == other->st_dev && file_stat.st_ino == other->st_ino;
+}
+
+/**
+ * This function copies its files (or stdin, also given as -) to stdout. The bytes are
+ *  moved by the kernel (see copy_fd()), so cat file | ... costs no copy through user
+ *  space. Options other than -u run the real cat.
+ */
+int cat_internal(char** tokens){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct stat out_stat;
+    int status = EXIT_SUCCESS;
+    int fd;
+    int result;
+    int i = 1;
+
+    while(tokens[i] != NULL && tokens[i][0] == '-' && tokens[i][1] != '\0'){
+        if(strcmp(tokens[i], "--") == 0){
+            i++;
+            break;
+        }
+        if(strcmp(tokens[i], "-u") != 0){
+            return execute_external(tokens);
+        }
+        i++;
+    }
+
+    fflush(stdout);
+    if(fstat(STDOUT_FILENO, &out_stat) == -1){
+        fprintf(stderr, "bcsh: cat: write error: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    do{
+        if(tokens[i] == NULL || strcmp(tokens[i], "-") == 0){
+            fd = STDIN_FILENO;
+        }else{
+            fd = open(tokens[i], O_RDONLY | O_CLOEXEC);
+            if(fd == -1){
+                fprintf(stderr, "bcsh: cat: %s: %s\n", tokens[i], strerror(errno));
+                status = EXIT_FAILURE;
+                continue;
+            }
+        }
+
+        if(S_ISREG(out_stat.st_mode) && same_file(fd, &out_stat)){
+            fprintf(stderr, "bcsh: cat: %s: input file is output file\n", (fd == STDIN_FILENO) ? "-" : tokens[i]);
+            status = EXIT_FAILURE;
+            result = COPY_OK;
+        }else{
+            result = copy_fd(fd, STDOUT_FILENO);
+        }
+        if(result == COPY_READ_ERROR){
+            fprintf(stderr, "bcsh: cat: %s: %s\n", (fd == STDIN_FILENO) ? "-" : tokens[i], strerror(errno));
+            status = EXIT_FAILURE;
+        }
+        if(fd != STDIN_FILENO){
+            close(fd);
+        }
+        if(result == COPY_WRITE_ERROR){
+            fprintf(stderr, "bcsh: cat: write error: %s\n", strerror(errno));
+            return EXIT_FAILURE;
+        }
+    }while(tokens[i] != NULL && tokens[++i] != NULL);
+
+    return status;
+}
+
+/**
+ * This function copies stdin to stdout and to every file given, truncating them, or
+ *  appending to them with -a. With stdin and stdout being pipes, the bytes are duplicated
+ *  by the kernel (see tee_fds()). Other options run the real tee.
+ */
+int tee_internal(char** tokens){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+    int status = EXIT_SUCCESS;
+    char** names;
+    int* outs;
+    int* failed;
+    int num_outs = 1;
+    int i = 1;
+
+    while(tokens[i] != NULL && tokens[i][0] == '-' && tokens[i][1] != '\0'){
+        if(strcmp(tokens[i], "--") == 0){
+            i++;
+            break;
+        }
+        if(strcmp(tokens[i], "-a") != 0){
+            return execute_external(tokens);
+        }
+        flags = O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC;
+        i++;
+    }
+
+    /********************************************************************
+    Output 0 is stdout, then every file that could be opened
+    ********************************************************************/
+    for(num_outs = 1; tokens[i + num_outs - 1] != NULL; num_outs++);
+    names = arena_alloc(&line_arena, num_outs * sizeof(char*));
+    outs = arena_alloc(&line_arena, num_outs * sizeof(int));
+    failed = arena_alloc(&line_arena, num_outs * sizeof(int));
+
+    names[0] = "standard output";
+    outs[0] = STDOUT_FILENO;
+    num_outs = 1;
+    for(; tokens[i] != NULL; i++){
+        outs[num_outs] = open(tokens[i], flags, 0666);
+        if(outs[num_outs] == -1){
+            fprintf(stderr, "bcsh: tee: %s: %s\n", tokens[i], strerror(errno));
+            status = EXIT_FAILURE;
+            continue;
+        }
+        names[num_outs++] = tokens[i];
+    }
+
+    fflush(stdout);
+    if(tee_fds(STDIN_FILENO, outs, num_outs, failed) == COPY_READ_ERROR){
+        fprintf(stderr, "bcsh: tee: read error: %s\n", strerror(errno));
+        status = EXIT_FAILURE;
+    }
+
+    for(i = 0; i < num_outs; i++){
+        if(failed[i] != 0){
+            fprintf(stderr, "bcsh: tee: %s: %s\n", names[i], strerror(failed[i]));
+            status = EXIT_FAILURE;
+        }
+        if(i > 0){
+            close(outs[i]);
+        }
+    }
+    return status;
+}
+
+/**
+ * Copies one file for cp, with copy_file_range() when both are on a file system that
+ *  supports it (a reflink or a copy inside the kernel)
+ * @param force Remove a destination that cannot be opened, then try again (-f)
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int copy_file(char* source, char* destination, int force){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct stat source_stat;
+    int in;
+    int out;
+    int result;
+
+    in = open(source, O_RDONLY | O_CLOEXEC);
+    if(in == -1){
+        fprintf(stderr, "bcsh: cp: %s: %s\n", source, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    fstat(in, &source_stat);
+    if(S_ISDIR(source_stat.st_mode)){
+        fprintf(stderr, "bcsh: cp: -r not specified; omitting directory '%s'\n", source);
+        close(in);
+        return EXIT_FAILURE;
+    }
+
+    out = open(destination, O_WRONLY | O_CREAT | O_CLOEXEC, source_stat.st_mode & 0777);
+    if(out == -1 && force && unlink(destination) == 0){
+        out = open(destination, O_WRONLY | O_CREAT | O_CLOEXEC, source_stat.st_mode & 0777);
+    }
+    if(out == -1){
+        fprintf(stderr, "bcsh: cp: %s: %s\n", destination, strerror(errno));
+        close(in);
+        return EXIT_FAILURE;
+    }
+
+    /********************************************************************
+    Only truncate once we know it is not the source itself
+    ********************************************************************/
+    if(same_file(out, &source_stat)){
+        fprintf(stderr, "bcsh: cp: '%s' and '%s' are the same file\n", source, destination);
+        close(in);
+        close(out);
+        return EXIT_FAILURE;
+    }
+    ftruncate(out, 0);
+
+    result = copy_fd(in, out);
+    if(result != COPY_OK){
+        fprintf(stderr, "bcsh: cp: %s: %s\n", (result == COPY_READ_ERROR) ? source : destination, strerror(errno));
+    }
+    close(in);
+    if(close(out) == -1 && result == COPY_OK){
+        fprintf(stderr, "bcsh: cp: %s: %s\n", destination, strerror(errno));
+        result = COPY_WRITE_ERROR;
+    }
+    return (result == COPY_OK) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * This function copies a file to another (cp source destination), or files into a
+ *  directory (cp source... directory). The copy is done by the kernel (see copy_fd()).
+ *  Options other than -f (-r, -p, -a...) run the real cp.
+ */
+int cp_internal(char** tokens){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct stat target_stat;
+    char* target;
+    char* base;
+    char* path;
+    int status = EXIT_SUCCESS;
+    int force = 0;
+    int count;
+    int i = 1;
+
+    while(tokens[i] != NULL && tokens[i][0] == '-' && tokens[i][1] != '\0'){
+        if(strcmp(tokens[i], "--") == 0){
+            i++;
+            break;
+        }
+        if(strcmp(tokens[i], "-f") != 0){
+            return execute_external(tokens);
+        }
+        force = 1;
+        i++;
+    }
+
+    for(count = 0; tokens[i + count] != NULL; count++);
+    if(count < 2){
+        fprintf(stderr, "bcsh: cp: missing %s operand\n", (count == 0) ? "file" : "destination file");
+        return EXIT_FAILURE;
+    }
+    target = tokens[i + count - 1];
+
+    if(stat(target, &target_stat) == -1 || !S_ISDIR(target_stat.st_mode)){
+        if(count > 2){
+            fprintf(stderr, "bcsh: cp: target '%s' is not a directory\n", target);
+            return EXIT_FAILURE;
+        }
+        return copy_file(tokens[i], target, force);
+    }
+
+    /********************************************************************
+    Copy each source into the directory, under its own name
+    ********************************************************************/
+    for(; tokens[i + 1] != NULL; i++){
+        base = strrchr(tokens[i], '/');
+        base = (base == NULL) ? tokens[i] : base + 1;
+        path = arena_alloc(&line_arena, strlen(target) + strlen(base) + 2);
+        sprintf(path, "%s/%s", target, base);
+        if(copy_file(tokens[i], path, force) != EXIT_SUCCESS){
+            status = EXIT_FAILURE;
+        }
+    }
+    return status;
+}
@@ -0,0 +1,233 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh_functions.c
+ * * * * * * * * * * * * * * * * * * *
+ * A function is defined by copying the
+ *  tree its body was parsed into out of
+ *  the line arena, into an arena of its
+ *  own, so every call runs the same tree
+ *  without reading the body again
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/bcsh_constants.h"
+#include "../include/bcsh_arena.h"
+#include "../include/bcsh_parser.h"
+#include "../include/bcsh_functions.h"
+
+/**
+ * Every function defined, most recent first. Scripts define a handful, so a list is
+ *  enough, and commands only look at it once there is one.
+ */
+static struct function* functions = NULL;
+
+static struct pipeline* copy_list(struct arena* arena, struct pipeline* list);
+
+/**
+ * Copies a string into the function's arena, NULL staying NULL
+ */
+static char* copy_string(struct arena* arena, char* string){
+    return (string != NULL) ? arena_strdup(arena, string) : NULL;
+}
+
+/**
+ * Copies a group of words and their expansions
+ * @param expansions Set to the copy of the expansions, NULL if there are none
+ * @return The copy of the words, null terminated
+ */
+static char** copy_words(struct arena* arena, char** words, char** expansions, int count, char*** copied){
+    char** copy = arena_alloc(arena, (count + 1) * sizeof(char*));
+    int i;
+
+    *copied = NULL;
+    if(expansions != NULL){
+        *copied = arena_alloc(arena, (count + 1) * sizeof(char*));
+    }
+    for(i = 0; i < count; i++){
+        copy[i] = copy_string(arena, words[i]);
+        if(expansions != NULL){
+            (*copied)[i] = copy_string(arena, expansions[i]);
+        }
+    }
+    copy[count] = NULL;
+    return copy;
+}
+
+static struct redirection* copy_redirections(struct arena* arena, struct redirection* redirection){
+    struct redirection* copy;
+
+    if(redirection == NULL){
+        return NULL;
+    }
+    copy = arena_alloc(arena, sizeof(struct redirection));
+    *copy = *redirection;
+    copy->target = copy_string(arena, redirection->target);
+    copy->expansion = copy_string(arena, redirection->expansion);
+    if(redirection->body != NULL){
+        copy->body = arena_alloc(arena, redirection->length + 1);
+        memcpy(copy->body, redirection->body, redirection->length + 1);
+    }
+    copy->next = copy_redirections(arena, redirection->next);
+    return copy;
+}
+
+static struct command* copy_command(struct arena* arena, struct command* command);
+
+static struct compound* copy_compound(struct arena* arena, struct compound* compound){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct compound* copy = arena_alloc(arena, sizeof(struct compound));
+    struct case_item* item;
+    struct case_item** tail = &copy->items;
+
+    *copy = *compound;
+    copy->condition = copy_list(arena, compound->condition);
+    copy->body = copy_list(arena, compound->body);
+    copy->else_body = copy_list(arena, compound->else_body);
+    copy->name = copy_string(arena, compound->name);
+    if(compound->words != NULL){
+        copy->words = copy_words(arena, compound->words, compound->expansions, compound->num_words, &copy->expansions);
+    }
+    for(item = compound->items; item != NULL; item = item->next){
+        *tail = arena_alloc(arena, sizeof(struct case_item));
+        (*tail)->patterns = copy_words(arena, item->patterns, item->expansions, item->num_patterns, &(*tail)->expansions);
+        (*tail)->num_patterns = item->num_patterns;
+        (*tail)->body = copy_list(arena, item->body);
+        tail = &(*tail)->next;
+    }
+    *tail = NULL;
+    if(compound->function != NULL){
+        copy->function = copy_command(arena, compound->function);
+    }
+    return copy;
+}
+
+/**
+ * Copies a command. Its assignments and argv stay one array, as the parser made them.
+ */
+static struct command* copy_command(struct arena* arena, struct command* command){
+    struct command* copy = arena_alloc(arena, sizeof(struct command));
+
+    *copy = *command;
+    copy->assignments = copy_words(arena, command->assignments, command->expansions,
+                                   command->num_assignments + command->argc, &copy->expansions);
+    copy->argv = copy->assignments + command->num_assignments;
+    copy->redirections = copy_redirections(arena, command->redirections);
+    if(command->compound != NULL){
+        copy->compound = copy_compound(arena, command->compound);
+    }
+    copy->next = NULL;
+    return copy;
+}
+
+static struct pipeline* copy_list(struct arena* arena, struct pipeline* list){
+    struct pipeline* copy;
+    struct command* command;
+    struct command** tail;
+
+    if(list == NULL){
+        return NULL;
+    }
+    copy = arena_alloc(arena, sizeof(struct pipeline));
+    *copy = *list;
+    if(list->text != NULL){
+        copy->text = arena_alloc(arena, list->text_length);
+        memcpy(copy->text, list->text, list->text_length);
+    }
+    tail = &copy->commands;
+    for(command = list->commands; command != NULL; command = command->next){
+        *tail = copy_command(arena, command);
+        tail = &(*tail)->next;
+    }
+    copy->next = copy_list(arena, list->next);
+    return copy;
+}
+
+/**
+ * Lets go of a function's memory
+ */
+static void function_free(struct function* function){
+    arena_release(&function->arena);
+    free(function->name);
+    free(function);
+}
+
+/**
+ * Defines a function, or defines it again. Its body is copied, since the tree it comes
+ *  from goes away with the line. A function defined again while it runs keeps its old
+ *  body until that call returns.
+ * @param body The compound command that is its body
+ */
+void function_define(char* name, struct command* body){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct function** link;
+    struct function* old;
+    struct function* function = malloc(sizeof(struct function));
+
+    if(function == NULL || (function->name = strdup(name)) == NULL){
+        fprintf(stderr, "Error in function_define() : Could not allocate space for function\n");
+        exit(EXIT_FAILURE);
+    }
+    memset(&function->arena, 0, sizeof(struct arena));
+    function->body = copy_command(&function->arena, body);
+    function->calls = 0;
+    function->replaced = 0;
+
+    for(link = &functions; *link != NULL; link = &(*link)->next){
+        if(strcmp((*link)->name, name) == 0){
+            old = *link;
+            *link = old->next;
+            if(old->calls == 0){
+                function_free(old);
+            }else{
+                old->replaced = 1;
+            }
+            break;
+        }
+    }
+    function->next = functions;
+    functions = function;
+}
+
+/**
+ * Finds a function by name
+ * @return The function, NULL if there is none with that name
+ */
+struct function* function_find(char* name){
+    struct function* function;
+
+    for(function = functions; function != NULL; function = function->next){
+        if(strcmp(function->name, name) == 0){
+            return function;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Keeps a function's body while it is being called
+ */
+void function_hold(struct function* function){
+    function->calls++;
+}
+
+/**
+ * Ends a call of a function, freeing it if it was defined again meanwhile
+ */
+void function_release(struct function* function){
+    function->calls--;
+    if(function->replaced && function->calls == 0){
+        function_free(function);
+    }
+}
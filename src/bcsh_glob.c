@@ -0,0 +1,954 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh_glob.c
+ * * * * * * * * * * * * * * * * * * *
+ * Word expansion: $ references are
+ *  replaced by the values of variables,
+ *  then pathnames are expanded. Each
+ *  component of a pattern is compiled
+ *  once, then every
+ *  entry of the directories it applies
+ *  to, read in bulk with getdents64(),
+ *  is checked against its fixed prefix
+ *  and suffix before the matcher runs
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../include/bcsh_constants.h"
+#include "../include/bcsh_arena.h"
+#include "../include/bcsh_dir.h"
+#include "../include/bcsh_parser.h"
+#include "../include/bcsh_execution.h"
+#include "../include/bcsh_jobs.h"
+#include "../include/bcsh_vars.h"
+#include "../include/bcsh_glob.h"
+
+/**
+ * What one element of a compiled pattern matches
+ */
+#define GLOB_CHAR 0 //One given character
+#define GLOB_ANY 1 //?, any one character
+#define GLOB_STAR 2 //*, any run of characters
+#define GLOB_CLASS 3 //[...], one character of a set
+
+struct glob_token {
+    unsigned char type;
+    unsigned char c; //The character of GLOB_CHAR
+    uint64_t* set; //The 256 bits of GLOB_CLASS
+};
+
+/**
+ * A component of a pattern (the part between two /), compiled. Most patterns start or
+ *  end with plain characters (src*, *.log), so entries are first compared to those with
+ *  memcmp(), and the matcher only runs on the ones that pass.
+ */
+struct glob_component {
+    char* literal; //The component without its escapes, if it has no wildcard
+    struct glob_token* tokens;
+    int num_tokens;
+    char prefix[GLOB_FIXED_LENGTH]; //The characters before the first wildcard
+    size_t prefix_length;
+    char suffix[GLOB_FIXED_LENGTH]; //The characters after the last *, if only characters follow it
+    size_t suffix_length;
+    int first_wildcard; //Token the matcher starts from, after the prefix
+};
+
+/**
+ * The words a command expands to, before they become its new argv. The array is kept
+ *  from one expansion to the next and only ever doubles, so even a million matches
+ *  cost a handful of reallocations.
+ */
+static char** words = NULL;
+static size_t num_words = 0;
+static size_t words_capacity = 0;
+
+/**
+ * The path being built while walking the directories of a pattern
+ */
+static char* path = NULL;
+static size_t path_capacity = 0;
+
+static void add_word(char* word){
+    char** grown;
+
+    if(num_words == words_capacity){
+        words_capacity = (words_capacity == 0) ? GLOB_INITIAL_WORDS : words_capacity * 2;
+        grown = realloc(words, words_capacity * sizeof(char*));
+        if(grown == NULL){
+            fprintf(stderr, "Error in add_word() : Could not reallocate space for words\n");
+            exit(EXIT_FAILURE);
+        }
+        words = grown;
+    }
+    words[num_words++] = word;
+}
+
+/**
+ * Makes room in the path for length more bytes and a null terminator
+ */
+static void path_reserve(size_t length){
+    char* grown;
+
+    if(length + 1 <= path_capacity){
+        return;
+    }
+    while(path_capacity < length + 1){
+        path_capacity = (path_capacity == 0) ? GLOB_INITIAL_PATH : path_capacity * 2;
+    }
+    grown = realloc(path, path_capacity);
+    if(grown == NULL){
+        fprintf(stderr, "Error in path_reserve() : Could not reallocate space for path\n");
+        exit(EXIT_FAILURE);
+    }
+    path = grown;
+}
+
+/**
+ * Adds the characters of a [:name:] class to a set
+ * @return 0, or -1 if the name is not a class
+ */
+static int add_named_class(uint64_t* set, char* name, size_t length){
+    static const char* names[] = {"alnum", "alpha", "blank", "cntrl", "digit", "graph",
+                                  "lower", "print", "punct", "space", "upper", "xdigit"};
+    static int (*tests[])(int) = {isalnum, isalpha, isblank, iscntrl, isdigit, isgraph,
+                                  islower, isprint, ispunct, isspace, isupper, isxdigit};
+    int i;
+    int c;
+
+    for(i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++){
+        if(strlen(names[i]) == length && strncmp(names[i], name, length) == 0){
+            for(c = 0; c < 256; c++){
+                if(tests[i](c)){
+                    set[c / 64] |= (uint64_t)1 << (c % 64);
+                }
+            }
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Compiles a bracket expression: [abc], [a-z], [!abc] or [^abc], [[:digit:]]. A ] right
+ *  after the opening bracket (or its !) is one of the characters.
+ * @param pattern Right after the [
+ * @return Where the expression ends (after its ]), NULL if it is not closed, in which
+ *  case the [ is just a character
+ */
+static char* compile_class(char* pattern, struct glob_token* token){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    uint64_t* set = arena_alloc(&line_arena, 4 * sizeof(uint64_t));
+    char* p = pattern;
+    char* end;
+    int negate = 0;
+    int first;
+    int last;
+    int c;
+
+    memset(set, 0, 4 * sizeof(uint64_t));
+    if(*p == '!' || *p == '^'){
+        negate = 1;
+        p++;
+    }
+
+    do{
+        if(*p == '\0'){
+            return NULL;
+        }
+        if(p[0] == '[' && p[1] == ':' && (end = strstr(p + 2, ":]")) != NULL
+           && add_named_class(set, p + 2, end - p - 2) == 0){
+            p = end + 2;
+            continue;
+        }
+
+        if(*p == '\\' && p[1] != '\0'){
+            p++;
+        }
+        first = (unsigned char)*p++;
+        last = first;
+        if(p[0] == '-' && p[1] != ']' && p[1] != '\0'){
+            p++;
+            if(*p == '\\' && p[1] != '\0'){
+                p++;
+            }
+            last = (unsigned char)*p++;
+        }
+        for(c = first; c <= last; c++){
+            set[c / 64] |= (uint64_t)1 << (c % 64);
+        }
+    }while(*p != ']');
+
+    if(negate){
+        for(c = 0; c < 4; c++){
+            set[c] = ~set[c];
+        }
+    }
+    set[0] &= ~((uint64_t)1 << '/'); //A / is never matched by a pattern
+    token->type = GLOB_CLASS;
+    token->set = set;
+    return p + 1;
+}
+
+/**
+ * Compiles one component of a pattern
+ * @param pattern The component, null terminated, with backslash escapes
+ * @return 1 if it has wildcards, 0 if it is a plain name (only literal is set then)
+ */
+static int compile_component(char* pattern, struct glob_component* component){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    size_t length = strlen(pattern);
+    struct glob_token* tokens = arena_alloc(&line_arena, (length + 1) * sizeof(struct glob_token));
+    char* literal = arena_alloc(&line_arena, length + 1);
+    char* next;
+    int num_tokens = 0;
+    int wildcards = 0;
+    int last_star = -1;
+    int i;
+
+    while(*pattern != '\0'){
+        tokens[num_tokens].type = GLOB_CHAR;
+        if(*pattern == '*'){
+            tokens[num_tokens].type = GLOB_STAR;
+            pattern++;
+        }else if(*pattern == '?'){
+            tokens[num_tokens].type = GLOB_ANY;
+            pattern++;
+        }else if(*pattern == '[' && (next = compile_class(pattern + 1, &tokens[num_tokens])) != NULL){
+            pattern = next;
+        }else{
+            if(*pattern == '\\' && pattern[1] != '\0'){
+                pattern++;
+            }
+            tokens[num_tokens].c = *pattern++;
+        }
+
+        if(tokens[num_tokens].type == GLOB_CHAR){
+            literal[num_tokens - wildcards] = tokens[num_tokens].c;
+        }else{
+            wildcards++;
+        }
+        if(tokens[num_tokens].type == GLOB_STAR){
+            last_star = num_tokens;
+        }
+        num_tokens++;
+    }
+
+    component->literal = NULL;
+    if(wildcards == 0){
+        literal[num_tokens] = '\0';
+        component->literal = literal;
+        return 0;
+    }
+    component->tokens = tokens;
+    component->num_tokens = num_tokens;
+
+    /********************************************************************
+    Work out the fixed prefix and suffix
+    ********************************************************************/
+    for(i = 0; i < num_tokens && i < GLOB_FIXED_LENGTH && tokens[i].type == GLOB_CHAR; i++){
+        component->prefix[i] = tokens[i].c;
+    }
+    component->prefix_length = i;
+    component->first_wildcard = i;
+
+    component->suffix_length = 0;
+    if(last_star != -1){
+        for(i = last_star + 1; i < num_tokens && tokens[i].type == GLOB_CHAR; i++);
+        if(i == num_tokens && num_tokens - last_star - 1 <= GLOB_FIXED_LENGTH){
+            for(i = last_star + 1; i < num_tokens; i++){
+                component->suffix[component->suffix_length++] = tokens[i].c;
+            }
+        }
+    }
+    return 1;
+}
+
+/**
+ * Checks if one token matches a character
+ */
+static int token_matches(struct glob_token* token, unsigned char c){
+    switch(token->type){
+        case GLOB_CHAR:
+            return token->c == c;
+        case GLOB_ANY:
+            return 1;
+        default:
+            return (token->set[c / 64] >> (c % 64)) & 1;
+    }
+}
+
+/**
+ * Checks if a string matches a compiled pattern with wildcards. The matcher goes forward,
+ *  and when it gets stuck goes back to the last * and lets it take one more character; it
+ *  never goes further back than that, so it does not blow up on patterns like *a*a*a*b.
+ */
+static int tokens_match(struct glob_component* component, char* name, size_t length){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct glob_token* tokens = component->tokens;
+    int num_tokens = component->num_tokens;
+    int token;
+    int star_token = -1;
+    size_t star_position = 0;
+    size_t position;
+
+    if(length < component->prefix_length + component->suffix_length
+       || memcmp(name, component->prefix, component->prefix_length) != 0
+       || memcmp(name + length - component->suffix_length, component->suffix, component->suffix_length) != 0){
+        return 0;
+    }
+
+    token = component->first_wildcard;
+    position = component->prefix_length;
+    while(position < length){
+        if(token < num_tokens && tokens[token].type == GLOB_STAR){
+            star_token = ++token;
+            star_position = position;
+        }else if(token < num_tokens && token_matches(&tokens[token], name[position])){
+            token++;
+            position++;
+        }else if(star_token != -1){
+            token = star_token;
+            position = ++star_position;
+        }else{
+            return 0;
+        }
+    }
+    while(token < num_tokens && tokens[token].type == GLOB_STAR){
+        token++;
+    }
+    return token == num_tokens;
+}
+
+/**
+ * Checks if a name of a directory matches a compiled component. A name starting with a
+ *  dot only matches a pattern that starts with one.
+ */
+static int component_matches(struct glob_component* component, char* name, size_t length){
+    if(name[0] == '.' && !(component->prefix_length > 0 && component->prefix[0] == '.')){
+        return 0;
+    }
+    return tokens_match(component, name, length);
+}
+
+/**
+ * Checks if an entry of a directory, whose path is in path, is a directory itself,
+ *  following symbolic links
+ */
+static int entry_is_dir(unsigned char type){
+    struct stat entry_stat;
+
+    if(type == DT_DIR){
+        return 1;
+    }
+    if(type != DT_LNK && type != DT_UNKNOWN){
+        return 0;
+    }
+    return stat(path, &entry_stat) == 0 && S_ISDIR(entry_stat.st_mode);
+}
+
+/**
+ * What the visitor of a directory needs, and the names it kept
+ */
+struct glob_scan {
+    struct glob_component* component;
+    size_t path_length;
+    int last;
+    char** names; //Matches to descend into, when this is not the last component
+    size_t num_names;
+    size_t names_capacity;
+};
+
+/**
+ * Checks one entry of a directory. A match of the last component is a result; a match of
+ *  an earlier one that is a directory is kept, and descended into once the directory has
+ *  been read, since the read buffer is still in use until then.
+ */
+static void scan_entry(char* name, size_t length, unsigned char type, void* context){
+    struct glob_scan* scan = context;
+
+    if(!component_matches(scan->component, name, length)){
+        return;
+    }
+
+    path_reserve(scan->path_length + length + 1);
+    memcpy(path + scan->path_length, name, length + 1);
+    if(scan->last){
+        add_word(arena_strdup(&line_arena, path));
+        return;
+    }
+    if(!entry_is_dir(type)){
+        return;
+    }
+    if(scan->num_names == scan->names_capacity){
+        scan->names = arena_realloc(&line_arena, scan->names, scan->names_capacity * sizeof(char*),
+                                    (scan->names_capacity * 2 + 8) * sizeof(char*));
+        scan->names_capacity = scan->names_capacity * 2 + 8;
+    }
+    scan->names[scan->num_names++] = arena_strdup(&line_arena, name);
+}
+
+/**
+ * Expands the components of a pattern from one on, under the directory in path
+ * @param path_length Bytes of path in use: the directory so far, ending with a /, or
+ *  nothing for the working directory
+ */
+static void expand_components(struct glob_component* components, int num_components, int current, size_t path_length){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct glob_component* component = &components[current];
+    struct glob_scan scan = {component, path_length, (current == num_components - 1), NULL, 0, 0};
+    struct stat entry_stat;
+    size_t length;
+    size_t i;
+    int fd;
+
+    /********************************************************************
+    A plain component only needs adding to the path. If it is the last
+        one, the path has to exist.
+    ********************************************************************/
+    if(component->literal != NULL){
+        length = strlen(component->literal);
+        path_reserve(path_length + length + 1);
+        memcpy(path + path_length, component->literal, length);
+        path_length += length;
+        if(scan.last){
+            path[path_length] = '\0';
+            if(lstat(path, &entry_stat) == 0){
+                add_word(arena_strdup(&line_arena, path));
+            }
+            return;
+        }
+        path[path_length++] = '/';
+        expand_components(components, num_components, current + 1, path_length);
+        return;
+    }
+
+    /********************************************************************
+    Check every entry in the buffers getdents64() fills, a large batch
+        at a time, so only the names that match are ever copied
+    ********************************************************************/
+    path[path_length] = '\0';
+    fd = open((path_length == 0) ? "." : path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(fd == -1){
+        return;
+    }
+    dir_each(fd, scan_entry, &scan);
+    close(fd);
+
+    for(i = 0; i < scan.num_names; i++){
+        length = strlen(scan.names[i]);
+        path_reserve(path_length + length + 1);
+        memcpy(path + path_length, scan.names[i], length);
+        path[path_length + length] = '/';
+        expand_components(components, num_components, current + 1, path_length + length + 1);
+    }
+}
+
+/**
+ * Orders two words, for qsort()
+ */
+static int compare_words(const void* a, const void* b){
+    return strcmp(*(char**)a, *(char**)b);
+}
+
+/**
+ * Adds the paths a pattern matches to the words, sorted
+ * @return How many there are; 0 if none matched or the pattern has no wildcard after all
+ *  (like [ on its own)
+ */
+static size_t expand_pattern(char* pattern){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct glob_component* components;
+    char* copy = arena_strdup(&line_arena, pattern);
+    char* start = copy;
+    char* p;
+    size_t first = num_words;
+    size_t path_length = 0;
+    int num_components = 1;
+    int wildcards = 0;
+    int i;
+
+    for(p = copy; *p != '\0'; p++){
+        if(*p == '\\' && p[1] != '\0'){
+            p++;
+        }else if(*p == '/'){
+            num_components++;
+        }
+    }
+    components = arena_alloc(&line_arena, num_components * sizeof(struct glob_component));
+
+    /********************************************************************
+    Split the pattern at every /, which a wildcard never matches, and
+        compile each part. An absolute pattern starts from /.
+    ********************************************************************/
+    if(*copy == '/'){
+        path_reserve(1);
+        path[path_length++] = '/';
+        start++;
+        num_components--;
+    }
+    for(i = 0, p = start; i < num_components; i++){
+        start = p;
+        while(*p != '\0' && *p != '/'){
+            p += (*p == '\\' && p[1] != '\0') ? 2 : 1;
+        }
+        if(*p == '/'){
+            *p++ = '\0';
+        }
+        wildcards += compile_component(start, &components[i]);
+    }
+    if(wildcards == 0){
+        return 0;
+    }
+
+    path_reserve(path_length);
+    expand_components(components, num_components, 0, path_length);
+    qsort(words + first, num_words - first, sizeof(char*), compare_words);
+    return num_words - first;
+}
+
+/**
+ * The field being built while a word is expanded, as a glob pattern: what must only
+ *  match itself is escaped with a backslash
+ */
+static char* field = NULL;
+static size_t field_length = 0;
+static size_t field_capacity = 0;
+static int field_started = 0; //Even an empty field is a word, if it came from quotes
+static int field_glob = 0; //The field has a wildcard that is not escaped
+
+/**
+ * Makes room in the field for one more character and a null terminator
+ */
+static void field_reserve(){
+    char* grown;
+
+    if(field_length + 2 > field_capacity){
+        field_capacity = (field_capacity == 0) ? GLOB_INITIAL_PATH : field_capacity * 2;
+        grown = realloc(field, field_capacity);
+        if(grown == NULL){
+            fprintf(stderr, "Error in field_append() : Could not reallocate space for field\n");
+            exit(EXIT_FAILURE);
+        }
+        field = grown;
+    }
+}
+
+static void field_append(char c){
+    field_reserve();
+    field[field_length++] = c;
+    field_started = 1;
+}
+
+/**
+ * Ends the field being built, adding the paths it matches if it is a pattern, or the
+ *  field itself without its escapes
+ */
+static void field_finish(){
+    char* word;
+    size_t i;
+    size_t j = 0;
+
+    field_reserve();
+    field[field_length] = '\0';
+    if(!field_glob || expand_pattern(field) == 0){
+        word = arena_alloc(&line_arena, field_length + 1);
+        for(i = 0; i < field_length; i++){
+            if(field[i] == '\\'){
+                i++;
+            }
+            word[j++] = field[i];
+        }
+        word[j] = '\0';
+        add_word(word);
+    }
+    field_length = 0;
+    field_started = 0;
+    field_glob = 0;
+}
+
+/**
+ * Set while the pattern of a case is built: the wildcards of its values that are not
+ *  quoted work, but they are not split
+ */
+static int field_pattern = 0;
+
+/**
+ * Adds the value of a variable to the field. A value that is not quoted is split into
+ *  fields at blanks, and its wildcards work; a quoted one is kept whole and only
+ *  matches itself.
+ * @param split Split the value into fields
+ * @param wildcards Let the wildcards of the value work
+ */
+static void field_append_value(char* value, int split, int wildcards){
+    char c;
+
+    for(; (c = *value) != '\0'; value++){
+        if(split && (c == ' ' || c == '\t' || c == '\n')){
+            if(field_started){
+                field_finish();
+            }
+            continue;
+        }
+        if(c == '\\' || (!wildcards && (c == '*' || c == '?' || c == '[' || c == ']'))){
+            field_append('\\');
+        }else if(c == '*' || c == '?' || c == '['){
+            field_glob = 1;
+        }
+        field_append(c);
+    }
+}
+
+/**
+ * Gives the positional parameters joined by spaces, for $* and $@, in the line arena
+ */
+static char* joined_params(){
+    size_t length = 1;
+    char* joined;
+    char* end;
+    int i;
+
+    for(i = 0; i < num_positional_params; i++){
+        length += strlen(positional_params[i]) + 1;
+    }
+    joined = arena_alloc(&line_arena, length);
+    end = joined;
+    for(i = 0; i < num_positional_params; i++){
+        if(i > 0){
+            *end++ = ' ';
+        }
+        end = stpcpy(end, positional_params[i]);
+    }
+    *end = '\0';
+    return joined;
+}
+
+/**
+ * Gives the value of a reference: a variable, $? for the status of the last pipeline,
+ *  $$ for the pid of the shell, $! for the pid of the last background job, $0 for the
+ *  name of the shell, $1... for the positional parameters, $# for how many there are,
+ *  or $* and $@ for all of them
+ * @return The value, "" if the variable is not set
+ */
+static char* reference_value(char* name){
+    static char number[24];
+    char* value;
+
+    if(name[1] == '\0'){
+        switch(name[0]){
+            case '?':
+                snprintf(number, sizeof(number), "%d", last_status);
+                return number;
+            case '$':
+                snprintf(number, sizeof(number), "%d", (int)getpid());
+                return number;
+            case '!':
+                if(last_background_pid == 0){
+                    return "";
+                }
+                snprintf(number, sizeof(number), "%d", (int)last_background_pid);
+                return number;
+            case '#':
+                snprintf(number, sizeof(number), "%d", num_positional_params);
+                return number;
+            case '*':
+            case '@':
+                return joined_params();
+            case '0':
+                return shell_name;
+            default:
+                if(name[0] >= '1' && name[0] <= '9'){
+                    return (name[0] - '0' <= num_positional_params) ? positional_params[name[0] - '1'] : "";
+                }
+                break;
+        }
+    }
+    value = var_get(name);
+    return (value != NULL) ? value : "";
+}
+
+/**
+ * Runs a command substitution in the middle of expanding a word. Its command is
+ *  expanded too, with the same buffers, so the words and the field so far are put aside
+ *  meanwhile.
+ * @return The output of the command
+ */
+static char* substitute(char* command){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    char** saved_words = arena_alloc(&line_arena, (num_words + 1) * sizeof(char*));
+    char* saved_field = arena_alloc(&line_arena, field_length + 1);
+    size_t saved_num_words = num_words;
+    size_t saved_length = field_length;
+    int saved_started = field_started;
+    int saved_glob = field_glob;
+    int saved_pattern = field_pattern;
+    char* output;
+
+    memcpy(saved_words, words, num_words * sizeof(char*));
+    memcpy(saved_field, field, field_length);
+
+    field_pattern = 0;
+    output = execute_substitution(command);
+
+    /********************************************************************
+    The buffers only ever grow, so what was in them fits back
+    ********************************************************************/
+    memcpy(words, saved_words, saved_num_words * sizeof(char*));
+    memcpy(field, saved_field, saved_length);
+    num_words = saved_num_words;
+    field_length = saved_length;
+    field_started = saved_started;
+    field_glob = saved_glob;
+    field_pattern = saved_pattern;
+    return output;
+}
+
+/**
+ * Builds the field of a word: its $ references are replaced by their values and its
+ *  command substitutions by the output of their commands, and when split is set,
+ *  unquoted values are split into fields, each finished as it ends (and "$@" gives one
+ *  field per positional parameter). The last field is left in the buffer.
+ * @param expansion The expansion the parser made of the word, see word_expansion()
+ */
+static void build_field(char* expansion, int split){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    char* name;
+    char* end;
+    char c;
+    int i;
+
+    field_length = 0;
+    field_started = 0;
+    field_glob = 0;
+
+    while((c = *expansion) != '\0'){
+        if(c >= EXPAND_VARIABLE && c <= EXPAND_QUOTED_COMMAND){
+            name = expansion + 1;
+            end = strchr(name, EXPAND_END);
+            if(c == EXPAND_COMMAND || c == EXPAND_QUOTED_COMMAND){
+
+                /********************************************************************
+                The command gets a copy: running it may expand this same
+                    word again, in a function that calls itself
+                ********************************************************************/
+                name = arena_alloc(&line_arena, end - expansion);
+                memcpy(name, expansion + 1, end - expansion - 1);
+                name[end - expansion - 1] = '\0';
+                field_append_value(substitute(name), split && c == EXPAND_COMMAND,
+                                   (split || field_pattern) && c == EXPAND_COMMAND);
+                if(c == EXPAND_QUOTED_COMMAND){
+                    field_started = 1;
+                }
+                expansion = end + 1;
+                continue;
+            }
+            *end = '\0';
+            if(c == EXPAND_QUOTED_VARIABLE && name[0] == '@' && name[1] == '\0'){
+                for(i = 0; i < num_positional_params; i++){
+                    if(i > 0 && split){
+                        field_finish();
+                    }else if(i > 0){
+                        field_append(' ');
+                    }
+                    field_append_value(positional_params[i], 0, 0);
+                    field_started = 1;
+                }
+                *end = EXPAND_END;
+                expansion = end + 1;
+                continue;
+            }
+            field_append_value(reference_value(name), split && c == EXPAND_VARIABLE,
+                               (split || field_pattern) && c == EXPAND_VARIABLE);
+            *end = EXPAND_END;
+            if(c == EXPAND_QUOTED_VARIABLE){
+                field_started = 1;
+            }
+            expansion = end + 1;
+            continue;
+        }
+        if(c == '\\'){
+            field_append(c);
+            c = *++expansion;
+        }else if(split && (c == '*' || c == '?' || c == '[')){
+            field_glob = 1;
+        }
+        field_append(c);
+        expansion++;
+    }
+}
+
+/**
+ * Adds the words one word expands to (see build_field()). With split, the fields that
+ *  are patterns are replaced by the paths they match; without it, it is always one word.
+ */
+static void expand_word(char* expansion, int split){
+    build_field(expansion, split);
+    if(field_started || !split){
+        field_finish();
+    }
+}
+
+/**
+ * Expands a word that always stays one word, like an assignment or the word of a case
+ * @return The word, in the line arena
+ */
+char* expand_string(char* expansion){
+    num_words = 0;
+    expand_word(expansion, 0);
+    return words[0];
+}
+
+/**
+ * Expands a list of words the way the arguments of a command are: split into fields and
+ *  globbed
+ * @param expansions How to expand each word, NULL if none needs it
+ * @param count Set to how many words they expand to
+ * @return The words, null terminated, in the line arena
+ */
+char** expand_words(char** list, char** expansions, int num_list, int* count){
+    char** result;
+    int i;
+
+    num_words = 0;
+    for(i = 0; i < num_list; i++){
+        if(expansions == NULL || expansions[i] == NULL){
+            add_word(list[i]);
+        }else{
+            expand_word(expansions[i], 1);
+        }
+    }
+
+    result = arena_alloc(&line_arena, (num_words + 1) * sizeof(char*));
+    memcpy(result, words, num_words * sizeof(char*));
+    result[num_words] = NULL;
+    *count = num_words;
+    return result;
+}
+
+/**
+ * Checks if a string matches a pattern of a case command. Wildcards match any character,
+ *  dots and slashes included. A pattern with nothing to expand and no wildcard is
+ *  compared as it is.
+ * @param pattern The pattern as the parser left it
+ * @param expansion Its expansion, NULL if it has none
+ */
+int pattern_matches(char* string, char* pattern, char* expansion){
+    struct glob_component component;
+
+    if(expansion == NULL){
+        return strcmp(string, pattern) == 0;
+    }
+
+    /********************************************************************
+    The field is the pattern with what must only match itself escaped,
+        which is what compile_component() takes
+    ********************************************************************/
+    num_words = 0;
+    field_pattern = 1;
+    build_field(expansion, 0);
+    field_pattern = 0;
+    field_reserve();
+    field[field_length] = '\0';
+    if(compile_component(field, &component) == 0){
+        return strcmp(string, component.literal) == 0;
+    }
+    return tokens_match(&component, string, strlen(string));
+}
+
+/**
+ * Expands the words of a command when it is about to run: $ references are replaced by
+ *  the values of the variables, and glob patterns by the paths they match, sorted (a
+ *  pattern that matches nothing stays as it is). Assignments and the targets of
+ *  redirections are expanded too, but always stay one word. The command itself is not
+ *  changed, so a loop can expand it again on its next iteration: the result is a copy,
+ *  in the line arena, whose new argv is built once, at its final size.
+ * @return The expanded copy
+ */
+struct command* expand_command(struct command* command){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct command* expanded = arena_alloc(&line_arena, sizeof(struct command));
+    struct redirection* redirection;
+    struct redirection** tail;
+    char** assignments;
+    int i;
+
+    *expanded = *command;
+
+    /********************************************************************
+    The redirections are copied if one of them needs expanding, and
+        shared otherwise
+    ********************************************************************/
+    for(redirection = command->redirections; redirection != NULL && redirection->expansion == NULL;
+        redirection = redirection->next);
+    if(redirection != NULL){
+        tail = &expanded->redirections;
+        for(redirection = command->redirections; redirection != NULL; redirection = redirection->next){
+            *tail = arena_alloc(&line_arena, sizeof(struct redirection));
+            **tail = *redirection;
+            if(redirection->expansion != NULL){
+                (*tail)->target = expand_string(redirection->expansion);
+                (*tail)->expansion = NULL;
+            }
+            if(redirection->type == REDIR_HERESTRING && redirection->expansion != NULL){
+                (*tail)->length = strlen((*tail)->target) + 1;
+                (*tail)->body = arena_alloc(&line_arena, (*tail)->length + 1);
+                memcpy((*tail)->body, (*tail)->target, (*tail)->length - 1);
+                (*tail)->body[(*tail)->length - 1] = '\n';
+                (*tail)->body[(*tail)->length] = '\0';
+            }
+            tail = &(*tail)->next;
+        }
+    }
+
+    if(command->expansions == NULL){
+        return expanded;
+    }
+
+    /********************************************************************
+    The assignments go in front of the new argv, as the parser put them
+    ********************************************************************/
+    assignments = arena_alloc(&line_arena, (command->num_assignments + 1) * sizeof(char*));
+    for(i = 0; i < command->num_assignments; i++){
+        assignments[i] = (command->expansions[i] != NULL) ? expand_string(command->expansions[i]) : command->assignments[i];
+    }
+    expanded->assignments = assignments;
+    expanded->argv = expand_words(command->argv, command->expansions + command->num_assignments, command->argc,
+                                  &expanded->argc);
+    expanded->expansions = NULL;
+    return expanded;
+}
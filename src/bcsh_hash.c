@@ -0,0 +1,260 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh_hash.c
+ * * * * * * * * * * * * * * * * * * *
+ * The command hash table is implemented
+ *  here. Each command name is resolved
+ *  against $PATH once and the result
+ *  (found or not found) is remembered
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../include/bcsh_constants.h"
+#include "../include/bcsh_vars.h"
+
+struct hash_entry {
+    char* name;
+    char* path; //NULL if the command was not found (negative entry)
+    unsigned int hits;
+    time_t expires; //Only used by negative entries
+    struct hash_entry* next;
+};
+
+static struct hash_entry* hash_table[HASH_TABLE_SIZE];
+
+/**
+ * The value of $PATH that the table was filled against. If $PATH changes, every entry
+ *  is stale, so the table is cleared.
+ */
+static char* hashed_path_variable = NULL;
+
+/**
+ * Hashes a command name into a bucket index (FNV-1a)
+ * @param name The command name
+ * @return The bucket the name belongs to
+ */
+static unsigned int hash_name(char* name){
+    unsigned int hash = 2166136261u;
+    while(*name != '\0'){
+        hash ^= (unsigned char) *name;
+        hash *= 16777619u;
+        name++;
+    }
+    return hash % HASH_TABLE_SIZE;
+}
+
+/**
+ * Removes every entry from the table
+ */
+void hash_clear(){
+    int i;
+    struct hash_entry* entry;
+    struct hash_entry* next;
+
+    for(i = 0; i < HASH_TABLE_SIZE; i++){
+        entry = hash_table[i];
+        while(entry != NULL){
+            next = entry->next;
+            free(entry->name);
+            free(entry->path);
+            free(entry);
+            entry = next;
+        }
+        hash_table[i] = NULL;
+    }
+}
+
+/**
+ * Removes a single command from the table, if it is there
+ * @param command The command name to forget
+ */
+void hash_remove(char* command){
+    struct hash_entry** link = &hash_table[hash_name(command)];
+    struct hash_entry* entry;
+
+    while(*link != NULL){
+        entry = *link;
+        if(strcmp(entry->name, command) == 0){
+            *link = entry->next;
+            free(entry->name);
+            free(entry->path);
+            free(entry);
+            return;
+        }
+        link = &entry->next;
+    }
+}
+
+/**
+ * Clears the table if $PATH is not the value the table was filled against
+ */
+static void hash_check_path(){
+    char* path_variable = var_get("PATH");
+
+    if(path_variable == NULL){
+        path_variable = DEFAULT_PATH;
+    }
+    if(hashed_path_variable != NULL && strcmp(hashed_path_variable, path_variable) == 0){
+        return;
+    }
+
+    hash_clear();
+    free(hashed_path_variable);
+    hashed_path_variable = strdup(path_variable);
+    if(hashed_path_variable == NULL){
+        fprintf(stderr, "Error in hash_check_path() : Could not allocate space for PATH\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * Walks every directory in $PATH looking for an executable regular file called command.
+ *  This does not touch the table.
+ * @param command The command name, which must not contain a '/'
+ * @return A malloced absolute path to the command, NULL if it was not found
+ */
+char* hash_resolve(char* command){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    char* path_variable = var_get("PATH");
+    char* directory;
+    char* end;
+    char* candidate;
+    size_t directory_length;
+    size_t command_length = strlen(command);
+    struct stat info;
+
+    if(path_variable == NULL){
+        path_variable = DEFAULT_PATH;
+    }
+
+    /********************************************************************
+    Allocate one buffer big enough for any directory in $PATH, the '/',
+        the command and a null terminator
+    ********************************************************************/
+    candidate = malloc(strlen(path_variable) + command_length + 3);
+    if(candidate == NULL){
+        fprintf(stderr, "Error in hash_resolve() : Could not allocate space for candidate path\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /********************************************************************
+    Try each directory in turn. An empty entry means the current
+        directory.
+    ********************************************************************/
+    directory = path_variable;
+    while(1){
+        end = strchr(directory, ':');
+        directory_length = (end == NULL) ? strlen(directory) : (size_t) (end - directory);
+
+        if(directory_length == 0){
+            candidate[0] = '.';
+            directory_length = 1;
+        }else{
+            memcpy(candidate, directory, directory_length);
+        }
+        candidate[directory_length] = '/';
+        memcpy(candidate + directory_length + 1, command, command_length + 1);
+
+        if(stat(candidate, &info) == 0 && S_ISREG(info.st_mode) && access(candidate, X_OK) == 0){
+            return candidate;
+        }
+
+        if(end == NULL){
+            break;
+        }
+        directory = end + 1;
+    }
+
+    free(candidate);
+    return NULL;
+}
+
+/**
+ * Finds the absolute path of a command, resolving it against $PATH only if it is not
+ *  already in the table. Commands containing a '/' are returned as they are.
+ * @param command The command name
+ * @return The path to execute (owned by the table), NULL if the command was not found
+ */
+char* hash_lookup(char* command){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    unsigned int bucket;
+    struct hash_entry* entry;
+
+    if(strchr(command, '/') != NULL){
+        return command;
+    }
+
+    hash_check_path();
+
+    /********************************************************************
+    Check if the command is already in the table. Negative entries
+        expire so that newly installed commands are eventually found.
+    ********************************************************************/
+    bucket = hash_name(command);
+    for(entry = hash_table[bucket]; entry != NULL; entry = entry->next){
+        if(strcmp(entry->name, command) == 0){
+            if(entry->path == NULL && time(NULL) >= entry->expires){
+                hash_remove(command);
+                break;
+            }
+            entry->hits++;
+            return entry->path;
+        }
+    }
+
+    /********************************************************************
+    Otherwise walk $PATH and remember the result, even if the command
+        was not found
+    ********************************************************************/
+    entry = malloc(sizeof(struct hash_entry));
+    if(entry == NULL){
+        fprintf(stderr, "Error in hash_lookup() : Could not allocate space for hash entry\n");
+        exit(EXIT_FAILURE);
+    }
+    entry->name = strdup(command);
+    if(entry->name == NULL){
+        fprintf(stderr, "Error in hash_lookup() : Could not allocate space for hash entry\n");
+        exit(EXIT_FAILURE);
+    }
+    entry->path = hash_resolve(command);
+    entry->hits = 1;
+    entry->expires = time(NULL) + HASH_NEGATIVE_TTL;
+    entry->next = hash_table[bucket];
+    hash_table[bucket] = entry;
+
+    return entry->path;
+}
+
+/**
+ * Prints every entry in the table along with how many times it was used
+ */
+void hash_print(){
+    int i;
+    struct hash_entry* entry;
+
+    fprintf(stdout, "hits\tcommand\n");
+    for(i = 0; i < HASH_TABLE_SIZE; i++){
+        for(entry = hash_table[i]; entry != NULL; entry = entry->next){
+            if(entry->path != NULL){
+                fprintf(stdout, "%4u\t%s\n", entry->hits, entry->path);
+            }else{
+                fprintf(stdout, "%4u\t%s (not found)\n", entry->hits, entry->name);
+            }
+        }
+    }
+}
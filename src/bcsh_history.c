@@ -0,0 +1,332 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh_history.c
+ * * * * * * * * * * * * * * * * * * *
+ * The command history. Every session
+ *  appends its lines to the same file
+ *  and none ever rewrites it; they read
+ *  it through a shared mapping, and find
+ *  lines with a trigram index
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "../include/bcsh_constants.h"
+#include "../include/bcsh_history.h"
+
+/**
+ * The history file as this session sees it. The file only grows, by whole lines that
+ *  any session appends, so what was read of it stays valid: the offsets of the entries
+ *  and the index are only ever extended.
+ */
+static struct {
+    int fd;
+    char* map;
+    size_t mapped; //Bytes of the file in map
+    size_t* offsets; //Where each entry starts, plus where the next one will
+    long count; //Number of complete entries in map
+    long capacity;
+    uint64_t* blocks; //The trigram bitmap of each block of HISTORY_BLOCK_ENTRIES entries
+    unsigned char* block_indexed; //Whether the bitmap of each block was computed
+    long num_blocks; //Blocks there is room for in blocks
+} history = {-1, NULL, 0, NULL, 0, 0, NULL, NULL, 0};
+
+/**
+ * Opens the history file at $BCSH_HISTFILE, or ~/.bcsh_history. A shell that cannot
+ *  open it just has no history.
+ */
+void history_init(){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    char* path = getenv("BCSH_HISTFILE");
+    char* home;
+    char* default_path;
+
+    if(path != NULL){
+        history_open(path);
+        return;
+    }
+
+    home = getenv("HOME");
+    if(home == NULL){
+        return;
+    }
+    default_path = malloc(strlen(home) + strlen(HISTORY_FILE_NAME) + 2);
+    if(default_path == NULL){
+        fprintf(stderr, "Error in history_init() : Could not allocate space for path\n");
+        return;
+    }
+    sprintf(default_path, "%s/%s", home, HISTORY_FILE_NAME);
+    history_open(default_path);
+    free(default_path);
+}
+
+/**
+ * Opens a history file, creating it if needed. It is opened O_APPEND, so the lines of
+ *  every session land after each other, whole, without any locking.
+ * @return 0 on success, -1 on failure
+ */
+int history_open(char* path){
+    history.fd = open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    if(history.fd == -1){
+        fprintf(stderr, "bcsh: history: %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Appends a line to the history, with one write so it cannot be mixed with the lines of
+ *  other sessions. Empty lines are left out.
+ * @param line The line as it was read, with or without its newline
+ */
+void history_add(char* line){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct iovec record[2];
+    size_t length = strlen(line);
+    size_t i;
+
+    if(history.fd == -1){
+        return;
+    }
+    if(length > 0 && line[length - 1] == '\n'){
+        length--;
+    }
+    for(i = 0; i < length && (line[i] == ' ' || line[i] == '\t'); i++);
+    if(i == length){
+        return;
+    }
+
+    record[0].iov_base = line;
+    record[0].iov_len = length;
+    record[1].iov_base = "\n";
+    record[1].iov_len = 1;
+    if(writev(history.fd, record, 2) == -1){
+        perror("Error in history_add() ");
+    }
+}
+
+/**
+ * Maps whatever the file grew by since the last look, from this session or another one,
+ *  and finds the entries in it. A line another session is writing right now is only
+ *  taken once its newline is there.
+ */
+static void history_sync(){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct stat file_stat;
+    char* map;
+    char* start;
+    char* end;
+    char* newline;
+    size_t* offsets;
+
+    if(history.fd == -1 || fstat(history.fd, &file_stat) == -1 || (size_t)file_stat.st_size <= history.mapped){
+        return;
+    }
+
+    if(history.map == NULL){
+        map = mmap(NULL, file_stat.st_size, PROT_READ, MAP_SHARED, history.fd, 0);
+    }else{
+        map = mremap(history.map, history.mapped, file_stat.st_size, MREMAP_MAYMOVE);
+    }
+    if(map == MAP_FAILED){
+        perror("Error in history_sync() : Could not map history ");
+        return;
+    }
+    history.map = map;
+    history.mapped = file_stat.st_size;
+
+    if(history.offsets == NULL){
+        history.capacity = HISTORY_INITIAL_ENTRIES;
+        history.offsets = malloc((history.capacity + 1) * sizeof(size_t));
+        if(history.offsets == NULL){
+            fprintf(stderr, "Error in history_sync() : Could not allocate space for entries\n");
+            exit(EXIT_FAILURE);
+        }
+        history.offsets[0] = 0;
+    }
+
+    /********************************************************************
+    Split the new part into entries
+    ********************************************************************/
+    start = history.map + history.offsets[history.count];
+    end = history.map + history.mapped;
+    while(start < end && (newline = memchr(start, '\n', end - start)) != NULL){
+        if(history.count == history.capacity){
+            offsets = realloc(history.offsets, (history.capacity * 2 + 1) * sizeof(size_t));
+            if(offsets == NULL){
+                fprintf(stderr, "Error in history_sync() : Could not reallocate space for entries\n");
+                exit(EXIT_FAILURE);
+            }
+            history.offsets = offsets;
+            history.capacity *= 2;
+        }
+        history.offsets[++history.count] = newline + 1 - history.map;
+        start = newline + 1;
+    }
+}
+
+/**
+ * The number of entries in the history, from every session
+ */
+long history_count(){
+    history_sync();
+    return history.count;
+}
+
+/**
+ * Gives an entry of the history. It is not null terminated, and only valid until the
+ *  history is next looked at.
+ * @param index The entry, from 0 for the oldest
+ * @param length Set to its length
+ */
+char* history_entry(long index, size_t* length){
+    *length = history.offsets[index + 1] - history.offsets[index] - 1;
+    return history.map + history.offsets[index];
+}
+
+/**
+ * Hashes the three characters at text to a bit of a block's bitmap
+ */
+static uint32_t trigram_bit(char* text){
+    uint32_t trigram = (unsigned char)text[0] | (unsigned char)text[1] << 8 | (unsigned char)text[2] << 16;
+
+    return (trigram * 2654435761u) >> (32 - HISTORY_BLOCK_BITS_LOG2);
+}
+
+/**
+ * Gives the bitmap of a full block of entries, computing it the first time: a bit is set
+ *  for every trigram of its entries. Blocks are only indexed when a search gets to
+ *  them, newest first, so a search that finds a recent entry never pays for the old ones.
+ */
+static uint64_t* block_bitmap(long block){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    uint64_t* bitmap;
+    unsigned char* indexed;
+    long num_blocks;
+    char* text;
+    size_t length;
+    size_t i;
+    long entry;
+    uint32_t bit;
+
+    /********************************************************************
+    Make room for the blocks the history grew by
+    ********************************************************************/
+    if(block >= history.num_blocks){
+        num_blocks = history.count / HISTORY_BLOCK_ENTRIES + 1;
+        bitmap = realloc(history.blocks, num_blocks * (HISTORY_BLOCK_BITS / 8));
+        indexed = realloc(history.block_indexed, num_blocks);
+        if(bitmap == NULL || indexed == NULL){
+            fprintf(stderr, "Error in block_bitmap() : Could not reallocate space for index\n");
+            exit(EXIT_FAILURE);
+        }
+        memset(indexed + history.num_blocks, 0, num_blocks - history.num_blocks);
+        history.blocks = bitmap;
+        history.block_indexed = indexed;
+        history.num_blocks = num_blocks;
+    }
+
+    bitmap = history.blocks + block * (HISTORY_BLOCK_BITS / 64);
+    if(!history.block_indexed[block]){
+        memset(bitmap, 0, HISTORY_BLOCK_BITS / 8);
+        for(entry = block * HISTORY_BLOCK_ENTRIES; entry < (block + 1) * HISTORY_BLOCK_ENTRIES; entry++){
+            text = history_entry(entry, &length);
+            for(i = 0; i + 3 <= length; i++){
+                bit = trigram_bit(text + i);
+                bitmap[bit / 64] |= (uint64_t)1 << (bit % 64);
+            }
+        }
+        history.block_indexed[block] = 1;
+    }
+    return bitmap;
+}
+
+/**
+ * Checks if an entry contains some text
+ */
+static int entry_matches(long index, char* text, size_t text_length){
+    size_t length;
+    char* entry = history_entry(index, &length);
+
+    return memmem(entry, length, text, text_length) != NULL;
+}
+
+/**
+ * Finds the newest entry before a given one that contains some text. Text of three
+ *  characters or more is looked up in the trigram index: a block of entries is only
+ *  compared if its bitmap has every trigram of the text. The last block, which is not
+ *  full yet, and shorter text are compared entry by entry.
+ * @param before Where to start looking back from, history_count() to search everything
+ * @return The entry, -1 if none matches
+ */
+long history_search(char* text, long before){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    size_t text_length = strlen(text);
+    uint32_t bits[HISTORY_SEARCH_TRIGRAMS];
+    int num_bits = 0;
+    uint64_t* bitmap;
+    long block;
+    long index;
+    size_t i;
+    int j;
+
+    history_sync();
+    if(before > history.count){
+        before = history.count;
+    }
+
+    for(i = 0; i + 3 <= text_length && num_bits < HISTORY_SEARCH_TRIGRAMS; i++){
+        bits[num_bits++] = trigram_bit(text + i);
+    }
+
+    index = before - 1;
+    while(index >= 0){
+        block = index / HISTORY_BLOCK_ENTRIES;
+
+        /********************************************************************
+        Skip a whole full block when one of the trigrams is not in it
+        ********************************************************************/
+        if(num_bits > 0 && (block + 1) * HISTORY_BLOCK_ENTRIES <= history.count){
+            bitmap = block_bitmap(block);
+            for(j = 0; j < num_bits && (bitmap[bits[j] / 64] & ((uint64_t)1 << (bits[j] % 64))); j++);
+            if(j < num_bits){
+                index = block * HISTORY_BLOCK_ENTRIES - 1;
+                continue;
+            }
+        }
+
+        for(; index >= block * HISTORY_BLOCK_ENTRIES; index--){
+            if(entry_matches(index, text, text_length)){
+                return index;
+            }
+        }
+    }
+    return -1;
+}
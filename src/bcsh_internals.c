@@ -13,81 +13,790 @@
 #include <stdlib.h>
 #include <string.h>
 #include <signal.h>
+#include <errno.h>
 #include <sys/types.h>
 
 #include "../include/bcsh_constants.h"
+#include "../include/bcsh_internals.h"
+#include "../include/bcsh_hash.h"
+#include "../include/bcsh_utils.h"
+#include "../include/bcsh_prompt.h"
+#include "../include/bcsh_arena.h"
+#include "../include/bcsh_execution.h"
+#include "../include/bcsh_jobs.h"
+#include "../include/bcsh_io.h"
+#include "../include/bcsh_parallel.h"
+#include "../include/bcsh_history.h"
+#include "../include/bcsh_vars.h"
+#include "../include/bcsh_trace.h"
 
 /**
- * This function attempts to change the current working directory with the path
- *  provided in the argument.
+ * This function changes the working directory of the shell, keeping $PWD and $OLDPWD.
+ *  cd              goes to $HOME
+ *  cd -            goes back to $OLDPWD, and prints it
+ *  cd [-L|-P] dir  goes to dir, following the logical path (the default) or resolving
+ *                  symbolic links
  */
 int cd_internal(char** tokens){
     /********************************************************************
     Declare variables
     ********************************************************************/
-    char* path;
-    int err;
+    char* target;
+    int physical = 0;
+    int print = 0;
+    int i = 1;
+
+    for(; tokens[i] != NULL && (strcmp(tokens[i], "-L") == 0 || strcmp(tokens[i], "-P") == 0); i++){
+        physical = (tokens[i][1] == 'P');
+    }
+
+    /********************************************************************
+    Work out where to go
+    ********************************************************************/
+    target = tokens[i];
+    if(target == NULL){
+        target = var_get("HOME");
+        if(target == NULL){
+            fprintf(stderr, "Error in cd_internal() : HOME not set\n");
+            return EXIT_FAILURE;
+        }
+    }else if(strcmp(target, "-") == 0){
+        target = get_oldpwd();
+        if(target == NULL){
+            fprintf(stderr, "Error in cd_internal() : OLDPWD not set\n");
+            return EXIT_FAILURE;
+        }
+        print = 1;
+    }
 
     /********************************************************************
-    Check if the provided path is null (no provided path)
+    Change the current directory, along with the shell's idea of it
     ********************************************************************/
+    if(change_directory(target, physical) == -1){
+        perror("Error in cd_internal ");
+        return EXIT_FAILURE;
+    }
+    if(print){
+        fprintf(stdout, "%s\n", get_cwd());
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * This function asks the shell to stop once the current command is done. The shell exits
+ *  with the status given as an argument, or the status of the last command. If there are
+ *  stopped jobs, the first exit only warns about them; the second one hangs them up.
+ */
+int exit_internal(char** tokens){
+    static int warned = 0;
+
+    if(jobs_count_stopped() > 0 && !warned){
+        fprintf(stderr, "bcsh: there are stopped jobs\n");
+        warned = 1;
+        return EXIT_FAILURE;
+    }
+    jobs_hangup();
+
+    exit_requested = 1;
+    if(tokens[1] != NULL){
+        return atoi(tokens[1]) & 0xff;
+    }
+    return last_status;
+}
+
+/**
+ * This function finds the job fg or bg was asked to continue
+ * @return The job, NULL (with an error printed) if there is none
+ */
+static struct job* find_job_argument(char* name, char* spec){
+    struct job* job;
+
+    if(!job_control){
+        fprintf(stderr, "bcsh: %s: no job control\n", name);
+        return NULL;
+    }
+    job = job_find(spec);
+    if(job == NULL || job->state == JOB_DONE){
+        fprintf(stderr, "bcsh: %s: %s: no such job\n", name, (spec != NULL) ? spec : "current");
+        return NULL;
+    }
+    return job;
+}
+
+/**
+ * This function brings a job (the current one by default) to the foreground, continuing
+ *  it if it is stopped, and waits for it
+ */
+int fg_internal(char** tokens){
+    struct job* job = find_job_argument("fg", tokens[1]);
+
+    if(job == NULL){
+        return EXIT_FAILURE;
+    }
+    return job_continue(job, 1);
+}
+
+/**
+ * This function continues stopped jobs (the current one by default) in the background
+ */
+int bg_internal(char** tokens){
+    struct job* job;
+    int status = EXIT_SUCCESS;
+    int i = 1;
+
+    do{
+        job = find_job_argument("bg", tokens[i]);
+        if(job == NULL){
+            status = EXIT_FAILURE;
+        }else if(job->state == JOB_RUNNING && job->background){
+            fprintf(stderr, "bcsh: bg: job %d already in background\n", job->id);
+        }else{
+            job_continue(job, 0);
+        }
+    }while(tokens[i] != NULL && tokens[++i] != NULL);
+
+    return status;
+}
+
+/**
+ * This function lists the jobs of the shell.
+ *  jobs            prints every job and its state
+ *  jobs -l         also prints the pid of every process
+ *  jobs -p         only prints the process group (or first pid) of every job
+ *  jobs %n ...     only prints the given jobs
+ */
+int jobs_internal(char** tokens){
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    sigset_t old_mask;
+    struct job* job;
+    struct job* done;
+    int show_pids = 0;
+    int pids_only = 0;
+    int status = EXIT_SUCCESS;
+    int i = 1;
+
+    if(tokens[1] != NULL && tokens[1][0] == '-'){
+        if(strcmp(tokens[1], "-l") == 0){
+            show_pids = 1;
+        }else if(strcmp(tokens[1], "-p") == 0){
+            pids_only = 1;
+        }else{
+            fprintf(stderr, "Error in jobs_internal() : Unknown option %s\n", tokens[1]);
+            return EXIT_FAILURE;
+        }
+        i = 2;
+    }
+
+    block_sigchld(&old_mask);
+    job = (tokens[i] != NULL) ? job_find(tokens[i]) : job_next(NULL);
+    while(job != NULL || tokens[i] != NULL){
+        if(job == NULL){
+            fprintf(stderr, "bcsh: jobs: %s: no such job\n", tokens[i]);
+            status = EXIT_FAILURE;
+        }else if(pids_only){
+            fprintf(stdout, "%d\n", (int)((job->pgid != 0) ? job->pgid : job->processes[0].pid));
+        }else{
+            job_print(job, show_pids);
+            job->notified = 1;
+        }
+
+        /********************************************************************
+        Move on to the next job given, or the next one in the table. An
+            interactive shell forgets finished jobs once they were shown.
+        ********************************************************************/
+        done = job;
+        if(tokens[i] != NULL){
+            i++;
+            job = (tokens[i] != NULL) ? job_find(tokens[i]) : NULL;
+        }else{
+            job = job_next(job);
+        }
+        if(done != NULL && done->state == JOB_DONE && job_control && !pids_only){
+            job_free(done);
+        }
+        if(job == NULL && tokens[i] == NULL){
+            break;
+        }
+    }
+    restore_sigmask(&old_mask);
+
+    return status;
+}
+
+/**
+ * This function waits for background jobs to finish.
+ *  wait            waits for every job, and returns 0
+ *  wait %n|pid     waits for the given jobs, and returns the status of the last one
+ * Stopped jobs are not waited for.
+ */
+int wait_internal(char** tokens){
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    sigset_t old_mask;
+    sigset_t wait_mask;
+    struct job* job;
+    int status = EXIT_SUCCESS;
+    int waiting;
+    int i;
+
+    block_sigchld(&old_mask);
+    wait_mask = old_mask;
+    sigdelset(&wait_mask, SIGCHLD);
+
     if(tokens[1] == NULL){
-        fprintf(stderr, "Error in cd_internal() : No path provided\n");
-        return EXIT_SUCCESS;
+        do{
+            waiting = 0;
+            for(job = job_next(NULL); job != NULL; job = job_next(job)){
+                if(job->state == JOB_RUNNING){
+                    waiting = 1;
+                }else if(job->state == JOB_DONE && !job_control){
+                    job_free(job);
+                }
+            }
+            if(waiting){
+                sigsuspend(&wait_mask);
+            }
+        }while(waiting);
+    }
+
+    for(i = 1; tokens[i] != NULL; i++){
+        job = job_find(tokens[i]);
+        if(job == NULL){
+            fprintf(stderr, "bcsh: wait: %s: no such job\n", tokens[i]);
+            status = EXIT_NOT_FOUND;
+            continue;
+        }
+        while(job->state == JOB_RUNNING){
+            sigsuspend(&wait_mask);
+        }
+        status = job_status(job);
+        if(job->state == JOB_DONE){
+            job_free(job);
+        }
     }
 
+    restore_sigmask(&old_mask);
+    return status;
+}
+
+/**
+ * This function inspects and manages the command hash table.
+ *  hash            prints every remembered command
+ *  hash -r         forgets every remembered command
+ *  hash -d name    forgets the given commands
+ *  hash -t name    prints the path the given commands resolve to
+ *  hash name       looks up the given commands ahead of time
+ */
+int hash_internal(char** tokens){
     /********************************************************************
-    Chdir() requires the path variable be addressable, so put it in heap
+    Declare variables
     ********************************************************************/
-    path = malloc((strlen(tokens[1]) + 1) * sizeof(char));
-    if(path == NULL){
-        fprintf(stderr, "Error in cd_internal() : Could not allocate space for path\n");
+    char* option = NULL;
+    char* path;
+    int i = 1;
+    int status = EXIT_SUCCESS;
+
+    if(tokens[1] == NULL){
+        hash_print();
         return EXIT_SUCCESS;
     }
 
+    if(tokens[1][0] == '-'){
+        option = tokens[1];
+        i = 2;
+        if(strcmp(option, "-r") == 0){
+            hash_clear();
+            return EXIT_SUCCESS;
+        }
+        if(strcmp(option, "-d") != 0 && strcmp(option, "-t") != 0){
+            fprintf(stderr, "Error in hash_internal() : Unknown option %s\n", option);
+            return EXIT_FAILURE;
+        }
+    }
+
     /********************************************************************
-    Copy the path token into the allocated space
+    Handle each named command
     ********************************************************************/
-    strncpy(path, tokens[1], strlen(tokens[1]) + 1);
+    for(; tokens[i] != NULL; i++){
+        if(option != NULL && option[1] == 'd'){
+            hash_remove(tokens[i]);
+            continue;
+        }
+
+        path = hash_lookup(tokens[i]);
+        if(path == NULL){
+            fprintf(stderr, "bcsh: hash: %s: not found\n", tokens[i]);
+            status = EXIT_FAILURE;
+        }else if(option != NULL){
+            fprintf(stdout, "%s\n", path);
+        }
+    }
+
+    return status;
+}
 
+/**
+ * This function prints how many times the shell called malloc() and free(), in total and
+ *  since the last memstat, along with how much the line arena has grown. Running memstat
+ *  twice around some commands shows what processing them cost the allocator (the second
+ *  memstat line itself is counted too).
+ */
+int memstat_internal(char** tokens){
     /********************************************************************
-    Change the current directory using chdir()
+    Declare variables
     ********************************************************************/
-    err = chdir(path);
-    if(err == -1){
-        perror("Error in cd_internal ");
+    static struct alloc_stats last;
+    struct alloc_stats now;
+
+    get_alloc_stats(&now);
+    if(now.enabled){
+        fprintf(stdout, "malloc %lu free %lu (since last memstat: malloc %lu free %lu)\n",
+                now.mallocs, now.frees, now.mallocs - last.mallocs, now.frees - last.frees);
+    }else{
+        fprintf(stdout, "malloc/free counting is disabled, build with make STATS=1 to enable it\n");
+    }
+    fprintf(stdout, "line arena: %lu chunk mallocs, %zu bytes high water\n",
+            line_arena.chunk_mallocs, line_arena.high_water);
+
+    get_alloc_stats(&last);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * This function runs a command once per argument, several at a time.
+ *  parallel [-j N] [-q] command [args] ::: arg ...     one job per argument after :::
+ *  parallel [-j N] [-q] command [args]                 one job per line of stdin
+ * {} in the command is replaced by the argument, which is otherwise added at the end.
+ *  Up to N jobs (one per online core by default) run at once. The output of each job is
+ *  written out when it is done, followed by its exit status and time unless -q is given.
+ */
+int parallel_internal(char** tokens){
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct input_source source;
+    char** command;
+    char** args;
+    char* line;
+    char* end;
+    long num_args = 0;
+    long capacity = 64;
+    int slots = default_parallel_slots();
+    int quiet = 0;
+    int i = 1;
+
+    /********************************************************************
+    Read the options
+    ********************************************************************/
+    for(; tokens[i] != NULL && tokens[i][0] == '-'; i++){
+        if(strcmp(tokens[i], "-q") == 0){
+            quiet = 1;
+        }else if(strncmp(tokens[i], "-j", 2) == 0){
+            line = (tokens[i][2] != '\0') ? &tokens[i][2] : tokens[++i];
+            slots = (line != NULL) ? strtol(line, &end, 10) : 0;
+            if(line == NULL || *end != '\0' || slots < 1){
+                fprintf(stderr, "Error in parallel_internal() : -j needs a number of jobs\n");
+                return EXIT_FAILURE;
+            }
+            if(slots > PARALLEL_MAX_SLOTS){
+                slots = PARALLEL_MAX_SLOTS;
+            }
+        }else{
+            fprintf(stderr, "Error in parallel_internal() : Unknown option %s\n", tokens[i]);
+            return EXIT_FAILURE;
+        }
     }
 
-    free(path);
+    command = &tokens[i];
+    while(tokens[i] != NULL && strcmp(tokens[i], ":::") != 0){
+        i++;
+    }
+    if(command[0] == NULL || command == &tokens[i]){
+        fprintf(stderr, "Error in parallel_internal() : No command given\n");
+        return EXIT_FAILURE;
+    }
+
+    /********************************************************************
+    The arguments follow :::, or come from stdin, one per line
+    ********************************************************************/
+    if(tokens[i] != NULL){
+        tokens[i] = NULL;
+        args = &tokens[i + 1];
+        while(args[num_args] != NULL){
+            num_args++;
+        }
+    }else{
+        args = arena_alloc(&line_arena, capacity * sizeof(char*));
+        open_input_fd(&source, STDIN_FILENO);
+        while((line = read_line_source(&source)) != NULL){
+            if(line[0] == '\0'){
+                continue;
+            }
+            if(num_args == capacity){
+                args = arena_realloc(&line_arena, args, capacity * sizeof(char*), capacity * 2 * sizeof(char*));
+                capacity *= 2;
+            }
+            args[num_args++] = arena_strdup(&line_arena, line);
+        }
+        close_input(&source);
+    }
+
+    return run_parallel(command, args, num_args, slots, quiet);
+}
 
+/**
+ * This function shows or changes the format of the prompt (see prompt_set_format()).
+ *  prompt          prints the format
+ *  prompt format   sets it, e.g. prompt '%u@%h %~ %g%$ '
+ */
+int prompt_internal(char** tokens){
+    if(tokens[1] == NULL){
+        fprintf(stdout, "%s\n", prompt_get_format());
+        return EXIT_SUCCESS;
+    }
+    prompt_set_format(tokens[1]);
     return EXIT_SUCCESS;
 }
 
-int exit_internal(char** tokens){
-    return 1;
+/**
+ * Prints an entry of the history with its number
+ */
+static void print_history_entry(long index){
+    size_t length;
+    char* entry = history_entry(index, &length);
+
+    fprintf(stdout, "%6ld  %.*s\n", index + 1, (int)length, entry);
 }
 
-int fg_internal(char** tokens){
-    return 0;
+/**
+ * This function shows the history, which every session shares.
+ *  history             prints every entry
+ *  history n           prints the last n entries
+ *  history -s text     prints the newest entries that contain text, newest first
+ */
+int history_internal(char** tokens){
+    long count = history_count();
+    long first = 0;
+    long index;
+    int found;
+
+    if(tokens[1] != NULL && strcmp(tokens[1], "-s") == 0){
+        if(tokens[2] == NULL){
+            fprintf(stderr, "bcsh: history: -s needs the text to search for\n");
+            return EXIT_FAILURE;
+        }
+        index = count;
+        for(found = 0; found < HISTORY_SEARCH_RESULTS; found++){
+            index = history_search(tokens[2], index);
+            if(index == -1){
+                break;
+            }
+            print_history_entry(index);
+        }
+        return (found > 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if(tokens[1] != NULL){
+        first = count - atol(tokens[1]);
+        if(first < 0){
+            first = 0;
+        }
+    }
+    for(index = first; index < count; index++){
+        print_history_entry(index);
+    }
+    return EXIT_SUCCESS;
 }
 
-int bg_internal(char** tokens){
-    fprintf(stderr, "bg\n");
+/**
+ * Prints the shell options the way set -o shows them
+ */
+static void print_options(){
+    if(default_pipe_size > 0){
+        fprintf(stdout, "pipesize        %ld\n", default_pipe_size);
+    }else{
+        fprintf(stdout, "pipesize        default\n");
+    }
+    fprintf(stdout, "pipestats       %s\n", pipe_stats ? "on" : "off");
+}
+
+/**
+ * This function sets the options of the shell.
+ *  set -o                  prints them
+ *  set -o pipesize=size    gives the pipes of pipelines that capacity (65536, 256k, 1M...),
+ *                          up to /proc/sys/fs/pipe-max-size; a pipe written |[size] gets
+ *                          its own
+ *  set +o pipesize         goes back to the kernel's default
+ *  set -o pipestats        reports, after each pipeline, what each stage read and wrote
+ *                          and how long it was blocked
+ *  set +o pipestats        stops reporting
+ */
+int set_internal(char** tokens){
+    int i;
+    int on;
+    long size;
+
+    if(tokens[1] == NULL || (strcmp(tokens[1], "-o") == 0 && tokens[2] == NULL)){
+        print_options();
+        return EXIT_SUCCESS;
+    }
+
+    for(i = 1; tokens[i] != NULL; i += 2){
+        if(strcmp(tokens[i], "-o") != 0 && strcmp(tokens[i], "+o") != 0){
+            fprintf(stderr, "bcsh: set: unknown option %s\n", tokens[i]);
+            return EXIT_FAILURE;
+        }
+        on = (tokens[i][0] == '-');
+        if(tokens[i + 1] == NULL){
+            fprintf(stderr, "bcsh: set: %s needs an option name\n", tokens[i]);
+            return EXIT_FAILURE;
+        }
+
+        if(strcmp(tokens[i + 1], "pipestats") == 0){
+            pipe_stats = on;
+        }else if(!on && strcmp(tokens[i + 1], "pipesize") == 0){
+            default_pipe_size = 0;
+        }else if(on && strncmp(tokens[i + 1], "pipesize=", 9) == 0){
+            size = parse_size(tokens[i + 1] + 9);
+            if(size <= 0){
+                fprintf(stderr, "bcsh: set: bad pipe size %s\n", tokens[i + 1] + 9);
+                return EXIT_FAILURE;
+            }
+            default_pipe_size = size;
+        }else{
+            fprintf(stderr, "bcsh: set: unknown option %s\n", tokens[i + 1]);
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * This function exports variables to the commands the shell runs.
+ *  export                  prints every exported variable
+ *  export name             exports name, now or once it is set
+ *  export name=value       sets name and exports it
+ */
+int export_internal(char** tokens){
+    int status = EXIT_SUCCESS;
+    int i = 1;
+
+    if(tokens[1] != NULL && strcmp(tokens[1], "-p") == 0){
+        i = 2;
+    }
+    if(tokens[i] == NULL){
+        var_print_exported();
+        return EXIT_SUCCESS;
+    }
+
+    for(; tokens[i] != NULL; i++){
+        if(var_name_length(tokens[i]) == strlen(tokens[i])){
+            var_export(tokens[i]);
+        }else if(var_assign(tokens[i], 1) == -1){
+            fprintf(stderr, "bcsh: export: `%s': not a valid identifier\n", tokens[i]);
+            status = EXIT_FAILURE;
+        }
+    }
+    return status;
+}
+
+/**
+ * This function removes variables.
+ *  unset name...   removes every name given
+ */
+int unset_internal(char** tokens){
+    int status = EXIT_SUCCESS;
+    int i = 1;
+
+    if(tokens[1] != NULL && strcmp(tokens[1], "-v") == 0){
+        i = 2;
+    }
+    for(; tokens[i] != NULL; i++){
+        if(var_name_length(tokens[i]) == 0 || var_name_length(tokens[i]) != strlen(tokens[i])){
+            fprintf(stderr, "bcsh: unset: `%s': not a valid identifier\n", tokens[i]);
+            status = EXIT_FAILURE;
+            continue;
+        }
+        var_unset(tokens[i]);
+    }
+    return status;
+}
+
+/**
+ * Reads the count break, continue, return and shift take
+ * @param count Set to the count, def if there is none
+ * @return 0 if the count is a number, -1 (with an error printed) if not
+ */
+static int read_count(char** tokens, long def, long* count){
+    char* end;
+
+    *count = def;
+    if(tokens[1] == NULL){
+        return 0;
+    }
+    *count = strtol(tokens[1], &end, 10);
+    if(*end != '\0' || end == tokens[1]){
+        fprintf(stderr, "bcsh: %s: %s: numeric argument required\n", tokens[0], tokens[1]);
+        return -1;
+    }
     return 0;
 }
 
+/**
+ * This function leaves the function being run.
+ *  return [n]   its status is n, or the one of the last command
+ */
+int return_internal(char** tokens){
+    long status;
+
+    if(function_depth == 0){
+        fprintf(stderr, "bcsh: return: can only `return' from a function\n");
+        return EXIT_FAILURE;
+    }
+    if(read_count(tokens, last_status, &status) == -1){
+        status = EXIT_SYNTAX_ERROR;
+    }
+    pending_jump = JUMP_RETURN;
+    return status & 0xff;
+}
+
+/**
+ * Leaves, or goes on with the next iteration of, the n innermost loops. Outside of a
+ *  loop it does nothing.
+ */
+static int loop_jump(char** tokens, int jump){
+    long levels;
+
+    if(read_count(tokens, 1, &levels) == -1){
+        return EXIT_SYNTAX_ERROR;
+    }
+    if(levels < 1){
+        fprintf(stderr, "bcsh: %s: %s: loop count out of range\n", tokens[0], tokens[1]);
+        return EXIT_FAILURE;
+    }
+    if(loop_depth == 0){
+        return EXIT_SUCCESS;
+    }
+    pending_jump = jump;
+    jump_levels = (levels > loop_depth) ? loop_depth : levels;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * This function leaves loops.
+ *  break [n]   leaves the n innermost loops, 1 by default
+ */
+int break_internal(char** tokens){
+    return loop_jump(tokens, JUMP_BREAK);
+}
+
+/**
+ * This function goes on with the next iteration of a loop.
+ *  continue [n]   of the nth innermost loop, 1 by default
+ */
+int continue_internal(char** tokens){
+    return loop_jump(tokens, JUMP_CONTINUE);
+}
+
+/**
+ * This function drops positional parameters.
+ *  shift [n]   $n+1 becomes $1, and so on
+ */
+int shift_internal(char** tokens){
+    long count;
+
+    if(read_count(tokens, 1, &count) == -1){
+        return EXIT_SYNTAX_ERROR;
+    }
+    if(count < 0 || count > num_positional_params){
+        fprintf(stderr, "bcsh: shift: can't shift that many\n");
+        return EXIT_FAILURE;
+    }
+    positional_params += count;
+    num_positional_params -= count;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * This function controls the execution trace.
+ *  trace               prints whether tracing is on and how many events it holds
+ *  trace on|off        starts or stops recording events
+ *  trace clear         forgets the events recorded so far
+ *  trace json [file]   writes the events as JSON, to stdout or the file
+ *  trace chrome [file] writes them in the Chrome trace-event format, which
+ *                      chrome://tracing and Perfetto load
+ */
+int trace_internal(char** tokens){
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    unsigned long dropped;
+    unsigned long count;
+    FILE* out = stdout;
+    int format;
+
+    if(tokens[1] == NULL){
+        count = trace_count(&dropped);
+        fprintf(stdout, "trace %s, %lu events (%lu dropped)\n", trace_enabled ? "on" : "off", count, dropped);
+        return EXIT_SUCCESS;
+    }
+    if(strcmp(tokens[1], "on") == 0){
+        trace_start();
+        return EXIT_SUCCESS;
+    }
+    if(strcmp(tokens[1], "off") == 0){
+        trace_stop();
+        return EXIT_SUCCESS;
+    }
+    if(strcmp(tokens[1], "clear") == 0){
+        trace_clear();
+        return EXIT_SUCCESS;
+    }
+    if(strcmp(tokens[1], "json") == 0){
+        format = TRACE_FORMAT_JSON;
+    }else if(strcmp(tokens[1], "chrome") == 0){
+        format = TRACE_FORMAT_CHROME;
+    }else{
+        fprintf(stderr, "bcsh: trace: usage: trace [on|off|clear|json [file]|chrome [file]]\n");
+        return EXIT_SYNTAX_ERROR;
+    }
+
+    /********************************************************************
+    Write the events out
+    ********************************************************************/
+    if(tokens[2] != NULL){
+        out = fopen(tokens[2], "w");
+        if(out == NULL){
+            fprintf(stderr, "bcsh: trace: %s: %s\n", tokens[2], strerror(errno));
+            return EXIT_FAILURE;
+        }
+    }
+    trace_write(out, format);
+    if(out != stdout){
+        fclose(out);
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Every internal command takes its arguments (command name first) and returns its exit
+ *  status. The list is in bcsh_builtins.def, which also feeds the perfect hash table
+ *  used to find them.
+ */
+#define BUILTIN(name, function) name,
 char* internal_command_names[] =
     {
-        "cd",
-        "exit",
-        "fg",
-        "bg"
+#include "../include/bcsh_builtins.def"
     };
+#undef BUILTIN
 
+#define BUILTIN(name, function) &function,
 int (*internal_commands[])(char** tokens) =
     {
-        &cd_internal,
-        &exit_internal,
-        &fg_internal,
-        &bg_internal
+#include "../include/bcsh_builtins.def"
     };
+#undef BUILTIN
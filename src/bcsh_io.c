@@ -11,29 +11,321 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../include/bcsh_constants.h"
+#include "../include/bcsh_arena.h"
+#include "../include/bcsh_io.h"
+#include "../include/bcsh_editor.h"
+#include "../include/bcsh_events.h"
 
 /**
- * Reads a line from stdin using getline() and returns it
- * @return The line read from stdin, NULL if getline() throws an error
+ * Reads a line from stdin after a prompt. On a terminal the line editor reads it;
+ *  otherwise the shell waits for the line in the event loop, then reads it with read(),
+ *  which a terminal in canonical mode answers one line at a time. The buffer is kept
+ *  between calls and only grows, so reading a line normally does not allocate anything.
+ *  The line is only valid until the next call.
+ * @param prompt What to print before reading
+ * @param wake What the line editor calls when something has to be shown while it
+ *  waits, see editor_read_line()
+ * @return The line read from stdin, an empty string if SIGINT dropped it, NULL at end of
+ *  input or on error
  */
-char* read_line_stdin(){
+char* read_line_stdin(char* prompt, char* (*wake)(char* prompt)){
 
     /********************************************************************
     Declare variables
     ********************************************************************/
-    char* line = NULL;
-    size_t buffer = 0; //getline decides how long this buffer should be
-    size_t chars_read;
+    static char* line = NULL;
+    static size_t capacity = 0;
+    size_t length = 0;
+    ssize_t bytes_read;
+    char* grown;
+    int event;
+
+    if(editor_available()){
+        return editor_read_line(prompt, wake);
+    }
+    fputs(prompt, stdout);
+    fflush(stdout);
 
     /********************************************************************
-    getline() allocates space for the line, no matter how big it is
-        That means we need to free() it in main(), though.
+    Without an editor there is no line to draw again, so only SIGINT
+        matters while waiting; job notifications wait for the next
+        prompt
     ********************************************************************/
-    chars_read = getline(&line, &buffer, stdin); //Returns a null terminated string with a newline at the end
-    if(chars_read == -1){
-        perror("ERROR in read_line_stdin() : getline() returned -1 characters read\n");
-        return NULL;
+    while(1){
+        if(capacity - length < INPUT_LINE_READ_SIZE){
+            grown = realloc(line, capacity + INPUT_LINE_READ_SIZE + 1);
+            if(grown == NULL){
+                fprintf(stderr, "Error in read_line_stdin() : Could not reallocate space for line\n");
+                exit(EXIT_FAILURE);
+            }
+            line = grown;
+            capacity += INPUT_LINE_READ_SIZE;
+        }
+        do{
+            event = events_wait(STDIN_FILENO, 0);
+        }while(event == EVENT_WAKE);
+        if(event == EVENT_INTERRUPT){
+            tcflush(STDIN_FILENO, TCIFLUSH); //What was typed of the line goes with it
+            fputc('\n', stdout);
+            line[0] = '\0';
+            return line;
+        }
+        bytes_read = read(STDIN_FILENO, line + length, capacity - length);
+        if(bytes_read == -1 && errno == EINTR){
+            continue;
+        }
+        if(bytes_read == -1){
+            perror("ERROR in read_line_stdin() : read() failed ");
+            return NULL;
+        }
+        if(bytes_read == 0){
+            if(length == 0){
+                return NULL;
+            }
+            line[length++] = '\n'; //A last line without its newline
+            break;
+        }
+        length += bytes_read;
+        if(line[length - 1] == '\n'){
+            break;
+        }
     }
-
+    line[length] = '\0';
     return line;
 }
+
+/**
+ * Reads commands from a file descriptor. Regular files are mapped into memory in one go;
+ *  anything else (pipes, terminals, devices) is read in large blocks.
+ * @param source The input source to fill in
+ * @param fd An open descriptor to read from
+ * @return 0 on success, -1 if fd could not be used
+ */
+int open_input_fd(struct input_source* source, int fd){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct stat info;
+    off_t offset;
+    void* map;
+
+    source->fd = fd;
+    source->buffer = NULL;
+    source->size = 0;
+    source->capacity = 0;
+    source->pos = 0;
+    source->mapped = 0;
+    source->sync_offset = 0;
+
+    if(fstat(fd, &info) == -1){
+        return -1;
+    }
+
+    /********************************************************************
+    Map regular files privately, so that the parser can write its null
+        terminators into the lines (only the pages it touches are copied).
+        Start from the current offset, in case part of the file was read
+        already.
+    ********************************************************************/
+    offset = lseek(fd, 0, SEEK_CUR);
+    if(S_ISREG(info.st_mode) && offset != -1 && info.st_size > 0){
+        map = mmap(NULL, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if(map != MAP_FAILED){
+            madvise(map, info.st_size, MADV_SEQUENTIAL);
+            source->buffer = map;
+            source->size = info.st_size;
+            source->pos = (offset < info.st_size) ? offset : info.st_size;
+            source->mapped = 1;
+            return 0;
+        }
+    }
+
+    /********************************************************************
+    Otherwise read in blocks
+    ********************************************************************/
+    source->capacity = INPUT_BLOCK_SIZE;
+    source->buffer = malloc(source->capacity);
+    if(source->buffer == NULL){
+        fprintf(stderr, "Error in open_input_fd() : Could not allocate space for input buffer\n");
+        exit(EXIT_FAILURE);
+    }
+    return 0;
+}
+
+/**
+ * Reads commands from a script file. A directory opens, but cannot be read, so it is
+ *  turned down here with EISDIR; pipes and devices (/dev/stdin) are read like stdin.
+ * @return 0 on success, -1 if the file could not be opened (errno says why)
+ */
+int open_input_file(struct input_source* source, char* path){
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat info;
+
+    if(fd == -1){
+        return -1;
+    }
+    if(fstat(fd, &info) == 0 && S_ISDIR(info.st_mode)){
+        close(fd);
+        errno = EISDIR;
+        return -1;
+    }
+    if(open_input_fd(source, fd) == -1){
+        close(fd);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Reads commands from a string, such as the argument of -c. The string is modified.
+ */
+void open_input_string(struct input_source* source, char* string){
+    source->fd = -1;
+    source->buffer = string;
+    source->size = strlen(string);
+    source->capacity = 0;
+    source->pos = 0;
+    source->mapped = 0;
+    source->sync_offset = 0;
+}
+
+/**
+ * Reads more input into a block buffer, moving the unread part to the front first
+ * @return The number of bytes read, 0 at end of input
+ */
+static ssize_t fill_input(struct input_source* source){
+    ssize_t bytes_read;
+
+    if(source->pos > 0){
+        memmove(source->buffer, source->buffer + source->pos, source->size - source->pos);
+        source->size -= source->pos;
+        source->pos = 0;
+    }
+
+    /********************************************************************
+    A line longer than the buffer makes it grow. Keep one byte free for
+        the null terminator of an unterminated last line.
+    ********************************************************************/
+    if(source->capacity - source->size < INPUT_BLOCK_SIZE / 2){
+        source->capacity *= 2;
+        source->buffer = realloc(source->buffer, source->capacity);
+        if(source->buffer == NULL){
+            fprintf(stderr, "Error in fill_input() : Could not reallocate space for input buffer\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    do{
+        bytes_read = read(source->fd, source->buffer + source->size, source->capacity - source->size - 1);
+    }while(bytes_read == -1 && errno == EINTR);
+    if(bytes_read == -1){
+        perror("Error in fill_input() ");
+        return 0;
+    }
+
+    source->size += bytes_read;
+    return bytes_read;
+}
+
+/**
+ * Hands out the next line of a non-interactive input source. The line is not copied: its
+ *  newline is replaced with a null terminator where it stands.
+ * @return The line, only valid until the next call, NULL at end of input
+ */
+char* read_line_source(struct input_source* source){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    char* start;
+    char* newline;
+    size_t length;
+    size_t scanned = 0;
+    off_t offset;
+
+    /********************************************************************
+    A command that read from the same stdin may have consumed some of
+        the input; carry on from wherever it stopped
+    ********************************************************************/
+    if(source->sync_offset){
+        offset = lseek(source->fd, 0, SEEK_CUR);
+        if(offset > (off_t) source->pos && offset <= (off_t) source->size){
+            source->pos = offset;
+        }
+    }
+
+    while(1){
+        start = source->buffer + source->pos;
+        length = source->size - source->pos;
+        newline = memchr(start + scanned, '\n', length - scanned);
+        if(newline != NULL){
+            *newline = '\0';
+            source->pos = newline + 1 - source->buffer;
+            break;
+        }
+
+        /********************************************************************
+        No newline in what is buffered: read more if we can, otherwise
+            this is the last line (or the end of input)
+        ********************************************************************/
+        if(source->fd != -1 && !source->mapped){
+            scanned = length;
+            if(fill_input(source) > 0){
+                continue;
+            }
+            start = source->buffer + source->pos;
+        }
+        if(length == 0){
+            return NULL;
+        }
+
+        /********************************************************************
+        The last line has no newline. A mapped file may end exactly on a
+            page boundary, so its last line is copied into the line arena
+            rather than terminated in place.
+        ********************************************************************/
+        if(source->mapped){
+            newline = arena_alloc(&line_arena, length + 1);
+            memcpy(newline, start, length);
+            start = newline;
+        }
+        start[length] = '\0';
+        source->pos = source->size;
+        break;
+    }
+
+    /********************************************************************
+    Commands that read stdin should find it right after this line
+    ********************************************************************/
+    if(source->sync_offset){
+        lseek(source->fd, source->pos, SEEK_SET);
+    }
+
+    return start;
+}
+
+/**
+ * Releases everything an input source holds
+ */
+void close_input(struct input_source* source){
+    if(source->mapped){
+        munmap(source->buffer, source->size);
+    }else if(source->fd != -1){
+        free(source->buffer);
+    }
+    if(source->fd > 2){
+        close(source->fd);
+    }
+    source->buffer = NULL;
+    source->fd = -1;
+}
@@ -0,0 +1,1070 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh_jobs.c
+ * * * * * * * * * * * * * * * * * * *
+ * The job table and job control are
+ *  implemented here. Children are reaped
+ *  as soon as they change state by the
+ *  SIGCHLD handler, which only records
+ *  their status in the table, except for
+ *  jobs with a time limit, whose
+ *  processes are watched through pidfds
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <termios.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+
+#include "../include/bcsh_constants.h"
+#include "../include/bcsh_signals.h"
+#include "../include/bcsh_jobs.h"
+#include "../include/bcsh_trace.h"
+#include "../include/bcsh_events.h"
+
+/**
+ * Job control (process groups and handing the terminal over) is only done by an
+ *  interactive shell. Scripts still have jobs, so that & and wait work.
+ */
+int job_control = 0;
+
+int terminal_fd = -1;
+
+pid_t shell_pgid = 0;
+
+/**
+ * The pid of the last process of the last background job ($!)
+ */
+pid_t last_background_pid = 0;
+
+/**
+ * Set by set -o pipestats: each process that exits has its I/O and the time it spent
+ *  blocked read from /proc while it is a zombie, before the shell reaps it
+ */
+int pipe_stats = 0;
+
+/**
+ * Set when ctrl-c killed a foreground job: like the shell itself was interrupted, the
+ *  rest of the command, the loop it is in included, does not run
+ */
+int job_interrupted = 0;
+
+/**
+ * The timer of the job waited for under a time limit, see job_supervise(); -1 if none
+ *  could be made
+ */
+static int deadline_fd = -1;
+
+static struct job job_table[MAX_JOBS];
+
+/**
+ * Terminal modes of the shell, restored whenever a foreground job stops or ends
+ */
+static struct termios shell_tmodes;
+
+/**
+ * Saved terminal modes of stopped jobs, restored when they are brought back with fg
+ */
+static struct termios job_tmodes[MAX_JOBS];
+
+/**
+ * Every job that is started, stopped or sent to the background gets the next sequence
+ *  number. The current job (%+) is the one with the highest.
+ */
+static unsigned long job_sequence[MAX_JOBS];
+
+static unsigned long next_sequence = 1;
+
+/**
+ * Installs the SIGCHLD handler, and for an interactive shell takes control of the
+ *  terminal: the shell waits until it is in the foreground, then puts itself in its own
+ *  process group and ignores the signals that are meant for its jobs.
+ * @param interactive 1 if the shell reads commands from a terminal
+ */
+void jobs_init(int interactive){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct sigaction action;
+
+    /********************************************************************
+    Reap children as soon as they change state. SA_RESTART keeps reads
+        from the terminal going.
+    ********************************************************************/
+    action.sa_handler = sigchld_handler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGCHLD, &action, NULL);
+    deadline_fd = events_timer(NULL);
+
+    if(!interactive){
+        return;
+    }
+
+    /********************************************************************
+    Wait until we are in the foreground, then take the terminal
+    ********************************************************************/
+    terminal_fd = STDIN_FILENO;
+    while(tcgetpgrp(terminal_fd) != (shell_pgid = getpgrp())){
+        kill(-shell_pgid, SIGTTIN);
+    }
+
+    catch_signal(SIGTTOU, SIG_IGN);
+    catch_signal(SIGTTIN, SIG_IGN);
+    catch_signal(SIGQUIT, SIG_IGN);
+
+    //A session leader cannot change its process group, but it already leads one
+    if(setpgid(0, 0) == 0){
+        shell_pgid = getpid();
+    }
+    tcsetpgrp(terminal_fd, shell_pgid);
+    tcgetattr(terminal_fd, &shell_tmodes);
+
+    job_control = 1;
+}
+
+/**
+ * Blocks SIGCHLD, so that the job table can be changed without the handler running
+ * @param old_mask Filled with the mask to restore afterwards
+ */
+void block_sigchld(sigset_t* old_mask){
+    sigset_t mask;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, old_mask);
+}
+
+/**
+ * Undoes block_sigchld()
+ */
+void restore_sigmask(sigset_t* old_mask){
+    sigprocmask(SIG_SETMASK, old_mask, NULL);
+}
+
+/**
+ * Puts the signals the shell changed back to their defaults in a child it forked, before
+ *  the child runs a command
+ */
+void reset_child_signals(){
+    sigset_t mask;
+
+    catch_signal(SIGINT, SIG_DFL);
+    catch_signal(SIGQUIT, SIG_DFL);
+    catch_signal(SIGTSTP, SIG_DFL);
+    catch_signal(SIGTTIN, SIG_DFL);
+    catch_signal(SIGTTOU, SIG_DFL);
+    catch_signal(SIGCHLD, SIG_DFL);
+    sigemptyset(&mask);
+    sigprocmask(SIG_SETMASK, &mask, NULL);
+}
+
+/**
+ * Frees the slots of finished jobs nobody asked about. Only done when the table is full,
+ *  so that a script can still wait for a job long after it finished.
+ */
+static void reclaim_done_jobs(){
+    int i;
+
+    for(i = 0; i < MAX_JOBS; i++){
+        if(job_table[i].state == JOB_DONE){
+            job_free(&job_table[i]);
+        }
+    }
+}
+
+/**
+ * Takes a free slot in the job table. SIGCHLD must be blocked.
+ * @param text What the job runs, as it was written, NULL if it has no text. Background
+ *  jobs are described right away, foreground ones only if they stop.
+ * @param text_length The length of text, which is not null terminated
+ * @param background 1 if the job will not be waited for right away
+ * @return The new job, NULL if the table is full
+ */
+struct job* job_create(char* text, size_t text_length, int background){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct job* job = NULL;
+    int highest_id = 0;
+    int i;
+
+    for(i = 0; i < MAX_JOBS; i++){
+        if(job_table[i].state == JOB_FREE){
+            if(job == NULL){
+                job = &job_table[i];
+            }
+        }else if(job_table[i].id > highest_id){
+            highest_id = job_table[i].id;
+        }
+    }
+    if(job == NULL){
+        reclaim_done_jobs();
+        for(i = 0; i < MAX_JOBS && job == NULL; i++){
+            if(job_table[i].state == JOB_FREE){
+                job = &job_table[i];
+            }
+        }
+        if(job == NULL){
+            fprintf(stderr, "bcsh: too many jobs\n");
+            return NULL;
+        }
+    }
+
+    job->id = highest_id + 1;
+    job->state = JOB_RUNNING;
+    job->background = background;
+    job->notified = 0;
+    job->keep = 0;
+    job->pgid = 0;
+    job->command = NULL;
+    job->text = text;
+    job->text_length = text_length;
+    job->processes = job->inline_processes;
+    job->num_processes = 0;
+    job->num_ended = 0;
+    job->capacity = JOB_INLINE_PROCESSES;
+    job->deadline = 0;
+    job->limit_signal = 0;
+    job->kill_after = 0;
+    job->timed_out = 0;
+    job_sequence[job - job_table] = next_sequence++;
+
+    if(background){
+        job_describe(job);
+    }
+
+    return job;
+}
+
+/**
+ * Adds a process that was just started to a job. With job control, or under a time
+ *  limit, the first process leads the job's process group. SIGCHLD must be blocked.
+ */
+void job_add_process(struct job* job, pid_t pid){
+    struct process* processes;
+
+    /********************************************************************
+    Pipelines with more stages than fit in the job itself get a heap
+        array, which doubles as needed
+    ********************************************************************/
+    if(job->num_processes == job->capacity){
+        processes = malloc(job->capacity * 2 * sizeof(struct process));
+        if(processes == NULL){
+            fprintf(stderr, "Error in job_add_process() : Could not allocate space for processes\n");
+            exit(EXIT_FAILURE);
+        }
+        memcpy(processes, job->processes, job->num_processes * sizeof(struct process));
+        if(job->processes != job->inline_processes){
+            free(job->processes);
+        }
+        job->processes = processes;
+        job->capacity *= 2;
+    }
+
+    job->processes[job->num_processes].pid = pid;
+    job->processes[job->num_processes].state = JOB_RUNNING;
+    job->processes[job->num_processes].status = 0;
+    job->processes[job->num_processes].bytes_read = 0;
+    job->processes[job->num_processes].bytes_written = 0;
+    job->processes[job->num_processes].blocked_ns = 0;
+    job->processes[job->num_processes].exit_order = 0;
+    job->processes[job->num_processes].pidfd = -1;
+    if(job->limit_signal != 0){
+        job->processes[job->num_processes].pidfd = syscall(SYS_pidfd_open, pid, 0);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &job->processes[job->num_processes].started);
+    job->num_processes++;
+
+    if(job->pgid == 0 && (job_control || job->limit_signal != 0)){
+        job->pgid = pid;
+    }
+}
+
+/**
+ * Keeps the text of the job's pipeline, like "ls -l | wc", as it was written, for jobs
+ *  and the job notifications. It must still be valid (the current line).
+ */
+void job_describe(struct job* job){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    char* text;
+
+    if(job->command != NULL){
+        return;
+    }
+
+    text = malloc(job->text_length + 1);
+    if(text == NULL){
+        fprintf(stderr, "Error in job_describe() : Could not allocate space for job description\n");
+        exit(EXIT_FAILURE);
+    }
+    if(job->text_length > 0){
+        memcpy(text, job->text, job->text_length);
+    }
+    text[job->text_length] = '\0';
+    job->command = text;
+}
+
+/**
+ * Gives a job a wall clock limit, counted from now. It has to be set before its
+ *  processes are added, so they each get a pidfd. SIGCHLD must be blocked.
+ * @param duration Nanoseconds the job may run
+ * @param signal Sent to its processes that are still running when the time is up
+ * @param kill_after Nanoseconds after which SIGKILL follows, 0 for never
+ */
+void job_set_limit(struct job* job, unsigned long long duration, int signal, unsigned long long kill_after){
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    job->deadline = (unsigned long long) now.tv_sec * 1000000000ULL + now.tv_nsec + duration;
+    job->limit_signal = signal;
+    job->kill_after = kill_after;
+}
+
+/**
+ * Works out the state of a job from the state of its processes
+ */
+static void job_update_state(struct job* job){
+    int running = 0;
+    int stopped = 0;
+    int state;
+    int i;
+
+    for(i = 0; i < job->num_processes; i++){
+        if(job->processes[i].state == JOB_RUNNING){
+            running = 1;
+        }else if(job->processes[i].state == JOB_STOPPED){
+            stopped = 1;
+        }
+    }
+
+    state = running ? JOB_RUNNING : (stopped ? JOB_STOPPED : JOB_DONE);
+    if(state != job->state){
+        job->state = state;
+        job->notified = 0;
+    }
+}
+
+/**
+ * Reads /proc/pid/name into buffer, null terminated. Called from the SIGCHLD handler,
+ *  so it only uses async-signal-safe calls.
+ * @return The number of bytes read, -1 on failure
+ */
+static ssize_t read_proc_file(pid_t pid, char* name, char* buffer, size_t size){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    char path[64] = "/proc/";
+    char digits[16];
+    int num_digits = 0;
+    int length = 6;
+    ssize_t bytes_read;
+    int fd;
+
+    do{
+        digits[num_digits++] = '0' + pid % 10;
+        pid /= 10;
+    }while(pid > 0);
+    while(num_digits > 0){
+        path[length++] = digits[--num_digits];
+    }
+    path[length++] = '/';
+    while(*name != '\0'){
+        path[length++] = *name++;
+    }
+    path[length] = '\0';
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd == -1){
+        return -1;
+    }
+    bytes_read = read(fd, buffer, size - 1);
+    close(fd);
+    if(bytes_read < 0){
+        return -1;
+    }
+    buffer[bytes_read] = '\0';
+    return bytes_read;
+}
+
+/**
+ * Reads the number that follows a field name in /proc output, 0 if it is not there
+ */
+static unsigned long long proc_field(char* text, char* field){
+    unsigned long long value = 0;
+
+    text = strstr(text, field);
+    if(text == NULL){
+        return 0;
+    }
+    for(text += strlen(field); *text == ' ' || *text == ':' || *text == '\t'; text++);
+    for(; *text >= '0' && *text <= '9'; text++){
+        value = value * 10 + (*text - '0');
+    }
+    return value;
+}
+
+/**
+ * Records, for set -o pipestats, what a process that exited but was not reaped yet read
+ *  and wrote (/proc/pid/io), and how long it was blocked: its lifetime minus the time it
+ *  ran and the time it waited for a CPU (/proc/pid/schedstat). Called from the SIGCHLD
+ *  handler.
+ */
+void job_record_stats(pid_t pid){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    char buffer[512];
+    struct process* process = NULL;
+    struct timespec now;
+    long long lifetime;
+    long long running;
+    char* field;
+    int i;
+    int j;
+
+    for(i = 0; i < MAX_JOBS && process == NULL; i++){
+        if(job_table[i].state == JOB_FREE){
+            continue;
+        }
+        for(j = 0; j < job_table[i].num_processes; j++){
+            if(job_table[i].processes[j].pid == pid){
+                process = &job_table[i].processes[j];
+                break;
+            }
+        }
+    }
+    if(process == NULL){
+        return;
+    }
+
+    if(read_proc_file(pid, "io", buffer, sizeof(buffer)) > 0){
+        process->bytes_read = proc_field(buffer, "rchar");
+        process->bytes_written = proc_field(buffer, "wchar");
+    }
+
+    /********************************************************************
+    schedstat is the time on a CPU, then the time waiting for one, in ns
+    ********************************************************************/
+    if(read_proc_file(pid, "schedstat", buffer, sizeof(buffer)) > 0){
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        lifetime = (now.tv_sec - process->started.tv_sec) * 1000000000LL + (now.tv_nsec - process->started.tv_nsec);
+        running = strtoll(buffer, &field, 10);
+        running += strtoll(field, NULL, 10);
+        process->blocked_ns = (lifetime > running) ? lifetime - running : 0;
+    }
+}
+
+/**
+ * Records a status reported by wait4() in the job table, with the resources the process
+ *  used. This is called from the SIGCHLD handler, so it only updates the table.
+ */
+void job_record_status(pid_t pid, int status, struct rusage* usage){
+    struct job* job;
+    int i;
+    int j;
+
+    for(i = 0; i < MAX_JOBS; i++){
+        job = &job_table[i];
+        if(job->state == JOB_FREE){
+            continue;
+        }
+        for(j = 0; j < job->num_processes; j++){
+            if(job->processes[j].pid != pid){
+                continue;
+            }
+
+            if(WIFSTOPPED(status)){
+                job->processes[j].state = JOB_STOPPED;
+            }else if(WIFCONTINUED(status)){
+                job->processes[j].state = JOB_RUNNING;
+            }else{
+                job->processes[j].state = JOB_DONE;
+                job->processes[j].status = status;
+                job->processes[j].usage = *usage;
+                job->processes[j].exit_order = ++job->num_ended;
+                clock_gettime(CLOCK_MONOTONIC, &job->processes[j].ended);
+                if(job->processes[j].pidfd != -1){
+                    close(job->processes[j].pidfd);
+                    job->processes[j].pidfd = -1;
+                }
+            }
+            job_update_state(job);
+            return;
+        }
+    }
+}
+
+/**
+ * The exit status of a job is the one of its last process
+ */
+int job_status(struct job* job){
+    int status;
+
+    if(job->num_processes == 0){
+        return EXIT_SUCCESS;
+    }
+    status = job->processes[job->num_processes - 1].status;
+    if(job->state == JOB_STOPPED){
+        return 128 + SIGTSTP;
+    }
+    if(WIFSIGNALED(status)){
+        return 128 + WTERMSIG(status);
+    }
+    return WEXITSTATUS(status);
+}
+
+/**
+ * Releases a job's slot in the table. SIGCHLD must be blocked.
+ */
+void job_free(struct job* job){
+    int i;
+
+    for(i = 0; i < job->num_processes; i++){
+        if(job->processes[i].pidfd != -1){
+            close(job->processes[i].pidfd);
+        }
+    }
+    if(job->processes != job->inline_processes){
+        free(job->processes);
+    }
+    free(job->command);
+    job->command = NULL;
+    job->processes = job->inline_processes;
+    job->num_processes = 0;
+    job->state = JOB_FREE;
+    job->id = 0;
+}
+
+/**
+ * Prints a job the way the jobs command shows it. The [n] column is as wide as the
+ *  highest id in the table, so the states line up.
+ * @param show_pids 1 to list the pid of every process as well
+ */
+void job_print(struct job* job, int show_pids){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    char* state;
+    char exit_text[16];
+    char id_text[16];
+    struct job* current = job_find("%+");
+    int highest_id = 0;
+    int status;
+    int i;
+
+    switch(job->state){
+        case JOB_RUNNING:
+            state = "Running";
+            break;
+        case JOB_STOPPED:
+            state = "Stopped";
+            break;
+        default:
+            status = job_status(job);
+            if(status == 0){
+                state = "Done";
+            }else{
+                snprintf(exit_text, sizeof(exit_text), "Exit %d", status);
+                state = exit_text;
+            }
+            break;
+    }
+
+    for(i = 0; i < MAX_JOBS; i++){
+        if(job_table[i].state != JOB_FREE && job_table[i].id > highest_id){
+            highest_id = job_table[i].id;
+        }
+    }
+    snprintf(id_text, sizeof(id_text), "[%d]%c", job->id, (job == current) ? '+' : ' ');
+    fprintf(stdout, "%-*s  ", snprintf(NULL, 0, "[%d]+", highest_id), id_text);
+    if(show_pids){
+        for(i = 0; i < job->num_processes; i++){
+            fprintf(stdout, "%d ", (int) job->processes[i].pid);
+        }
+    }
+    fprintf(stdout, "%-22s %s%s\n", state, (job->command != NULL) ? job->command : "",
+            (job->state == JOB_RUNNING && job->background) ? " &" : "");
+}
+
+/**
+ * Sends the signal of a job whose time is up to its processes that are still running,
+ *  and continues the stopped ones so they get it. The job leads a process group of its
+ *  own, even without job control, so the whole group gets it, the processes its stages
+ *  started included. The pidfds are only there to wait for the stages, and to signal
+ *  them in a job that has no group. The next deadline is the one of SIGKILL, if -k
+ *  asked for it.
+ */
+static void job_expire(struct job* job){
+    struct process* process;
+    struct timespec now;
+    int i;
+
+    if(trace_enabled){
+        trace_record(trace_now(), TRACE_INSTANT, "timeout", 0, job->limit_signal, NULL);
+    }
+    for(i = 0; i < job->num_processes; i++){
+        process = &job->processes[i];
+        if(process->state == JOB_DONE || job->pgid != 0){
+            continue;
+        }
+        if(process->pidfd != -1){
+            syscall(SYS_pidfd_send_signal, process->pidfd, job->limit_signal, NULL, 0);
+            if(process->state == JOB_STOPPED){
+                syscall(SYS_pidfd_send_signal, process->pidfd, SIGCONT, NULL, 0);
+            }
+        }else{
+            kill(process->pid, job->limit_signal);
+            kill(process->pid, SIGCONT);
+        }
+    }
+    if(job->pgid != 0){
+        kill(-job->pgid, job->limit_signal);
+        kill(-job->pgid, SIGCONT);
+    }
+
+    job->timed_out = 1;
+    job->deadline = 0;
+    if(job->kill_after != 0 && job->limit_signal != SIGKILL){
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        job->deadline = (unsigned long long) now.tv_sec * 1000000000ULL + now.tv_nsec + job->kill_after;
+        job->limit_signal = SIGKILL;
+    }
+}
+
+/**
+ * Waits until a process of a job with a time limit ends, or its time is up. The
+ *  processes are polled through their pidfds, along with a timer armed for the
+ *  deadline, and each one that ended is reaped on its own, so only the job's processes
+ *  are waited for. Without job control, SIGCHLD stays blocked meanwhile (other children
+ *  are reaped once the job is done); with it, the handler still runs, as it is the one
+ *  that sees stages stop.
+ * @param wait_mask The signal mask to wait with, SIGCHLD not blocked
+ */
+static void job_supervise(struct job* job, sigset_t* wait_mask){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct pollfd inline_fds[JOB_INLINE_PROCESSES + 1];
+    struct pollfd* fds = inline_fds;
+    struct timespec now;
+    struct timespec timeout;
+    struct timespec* wait_time = NULL;
+    struct rusage usage;
+    sigset_t mask = *wait_mask;
+    unsigned long long now_ns;
+    uint64_t expirations;
+    int num_fds = 0;
+    int polled = 1;
+    int expired;
+    int count;
+    int status;
+    int i;
+    int j;
+
+    if(job->num_processes > JOB_INLINE_PROCESSES){
+        fds = malloc((job->num_processes + 1) * sizeof(struct pollfd));
+        if(fds == NULL){
+            fprintf(stderr, "Error in job_supervise() : Could not allocate space for pidfds\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for(i = 0; i < job->num_processes; i++){
+        if(job->processes[i].state == JOB_DONE){
+            continue;
+        }
+        if(job->processes[i].pidfd == -1){
+            polled = 0; //No pidfd (an old kernel): SIGCHLD tells when it ends
+            continue;
+        }
+        fds[num_fds].fd = job->processes[i].pidfd;
+        fds[num_fds].events = POLLIN;
+        num_fds++;
+    }
+    if(polled && !job_control){
+        sigaddset(&mask, SIGCHLD);
+    }
+
+    /********************************************************************
+    The timer goes off at the deadline, which it takes as it is, so
+        nothing has to be worked out again after each wake up. Without
+        one, the wait is given the time left instead.
+    ********************************************************************/
+    if(job->deadline != 0 && deadline_fd != -1){
+        events_arm(deadline_fd, job->deadline);
+        fds[num_fds].fd = deadline_fd;
+        fds[num_fds].events = POLLIN;
+        num_fds++;
+    }else if(job->deadline != 0){
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        now_ns = (unsigned long long) now.tv_sec * 1000000000ULL + now.tv_nsec;
+        now_ns = (now_ns < job->deadline) ? job->deadline - now_ns : 0;
+        timeout.tv_sec = now_ns / 1000000000ULL;
+        timeout.tv_nsec = now_ns % 1000000000ULL;
+        wait_time = &timeout;
+    }
+
+    count = ppoll(fds, num_fds, wait_time, &mask);
+    expired = (count == 0 && wait_time != NULL);
+    for(i = 0; count > 0 && i < num_fds; i++){
+        if(fds[i].revents == 0){
+            continue;
+        }
+        if(fds[i].fd == deadline_fd){
+            expired = (read(deadline_fd, &expirations, sizeof(expirations)) > 0);
+            continue;
+        }
+        for(j = 0; j < job->num_processes && job->processes[j].pidfd != fds[i].fd; j++);
+        if(j == job->num_processes){
+            continue;
+        }
+        if(pipe_stats){
+            job_record_stats(job->processes[j].pid);
+        }
+        if(wait4(job->processes[j].pid, &status, WNOHANG, &usage) > 0){
+            if(trace_enabled){
+                trace_record(trace_now(), TRACE_END, "exit", job->processes[j].pid,
+                             WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status), NULL);
+            }
+            job_record_status(job->processes[j].pid, status, &usage);
+        }
+    }
+    if(expired){
+        job_expire(job);
+    }
+
+    if(fds != inline_fds){
+        free(fds);
+    }
+}
+
+/**
+ * Waits for a job in the foreground. With job control it gets the terminal until it
+ *  stops or finishes. SIGCHLD must be blocked; the wait happens in sigsuspend(), so a
+ *  child exiting cannot be missed. A job with a time limit is waited for by
+ *  job_supervise() instead, and ends with EXIT_TIMED_OUT if its time was up.
+ * @param job The job to wait for
+ * @param old_mask The signal mask from before SIGCHLD was blocked
+ * @return The exit status of the job. A stopped job stays in the table, a finished one
+ *  is freed unless it is marked keep.
+ */
+int job_wait(struct job* job, sigset_t* old_mask){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    sigset_t wait_mask = *old_mask;
+    int status;
+
+    sigdelset(&wait_mask, SIGCHLD);
+    job->background = 0;
+    job_update_state(job); //A job none of whose commands could be started is already done
+
+    if(job_control && job->pgid != 0){
+        tcsetpgrp(terminal_fd, job->pgid);
+    }
+
+    if(trace_enabled){
+        trace_record(trace_now(), TRACE_BEGIN, "wait", 0, job->num_processes, NULL);
+    }
+    while(job->state == JOB_RUNNING){
+        if(job->limit_signal != 0){
+            job_supervise(job, &wait_mask);
+        }else{
+            sigsuspend(&wait_mask);
+        }
+    }
+    if(trace_enabled){
+        trace_record(trace_now(), TRACE_END, "wait", 0, job_status(job), NULL);
+    }
+
+    /********************************************************************
+    Take the terminal back, keeping the job's terminal modes for when it
+        is continued
+    ********************************************************************/
+    if(job_control){
+        tcsetpgrp(terminal_fd, shell_pgid);
+        if(job->state == JOB_STOPPED){
+            tcgetattr(terminal_fd, &job_tmodes[job - job_table]);
+        }
+        tcsetattr(terminal_fd, TCSADRAIN, &shell_tmodes);
+    }
+
+    status = job->timed_out ? EXIT_TIMED_OUT : job_status(job);
+    if(job_control && job->state == JOB_DONE && job->num_processes > 0
+       && WIFSIGNALED(job->processes[job->num_processes - 1].status)
+       && WTERMSIG(job->processes[job->num_processes - 1].status) == SIGINT){
+        job_interrupted = 1;
+    }
+    if(job->state == JOB_STOPPED){
+        job_describe(job);
+        job_sequence[job - job_table] = next_sequence++;
+        fprintf(stdout, "\n");
+        job_print(job, 0);
+        job->notified = 1;
+    }else if(!job->keep){
+        job_free(job);
+    }
+
+    return status;
+}
+
+/**
+ * Continues a stopped job, in the foreground or in the background
+ * @param foreground 1 for fg, 0 for bg
+ * @return The exit status of the job if it ran in the foreground, 0 otherwise
+ */
+int job_continue(struct job* job, int foreground){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    sigset_t old_mask;
+    int status = EXIT_SUCCESS;
+    int i;
+
+    block_sigchld(&old_mask);
+
+    if(foreground && job_control && job->state == JOB_STOPPED){
+        tcsetattr(terminal_fd, TCSADRAIN, &job_tmodes[job - job_table]);
+    }
+
+    /********************************************************************
+    Mark every stopped process as running again before waking them up
+    ********************************************************************/
+    for(i = 0; i < job->num_processes; i++){
+        if(job->processes[i].state == JOB_STOPPED){
+            job->processes[i].state = JOB_RUNNING;
+        }
+    }
+    job_update_state(job);
+
+    if(job->pgid != 0){
+        kill(-job->pgid, SIGCONT);
+    }else{
+        for(i = 0; i < job->num_processes; i++){
+            kill(job->processes[i].pid, SIGCONT);
+        }
+    }
+
+    if(foreground){
+        fprintf(stdout, "%s\n", (job->command != NULL) ? job->command : "");
+        fflush(stdout);
+        status = job_wait(job, &old_mask);
+    }else{
+        job->background = 1;
+        job->notified = 1;
+        job_sequence[job - job_table] = next_sequence++;
+        fprintf(stdout, "[%d] %s &\n", job->id, (job->command != NULL) ? job->command : "");
+    }
+
+    restore_sigmask(&old_mask);
+    return status;
+}
+
+/**
+ * Tells the user about background jobs that finished or stopped since the last prompt,
+ *  and frees the finished ones. Scripts are not told; their finished jobs are kept for
+ *  wait.
+ */
+void jobs_notify(){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    sigset_t old_mask;
+    struct job* job;
+    int i;
+
+    if(!job_control){
+        return;
+    }
+
+    block_sigchld(&old_mask);
+    for(i = 0; i < MAX_JOBS; i++){
+        job = &job_table[i];
+        if(job->state == JOB_FREE || job->notified){
+            continue;
+        }
+        if(job->state == JOB_DONE){
+            job_print(job, 0);
+            job_free(job);
+        }else if(job->state == JOB_STOPPED){
+            job_print(job, 0);
+            job->notified = 1;
+        }
+    }
+    restore_sigmask(&old_mask);
+    fflush(stdout);
+}
+
+/**
+ * Counts the jobs jobs_notify() would tell the user about
+ */
+int jobs_count_unnotified(){
+    int count = 0;
+    int i;
+
+    if(!job_control){
+        return 0;
+    }
+    for(i = 0; i < MAX_JOBS; i++){
+        if(!job_table[i].notified && (job_table[i].state == JOB_DONE || job_table[i].state == JOB_STOPPED)){
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+ * Finds a job from a job specification
+ *  %n or n     job number n
+ *  %+ or %%    the current job (also used when spec is NULL)
+ *  %-          the previous job
+ *  %string     the job whose command starts with string
+ *  pid         the job that has a process with that pid
+ * @return The job, NULL if there is no such job
+ */
+struct job* job_find(char* spec){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct job* best = NULL;
+    struct job* second = NULL;
+    struct job* job;
+    char* end;
+    long number;
+    int by_pid = 0;
+    int i;
+    int j;
+
+    if(spec == NULL || strcmp(spec, "%+") == 0 || strcmp(spec, "%%") == 0 || strcmp(spec, "%-") == 0){
+        /********************************************************************
+        The current job is the one stopped or started most recently,
+            preferring stopped jobs; the previous job comes right before it
+        ********************************************************************/
+        for(i = 0; i < MAX_JOBS; i++){
+            job = &job_table[i];
+            if(job->state == JOB_FREE || job->state == JOB_DONE){
+                continue;
+            }
+            if(best == NULL || (job->state == JOB_STOPPED && best->state != JOB_STOPPED)
+               || (job->state == best->state && job_sequence[i] > job_sequence[best - job_table])){
+                second = best;
+                best = job;
+            }else if(second == NULL || job_sequence[i] > job_sequence[second - job_table]){
+                second = job;
+            }
+        }
+        return (spec != NULL && strcmp(spec, "%-") == 0) ? second : best;
+    }
+
+    if(spec[0] == '%'){
+        spec++;
+    }else{
+        by_pid = 1;
+    }
+
+    number = strtol(spec, &end, 10);
+    for(i = 0; i < MAX_JOBS; i++){
+        job = &job_table[i];
+        if(job->state == JOB_FREE){
+            continue;
+        }
+        if(*end != '\0' || end == spec){
+            if(!by_pid && job->command != NULL && strncmp(job->command, spec, strlen(spec)) == 0){
+                return job;
+            }
+        }else if(by_pid){
+            for(j = 0; j < job->num_processes; j++){
+                if(job->processes[j].pid == number){
+                    return job;
+                }
+            }
+        }else if(job->id == number){
+            return job;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Finds the next job in use, for walking the table from outside
+ * @param job The job to start after, NULL to start from the beginning
+ * @return The next job that is not free, NULL once there are none left
+ */
+struct job* job_next(struct job* job){
+    int i = (job == NULL) ? 0 : (job - job_table) + 1;
+
+    for(; i < MAX_JOBS; i++){
+        if(job_table[i].state != JOB_FREE){
+            return &job_table[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Counts the jobs that are running or stopped, for the prompt
+ */
+int jobs_count_active(){
+    int count = 0;
+    int i;
+
+    for(i = 0; i < MAX_JOBS; i++){
+        if(job_table[i].state == JOB_RUNNING || job_table[i].state == JOB_STOPPED){
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+ * Counts the jobs that are stopped, so exit can warn about them
+ */
+int jobs_count_stopped(){
+    int count = 0;
+    int i;
+
+    for(i = 0; i < MAX_JOBS; i++){
+        if(job_table[i].state == JOB_STOPPED){
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+ * Sends SIGHUP to every stopped job (and SIGCONT so it can act on it) as the shell exits
+ */
+void jobs_hangup(){
+    int i;
+
+    for(i = 0; i < MAX_JOBS; i++){
+        if(job_table[i].state == JOB_STOPPED && job_table[i].pgid != 0){
+            kill(-job_table[i].pgid, SIGHUP);
+            kill(-job_table[i].pgid, SIGCONT);
+        }
+    }
+}
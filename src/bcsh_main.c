@@ -12,6 +12,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
 #include <signal.h>
 
 #include "../include/bcsh_constants.h"
@@ -19,100 +20,326 @@
 #include "../include/bcsh_utils.h"
 #include "../include/bcsh_execution.h"
 #include "../include/bcsh_signals.h"
+#include "../include/bcsh_arena.h"
+#include "../include/bcsh_parser.h"
+#include "../include/bcsh_jobs.h"
+#include "../include/bcsh_prompt.h"
+#include "../include/bcsh_history.h"
+#include "../include/bcsh_editor.h"
+#include "../include/bcsh_vars.h"
+#include "../include/bcsh_trace.h"
+#include "../include/bcsh_events.h"
+#include "../include/bcsh_zygote.h"
+#include "../include/bcsh_serve.h"
 
 volatile sig_atomic_t signal_handled = 0;
 
+/**
+ * The lines of a command that did not end on its first line (an if without its fi, an
+ *  open quote, a here-document...), each followed by its newline, kept until the
+ *  command is complete
+ */
+static char* pending = NULL;
+static size_t pending_length = 0;
+static size_t pending_capacity = 0;
+
+/**
+ * Shows what happened while a line was being edited: the jobs that finished or stopped
+ *  are reported right away, and the prompt is brought up to date (the answer of git
+ *  status may have come)
+ * @param prompt The prompt the line is edited with
+ * @return The prompt to edit it with from now on
+ */
+static char* show_events(char* prompt){
+    jobs_notify();
+    return (pending_length > 0) ? prompt : prompt_render();
+}
+
+/**
+ * Adds a line to the pending command
+ */
+static void pending_append(char* line){
+    size_t length = strlen(line);
+    size_t needed = pending_length + length + 2;
+    char* grown;
+
+    if(needed > pending_capacity){
+        grown = realloc(pending, needed * 2);
+        if(grown == NULL){
+            fprintf(stderr, "Error in pending_append() : Could not reallocate space for input\n");
+            exit(EXIT_FAILURE);
+        }
+        pending = grown;
+        pending_capacity = needed * 2;
+    }
+    memcpy(pending + pending_length, line, length);
+    pending_length += length;
+    if(length == 0 || line[length - 1] != '\n'){
+        pending[pending_length++] = '\n';
+    }
+    pending[pending_length] = '\0';
+}
+
 /**
  * Starts up Brennan Couturier's Shell (bcsh) and runs it
- * This program will read commands from stdin, separate them into tokens, then execute them if they're valid
+ * This program will read commands from stdin, a script or the -c argument, parse them, then execute them if they're valid
  * @param argc The number of command line arguments
  * @param argv A reference to an array of command line arguments
- * @return Returns EXIT_SUCCESS if everything goes well, EXIT_FAILURE if things did not go well
+ * @return The exit status of the last command, or the one given to exit
  */
 int main(int argc, char** argv){
 
     /********************************************************************
     Declare and initialize variables
     ********************************************************************/
-    char* path = NULL;
-    char** path_ref = &path;
     char* line = NULL;
-    char** tokens = NULL;
-    char*** piped_commands = NULL;
+    char* text;
+    struct pipeline* list = NULL;
+    struct input_source source;
+    char* spawn_name;
+    char* serve_path = NULL;
+    char* serve_max;
+    int interactive = 0;
     int done = 0;
+    int status;
+
+    /********************************************************************
+    Work out where commands come from, and what $0 and the positional
+        parameters are
+        bcsh -c 'commands' [name [args]]  runs the given string
+        bcsh script [args]                runs the script
+        bcsh --serve socket               runs the commands sent to the socket
+        bcsh --connect socket 'commands'  has the shell serving socket run them
+        bcsh                              reads stdin, with a prompt if it is a terminal
+    ********************************************************************/
+    if(argc > 1 && strcmp(argv[1], "--connect") == 0){
+        if(argc < 4){
+            fprintf(stderr, "bcsh: --connect: usage: bcsh --connect socket 'commands'\n");
+            return EXIT_SYNTAX_ERROR;
+        }
+        return client_run(argv[2], argv[3]);
+    }else if(argc > 1 && strcmp(argv[1], "--serve") == 0){
+        if(argc < 3){
+            fprintf(stderr, "bcsh: --serve: option requires an argument\n");
+            return EXIT_SYNTAX_ERROR;
+        }
+        serve_path = argv[2];
+    }else if(argc > 1 && strcmp(argv[1], "-c") == 0){
+        if(argc < 3){
+            fprintf(stderr, "bcsh: -c: option requires an argument\n");
+            return EXIT_SYNTAX_ERROR;
+        }
+        open_input_string(&source, argv[2]);
+        if(argc > 3){
+            shell_name = argv[3];
+            positional_params = argv + 4;
+            num_positional_params = argc - 4;
+        }
+    }else if(argc > 1){
+        if(open_input_file(&source, argv[1]) == -1){
+            fprintf(stderr, "bcsh: %s: %s\n", argv[1], strerror(errno));
+            return (errno == ENOENT || errno == ENOTDIR) ? EXIT_NOT_FOUND : EXIT_NOT_EXECUTABLE;
+        }
+        shell_name = argv[1];
+        positional_params = argv + 2;
+        num_positional_params = argc - 2;
+    }else if(isatty(STDIN_FILENO)){
+        interactive = 1;
+    }else{
+        open_input_fd(&source, STDIN_FILENO);
+        source.sync_offset = source.mapped;
+    }
 
     /********************************************************************
-    Register for SIGTSTP signal (ctrl-z)
-        Also, store the current process id. The handler uses it to
-        determine if a program is running on top of the shell or not.
+    Every variable of the environment becomes an exported shell
+        variable; from now on the commands get theirs
     ********************************************************************/
-    signal(SIGTSTP, signal_handler);
+    vars_init(environ);
 
-    do{
+    /********************************************************************
+    Pick the backend used to launch external commands, if the
+        environment asks for a specific one
+    ********************************************************************/
+    spawn_name = var_get("BCSH_SPAWN");
+    if(spawn_name != NULL && select_spawn_backend(spawn_name) == -1){
+        fprintf(stderr, "bcsh: unknown spawn backend %s, using the default\n", spawn_name);
+    }
 
-        /********************************************************************
-        Get the current working directory and print it out
-            We are getting it each iteration in case it was changed in the
-            previous iteration.
-        ********************************************************************/
-        get_cwd_direct(path_ref);
+    /********************************************************************
+    Start tracing right away if $BCSH_TRACE asks for it, see
+        trace_init()
+    ********************************************************************/
+    trace_init(var_get("BCSH_TRACE"));
+
+    /********************************************************************
+    Register for SIGTSTP signal (ctrl-z), and SIGINT (ctrl-c) when
+        interactive. The shell itself is never stopped or interrupted by
+        them; with job control they go to the foreground job's process
+        group instead. Then set up the job table, and take the terminal
+        if interactive.
+    ********************************************************************/
+    catch_signal(SIGTSTP, signal_handler);
+    if(interactive){
+        catch_signal(SIGINT, signal_handler);
+    }
+    jobs_init(interactive);
+
+    /********************************************************************
+    The zygote backend needs its spawn helper, forked now while the
+        shell is still small; without one, commands are launched with
+        posix_spawn()
+    ********************************************************************/
+    if(spawn_backend == SPAWN_BACKEND_ZYGOTE && zygote_start(terminal_fd) == -1){
+        spawn_backend = SPAWN_BACKEND_POSIX_SPAWN;
+    }
 
-        if(signal_handled){
-            fprintf(stdout, "\n");
-            signal_handled = 0;
+    /********************************************************************
+    While an interactive shell waits for input, these signals come
+        through the event loop instead, see events_wait()
+    ********************************************************************/
+    if(interactive){
+        events_on_signal(SIGCHLD, sigchld_event);
+        events_on_signal(SIGINT, sigint_event);
+        events_on_signal(SIGTSTP, ignore_event);
+        events_on_signal(SIGWINCH, editor_resized);
+    }
+
+    /********************************************************************
+    Work out the working directory once; from now on cd keeps it. The
+        prompt format can be given in $BCSH_PROMPT. Interactive shells
+        also open the history file they share.
+    ********************************************************************/
+    cwd_init();
+    if(interactive){
+        prompt_set_format(var_get("BCSH_PROMPT"));
+        history_init();
+    }
+
+    /********************************************************************
+    A server only returns from serve() in the copy of itself forked for a
+        request, which then runs the request's commands like -c would.
+        $BCSH_SERVE_MAX caps how many run at once.
+    ********************************************************************/
+    if(serve_path != NULL){
+        serve_max = var_get("BCSH_SERVE_MAX");
+        text = serve(serve_path, (serve_max != NULL && atoi(serve_max) > 0) ? atoi(serve_max) : SERVE_MAX_IN_FLIGHT);
+        if(text == NULL){
+            return last_status;
         }
-        fprintf(stdout, "%s%% ", *path_ref);
+        open_input_string(&source, text);
+    }
 
-        /********************************************************************
-        Get a line of input
-        ********************************************************************/
-        line = read_line_stdin();
+    do{
 
-        /********************************************************************
-        Tokenize the input
-        ********************************************************************/
-        tokens = get_tokens(line);
+        if(interactive){
+            /********************************************************************
+            Print the prompt
+                The working directory is kept by the shell and only changes
+                with cd, and the prompt only recomputes what changed
+            ********************************************************************/
+            if(pending_length == 0){
+                jobs_notify();
+            }
+            if(signal_handled){
+                fprintf(stdout, "\n");
+                signal_handled = 0;
+            }
 
-        /********************************************************************
-        Execute the commands contained in tokens
-            Treat commands with pipes different than simple commands
-        ********************************************************************/
-        if(has_pipes(tokens)){
-            piped_commands = prepare_commands(tokens);
-            if(piped_commands != NULL){
-                done = execute_piped_commands(piped_commands);
+            /********************************************************************
+            Get a line of input, which the line editor lets the user edit,
+                complete and recall from the history. The lines that
+                continue a command get a prompt of their own, and ctrl-c
+                drops the whole command.
+            ********************************************************************/
+            line = read_line_stdin((pending_length > 0) ? "> " : prompt_render(), show_events);
+            if(line == NULL){
+                fprintf(stdout, "\n");
+                break;
             }
+            if(line[0] == '\0'){
+                pending_length = 0;
+                continue;
+            }
+            history_add(line);
         }else{
-            done = execute_command(tokens);
+            /********************************************************************
+            Scripts get no prompt, and their lines are handed over in place
+            ********************************************************************/
+            line = read_line_source(&source);
+            if(line == NULL){
+                break;
+            }
         }
 
-
         /********************************************************************
-        Free our malloced variables so that when we start the next iteration
-            we don't need to worry about losing track of memory. We're going
-            to end up mallocing them again, so it's better to free here than
-            inside a bunch of different functions
+        Parse the input and execute the pipelines it contains
+            Lines with a syntax error are not run at all. A line that ends
+            in the middle of a command is kept, and parsed again with the
+            lines that follow once one of them may complete it; the bodies
+            of here-documents come from those lines too. The parser
+            modifies what it parses, so a line it may have to keep, and
+            the kept command, are parsed from a copy. Any other line is
+            parsed in place.
         ********************************************************************/
-        if(piped_commands != NULL){
-            int k = 0;
-            while(piped_commands[k] != NULL){
-                free(piped_commands[k]);
-                piped_commands[k] = NULL;
-                k++;
+        if(pending_length == 0){
+            text = line_may_continue(line) ? arena_strdup(&line_arena, line) : line;
+        }else{
+            pending_append(line);
+            if(!line_may_complete(line)){
+                continue;
+            }
+            text = arena_strdup(&line_arena, pending);
+        }
+        if(trace_enabled){
+            trace_record(trace_now(), TRACE_BEGIN, "parse", 0, 0, NULL);
+        }
+        status = parse_line(text, &list);
+        if(trace_enabled){
+            trace_record(trace_now(), TRACE_END, "parse", 0, status, NULL);
+        }
+        if(status == PARSE_INCOMPLETE){
+            if(pending_length == 0){
+                pending_append(line);
             }
-            free(piped_commands);
-            piped_commands = NULL;
+            arena_reset(&line_arena);
+            continue;
         }
-        free(*path_ref);
-        *path_ref = NULL;
-        free(tokens);
-        tokens = NULL;
-        free(line);
+        pending_length = 0;
+        if(status == 0){
+            job_interrupted = 0;
+            if(trace_enabled){
+                trace_record(trace_now(), TRACE_BEGIN, "line", 0, 0, NULL);
+            }
+            done = execute_list(list);
+            if(trace_enabled){
+                trace_record(trace_now(), TRACE_END, "line", 0, last_status, NULL);
+            }
+        }else{
+            last_status = EXIT_SYNTAX_ERROR;
+        }
+
+        /********************************************************************
+        Everything this command needed (its copy, the parsed pipelines)
+            came from the line arena, so it is all released at once here.
+            The line itself belongs to read_line_stdin() or the input
+            source, which reuse it for the next line.
+        ********************************************************************/
+        arena_reset(&line_arena);
+        list = NULL;
         line = NULL;
 
     }while(!done);
 
+    if(pending_length > 0){
+        fprintf(stderr, "bcsh: syntax error: unexpected end of file\n");
+        last_status = EXIT_SYNTAX_ERROR;
+    }
+    free(pending);
+    if(!interactive){
+        close_input(&source);
+    }
+    trace_finish();
+    serve_finish(last_status);
 
-
-    return EXIT_SUCCESS;
+    return last_status;
 }
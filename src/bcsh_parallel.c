@@ -0,0 +1,376 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh_parallel.c
+ * * * * * * * * * * * * * * * * * * *
+ * The scheduler behind the parallel
+ *  command: a fixed number of job slots,
+ *  refilled as soon as a job finishes,
+ *  with the output of every job grouped
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../include/bcsh_constants.h"
+#include "../include/bcsh_arena.h"
+#include "../include/bcsh_jobs.h"
+#include "../include/bcsh_execution.h"
+#include "../include/bcsh_parallel.h"
+
+/**
+ * One running job. Its stdout and stderr go to pipes, and everything it writes is kept
+ *  until it is done, then written out at once so jobs never interleave.
+ */
+struct parallel_slot {
+    struct job* job; //NULL when the slot is free
+    long index; //Which argument the job runs, from 0
+    struct timespec start;
+    int fds[2]; //Read ends of the stdout and stderr pipes, -1 once closed
+    char* output[2];
+    size_t length[2];
+    size_t capacity[2];
+};
+
+/**
+ * The number of jobs parallel runs at once when it is not given -j: one per online core
+ */
+int default_parallel_slots(){
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if(cores < 1){
+        return 1;
+    }
+    return (cores > PARALLEL_MAX_SLOTS) ? PARALLEL_MAX_SLOTS : (int)cores;
+}
+
+/**
+ * Builds the argv of one job. Every {} in the command is replaced by the argument; if
+ *  there is none, the argument is added at the end. Everything comes from the line arena.
+ */
+static char** build_job_argv(char** command, char* arg){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    char** argv;
+    char* word;
+    char* marker;
+    size_t arg_length = strlen(arg);
+    int num_words = 0;
+    int replaced = 0;
+    int i;
+
+    while(command[num_words] != NULL){
+        num_words++;
+    }
+    argv = arena_alloc(&line_arena, (num_words + 2) * sizeof(char*));
+
+    for(i = 0; i < num_words; i++){
+        marker = strstr(command[i], "{}");
+        if(marker == NULL){
+            argv[i] = command[i];
+            continue;
+        }
+
+        /********************************************************************
+        Copy the word, with the argument in place of each {}
+        ********************************************************************/
+        word = arena_alloc(&line_arena, strlen(command[i]) * (arg_length + 1) + 1);
+        argv[i] = word;
+        replaced = 1;
+        for(marker = command[i]; *marker != '\0'; marker++){
+            if(marker[0] == '{' && marker[1] == '}'){
+                memcpy(word, arg, arg_length);
+                word += arg_length;
+                marker++;
+            }else{
+                *word++ = *marker;
+            }
+        }
+        *word = '\0';
+    }
+
+    if(!replaced){
+        argv[i++] = arg;
+    }
+    argv[i] = NULL;
+    return argv;
+}
+
+/**
+ * Writes all of a buffer, even if the descriptor takes it in pieces
+ */
+static void write_all(int fd, char* buffer, size_t length){
+    ssize_t written;
+
+    while(length > 0){
+        written = write(fd, buffer, length);
+        if(written == -1){
+            if(errno == EINTR){
+                continue;
+            }
+            return;
+        }
+        buffer += written;
+        length -= written;
+    }
+}
+
+/**
+ * Reads what a job wrote to one of its pipes into its buffer
+ */
+static void read_job_output(struct parallel_slot* slot, int which){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    char* output;
+    ssize_t bytes_read;
+
+    if(slot->capacity[which] - slot->length[which] < PARALLEL_READ_SIZE){
+        output = realloc(slot->output[which], slot->capacity[which] * 2 + PARALLEL_READ_SIZE);
+        if(output == NULL){
+            fprintf(stderr, "Error in read_job_output() : Could not allocate space for output\n");
+            exit(EXIT_FAILURE);
+        }
+        slot->output[which] = output;
+        slot->capacity[which] = slot->capacity[which] * 2 + PARALLEL_READ_SIZE;
+    }
+
+    bytes_read = read(slot->fds[which], slot->output[which] + slot->length[which],
+                      slot->capacity[which] - slot->length[which]);
+    if(bytes_read > 0){
+        slot->length[which] += bytes_read;
+    }else if(bytes_read == 0 || errno != EINTR){
+        close(slot->fds[which]);
+        slot->fds[which] = -1;
+    }
+}
+
+/**
+ * Writes out the output of a finished job and reports how it went
+ */
+static void finish_job(struct parallel_slot* slot, char* arg, int status, int quiet){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct timespec end;
+    double seconds;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    seconds = (end.tv_sec - slot->start.tv_sec) + (end.tv_nsec - slot->start.tv_nsec) / 1e9;
+
+    write_all(1, slot->output[0], slot->length[0]);
+    write_all(2, slot->output[1], slot->length[1]);
+    slot->length[0] = 0;
+    slot->length[1] = 0;
+
+    if(!quiet){
+        fprintf(stderr, "parallel: [%ld] exit %d, %.3fs: %s\n", slot->index + 1, status, seconds, arg);
+    }
+}
+
+/**
+ * Starts the job for one argument in a free slot
+ * @return The exit status of the job if it could not be started, -1 if it is running
+ */
+static int start_job(struct parallel_slot* slot, char** command, char* arg, long index){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    int out_pipe[2];
+    int err_pipe[2];
+    int no_fds[] = {-1};
+    struct child_setup setup = {-1, -1, -1, no_fds, -1, 0, NULL, 0, NULL};
+    pid_t pid;
+
+    slot->index = index;
+    clock_gettime(CLOCK_MONOTONIC, &slot->start);
+
+    slot->job = job_create(NULL, 0, 0);
+    if(slot->job == NULL){
+        return EXIT_FAILURE;
+    }
+
+    /********************************************************************
+    The pipes are close-on-exec, so the children of other slots do not
+        keep them open; dup2() clears the flag on the copies a child uses
+    ********************************************************************/
+    if(pipe2(out_pipe, O_CLOEXEC) == -1){
+        perror("Error in start_job() : Could not create pipe ");
+        job_free(slot->job);
+        slot->job = NULL;
+        return EXIT_FAILURE;
+    }
+    if(pipe2(err_pipe, O_CLOEXEC) == -1){
+        perror("Error in start_job() : Could not create pipe ");
+        close(out_pipe[0]);
+        close(out_pipe[1]);
+        job_free(slot->job);
+        slot->job = NULL;
+        return EXIT_FAILURE;
+    }
+
+    /********************************************************************
+    Jobs stay in the shell's process group, so ctrl-c reaches them
+    ********************************************************************/
+    setup.out_fd = out_pipe[1];
+    setup.err_fd = err_pipe[1];
+    pid = launch_external(build_job_argv(command, arg), &setup);
+    close(out_pipe[1]);
+    close(err_pipe[1]);
+
+    slot->fds[0] = out_pipe[0];
+    slot->fds[1] = err_pipe[0];
+    if(pid <= 0){
+        close(out_pipe[0]);
+        close(err_pipe[0]);
+        slot->fds[0] = -1;
+        slot->fds[1] = -1;
+        job_free(slot->job);
+        slot->job = NULL;
+        return (pid == 0) ? last_status : EXIT_FAILURE;
+    }
+
+    job_add_process(slot->job, pid);
+    slot->job->pgid = 0; //Not a process group of its own, see above
+    return -1;
+}
+
+/**
+ * Runs command once for every argument, with up to slots jobs running at the same time.
+ *  A new job starts as soon as any running job is done. SIGCHLD stays blocked except
+ *  while waiting in ppoll(), so a job cannot finish unnoticed between the checks.
+ * @param command The null-terminated command, where {} stands for the argument
+ * @param args The arguments, one job each
+ * @param slots How many jobs may run at once
+ * @param quiet 1 to leave out the exit status and time of every job
+ * @return 0 if every job succeeded, 1 otherwise
+ */
+int run_parallel(char** command, char** args, long num_args, int slots, int quiet){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct parallel_slot* table;
+    struct parallel_slot* slot;
+    struct pollfd* fds;
+    sigset_t old_mask;
+    sigset_t wait_mask;
+    long next = 0;
+    int running = 0;
+    int failed = 0;
+    int num_fds;
+    int status;
+    int i;
+    int j;
+
+    table = calloc(slots, sizeof(struct parallel_slot));
+    fds = malloc(slots * 2 * sizeof(struct pollfd));
+    if(table == NULL || fds == NULL){
+        fprintf(stderr, "Error in run_parallel() : Could not allocate space for job slots\n");
+        free(table);
+        free(fds);
+        return EXIT_FAILURE;
+    }
+
+    /********************************************************************
+    A forked pipeline stage starts with the default SIGCHLD action, so
+        make sure the job table hears about the jobs
+    ********************************************************************/
+    jobs_init(0);
+    fflush(stdout);
+    block_sigchld(&old_mask);
+    wait_mask = old_mask;
+    sigdelset(&wait_mask, SIGCHLD);
+
+    while(next < num_args || running > 0){
+
+        /********************************************************************
+        Fill every free slot
+        ********************************************************************/
+        for(i = 0; i < slots && next < num_args; i++){
+            slot = &table[i];
+            if(slot->job != NULL){
+                continue;
+            }
+            status = start_job(slot, command, args[next], next);
+            if(status == -1){
+                running++;
+            }else{
+                finish_job(slot, args[next], status, quiet);
+                failed |= (status != 0);
+                i--; //Try the same slot again with the next argument
+            }
+            next++;
+        }
+
+        /********************************************************************
+        Wait until a job writes something or a child changes state
+        ********************************************************************/
+        num_fds = 0;
+        for(i = 0; i < slots; i++){
+            for(j = 0; j < 2; j++){
+                if(table[i].job != NULL && table[i].fds[j] != -1){
+                    fds[num_fds].fd = table[i].fds[j];
+                    fds[num_fds].events = POLLIN;
+                    fds[num_fds].revents = 0;
+                    num_fds++;
+                }
+            }
+        }
+        if(running > 0 && ppoll(fds, num_fds, NULL, &wait_mask) == -1 && errno != EINTR){
+            perror("Error in run_parallel() : ppoll failed ");
+            break;
+        }
+
+        /********************************************************************
+        Collect output, and finish the jobs that exited and closed both
+            of their pipes
+        ********************************************************************/
+        num_fds = 0;
+        for(i = 0; i < slots; i++){
+            slot = &table[i];
+            for(j = 0; j < 2; j++){
+                if(slot->job != NULL && slot->fds[j] != -1){
+                    if(fds[num_fds].revents != 0){
+                        read_job_output(slot, j);
+                    }
+                    num_fds++;
+                }
+            }
+
+            if(slot->job != NULL && slot->job->state == JOB_DONE && slot->fds[0] == -1 && slot->fds[1] == -1){
+                status = job_status(slot->job);
+                finish_job(slot, args[slot->index], status, quiet);
+                failed |= (status != 0);
+                job_free(slot->job);
+                slot->job = NULL;
+                running--;
+            }
+        }
+    }
+
+    restore_sigmask(&old_mask);
+
+    for(i = 0; i < slots; i++){
+        free(table[i].output[0]);
+        free(table[i].output[1]);
+    }
+    free(table);
+    free(fds);
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,1665 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh_parser.c
+ * * * * * * * * * * * * * * * * * * *
+ * The lexer and parser are implemented
+ *  here. A command line is read exactly
+ *  once, left to right, and turned into
+ *  a tree without copying any words.
+ *  Loops and functions run that tree as
+ *  many times as they need, so their
+ *  bodies are never read again
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/bcsh_constants.h"
+#include "../include/bcsh_arena.h"
+#include "../include/bcsh_utils.h"
+#include "../include/bcsh_parser.h"
+
+/**
+ * Token types
+ */
+#define TOKEN_END 0
+#define TOKEN_WORD 1
+#define TOKEN_IO_NUMBER 2 //The digits in front of a redirection, like the 2 in 2>&1
+#define TOKEN_PIPE 3 //|
+#define TOKEN_AND_IF 4 //&&
+#define TOKEN_OR_IF 5 //||
+#define TOKEN_AMP 6 //&
+#define TOKEN_SEMI 7 //;
+#define TOKEN_LESS 8 //<
+#define TOKEN_GREAT 9 //>
+#define TOKEN_DGREAT 10 //>>
+#define TOKEN_LESSAND 11 //<&
+#define TOKEN_GREATAND 12 //>&
+#define TOKEN_DLESS 13 //<<
+#define TOKEN_DLESSDASH 14 //<<-
+#define TOKEN_TLESS 15 //<<<
+#define TOKEN_NEWLINE 16
+#define TOKEN_ERROR 17
+#define TOKEN_LPAREN 18 //(
+#define TOKEN_RPAREN 19 //)
+#define TOKEN_DSEMI 20 //;;
+
+/**
+ * The lexer removes quotes and escapes by copying each word over itself, so the write
+ *  position never passes the read position. The only character that can be overwritten
+ *  before it is read is the one right after a word, when the word's null terminator lands
+ *  on it; that character is kept in pending.
+ */
+struct lexer {
+    char* pos;
+    char pending;
+    int has_pending;
+    size_t* quoted; //Where the quoted pattern characters of the current word are
+    size_t num_quoted;
+    size_t quoted_capacity;
+    struct reference* references; //The $ references and command substitutions of the current word
+    size_t num_references;
+    size_t references_capacity;
+    struct redirection** heredocs; //The here-documents whose bodies start after the current line
+    size_t num_heredocs;
+    size_t heredocs_capacity;
+    int incomplete; //The input ended inside a quote, a substitution or a here-document
+};
+
+/**
+ * A $name or ${name} in a word, or a command substitution, $(command) or `command`. The
+ *  lexer leaves just the name, or the command, in the word.
+ */
+struct reference {
+    size_t start; //Where the name or command is in the word
+    size_t length;
+    int quoted; //Inside double quotes
+    int command; //A command substitution
+};
+
+struct token {
+    int type;
+    char* text;
+    char* start; //Where the token, or the comment in front of it, starts in the line
+    char* expansion; //How to expand the word (see word_expansion()), NULL if it is used as it is
+    int assignment; //The word is NAME=value
+    int literal; //Nothing in the word was quoted, escaped or referenced, so it can be a reserved word
+    long pipe_size; //The size given to a pipe with |[size], 0 if there is none
+};
+
+struct parser {
+    struct lexer lexer;
+    struct token token; //The current token
+    char* line; //The line being parsed, which the lexer modifies
+    char* source; //A copy of the line as it was written, for the text of the pipelines
+    char** slots; //Every argv array of the line is carved out of this
+    char** expansion_slots; //And their expansions, allocated with the first expansion of the line
+    size_t num_slots;
+    size_t max_slots;
+    int incomplete; //A syntax error was found at the end of the input
+    int depth; //How many compound commands are open
+    char* closer; //The reserved word, or ), that closes the outermost one, NULL outside any
+};
+
+/**
+ * What the last command found incomplete waits for, so that a line added to it is only
+ *  parsed again if it can complete it (see line_may_complete())
+ */
+static struct {
+    char* closer; //The closer of its outermost compound command, NULL if any line may complete it
+    char* delimiters; //The delimiters of its here-documents, one after the other
+    size_t delimiters_length; //0 if it has none
+    size_t delimiters_capacity;
+    int joined; //The last line ended in a backslash, so the next one continues its last word
+} waiting;
+
+/**
+ * The characters that separate the words of a line, for the checks on lines made
+ *  without parsing them
+ */
+#define WORD_SEPARATORS " \t\n;&|()<>"
+
+/**
+ * The argv of compound commands
+ */
+static char* no_words[] = {NULL};
+
+static char peek(struct lexer* lexer){
+    return lexer->has_pending ? lexer->pending : *lexer->pos;
+}
+
+static void advance(struct lexer* lexer){
+    lexer->pos++;
+    lexer->has_pending = 0;
+}
+
+/**
+ * Checks if a character ends an unquoted word
+ */
+static int is_word_end(char c){
+    switch(c){
+        case '\0':
+        case ' ':
+        case '\t':
+        case '\n':
+        case '|':
+        case '&':
+        case ';':
+        case '<':
+        case '>':
+        case '(':
+        case ')':
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * Checks if a character means something in a glob pattern
+ */
+static int is_pattern_char(char c){
+    return c == '*' || c == '?' || c == '[' || c == ']' || c == '\\';
+}
+
+/**
+ * Checks if a character can be part of a variable name
+ */
+static int is_name_char(char c){
+    return c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+}
+
+/**
+ * Remembers that the character about to be written at write came from quotes or a
+ *  backslash, if it would mean something in a pattern. Words without any are the
+ *  common case and record nothing.
+ */
+static void note_quoted(struct lexer* lexer, struct token* token, char* write, char c){
+    if(!is_pattern_char(c)){
+        return;
+    }
+    if(lexer->num_quoted == lexer->quoted_capacity){
+        lexer->quoted = arena_realloc(&line_arena, lexer->quoted, lexer->quoted_capacity * sizeof(size_t),
+                                      (lexer->quoted_capacity * 2 + 8) * sizeof(size_t));
+        lexer->quoted_capacity = lexer->quoted_capacity * 2 + 8;
+    }
+    lexer->quoted[lexer->num_quoted++] = write - token->text;
+}
+
+/**
+ * Remembers the reference whose name or command was just written, from start to write
+ */
+static void add_reference(struct lexer* lexer, struct token* token, char* start, char* write, int quoted, int command){
+    struct reference* reference;
+
+    if(lexer->num_references == lexer->references_capacity){
+        lexer->references = arena_realloc(&line_arena, lexer->references,
+                                          lexer->references_capacity * sizeof(struct reference),
+                                          (lexer->references_capacity * 2 + 4) * sizeof(struct reference));
+        lexer->references_capacity = lexer->references_capacity * 2 + 4;
+    }
+    reference = &lexer->references[lexer->num_references++];
+    reference->start = start - token->text;
+    reference->length = write - start;
+    reference->quoted = quoted;
+    reference->command = command;
+}
+
+/**
+ * Reads a command substitution written $(command), right after the $. The command is
+ *  copied as it is, quotes included, up to the ) that closes the (; it is parsed when
+ *  it runs.
+ * @param write Where the word is being written, moved past the command
+ * @return 0, or -1 if the input ends before the ) (more input can complete it)
+ */
+static int lex_substitution(struct lexer* lexer, struct token* token, char** write, int quoted){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    char* start = *write;
+    int depth = 1;
+    char quote;
+    char c;
+
+    advance(lexer);
+    while(1){
+        c = peek(lexer);
+        if(c == '\0'){
+            lexer->incomplete = 1;
+            return -1;
+        }
+        advance(lexer);
+        if(c == ')' && --depth == 0){
+            break;
+        }
+        if(c == '('){
+            depth++;
+        }
+        *(*write)++ = c;
+
+        /********************************************************************
+        A ) that is escaped or quoted does not count
+        ********************************************************************/
+        if(c == '\\' && peek(lexer) != '\0'){
+            *(*write)++ = peek(lexer);
+            advance(lexer);
+        }else if(c == '\'' || c == '"'){
+            quote = c;
+            while((c = peek(lexer)) != quote && c != '\0'){
+                *(*write)++ = c;
+                advance(lexer);
+                if(c == '\\' && quote == '"' && peek(lexer) != '\0'){
+                    *(*write)++ = peek(lexer);
+                    advance(lexer);
+                }
+            }
+            if(c == quote){
+                *(*write)++ = c;
+                advance(lexer);
+            }
+        }
+    }
+
+    add_reference(lexer, token, start, *write, quoted, 1);
+    return 0;
+}
+
+/**
+ * Reads a command substitution written `command`. Inside it, a backslash only escapes $,
+ *  ` and \ (and " inside double quotes).
+ * @param write Where the word is being written, moved past the command
+ * @return 0, or -1 if the input ends before the closing ` (more input can complete it)
+ */
+static int lex_backquote(struct lexer* lexer, struct token* token, char** write, int quoted){
+    char* start = *write;
+    char c;
+
+    advance(lexer);
+    while((c = peek(lexer)) != '`'){
+        if(c == '\0'){
+            lexer->incomplete = 1;
+            return -1;
+        }
+        advance(lexer);
+        if(c == '\\'){
+            c = peek(lexer);
+            if(c == '$' || c == '`' || c == '\\' || (quoted && c == '"')){
+                advance(lexer);
+            }else{
+                c = '\\';
+            }
+        }
+        *(*write)++ = c;
+    }
+    advance(lexer);
+
+    add_reference(lexer, token, start, *write, quoted, 1);
+    return 0;
+}
+
+/**
+ * Reads what follows a $ that is not quoted, or is inside double quotes: a name, a name
+ *  in braces, a digit, one of ?, $, !, #, @ and *, or a command substitution. The name is written in place
+ *  of the reference and remembered, to be replaced by its value when the command runs.
+ *  A $ followed by anything else is just a $.
+ * @param write Where the word is being written, moved past the name
+ * @return 0, or -1 if a ${ or $( is not closed
+ */
+static int lex_reference(struct lexer* lexer, struct token* token, char** write, int quoted){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    char* start = *write;
+    int braces = 0;
+    char c;
+
+    advance(lexer);
+    c = peek(lexer);
+    if(c == '('){
+        return lex_substitution(lexer, token, write, quoted);
+    }
+    if(c == '{'){
+        braces = 1;
+        advance(lexer);
+        c = peek(lexer);
+    }
+
+    if(c == '?' || c == '$' || c == '!' || c == '#' || c == '@' || c == '*' || (c >= '0' && c <= '9')){
+        *(*write)++ = c;
+        advance(lexer);
+    }else if(is_name_char(c)){
+        while(is_name_char(c = peek(lexer))){
+            *(*write)++ = c;
+            advance(lexer);
+        }
+    }else if(!braces){
+        *(*write)++ = '$';
+        return 0;
+    }
+
+    if(braces){
+        if(peek(lexer) != '}' || *write == start){
+            fprintf(stderr, "bcsh: syntax error: bad substitution\n");
+            return -1;
+        }
+        advance(lexer);
+    }
+
+    add_reference(lexer, token, start, *write, quoted, 0);
+    return 0;
+}
+
+/**
+ * Builds the expansion of a word that has $ references, command substitutions or
+ *  unquoted pattern characters: the word as a glob pattern, with its quoted pattern
+ *  characters escaped by a backslash so they only match themselves, and each reference
+ *  written as EXPAND_VARIABLE or EXPAND_COMMAND (EXPAND_QUOTED_VARIABLE or
+ *  EXPAND_QUOTED_COMMAND inside double quotes), its name or command, and EXPAND_END.
+ *  That needs a copy, since the word itself has no room for them. A pattern without
+ *  anything to escape is the word itself.
+ */
+static char* word_expansion(struct lexer* lexer, struct token* token, size_t length){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct reference* reference;
+    char* expansion;
+    size_t i;
+    size_t j = 0;
+    size_t next_quoted = 0;
+    size_t next_reference = 0;
+
+    if(lexer->num_quoted == 0 && lexer->num_references == 0){
+        return token->text;
+    }
+
+    expansion = arena_alloc(&line_arena, 2 * length + 2 * lexer->num_references + 1);
+    for(i = 0; i < length; i++){
+        if(next_reference < lexer->num_references && lexer->references[next_reference].start == i){
+            reference = &lexer->references[next_reference++];
+            if(reference->command){
+                expansion[j++] = reference->quoted ? EXPAND_QUOTED_COMMAND : EXPAND_COMMAND;
+            }else{
+                expansion[j++] = reference->quoted ? EXPAND_QUOTED_VARIABLE : EXPAND_VARIABLE;
+            }
+            memcpy(expansion + j, token->text + i, reference->length);
+            j += reference->length;
+            expansion[j++] = EXPAND_END;
+            i += reference->length - 1;
+            continue;
+        }
+        if((next_quoted < lexer->num_quoted && lexer->quoted[next_quoted] == i)
+           || (unsigned char)token->text[i] <= EXPAND_END){
+            expansion[j++] = '\\';
+        }
+        if(next_quoted < lexer->num_quoted && lexer->quoted[next_quoted] == i){
+            next_quoted++;
+        }
+        expansion[j++] = token->text[i];
+    }
+    expansion[j] = '\0';
+    return expansion;
+}
+
+/**
+ * Reads a word starting at the lexer's position, removing quotes and backslashes in place.
+ *  A word with $ references, command substitutions, unquoted *, ? or [, or quoted ones
+ *  (which a case pattern must tell apart) also gets an expansion, used when the command
+ *  runs. A word that starts with a name and an unquoted = is an assignment.
+ * @return TOKEN_WORD, TOKEN_IO_NUMBER if the word is all digits and touches a redirection,
+ *  or TOKEN_ERROR if the input ends inside a quote or after a backslash
+ */
+static int lex_word(struct lexer* lexer, struct token* token){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    char* write = lexer->pos;
+    char* equals = NULL;
+    char* name_end;
+    int all_digits = 1;
+    int plain = 1; //Nothing was quoted or referenced yet
+    int glob = 0;
+    char c;
+
+    token->text = write;
+    token->expansion = NULL;
+    token->assignment = 0;
+    token->literal = 0;
+    lexer->num_quoted = 0;
+    lexer->num_references = 0;
+
+    while(!is_word_end(c = peek(lexer))){
+        if(c == '\\'){
+            /********************************************************************
+            A backslash keeps the next character as it is. A backslash
+                followed by a newline joins the lines.
+            ********************************************************************/
+            plain = 0;
+            advance(lexer);
+            c = peek(lexer);
+            if(c == '\0'){
+                lexer->incomplete = 1; //The line goes on after the next one
+                return TOKEN_ERROR;
+            }
+            advance(lexer);
+            if(c != '\n'){
+                note_quoted(lexer, token, write, c);
+                *write++ = c;
+            }
+            all_digits = 0;
+        }else if(c == '\''){
+            /********************************************************************
+            Everything up to the closing single quote is literal
+            ********************************************************************/
+            plain = 0;
+            advance(lexer);
+            while((c = peek(lexer)) != '\''){
+                if(c == '\0'){
+                    lexer->incomplete = 1;
+                    return TOKEN_ERROR;
+                }
+                note_quoted(lexer, token, write, c);
+                *write++ = c;
+                advance(lexer);
+            }
+            advance(lexer);
+            all_digits = 0;
+        }else if(c == '"'){
+            /********************************************************************
+            Inside double quotes, a backslash only escapes $, `, " and \
+                (and joins lines), and $ references are still expanded
+            ********************************************************************/
+            plain = 0;
+            advance(lexer);
+            while((c = peek(lexer)) != '"'){
+                if(c == '\0'){
+                    lexer->incomplete = 1;
+                    return TOKEN_ERROR;
+                }
+                if(c == '$' || c == '`'){
+                    if(((c == '$') ? lex_reference(lexer, token, &write, 1) : lex_backquote(lexer, token, &write, 1)) == -1){
+                        return TOKEN_ERROR;
+                    }
+                    continue;
+                }
+                advance(lexer);
+                if(c == '\\'){
+                    c = peek(lexer);
+                    if(c == '$' || c == '`' || c == '"' || c == '\\'){
+                        advance(lexer);
+                    }else if(c == '\n'){
+                        advance(lexer);
+                        continue;
+                    }else{
+                        c = '\\';
+                    }
+                }
+                note_quoted(lexer, token, write, c);
+                *write++ = c;
+            }
+            advance(lexer);
+            all_digits = 0;
+        }else if(c == '$' || c == '`'){
+            plain = 0;
+            all_digits = 0;
+            if(((c == '$') ? lex_reference(lexer, token, &write, 0) : lex_backquote(lexer, token, &write, 0)) == -1){
+                return TOKEN_ERROR;
+            }
+        }else{
+            if(c < '0' || c > '9'){
+                all_digits = 0;
+            }
+            if(c == '*' || c == '?' || c == '['){
+                glob = 1;
+            }
+            if(c == '=' && plain && equals == NULL){
+                equals = write;
+            }
+            *write++ = c;
+            advance(lexer);
+        }
+    }
+
+    /********************************************************************
+    Null terminate the word, remembering the character underneath
+    ********************************************************************/
+    if(!lexer->has_pending){
+        lexer->pending = *lexer->pos;
+        lexer->has_pending = 1;
+    }
+    *write = '\0';
+
+    if(all_digits && write != token->text && (c == '<' || c == '>')){
+        return TOKEN_IO_NUMBER;
+    }
+    if(equals != NULL && equals != token->text && (*token->text < '0' || *token->text > '9')){
+        for(name_end = token->text; name_end < equals && is_name_char(*name_end); name_end++);
+        token->assignment = (name_end == equals);
+    }
+    if(glob || lexer->num_references > 0 || lexer->num_quoted > 0){
+        token->expansion = word_expansion(lexer, token, write - token->text);
+    }
+    token->literal = plain;
+    return TOKEN_WORD;
+}
+
+/**
+ * Reads the size of a pipe written |[size], right after the |
+ * @return TOKEN_PIPE, or TOKEN_ERROR if the size is not one
+ */
+static int lex_pipe_size(struct lexer* lexer, struct token* token){
+    char size[32];
+    int length = 0;
+    char c;
+
+    advance(lexer);
+    while((c = peek(lexer)) != ']' && c != '\0' && c != '\n' && length < (int)sizeof(size) - 1){
+        size[length++] = c;
+        advance(lexer);
+    }
+    size[length] = '\0';
+
+    token->pipe_size = parse_size(size);
+    if(c != ']' || token->pipe_size <= 0){
+        fprintf(stderr, "bcsh: syntax error: bad pipe size `%s'\n", size);
+        return TOKEN_ERROR;
+    }
+    advance(lexer);
+    return TOKEN_PIPE;
+}
+
+/**
+ * Remembers a here-document whose body starts on the line after the current one
+ */
+static void add_heredoc(struct lexer* lexer, struct redirection* heredoc){
+    if(lexer->num_heredocs == lexer->heredocs_capacity){
+        lexer->heredocs = arena_realloc(&line_arena, lexer->heredocs,
+                                        lexer->heredocs_capacity * sizeof(struct redirection*),
+                                        (lexer->heredocs_capacity * 2 + 4) * sizeof(struct redirection*));
+        lexer->heredocs_capacity = lexer->heredocs_capacity * 2 + 4;
+    }
+    lexer->heredocs[lexer->num_heredocs++] = heredoc;
+}
+
+/**
+ * Reads the bodies of the here-documents started on the line that just ended, in order,
+ *  from the lines that follow it, each up to its delimiter. The bodies are copied into
+ *  the line arena, and the lexer goes on after the last delimiter.
+ * @return 0, or -1 if the input ends before a delimiter (more input can complete it)
+ */
+static int lex_heredocs(struct lexer* lexer){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct redirection* heredoc;
+    char* line;
+    char* end;
+    size_t length;
+    size_t delimiter_length;
+    size_t capacity;
+    size_t i;
+
+    for(i = 0; i < lexer->num_heredocs; i++){
+        heredoc = lexer->heredocs[i];
+        delimiter_length = strlen(heredoc->target);
+        capacity = 0;
+
+        while(1){
+            if(*lexer->pos == '\0'){
+                lexer->incomplete = 1;
+                return -1;
+            }
+            line = lexer->pos;
+            end = strchrnul(line, '\n');
+            lexer->pos = (*end == '\n') ? end + 1 : end;
+            if(heredoc->type == REDIR_HEREDOC_STRIP){
+                while(*line == '\t'){
+                    line++;
+                }
+            }
+            length = end - line;
+            if(length == delimiter_length && memcmp(line, heredoc->target, length) == 0){
+                break;
+            }
+
+            /********************************************************************
+            Grow the body by doubling, with room for the newline and a null
+                terminator
+            ********************************************************************/
+            if(heredoc->length + length + 2 > capacity){
+                capacity = (capacity == 0) ? 256 : capacity;
+                while(heredoc->length + length + 2 > capacity){
+                    capacity *= 2;
+                }
+                heredoc->body = arena_realloc(&line_arena, heredoc->body, heredoc->length, capacity);
+            }
+            memcpy(heredoc->body + heredoc->length, line, length);
+            heredoc->length += length;
+            heredoc->body[heredoc->length++] = '\n';
+            heredoc->body[heredoc->length] = '\0';
+        }
+    }
+
+    lexer->num_heredocs = 0;
+    return 0;
+}
+
+/**
+ * Reads the next token of the line
+ */
+static void next_token(struct lexer* lexer, struct token* token){
+    char c;
+
+    /********************************************************************
+    Skip blanks and comments
+    ********************************************************************/
+    while(1){
+        c = peek(lexer);
+        if(c == ' ' || c == '\t'){
+            advance(lexer);
+        }else if(c == '\\' && lexer->pos[1] == '\n'){
+            advance(lexer);
+            advance(lexer);
+        }else{
+            break;
+        }
+    }
+    token->start = lexer->pos;
+    if(c == '#'){
+        while((c = peek(lexer)) != '\0' && c != '\n'){
+            advance(lexer);
+        }
+    }
+
+    token->text = NULL;
+    switch(c){
+        case '\0':
+            token->type = TOKEN_END;
+            if(lexer->num_heredocs > 0){
+                lexer->incomplete = 1; //The bodies have not started yet
+                token->type = TOKEN_ERROR;
+            }
+            return;
+        case '\n':
+            advance(lexer);
+            token->type = TOKEN_NEWLINE;
+            if(lexer->num_heredocs > 0 && lex_heredocs(lexer) == -1){
+                token->type = TOKEN_ERROR;
+            }
+            return;
+        case ';':
+            advance(lexer);
+            if(peek(lexer) == ';'){
+                advance(lexer);
+                token->type = TOKEN_DSEMI;
+            }else{
+                token->type = TOKEN_SEMI;
+            }
+            return;
+        case '(':
+            advance(lexer);
+            token->type = TOKEN_LPAREN;
+            return;
+        case ')':
+            advance(lexer);
+            token->type = TOKEN_RPAREN;
+            return;
+        case '|':
+            advance(lexer);
+            if(peek(lexer) == '|'){
+                advance(lexer);
+                token->type = TOKEN_OR_IF;
+            }else if(peek(lexer) == '['){
+                token->type = lex_pipe_size(lexer, token);
+            }else{
+                token->type = TOKEN_PIPE;
+                token->pipe_size = 0;
+            }
+            return;
+        case '&':
+            advance(lexer);
+            if(peek(lexer) == '&'){
+                advance(lexer);
+                token->type = TOKEN_AND_IF;
+            }else{
+                token->type = TOKEN_AMP;
+            }
+            return;
+        case '<':
+            advance(lexer);
+            if(peek(lexer) == '&'){
+                advance(lexer);
+                token->type = TOKEN_LESSAND;
+            }else if(peek(lexer) == '<'){
+                advance(lexer);
+                if(peek(lexer) == '<'){
+                    advance(lexer);
+                    token->type = TOKEN_TLESS;
+                }else if(peek(lexer) == '-'){
+                    advance(lexer);
+                    token->type = TOKEN_DLESSDASH;
+                }else{
+                    token->type = TOKEN_DLESS;
+                }
+            }else{
+                token->type = TOKEN_LESS;
+            }
+            return;
+        case '>':
+            advance(lexer);
+            if(peek(lexer) == '>'){
+                advance(lexer);
+                token->type = TOKEN_DGREAT;
+            }else if(peek(lexer) == '&'){
+                advance(lexer);
+                token->type = TOKEN_GREATAND;
+            }else{
+                token->type = TOKEN_GREAT;
+            }
+            return;
+        default:
+            token->type = lex_word(lexer, token);
+            return;
+    }
+}
+
+/**
+ * Prints a syntax error about the current token. One found at the end of the input is
+ *  not printed: the input is incomplete, and more lines may complete it.
+ */
+static void syntax_error(struct parser* parser){
+    static char* names[] = {"newline", NULL, NULL, "|", "&&", "||", "&", ";", "<", ">", ">>", "<&", ">&",
+                           "<<", "<<-", "<<<", "newline", NULL, "(", ")", ";;"};
+    char* name;
+
+    if(parser->token.type == TOKEN_ERROR){
+        return; //The lexer already said what went wrong, or the input is incomplete
+    }
+    if(parser->token.type == TOKEN_END){
+        parser->incomplete = 1;
+        return;
+    }
+    name = (parser->token.text != NULL) ? parser->token.text : names[parser->token.type];
+    fprintf(stderr, "bcsh: syntax error near unexpected token `%s'\n", name);
+}
+
+/**
+ * Checks if the current token is the reserved word given. Reserved words only count
+ *  where a command starts, and only if nothing in them was quoted.
+ */
+static int is_word(struct parser* parser, char* word){
+    return parser->token.type == TOKEN_WORD && parser->token.literal && strcmp(parser->token.text, word) == 0;
+}
+
+/**
+ * Checks if the current token ends a list: the end of the input, ), ;; or a reserved
+ *  word that closes or continues a compound command
+ */
+static int ends_list(struct parser* parser){
+    static char* words[] = {"then", "elif", "else", "fi", "do", "done", "esac", "}"};
+    size_t i;
+
+    switch(parser->token.type){
+        case TOKEN_END:
+        case TOKEN_RPAREN:
+        case TOKEN_DSEMI:
+            return 1;
+        case TOKEN_WORD:
+            for(i = 0; i < sizeof(words) / sizeof(words[0]); i++){
+                if(is_word(parser, words[i])){
+                    return 1;
+                }
+            }
+            return 0;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * Checks if the current token starts a compound command
+ */
+static int starts_compound(struct parser* parser){
+    return parser->token.type == TOKEN_LPAREN || is_word(parser, "{") || is_word(parser, "if")
+           || is_word(parser, "while") || is_word(parser, "until") || is_word(parser, "for")
+           || is_word(parser, "case");
+}
+
+/**
+ * Moves past the current token, which has to be the reserved word given
+ * @return 0, or -1 on a syntax error
+ */
+static int expect_word(struct parser* parser, char* word){
+    if(!is_word(parser, word)){
+        syntax_error(parser);
+        return -1;
+    }
+    next_token(&parser->lexer, &parser->token);
+    return 0;
+}
+
+static void skip_newlines(struct parser* parser){
+    while(parser->token.type == TOKEN_NEWLINE){
+        next_token(&parser->lexer, &parser->token);
+    }
+}
+
+/**
+ * Stores the current word in the next argv slot, and its expansion in the matching
+ *  expansion slot
+ * @param first The slot of the first word of the group the word belongs to
+ * @param expansions Set to the expansions of that group, once one of its words has one
+ */
+static void store_word(struct parser* parser, char** first, char*** expansions){
+    if(parser->token.expansion != NULL){
+        if(parser->expansion_slots == NULL){
+            parser->expansion_slots = arena_alloc(&line_arena, parser->max_slots * sizeof(char*));
+            memset(parser->expansion_slots, 0, parser->max_slots * sizeof(char*));
+        }
+        *expansions = parser->expansion_slots + (first - parser->slots);
+        (*expansions)[parser->num_slots - (first - parser->slots)] = parser->token.expansion;
+    }
+    parser->slots[parser->num_slots++] = parser->token.text;
+}
+
+/**
+ * Makes an empty command
+ * @param words Where its words go
+ */
+static struct command* new_command(char** words){
+    struct command* command = arena_alloc(&line_arena, sizeof(struct command));
+
+    command->assignments = words;
+    command->num_assignments = 0;
+    command->argv = words;
+    command->argc = 0;
+    command->expansions = NULL;
+    command->redirections = NULL;
+    command->compound = NULL;
+    command->pipe_size = 0;
+    command->next = NULL;
+    return command;
+}
+
+/**
+ * Makes a pipeline of the one compound command given, for an elif
+ */
+static struct pipeline* compound_pipeline(struct compound* compound){
+    struct pipeline* pipeline = arena_alloc(&line_arena, sizeof(struct pipeline));
+
+    pipeline->commands = new_command(no_words);
+    pipeline->commands->compound = compound;
+    pipeline->num_commands = 1;
+    pipeline->text = NULL;
+    pipeline->text_length = 0;
+    pipeline->connector = CONNECT_END;
+    pipeline->background = 0;
+    pipeline->next = NULL;
+    return pipeline;
+}
+
+/**
+ * Parses one redirection, the current token being its operator
+ * @param fd The descriptor given in front of the operator, -1 for the default one
+ * @return The redirection, NULL on a syntax error
+ */
+static struct redirection* parse_redirection(struct parser* parser, int fd){
+    struct redirection* redirection = arena_alloc(&line_arena, sizeof(struct redirection));
+
+    switch(parser->token.type){
+        case TOKEN_LESS:
+            redirection->type = REDIR_IN;
+            break;
+        case TOKEN_GREAT:
+            redirection->type = REDIR_OUT;
+            break;
+        case TOKEN_DGREAT:
+            redirection->type = REDIR_APPEND;
+            break;
+        case TOKEN_LESSAND:
+            redirection->type = REDIR_DUP_IN;
+            break;
+        case TOKEN_DLESS:
+            redirection->type = REDIR_HEREDOC;
+            break;
+        case TOKEN_DLESSDASH:
+            redirection->type = REDIR_HEREDOC_STRIP;
+            break;
+        case TOKEN_TLESS:
+            redirection->type = REDIR_HERESTRING;
+            break;
+        default:
+            redirection->type = REDIR_DUP_OUT;
+            break;
+    }
+    if(fd == -1){
+        fd = (redirection->type == REDIR_OUT || redirection->type == REDIR_APPEND
+              || redirection->type == REDIR_DUP_OUT) ? 1 : 0;
+    }
+    redirection->fd = fd;
+    redirection->body = NULL;
+    redirection->length = 0;
+    redirection->next = NULL;
+
+    next_token(&parser->lexer, &parser->token);
+    if(parser->token.type != TOKEN_WORD){
+        if(parser->token.type == TOKEN_END){
+            parser->token.type = TOKEN_NEWLINE; //More input would not give the redirection its word
+        }
+        syntax_error(parser);
+        return NULL;
+    }
+    redirection->target = parser->token.text;
+    redirection->expansion = parser->token.expansion;
+
+    /********************************************************************
+    A here-string is its word and a newline. The body of a here-document
+        is on the lines after this one, see lex_heredocs().
+    ********************************************************************/
+    if(redirection->type == REDIR_HERESTRING){
+        redirection->length = strlen(redirection->target) + 1;
+        redirection->body = arena_alloc(&line_arena, redirection->length + 1);
+        memcpy(redirection->body, redirection->target, redirection->length - 1);
+        redirection->body[redirection->length - 1] = '\n';
+        redirection->body[redirection->length] = '\0';
+    }else if(redirection->type == REDIR_HEREDOC || redirection->type == REDIR_HEREDOC_STRIP){
+        add_heredoc(&parser->lexer, redirection);
+    }
+    next_token(&parser->lexer, &parser->token);
+
+    return redirection;
+}
+
+static int parse_list(struct parser* parser, struct pipeline** list);
+
+static struct compound* parse_compound(struct parser* parser);
+
+/**
+ * Parses a function definition, name() compound-command, the current token being the (
+ *  after the name
+ * @param command The command holding the name, which becomes the definition
+ * @return The command, NULL on a syntax error
+ */
+static struct command* parse_function(struct parser* parser, struct command* command){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct compound* compound = arena_alloc(&line_arena, sizeof(struct compound));
+    struct command* body;
+    struct redirection** tail;
+    int fd;
+
+    memset(compound, 0, sizeof(struct compound));
+    compound->type = COMPOUND_FUNCTION;
+    compound->name = command->argv[0];
+    parser->num_slots--;
+    command->assignments = no_words;
+    command->argv = no_words;
+    command->argc = 0;
+    command->expansions = NULL;
+    command->compound = compound;
+
+    next_token(&parser->lexer, &parser->token);
+    if(parser->token.type != TOKEN_RPAREN){
+        syntax_error(parser);
+        return NULL;
+    }
+    next_token(&parser->lexer, &parser->token);
+    skip_newlines(parser);
+    if(!starts_compound(parser)){
+        syntax_error(parser);
+        return NULL;
+    }
+
+    /********************************************************************
+    The body is a compound command, with the redirections that follow it
+    ********************************************************************/
+    body = new_command(no_words);
+    body->compound = parse_compound(parser);
+    if(body->compound == NULL){
+        return NULL;
+    }
+    tail = &body->redirections;
+    while(1){
+        fd = -1;
+        if(parser->token.type == TOKEN_IO_NUMBER){
+            fd = atoi(parser->token.text);
+            next_token(&parser->lexer, &parser->token);
+        }else if(parser->token.type < TOKEN_LESS || parser->token.type > TOKEN_TLESS){
+            break;
+        }
+        *tail = parse_redirection(parser, fd);
+        if(*tail == NULL){
+            return NULL;
+        }
+        tail = &(*tail)->next;
+    }
+    compound->function = body;
+    return command;
+}
+
+/**
+ * Parses a command: a simple command (words and redirections in any order), a compound
+ *  command and its redirections, or a function definition
+ * @return The command, NULL on a syntax error or if there is no command here
+ */
+static struct command* parse_command(struct parser* parser){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct command* command = new_command(parser->slots + parser->num_slots);
+    struct redirection** tail = &command->redirections;
+    int first;
+    int fd;
+
+    if(starts_compound(parser)){
+        command->assignments = no_words;
+        command->argv = no_words;
+        command->compound = parse_compound(parser);
+        if(command->compound == NULL){
+            return NULL;
+        }
+    }
+
+    while(1){
+        fd = -1;
+        switch(parser->token.type){
+            case TOKEN_WORD:
+                if(command->compound != NULL){
+                    break;
+                }
+                first = (command->argc == 0 && command->num_assignments == 0 && command->redirections == NULL
+                         && parser->token.literal && !parser->token.assignment);
+                store_word(parser, command->assignments, &command->expansions);
+
+                /********************************************************************
+                Assignments in front of the command name are kept apart from
+                    its arguments
+                ********************************************************************/
+                if(parser->token.assignment && command->argc == 0){
+                    command->num_assignments++;
+                    command->argv++;
+                }else{
+                    command->argc++;
+                }
+                next_token(&parser->lexer, &parser->token);
+
+                /********************************************************************
+                A name followed by ( defines a function
+                ********************************************************************/
+                if(first && parser->token.type == TOKEN_LPAREN){
+                    return parse_function(parser, command);
+                }
+                continue;
+            case TOKEN_IO_NUMBER:
+                fd = atoi(parser->token.text);
+                next_token(&parser->lexer, &parser->token); //The redirection operator follows
+                /* fall through */
+            case TOKEN_LESS:
+            case TOKEN_GREAT:
+            case TOKEN_DGREAT:
+            case TOKEN_LESSAND:
+            case TOKEN_GREATAND:
+            case TOKEN_DLESS:
+            case TOKEN_DLESSDASH:
+            case TOKEN_TLESS:
+                *tail = parse_redirection(parser, fd);
+                if(*tail == NULL){
+                    return NULL;
+                }
+                tail = &(*tail)->next;
+                continue;
+            default:
+                break;
+        }
+        break;
+    }
+
+    if(command->compound != NULL){
+        return command;
+    }
+    if(command->argc == 0 && command->num_assignments == 0 && command->redirections == NULL){
+        syntax_error(parser);
+        return NULL;
+    }
+
+    parser->slots[parser->num_slots++] = NULL;
+    return command;
+}
+
+/**
+ * Parses commands separated by pipes
+ * @return The pipeline, NULL on a syntax error
+ */
+static struct pipeline* parse_pipeline(struct parser* parser){
+    struct pipeline* pipeline = arena_alloc(&line_arena, sizeof(struct pipeline));
+    struct command** tail = &pipeline->commands;
+    char* start = parser->token.start;
+    size_t length;
+
+    pipeline->num_commands = 0;
+    pipeline->connector = CONNECT_END;
+    pipeline->background = 0;
+    pipeline->next = NULL;
+
+    while(1){
+        *tail = parse_command(parser);
+        if(*tail == NULL){
+            return NULL;
+        }
+        pipeline->num_commands++;
+
+        if(parser->token.type != TOKEN_PIPE){
+            //Its text runs up to the token after it, without the blanks in between
+            pipeline->text = parser->source + (start - parser->line);
+            length = parser->token.start - start;
+            while(length > 0 && (pipeline->text[length - 1] == ' ' || pipeline->text[length - 1] == '\t'
+                                 || pipeline->text[length - 1] == '\n')){
+                length--;
+            }
+            pipeline->text_length = length;
+            return pipeline;
+        }
+        (*tail)->pipe_size = parser->token.pipe_size;
+        tail = &(*tail)->next;
+        next_token(&parser->lexer, &parser->token);
+        skip_newlines(parser);
+    }
+}
+
+/**
+ * Parses a list that cannot be empty, followed by the reserved word that ends it
+ * @return 0, or -1 on a syntax error
+ */
+static int parse_body(struct parser* parser, struct pipeline** list, char* end){
+    if(parse_list(parser, list) == -1){
+        return -1;
+    }
+    if(*list == NULL){
+        syntax_error(parser);
+        return -1;
+    }
+    return expect_word(parser, end);
+}
+
+/**
+ * Parses the rest of an if, after the if (or elif): the condition, the then part, and
+ *  the elif and else parts up to the fi. An elif becomes an if of its own, in the else
+ *  part, which reads the fi.
+ * @return 0, or -1 on a syntax error
+ */
+static int parse_if(struct parser* parser, struct compound* compound){
+    struct compound* elif;
+
+    compound->type = COMPOUND_IF;
+    if(parse_body(parser, &compound->condition, "then") == -1 || parse_list(parser, &compound->body) == -1){
+        return -1;
+    }
+    if(compound->body == NULL){
+        syntax_error(parser);
+        return -1;
+    }
+
+    if(is_word(parser, "elif")){
+        next_token(&parser->lexer, &parser->token);
+        elif = arena_alloc(&line_arena, sizeof(struct compound));
+        memset(elif, 0, sizeof(struct compound));
+        if(parse_if(parser, elif) == -1){
+            return -1;
+        }
+        compound->else_body = compound_pipeline(elif);
+        return 0;
+    }
+    if(is_word(parser, "else")){
+        next_token(&parser->lexer, &parser->token);
+        if(parse_list(parser, &compound->else_body) == -1){
+            return -1;
+        }
+        if(compound->else_body == NULL){
+            syntax_error(parser);
+            return -1;
+        }
+    }
+    return expect_word(parser, "fi");
+}
+
+/**
+ * Parses the rest of a for, after the for: the name, the words after in, and the body
+ * @return 0, or -1 on a syntax error
+ */
+static int parse_for(struct parser* parser, struct compound* compound){
+    char* c;
+
+    compound->type = COMPOUND_FOR;
+    if(parser->token.type != TOKEN_WORD || !parser->token.literal
+       || (parser->token.text[0] >= '0' && parser->token.text[0] <= '9')){
+        syntax_error(parser);
+        return -1;
+    }
+    for(c = parser->token.text; *c != '\0'; c++){
+        if(!is_name_char(*c)){
+            syntax_error(parser);
+            return -1;
+        }
+    }
+    compound->name = parser->token.text;
+    next_token(&parser->lexer, &parser->token);
+    skip_newlines(parser);
+
+    /********************************************************************
+    Without in, the loop goes through the positional parameters
+    ********************************************************************/
+    if(is_word(parser, "in")){
+        next_token(&parser->lexer, &parser->token);
+        compound->words = parser->slots + parser->num_slots;
+        while(parser->token.type == TOKEN_WORD){
+            store_word(parser, compound->words, &compound->expansions);
+            compound->num_words++;
+            next_token(&parser->lexer, &parser->token);
+        }
+        if(parser->token.type != TOKEN_SEMI && parser->token.type != TOKEN_NEWLINE){
+            syntax_error(parser);
+            return -1;
+        }
+        next_token(&parser->lexer, &parser->token);
+    }else if(parser->token.type == TOKEN_SEMI){
+        next_token(&parser->lexer, &parser->token);
+    }
+    skip_newlines(parser);
+
+    if(expect_word(parser, "do") == -1){
+        return -1;
+    }
+    return parse_body(parser, &compound->body, "done");
+}
+
+/**
+ * Parses the rest of a case, after the case: the word, then each item up to the esac
+ * @return 0, or -1 on a syntax error
+ */
+static int parse_case(struct parser* parser, struct compound* compound){
+    struct case_item** tail = &compound->items;
+    struct case_item* item;
+
+    compound->type = COMPOUND_CASE;
+    if(parser->token.type != TOKEN_WORD){
+        syntax_error(parser);
+        return -1;
+    }
+    compound->words = parser->slots + parser->num_slots;
+    store_word(parser, compound->words, &compound->expansions);
+    compound->num_words = 1;
+    next_token(&parser->lexer, &parser->token);
+    skip_newlines(parser);
+    if(expect_word(parser, "in") == -1){
+        return -1;
+    }
+
+    while(1){
+        skip_newlines(parser);
+        if(is_word(parser, "esac")){
+            break;
+        }
+
+        /********************************************************************
+        The patterns of an item, separated by |, up to the )
+        ********************************************************************/
+        item = arena_alloc(&line_arena, sizeof(struct case_item));
+        memset(item, 0, sizeof(struct case_item));
+        if(parser->token.type == TOKEN_LPAREN){
+            next_token(&parser->lexer, &parser->token);
+        }
+        item->patterns = parser->slots + parser->num_slots;
+        while(1){
+            if(parser->token.type != TOKEN_WORD){
+                syntax_error(parser);
+                return -1;
+            }
+            store_word(parser, item->patterns, &item->expansions);
+            item->num_patterns++;
+            next_token(&parser->lexer, &parser->token);
+            if(parser->token.type != TOKEN_PIPE){
+                break;
+            }
+            next_token(&parser->lexer, &parser->token);
+        }
+        if(parser->token.type != TOKEN_RPAREN){
+            syntax_error(parser);
+            return -1;
+        }
+        next_token(&parser->lexer, &parser->token);
+
+        if(parse_list(parser, &item->body) == -1){
+            return -1;
+        }
+        *tail = item;
+        tail = &item->next;
+
+        /********************************************************************
+        The last item does not need its ;;
+        ********************************************************************/
+        if(parser->token.type == TOKEN_DSEMI){
+            next_token(&parser->lexer, &parser->token);
+        }else if(!is_word(parser, "esac")){
+            syntax_error(parser);
+            return -1;
+        }
+    }
+
+    next_token(&parser->lexer, &parser->token);
+    return 0;
+}
+
+/**
+ * Parses a compound command, the current token being the ( or the reserved word that
+ *  starts it
+ * @return The compound command, NULL on a syntax error
+ */
+static struct compound* parse_compound(struct parser* parser){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct compound* compound = arena_alloc(&line_arena, sizeof(struct compound));
+    int subshell = (parser->token.type == TOKEN_LPAREN);
+    char* word = parser->token.text;
+    int result;
+
+    memset(compound, 0, sizeof(struct compound));
+    next_token(&parser->lexer, &parser->token);
+    if(parser->depth++ == 0){
+        parser->closer = subshell ? ")" : (strcmp(word, "{") == 0) ? "}" : (strcmp(word, "if") == 0) ? "fi"
+                         : (strcmp(word, "case") == 0) ? "esac" : "done";
+    }
+
+    if(subshell){
+        compound->type = COMPOUND_SUBSHELL;
+        result = parse_list(parser, &compound->body);
+        if(result == 0 && (compound->body == NULL || parser->token.type != TOKEN_RPAREN)){
+            syntax_error(parser);
+            result = -1;
+        }
+        if(result == 0){
+            next_token(&parser->lexer, &parser->token);
+        }
+    }else if(strcmp(word, "{") == 0){
+        compound->type = COMPOUND_BRACE;
+        result = parse_body(parser, &compound->body, "}");
+    }else if(strcmp(word, "if") == 0){
+        result = parse_if(parser, compound);
+    }else if(strcmp(word, "for") == 0){
+        result = parse_for(parser, compound);
+    }else if(strcmp(word, "case") == 0){
+        result = parse_case(parser, compound);
+    }else{
+        compound->type = (strcmp(word, "while") == 0) ? COMPOUND_WHILE : COMPOUND_UNTIL;
+        result = parse_body(parser, &compound->condition, "do");
+        if(result == 0){
+            result = parse_body(parser, &compound->body, "done");
+        }
+    }
+
+    if(result == -1){
+        return NULL; //The closer stays, for an input that ends before it
+    }
+    if(--parser->depth == 0){
+        parser->closer = NULL;
+    }
+    return compound;
+}
+
+/**
+ * Parses pipelines separated by ;, &, &&, || or newlines, up to the end of the input or a
+ *  token that ends a list (see ends_list()), which is left for the caller to check
+ * @param list Set to the first pipeline, NULL if the list is empty
+ * @return 0 if the list was parsed, -1 on a syntax error
+ */
+static int parse_list(struct parser* parser, struct pipeline** list){
+    struct pipeline** tail = list;
+
+    *list = NULL;
+    while(1){
+        /********************************************************************
+        Skip empty commands between separators, like the end of "ls ;"
+        ********************************************************************/
+        while(parser->token.type == TOKEN_SEMI || parser->token.type == TOKEN_NEWLINE){
+            next_token(&parser->lexer, &parser->token);
+        }
+        if(ends_list(parser)){
+            return 0;
+        }
+
+        *tail = parse_pipeline(parser);
+        if(*tail == NULL){
+            return -1;
+        }
+
+        switch(parser->token.type){
+            case TOKEN_AND_IF:
+                (*tail)->connector = CONNECT_AND;
+                break;
+            case TOKEN_OR_IF:
+                (*tail)->connector = CONNECT_OR;
+                break;
+            case TOKEN_AMP:
+                (*tail)->background = 1;
+                break;
+            case TOKEN_SEMI:
+            case TOKEN_NEWLINE:
+                break;
+            default:
+                if(ends_list(parser)){
+                    return 0;
+                }
+                syntax_error(parser);
+                return -1;
+        }
+
+        /********************************************************************
+        && and || need a pipeline after them, which may be on the next line
+        ********************************************************************/
+        next_token(&parser->lexer, &parser->token);
+        if((*tail)->connector != CONNECT_END){
+            skip_newlines(parser);
+            if(ends_list(parser) || parser->token.type == TOKEN_SEMI){
+                syntax_error(parser);
+                return -1;
+            }
+        }
+        tail = &(*tail)->next;
+    }
+}
+
+/**
+ * Checks if a word appears in a line, separated from what is around it by blanks or
+ *  operators. Quotes are not looked at, so a quoted word counts too.
+ */
+static int has_word(char* line, char* word){
+    size_t length = strlen(word);
+    char* c = line;
+
+    while(*c != '\0'){
+        c += strspn(c, WORD_SEPARATORS);
+        if(strncmp(c, word, length) == 0 && (c[length] == '\0' || strchr(WORD_SEPARATORS, c[length]) != NULL)){
+            return 1;
+        }
+        c += strcspn(c, WORD_SEPARATORS);
+    }
+    return 0;
+}
+
+/**
+ * Remembers what an incomplete command waits for: the delimiters of its here-documents
+ *  if it has any, or else the closer of its outermost compound command. Input that ends
+ *  inside a quote or a substitution, or right after an operator, waits for nothing in
+ *  particular.
+ */
+static void note_waiting(struct parser* parser){
+    size_t length;
+    size_t i;
+
+    waiting.closer = parser->lexer.incomplete ? NULL : parser->closer;
+    waiting.delimiters_length = 0;
+    waiting.joined = 0;
+    for(i = 0; i < parser->lexer.num_heredocs; i++){
+        length = strlen(parser->lexer.heredocs[i]->target) + 1;
+        if(waiting.delimiters_length + length > waiting.delimiters_capacity){
+            waiting.delimiters_capacity = (waiting.delimiters_length + length) * 2;
+            waiting.delimiters = realloc(waiting.delimiters, waiting.delimiters_capacity);
+            if(waiting.delimiters == NULL){
+                fprintf(stderr, "Error in note_waiting() : Could not reallocate space for delimiters\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        memcpy(waiting.delimiters + waiting.delimiters_length, parser->lexer.heredocs[i]->target, length);
+        waiting.delimiters_length += length;
+    }
+}
+
+/**
+ * Gives a name for a command in job descriptions and reports: its first word, or the
+ *  keyword of a compound command
+ */
+char* command_name(struct command* command){
+    static char* keywords[] = {"{", "(", "if", "while", "until", "for", "case"};
+
+    if(command->argc > 0){
+        return command->argv[0];
+    }
+    if(command->compound == NULL){
+        return "";
+    }
+    if(command->compound->type == COMPOUND_FUNCTION){
+        return command->compound->name;
+    }
+    return keywords[command->compound->type];
+}
+
+/**
+ * This function parses a whole command line in a single pass: the lexer hands the parser
+ *  one token at a time, and each word is unquoted in place and stored straight into the
+ *  argv array of its command. The result is a list of pipelines joined by ;, &, && or ||,
+ *  whose commands may be compound commands holding lists of their own. The bodies of
+ *  here-documents are read from the lines that follow the one they start on.
+ *  Everything is allocated from the line arena and points into line, which is modified.
+ * ex. ls -l | grep a && echo found
+ *  list = {{ls, -l} | {grep, a}} && {{echo, found}}
+ * @param line The command line, which is modified. It may hold several lines.
+ * @param list Set to the first pipeline of the line, NULL if the line is empty
+ * @return 0 if the line was parsed, -1 if it has a syntax error, PARSE_INCOMPLETE if it
+ *  ends in the middle of a command
+ */
+int parse_line(char* line, struct pipeline** list){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct parser parser;
+    size_t length = strlen(line);
+
+    /********************************************************************
+    Every word takes at least one character and every command's null
+        terminator needs a separator (or the end of the line), so there
+        can never be more than strlen(line) + 1 argv slots in total. The
+        pipelines keep their text in a copy of the line, taken before the
+        lexer modifies it, for the jobs they start.
+    ********************************************************************/
+    memset(&parser.lexer, 0, sizeof(struct lexer));
+    parser.lexer.pos = line;
+    parser.line = line;
+    parser.source = arena_alloc(&line_arena, length + 1);
+    memcpy(parser.source, line, length + 1);
+    parser.max_slots = length + 2;
+    parser.slots = arena_alloc(&line_arena, parser.max_slots * sizeof(char*));
+    parser.expansion_slots = NULL;
+    parser.num_slots = 0;
+    parser.incomplete = 0;
+    parser.depth = 0;
+    parser.closer = NULL;
+
+    next_token(&parser.lexer, &parser.token);
+    if(parse_list(&parser, list) == 0){
+        if(parser.token.type == TOKEN_END){
+            return 0;
+        }
+        syntax_error(&parser); //A reserved word or ) with nothing to close
+    }
+    if(!parser.incomplete && !parser.lexer.incomplete){
+        return -1;
+    }
+    note_waiting(&parser);
+    return PARSE_INCOMPLETE;
+}
+
+/**
+ * Checks if a line may stop in the middle of a command, without parsing it. Only a
+ *  quote, a backslash, a substitution, a here-document, an operator or a redirection
+ *  with nothing after it, a function definition or a compound command can leave a line
+ *  unfinished, and a line with none of their characters or reserved words cannot. Such
+ *  a line is parsed in place, as nothing of it has to be kept for the lines that follow.
+ * @return 1 if it may, 0 if it is certainly complete (or a syntax error)
+ */
+int line_may_continue(char* line){
+    static char* openers[] = {"{", "if", "while", "until", "for", "case"};
+    size_t i;
+
+    if(strpbrk(line, "\\'\"`|&<>(") != NULL){
+        return 1;
+    }
+    for(i = 0; i < sizeof(openers) / sizeof(openers[0]); i++){
+        if(has_word(line, openers[i])){
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Checks if a line added to the command parse_line() last found incomplete may complete
+ *  it. A command inside a compound command is only complete once the reserved word (or
+ *  the parenthesis) that closes the outermost one comes, and one with here-documents
+ *  once the line of a delimiter comes, so the other lines are not parsed at all: parsing
+ *  the whole command again for each of them would take time growing with the square of
+ *  its length. Anything else, like an open quote or a line that ends in |, may be
+ *  completed by any line.
+ * @return 1 if the command has to be parsed again, 0 if it certainly stays incomplete
+ */
+int line_may_complete(char* line){
+    size_t length = strcspn(line, "\n");
+    int joined = waiting.joined;
+    char* delimiter;
+
+    waiting.joined = (length > 0 && line[length - 1] == '\\');
+    if(joined){
+        return 1; //The word that closes it may start on the line before
+    }
+
+    if(waiting.delimiters_length > 0){
+        while(*line == '\t'){
+            line++;
+            length--;
+        }
+        for(delimiter = waiting.delimiters; delimiter < waiting.delimiters + waiting.delimiters_length;
+            delimiter += strlen(delimiter) + 1){
+            if(strlen(delimiter) == length && memcmp(line, delimiter, length) == 0){
+                return 1;
+            }
+        }
+        return 0;
+    }
+    if(waiting.closer == NULL){
+        return 1;
+    }
+    return (waiting.closer[0] == ')') ? (strchr(line, ')') != NULL) : has_word(line, waiting.closer);
+}
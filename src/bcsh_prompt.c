@@ -0,0 +1,533 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh_prompt.c
+ * * * * * * * * * * * * * * * * * * *
+ * The prompt engine: the prompt is made
+ *  of segments that are only computed
+ *  when something they show changed, and
+ *  the VCS segment is refreshed in the
+ *  background, and again on a timer
+ *  while the prompt is shown
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pwd.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../include/bcsh_constants.h"
+#include "../include/bcsh_utils.h"
+#include "../include/bcsh_hash.h"
+#include "../include/bcsh_jobs.h"
+#include "../include/bcsh_execution.h"
+#include "../include/bcsh_prompt.h"
+#include "../include/bcsh_vars.h"
+#include "../include/bcsh_events.h"
+
+/**
+ * One piece of the prompt: literal text, or what a %x sequence stands for
+ */
+struct prompt_segment {
+    char kind; //0 for literal text, otherwise the letter after %
+    char* text; //Malloced
+    size_t length;
+    unsigned long key; //What text was computed from (a generation, a status...)
+    int valid;
+};
+
+static char* prompt_format = NULL;
+
+static struct prompt_segment* segments = NULL;
+
+static int num_segments = 0;
+
+/**
+ * The whole prompt, rebuilt only when a segment changed
+ */
+static char* rendered = NULL;
+
+static size_t rendered_capacity = 0;
+
+/**
+ * What the VCS segment knows about the repository the shell is in. The branch is read
+ *  from .git/HEAD when the directory changes; whether there are changes takes running
+ *  git status, which is done in the background.
+ */
+static char* vcs_root = NULL; //The directory holding .git, NULL outside of a repository
+static char vcs_branch[VCS_BRANCH_LENGTH];
+static int vcs_dirty = -1; //-1 until git status has answered
+static unsigned long vcs_cwd_generation = 0; //The cwd generation vcs_root was found for
+static unsigned long vcs_generation = 0; //Changes whenever any of the above does
+static int vcs_fd = -1; //Read end of the output of a running git status, -1 if none
+static size_t vcs_output = 0; //Bytes git status wrote so far
+static int vcs_unavailable = 0; //git is not installed
+static int vcs_timer = -1; //Goes off when git status is due again, see vcs_due()
+
+/**
+ * Replaces the text of a segment
+ */
+static void set_segment_text(struct prompt_segment* segment, const char* text, size_t length){
+    char* copy = realloc(segment->text, length + 1);
+
+    if(copy == NULL){
+        fprintf(stderr, "Error in set_segment_text() : Could not allocate space for prompt\n");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    segment->text = copy;
+    segment->length = length;
+}
+
+/**
+ * Sets the format of the prompt and splits it into segments
+ *  %d  the working directory         %~  the same, with $HOME as ~
+ *  %c  the last part of the working directory
+ *  %u  the user name                 %h  the host name, up to the first dot
+ *  %s  the exit status of the last command
+ *  %j  the number of jobs            %g  the VCS branch, with * if there are changes
+ *  %$  # for root, % otherwise       %%  a %
+ * @param format The format, NULL for the default one
+ */
+void prompt_set_format(char* format){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct prompt_segment* segment;
+    char* start;
+    char* text;
+    int i;
+
+    if(format == NULL){
+        format = DEFAULT_PROMPT;
+    }
+
+    for(i = 0; i < num_segments; i++){
+        free(segments[i].text);
+    }
+    free(segments);
+    free(prompt_format);
+    prompt_format = strdup(format);
+
+    /********************************************************************
+    There are at most two segments per character of the format
+    ********************************************************************/
+    segments = calloc(strlen(format) * 2 + 1, sizeof(struct prompt_segment));
+    num_segments = 0;
+    if(segments == NULL || prompt_format == NULL){
+        fprintf(stderr, "Error in prompt_set_format() : Could not allocate space for prompt\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for(text = format; *text != '\0';){
+        segment = &segments[num_segments++];
+        if(text[0] == '%' && text[1] != '\0' && text[1] != '%'){
+            segment->kind = text[1];
+            text += 2;
+            continue;
+        }
+
+        /********************************************************************
+        Literal text runs until the next % sequence, with %% as a %
+        ********************************************************************/
+        segment->kind = 0;
+        segment->valid = 1;
+        start = text;
+        if(text[0] == '%'){
+            set_segment_text(segment, "%", 1);
+            text += 2;
+            continue;
+        }
+        while(*text != '\0' && *text != '%'){
+            text++;
+        }
+        set_segment_text(segment, start, text - start);
+    }
+
+    rendered_capacity = 0;
+}
+
+/**
+ * The current format of the prompt
+ */
+char* prompt_get_format(){
+    return prompt_format;
+}
+
+/**
+ * Finds the repository the working directory is in by walking up to the closest .git,
+ *  and reads its branch from HEAD. Done once per cd.
+ */
+static void vcs_find_repository(){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    char* cwd = get_cwd();
+    char* path;
+    char* end;
+    size_t length = strlen(cwd);
+    struct stat info;
+    FILE* head;
+    char line[VCS_BRANCH_LENGTH + 16];
+
+    free(vcs_root);
+    vcs_root = NULL;
+    vcs_dirty = -1;
+    vcs_branch[0] = '\0';
+
+    path = malloc(length + sizeof("/.git/HEAD"));
+    if(path == NULL || cwd[0] != '/'){
+        free(path);
+        return;
+    }
+    memcpy(path, cwd, length + 1);
+
+    for(;;){
+        strcpy(path + length, "/.git");
+        if(stat(path, &info) == 0){
+            break;
+        }
+        if(length == 0){
+            free(path);
+            return;
+        }
+        while(length > 0 && path[--length] != '/');
+    }
+
+    /********************************************************************
+    HEAD names the branch, or holds a commit when it is detached
+    ********************************************************************/
+    path[length] = '\0';
+    vcs_root = strdup((length == 0) ? "/" : path);
+    strcpy(path + length, "/.git/HEAD");
+    head = fopen(path, "r");
+    if(head != NULL){
+        if(fgets(line, sizeof(line), head) != NULL){
+            end = strchr(line, '\n');
+            if(end != NULL){
+                *end = '\0';
+            }
+            if(strncmp(line, "ref: refs/heads/", 16) == 0){
+                snprintf(vcs_branch, sizeof(vcs_branch), "%s", line + 16);
+            }else{
+                snprintf(vcs_branch, sizeof(vcs_branch), "%.7s", line);
+            }
+        }
+        fclose(head);
+    }else{
+        //A worktree or submodule, where .git is a file; the branch is left to git
+        strcpy(vcs_branch, "git");
+    }
+    free(path);
+}
+
+/**
+ * Collects what a running git status wrote, without waiting. Any output means there are
+ *  changes.
+ */
+static void vcs_poll(){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    char buffer[PROMPT_READ_SIZE];
+    struct timespec now;
+    ssize_t bytes_read;
+
+    if(vcs_fd == -1){
+        return;
+    }
+    while((bytes_read = read(vcs_fd, buffer, sizeof(buffer))) > 0){
+        vcs_output += bytes_read;
+    }
+    if(bytes_read == -1 && (errno == EAGAIN || errno == EINTR)){
+        return;
+    }
+
+    events_unwatch(vcs_fd);
+    close(vcs_fd);
+    vcs_fd = -1;
+    if(vcs_dirty != (vcs_output > 0)){
+        vcs_dirty = (vcs_output > 0);
+        vcs_generation++;
+    }
+    if(vcs_timer != -1){
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        events_arm(vcs_timer, (unsigned long long) now.tv_sec * 1000000000ULL + now.tv_nsec + PROMPT_VCS_INTERVAL);
+    }
+}
+
+/**
+ * Reads the answer of git status as it comes, while a line is edited
+ * @return EVENT_WAKE if the prompt has to be drawn again with it
+ */
+static int vcs_ready(int fd){
+    unsigned long generation = vcs_generation;
+
+    (void) fd;
+    vcs_poll();
+    return (vcs_generation != generation) ? EVENT_WAKE : EVENT_QUIET;
+}
+
+/**
+ * Starts git status in the background. Its output goes to a non-blocking pipe that the
+ *  event loop watches, so a prompt that is already shown is updated when the answer
+ *  comes; otherwise vcs_poll() reads it when the next prompt is shown. The child is
+ *  reaped like any other.
+ */
+static void vcs_refresh(){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    static char* argv[] = {"git", "status", "--porcelain", "--untracked-files=no", NULL};
+    static int null_fd = -1;
+    int output[2];
+    int no_fds[] = {-1};
+    struct child_setup setup = {-1, -1, -1, no_fds, -1, 0, NULL, 0, NULL};
+    sigset_t old_mask;
+    pid_t pid;
+
+    if(vcs_unavailable || vcs_root == NULL || vcs_fd != -1){
+        return;
+    }
+    if(hash_lookup("git") == NULL){
+        vcs_unavailable = 1;
+        return;
+    }
+    if(null_fd == -1){
+        null_fd = open("/dev/null", O_RDWR | O_CLOEXEC);
+    }
+    if(pipe2(output, O_CLOEXEC) == -1){
+        return;
+    }
+
+    setup.in_fd = null_fd;
+    setup.out_fd = output[1];
+    setup.err_fd = null_fd;
+    block_sigchld(&old_mask);
+    pid = launch_external(argv, &setup);
+    restore_sigmask(&old_mask);
+    close(output[1]);
+
+    if(pid <= 0){
+        close(output[0]);
+        vcs_unavailable = 1;
+        return;
+    }
+    fcntl(output[0], F_SETFL, O_NONBLOCK);
+    vcs_fd = output[0];
+    vcs_output = 0;
+    events_watch(vcs_fd, vcs_ready);
+}
+
+/**
+ * Runs git status again when a prompt has been shown for PROMPT_VCS_INTERVAL, so that
+ *  changes made meanwhile, by an editor or another shell, show up without a new prompt
+ */
+static int vcs_due(int fd){
+    uint64_t expirations;
+
+    if(read(fd, &expirations, sizeof(expirations)) > 0){
+        vcs_refresh();
+    }
+    return EVENT_QUIET;
+}
+
+/**
+ * Brings what the VCS segment knows up to date, without ever waiting for git
+ */
+static void vcs_update(){
+    if(vcs_cwd_generation != cwd_generation){
+        if(vcs_fd != -1){
+            //The answer would be about the old directory
+            events_unwatch(vcs_fd);
+            close(vcs_fd);
+            vcs_fd = -1;
+        }
+        vcs_find_repository();
+        vcs_cwd_generation = cwd_generation;
+        vcs_generation++;
+        if(vcs_timer != -1 && vcs_root == NULL){
+            events_arm(vcs_timer, 0);
+        }
+    }
+    if(vcs_timer == -1 && vcs_root != NULL){
+        vcs_timer = events_timer(vcs_due);
+    }
+    vcs_poll();
+    vcs_refresh();
+}
+
+/**
+ * Works out the key of a segment: when it is the same as the one the text was computed
+ *  from, the text is still right
+ */
+static unsigned long segment_key(char kind){
+    switch(kind){
+        case 'd':
+        case '~':
+        case 'c':
+            return cwd_generation;
+        case 's':
+            return (unsigned long)last_status;
+        case 'j':
+            return (unsigned long)jobs_count_active();
+        case 'g':
+            vcs_update();
+            return vcs_generation;
+    }
+    return 0;
+}
+
+/**
+ * Computes the text of a segment
+ */
+static void compute_segment(struct prompt_segment* segment){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    char buffer[VCS_BRANCH_LENGTH + 8];
+    char* cwd = get_cwd();
+    char* home;
+    char* slash;
+    struct passwd* user;
+    size_t home_length;
+
+    switch(segment->kind){
+        case 'd':
+            set_segment_text(segment, cwd, strlen(cwd));
+            return;
+        case '~':
+            home = var_get("HOME");
+            home_length = (home != NULL) ? strlen(home) : 0;
+            if(home_length > 1 && strncmp(cwd, home, home_length) == 0
+               && (cwd[home_length] == '/' || cwd[home_length] == '\0')){
+                //Keep the last character of $HOME, to be replaced by ~
+                set_segment_text(segment, cwd + home_length - 1, strlen(cwd) - home_length + 1);
+                segment->text[0] = '~';
+            }else{
+                set_segment_text(segment, cwd, strlen(cwd));
+            }
+            return;
+        case 'c':
+            slash = strrchr(cwd, '/');
+            slash = (slash != NULL && slash[1] != '\0') ? slash + 1 : cwd;
+            set_segment_text(segment, slash, strlen(slash));
+            return;
+        case 'u':
+            user = getpwuid(geteuid());
+            home = (user != NULL) ? user->pw_name : var_get("USER");
+            if(home == NULL){
+                home = "";
+            }
+            set_segment_text(segment, home, strlen(home));
+            return;
+        case 'h':
+            if(gethostname(buffer, sizeof(buffer)) == -1){
+                buffer[0] = '\0';
+            }
+            buffer[sizeof(buffer) - 1] = '\0';
+            slash = strchr(buffer, '.');
+            if(slash != NULL){
+                *slash = '\0';
+            }
+            set_segment_text(segment, buffer, strlen(buffer));
+            return;
+        case 's':
+        case 'j':
+            snprintf(buffer, sizeof(buffer), "%lu", segment->key);
+            set_segment_text(segment, buffer, strlen(buffer));
+            return;
+        case 'g':
+            if(vcs_root == NULL){
+                set_segment_text(segment, "", 0);
+            }else{
+                snprintf(buffer, sizeof(buffer), "%s%s", vcs_branch, (vcs_dirty == 1) ? "*" : "");
+                set_segment_text(segment, buffer, strlen(buffer));
+            }
+            return;
+        case '$':
+            set_segment_text(segment, (geteuid() == 0) ? "#" : "%", 1);
+            return;
+    }
+
+    //Unknown sequences are shown as they are
+    buffer[0] = '%';
+    buffer[1] = segment->kind;
+    set_segment_text(segment, buffer, 2);
+}
+
+/**
+ * Renders the prompt. Only the segments whose inputs changed since the last prompt are
+ *  computed again, so the cost does not depend on how deep the working directory is, and
+ *  the prompt is not rebuilt at all when nothing changed.
+ * @return The prompt, valid until the next call
+ */
+char* prompt_render(){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct prompt_segment* segment;
+    unsigned long key;
+    size_t length = 0;
+    int changed = (rendered_capacity == 0);
+    int i;
+
+    if(segments == NULL){
+        prompt_set_format(NULL);
+    }
+
+    for(i = 0; i < num_segments; i++){
+        segment = &segments[i];
+        if(segment->kind == 0){
+            length += segment->length;
+            continue;
+        }
+        key = segment_key(segment->kind);
+        if(!segment->valid || segment->key != key){
+            segment->key = key;
+            segment->valid = 1;
+            compute_segment(segment);
+            changed = 1;
+        }
+        length += segment->length;
+    }
+
+    if(!changed){
+        return rendered;
+    }
+
+    /********************************************************************
+    Put the segments together
+    ********************************************************************/
+    if(length + 1 > rendered_capacity){
+        rendered = realloc(rendered, length + 1);
+        if(rendered == NULL){
+            fprintf(stderr, "Error in prompt_render() : Could not allocate space for prompt\n");
+            exit(EXIT_FAILURE);
+        }
+        rendered_capacity = length + 1;
+    }
+    length = 0;
+    for(i = 0; i < num_segments; i++){
+        memcpy(rendered + length, segments[i].text, segments[i].length);
+        length += segments[i].length;
+    }
+    rendered[length] = '\0';
+
+    return rendered;
+}
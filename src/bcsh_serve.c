@@ -0,0 +1,398 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh_serve.c
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh --serve socket keeps a shell
+ *  running that takes command lines over
+ *  a Unix socket. Each request is run by
+ *  a copy of the shell forked for it,
+ *  which already has everything set up,
+ *  in the working directory and with the
+ *  environment and the descriptors of
+ *  the client. The copy runs the command
+ *  as bcsh -c would, then sends back its
+ *  exit status.
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/signalfd.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "../include/bcsh_constants.h"
+#include "../include/bcsh_execution.h"
+#include "../include/bcsh_utils.h"
+#include "../include/bcsh_vars.h"
+#include "../include/bcsh_zygote.h"
+#include "../include/bcsh_serve.h"
+
+/**
+ * A client connected to the server, and the copy of the shell running its request, 0
+ *  while it has none
+ */
+struct connection {
+    int fd;
+    pid_t worker;
+};
+
+/**
+ * In a copy of the shell running a request, the connection its status goes back to;
+ *  -1 anywhere else
+ */
+static int reply_fd = -1;
+
+/**
+ * Receives one message, retrying when interrupted
+ * @return Its length, 0 if the client is gone
+ */
+static ssize_t receive(int socket, struct msghdr* message){
+    ssize_t length;
+
+    do{
+        length = recvmsg(socket, message, MSG_CMSG_CLOEXEC);
+    }while(length == -1 && errno == EINTR);
+    return (length == -1) ? 0 : length;
+}
+
+/**
+ * Takes the request waiting on a connection, in the copy of the shell forked to run it,
+ *  and puts the copy in the client's place: its descriptors, its working directory and
+ *  its environment, which replaces the server's, so the command sees what bcsh -c run
+ *  by the client would. A copy that cannot get a complete request leaves.
+ * @return The command to run
+ */
+static char* take_request(int socket){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct serve_request request;
+    struct msghdr message;
+    struct iovec vector;
+    struct cmsghdr* control;
+    union {
+        struct cmsghdr header;
+        char buffer[CMSG_SPACE(SERVE_NUM_FDS * sizeof(int))];
+    } fd_buffer;
+    int fds[SERVE_NUM_FDS];
+    int num_fds = 0;
+    char* strings;
+    char* c;
+    size_t received;
+    ssize_t length;
+    int i;
+
+    memset(&message, 0, sizeof(message));
+    vector.iov_base = &request;
+    vector.iov_len = sizeof(request);
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = fd_buffer.buffer;
+    message.msg_controllen = sizeof(fd_buffer.buffer);
+    length = receive(socket, &message);
+    for(control = CMSG_FIRSTHDR(&message); control != NULL; control = CMSG_NXTHDR(&message, control)){
+        if(control->cmsg_level == SOL_SOCKET && control->cmsg_type == SCM_RIGHTS){
+            num_fds = (control->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            memcpy(fds, CMSG_DATA(control), num_fds * sizeof(int));
+        }
+    }
+    if(length != sizeof(request) || num_fds != SERVE_NUM_FDS || request.length == 0){
+        _exit(EXIT_FAILURE);
+    }
+
+    strings = malloc(request.length);
+    if(strings == NULL){
+        fprintf(stderr, "Error in take_request() : Could not allocate space for the request\n");
+        exit(EXIT_FAILURE);
+    }
+    for(received = 0; received < request.length; received += length){
+        memset(&message, 0, sizeof(message));
+        vector.iov_base = strings + received;
+        vector.iov_len = request.length - received;
+        message.msg_iov = &vector;
+        message.msg_iovlen = 1;
+        length = receive(socket, &message);
+        if(length == 0){
+            _exit(EXIT_FAILURE);
+        }
+    }
+    strings[request.length - 1] = '\0';
+
+    /********************************************************************
+    Become the client. $? starts at 0 as in a new shell, not at the
+        status the server had when it forked.
+    ********************************************************************/
+    last_status = EXIT_SUCCESS;
+    for(i = 0; i < 3; i++){
+        dup2(fds[i], i);
+    }
+    if(fchdir(fds[3]) == -1){
+        fprintf(stderr, "bcsh: cannot change to the working directory of the request: %s\n", strerror(errno));
+    }
+    for(i = 0; i < SERVE_NUM_FDS; i++){
+        close(fds[i]);
+    }
+    vars_unset_exported();
+    c = strings + strlen(strings) + 1;
+    for(i = 0; i < request.envc && c < strings + request.length; i++){
+        var_assign(c, 1);
+        c += strlen(c) + 1;
+    }
+    cwd_init();
+
+    reply_fd = socket;
+    return strings;
+}
+
+/**
+ * Runs the server until it gets SIGTERM, SIGINT or SIGHUP. Every connection is served
+ *  at the same time, each request by a copy of the shell of its own, up to
+ *  max_in_flight copies; the requests beyond wait in their sockets until one is done.
+ *  A client may send one request after the other on its connection. As the requests
+ *  run as the user of the server, only that user may connect: the socket is made with
+ *  mode 0600, and a connection from another user is closed at once.
+ * @param path Where the socket is made; a socket left there by a server that is gone is
+ *  replaced, but not one a server still answers on
+ * @return In a copy of the shell, the command it has to run; in the server, NULL once it
+ *  stops, with last_status set
+ */
+char* serve(char* path, int max_in_flight){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct sockaddr_un address;
+    struct signalfd_siginfo infos[EVENTS_BATCH];
+    struct connection* connections = NULL;
+    struct pollfd* polled = NULL;
+    struct ucred peer;
+    struct stat info;
+    socklen_t peer_length;
+    sigset_t signals;
+    mode_t old_umask;
+    sigset_t old_mask;
+    size_t num_connections = 0;
+    size_t capacity = 0;
+    size_t num_polled;
+    size_t i;
+    size_t j;
+    ssize_t length;
+    int listen_fd;
+    int signal_fd;
+    int in_flight = 0;
+    int stopping = 0;
+    int fd;
+    char peek;
+    pid_t pid;
+
+    last_status = EXIT_FAILURE;
+    if(strlen(path) >= sizeof(address.sun_path)){
+        fprintf(stderr, "bcsh: --serve: %s: %s\n", path, strerror(ENAMETOOLONG));
+        return NULL;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    if(lstat(path, &info) == 0 && S_ISSOCK(info.st_mode)){
+        fd = client_connect(path);
+        if(fd != -1){
+            close(fd);
+            fprintf(stderr, "bcsh: --serve: %s: a server is already running there\n", path);
+            return NULL;
+        }
+        unlink(path);
+    }
+
+    /********************************************************************
+    The socket is made with mode 0600 from the start, so nobody else
+        can connect between the bind() and a chmod()
+    ********************************************************************/
+    listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if(listen_fd == -1){
+        fprintf(stderr, "bcsh: --serve: %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    old_umask = umask(S_IXUSR | S_IRWXG | S_IRWXO);
+    if(bind(listen_fd, (struct sockaddr*) &address, sizeof(address)) == -1){
+        umask(old_umask);
+        fprintf(stderr, "bcsh: --serve: %s: %s\n", path, strerror(errno));
+        close(listen_fd);
+        return NULL;
+    }
+    umask(old_umask);
+    if(listen(listen_fd, SOMAXCONN) == -1){
+        fprintf(stderr, "bcsh: --serve: %s: %s\n", path, strerror(errno));
+        unlink(path);
+        close(listen_fd);
+        return NULL;
+    }
+
+    /********************************************************************
+    The signals come through a signalfd, polled with the connections
+    ********************************************************************/
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGCHLD);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGHUP);
+    sigprocmask(SIG_BLOCK, &signals, &old_mask);
+    signal_fd = signalfd(-1, &signals, SFD_CLOEXEC);
+    if(signal_fd == -1){
+        fprintf(stderr, "bcsh: --serve: signalfd: %s\n", strerror(errno));
+        return NULL;
+    }
+
+    while(!stopping){
+
+        /********************************************************************
+        Wait for signals, new clients, and requests on the connections
+            that have none running, while there is room for one more
+        ********************************************************************/
+        if(num_connections + 2 > capacity){
+            capacity = (capacity == 0) ? 16 : capacity * 2;
+            connections = realloc(connections, capacity * sizeof(struct connection));
+            polled = realloc(polled, capacity * sizeof(struct pollfd));
+            if(connections == NULL || polled == NULL){
+                fprintf(stderr, "Error in serve() : Could not reallocate space for connections\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        polled[0].fd = signal_fd;
+        polled[1].fd = listen_fd;
+        num_polled = 2;
+        for(i = 0; i < num_connections && in_flight < max_in_flight; i++){
+            if(connections[i].worker == 0){
+                polled[num_polled++].fd = connections[i].fd;
+            }
+        }
+        for(i = 0; i < num_polled; i++){
+            polled[i].events = POLLIN;
+            polled[i].revents = 0;
+        }
+        if(poll(polled, num_polled, -1) == -1){
+            continue;
+        }
+
+        if(polled[0].revents & POLLIN){
+            length = read(signal_fd, infos, sizeof(infos));
+            for(i = 0; length > 0 && i < length / sizeof(struct signalfd_siginfo); i++){
+                if(infos[i].ssi_signo != SIGCHLD){
+                    stopping = 1;
+                }
+            }
+            while((pid = waitpid(-1, NULL, WNOHANG)) > 0){
+                for(i = 0; i < num_connections; i++){
+                    if(connections[i].worker == pid){
+                        connections[i].worker = 0;
+                        in_flight--;
+                    }
+                }
+            }
+        }
+
+        if(polled[1].revents & POLLIN){
+            fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+            peer_length = sizeof(peer);
+            if(fd != -1 && (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &peer_length) == -1
+                            || peer.uid != geteuid())){
+                close(fd); //Another user, whose commands would run as this one
+                fd = -1;
+            }
+            if(fd != -1){
+                connections[num_connections].fd = fd;
+                connections[num_connections].worker = 0;
+                num_connections++;
+            }
+        }
+
+        /********************************************************************
+        A request gets a copy of the shell, which returns from here to run
+            it; a connection the client closed is dropped
+        ********************************************************************/
+        for(i = 2; i < num_polled && !stopping; i++){
+            if(polled[i].revents == 0){
+                continue;
+            }
+            for(j = 0; connections[j].fd != polled[i].fd; j++);
+            if(recv(polled[i].fd, &peek, 1, MSG_PEEK | MSG_DONTWAIT) <= 0){
+                close(polled[i].fd);
+                connections[j].fd = -1;
+                continue;
+            }
+            fflush(stdout);
+            pid = fork();
+            if(pid == 0){
+                //We're in child, the copy that runs the request
+                for(j = 0; j < num_connections; j++){
+                    if(connections[j].fd != polled[i].fd && connections[j].fd != -1){
+                        close(connections[j].fd);
+                    }
+                }
+                close(listen_fd);
+                close(signal_fd);
+                sigprocmask(SIG_SETMASK, &old_mask, NULL);
+                zygote_detach();
+                return take_request(polled[i].fd);
+            }
+            if(pid == -1){
+                perror("Error in serve() : fork failed ");
+                continue;
+            }
+            connections[j].worker = pid;
+            in_flight++;
+        }
+
+        for(i = 0, j = 0; i < num_connections; i++){
+            if(connections[i].fd != -1){
+                connections[j++] = connections[i];
+            }
+        }
+        num_connections = j;
+    }
+
+    /********************************************************************
+    Stop taking requests; the ones running finish on their own
+    ********************************************************************/
+    unlink(path);
+    close(listen_fd);
+    close(signal_fd);
+    for(i = 0; i < num_connections; i++){
+        close(connections[i].fd);
+    }
+    free(connections);
+    free(polled);
+    sigprocmask(SIG_SETMASK, &old_mask, NULL);
+    last_status = EXIT_SUCCESS;
+    return NULL;
+}
+
+/**
+ * Sends the exit status of the request back to its client, once the copy of the shell
+ *  that ran it is done. Does nothing anywhere else.
+ */
+void serve_finish(int status){
+    struct serve_reply reply;
+
+    if(reply_fd == -1){
+        return;
+    }
+    fflush(stdout);
+    fflush(stderr);
+    reply.status = status;
+    if(send(reply_fd, &reply, sizeof(reply), MSG_NOSIGNAL) == -1){
+        perror("bcsh: --serve: could not answer the client ");
+    }
+    close(reply_fd);
+    reply_fd = -1;
+}
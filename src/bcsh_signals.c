@@ -4,17 +4,112 @@
  * * * * * * * * * * * * * * * * * * *
  * bcsh_signals.c
  * * * * * * * * * * * * * * * * * * *
- * Signal handlers will be implemented here
+ * Signal handlers will be implemented here,
+ *  along with what handles the signals
+ *  that come through the event loop
  * * * * * * * * * * * * * * * * * * *
  */
 
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "../include/bcsh_jobs.h"
+#include "../include/bcsh_trace.h"
+#include "../include/bcsh_events.h"
+#include "../include/bcsh_signals.h"
 
 extern volatile sig_atomic_t signal_handled;
 
 void signal_handler(int signum){
+    (void) signum;
     signal_handled = 1;
-    signal(signum, signal_handler);
+}
+
+/**
+ * Installs a handler with sigaction(), which stays installed once it ran. System calls
+ *  it interrupts are restarted. The handler may also be SIG_IGN or SIG_DFL.
+ */
+void catch_signal(int signum, void (*handler)(int signum)){
+    struct sigaction action;
+
+    action.sa_handler = handler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(signum, &action, NULL);
+}
+
+/**
+ * Records, while tracing, the end of a child that was just reaped
+ */
+static void trace_exit(pid_t pid, int status){
+    if(trace_enabled && (WIFEXITED(status) || WIFSIGNALED(status))){
+        trace_record(trace_now(), TRACE_END, "exit", pid,
+                     WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status), NULL);
+    }
+}
+
+/**
+ * Reaps every child that changed state (exited, was killed, stopped or continued) and
+ *  records it in the job table, along with the resources it used. Children never stay
+ *  zombies, even while the shell is waiting for input.
+ */
+void sigchld_handler(int signum){
+    int saved_errno = errno;
+    int status;
+    struct rusage usage;
+    siginfo_t info;
+    pid_t pid;
+
+    /********************************************************************
+    Under set -o pipestats, look at each child that exited while it is
+        still a zombie, as /proc forgets it once it is reaped
+    ********************************************************************/
+    while(pipe_stats){
+        info.si_pid = 0;
+        if(waitid(P_ALL, 0, &info, WEXITED | WNOHANG | WNOWAIT) == -1 || info.si_pid == 0){
+            break;
+        }
+        job_record_stats(info.si_pid);
+        if(wait4(info.si_pid, &status, WNOHANG, &usage) > 0){
+            trace_exit(info.si_pid, status);
+            job_record_status(info.si_pid, status, &usage);
+        }
+    }
+
+    while((pid = wait4(-1, &status, WNOHANG | WUNTRACED | WCONTINUED, &usage)) > 0){
+        trace_exit(pid, status);
+        job_record_status(pid, status, &usage);
+    }
+
+    errno = saved_errno;
+}
+
+/**
+ * Handles SIGCHLD from the event loop, while the shell waits for input: the children
+ *  are reaped right away, and the line being edited makes room for the notification of
+ *  a job that finished or stopped
+ */
+int sigchld_event(int signum){
+    sigchld_handler(signum);
+    return jobs_count_unnotified() > 0 ? EVENT_WAKE : EVENT_QUIET;
+}
+
+/**
+ * Handles SIGINT from the event loop: the line being read is dropped
+ */
+int sigint_event(int signum){
+    (void) signum;
+    return EVENT_INTERRUPT;
+}
+
+/**
+ * Handles a signal the shell ignores while it waits for input, like SIGTSTP
+ */
+int ignore_event(int signum){
+    (void) signum;
+    return EVENT_QUIET;
 }
@@ -0,0 +1,260 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh_time.c
+ * * * * * * * * * * * * * * * * * * *
+ * The time keyword, which reports the
+ *  time and resources a pipeline used,
+ *  as a whole and for each stage
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "../include/bcsh_constants.h"
+#include "../include/bcsh_arena.h"
+#include "../include/bcsh_parser.h"
+#include "../include/bcsh_jobs.h"
+#include "../include/bcsh_time.h"
+
+/**
+ * Reads the options of time and removes them, along with the word time, from the first
+ *  command of the pipeline.
+ *  time        prints a readable report
+ *  time -p     prints real, user and sys in the POSIX format
+ *  time -j     prints the report as one line of JSON
+ * @param format Set to one of the TIME_FORMAT_* values
+ * @return 0 on success, -1 if an option is not known
+ */
+int time_options(struct command* command, int* format){
+    *format = TIME_FORMAT_HUMAN;
+
+    command->argv++;
+    command->argc--;
+    while(command->argc > 0 && command->argv[0][0] == '-'){
+        if(strcmp(command->argv[0], "-p") == 0){
+            *format = TIME_FORMAT_POSIX;
+        }else if(strcmp(command->argv[0], "-j") == 0){
+            *format = TIME_FORMAT_JSON;
+        }else if(strcmp(command->argv[0], "--") == 0){
+            command->argv++;
+            command->argc--;
+            break;
+        }else{
+            fprintf(stderr, "bcsh: time: unknown option %s\n", command->argv[0]);
+            return -1;
+        }
+        command->argv++;
+        command->argc--;
+    }
+    return 0;
+}
+
+/**
+ * Starts timing a pipeline
+ */
+void time_start(struct time_report* report, int format){
+    report->format = format;
+    report->stages = NULL;
+    report->num_stages = 0;
+    report->capacity = 0;
+    getrusage(RUSAGE_SELF, &report->shell_start);
+    clock_gettime(CLOCK_MONOTONIC, &report->start);
+}
+
+/**
+ * Remembers a process the pipeline started, so its usage can be reported on its own
+ */
+void time_add_stage(struct time_report* report, char* name, pid_t pid){
+    struct time_stage* stage;
+
+    if(report->num_stages == report->capacity){
+        report->stages = arena_realloc(&line_arena, report->stages,
+                                       report->capacity * sizeof(struct time_stage),
+                                       (report->capacity * 2 + JOB_INLINE_PROCESSES) * sizeof(struct time_stage));
+        report->capacity = report->capacity * 2 + JOB_INLINE_PROCESSES;
+    }
+
+    stage = &report->stages[report->num_stages++];
+    stage->name = name;
+    stage->pid = pid;
+    stage->status = 0;
+    memset(&stage->usage, 0, sizeof(stage->usage));
+    stage->real = 0;
+    stage->exit_order = 0;
+}
+
+/**
+ * Copies the status and usage wait4() reported for the processes of a job into the
+ *  report, with how long each ran and in which order they ended. SIGCHLD must be
+ *  blocked.
+ */
+void time_collect(struct time_report* report, struct job* job){
+    struct process* process;
+    int i;
+    int j;
+
+    for(i = 0; i < job->num_processes; i++){
+        process = &job->processes[i];
+        for(j = 0; j < report->num_stages; j++){
+            if(report->stages[j].pid == process->pid){
+                report->stages[j].status = process->status;
+                report->stages[j].usage = process->usage;
+                report->stages[j].exit_order = process->exit_order;
+                if(process->exit_order > 0){
+                    report->stages[j].real = (process->ended.tv_sec - process->started.tv_sec)
+                                             + (process->ended.tv_nsec - process->started.tv_nsec) / 1e9;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Turns a timeval into seconds
+ */
+static double seconds_of(struct timeval* time){
+    return time->tv_sec + time->tv_usec / 1e6;
+}
+
+/**
+ * Adds the usage of a stage to the total of the pipeline. Times and counts add up,
+ *  while the maximum resident set size is the largest one.
+ */
+static void add_usage(struct rusage* total, struct rusage* usage){
+    timeradd(&total->ru_utime, &usage->ru_utime, &total->ru_utime);
+    timeradd(&total->ru_stime, &usage->ru_stime, &total->ru_stime);
+    if(usage->ru_maxrss > total->ru_maxrss){
+        total->ru_maxrss = usage->ru_maxrss;
+    }
+    total->ru_nvcsw += usage->ru_nvcsw;
+    total->ru_nivcsw += usage->ru_nivcsw;
+    total->ru_majflt += usage->ru_majflt;
+    total->ru_minflt += usage->ru_minflt;
+}
+
+/**
+ * Prints a string as a JSON string
+ */
+static void print_json_string(char* string){
+    fputc('"', stderr);
+    for(; *string != '\0'; string++){
+        if(*string == '"' || *string == '\\'){
+            fprintf(stderr, "\\%c", *string);
+        }else if((unsigned char)*string < 0x20){
+            fprintf(stderr, "\\u%04x", *string);
+        }else{
+            fputc(*string, stderr);
+        }
+    }
+    fputc('"', stderr);
+}
+
+/**
+ * Prints the fields of a usage as JSON object members
+ */
+static void print_json_usage(struct rusage* usage){
+    fprintf(stderr, "\"user\":%.6f,\"sys\":%.6f,\"maxrss_kb\":%ld,"
+            "\"voluntary_ctxsw\":%ld,\"involuntary_ctxsw\":%ld,\"major_faults\":%ld,\"minor_faults\":%ld",
+            seconds_of(&usage->ru_utime), seconds_of(&usage->ru_stime), usage->ru_maxrss,
+            usage->ru_nvcsw, usage->ru_nivcsw, usage->ru_majflt, usage->ru_minflt);
+}
+
+/**
+ * Turns a status filled in by wait4() into a shell exit status
+ */
+static int exit_status_of(int status){
+    if(WIFSIGNALED(status)){
+        return 128 + WTERMSIG(status);
+    }
+    return WEXITSTATUS(status);
+}
+
+/**
+ * Prints the report of a timed pipeline on stderr. The total is the usage of every stage
+ *  plus what the shell itself used meanwhile (internal commands run inside the shell).
+ * @param status The exit status of the pipeline
+ */
+void time_finish(struct time_report* report, int status){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct timespec end;
+    struct rusage shell_end;
+    struct rusage total;
+    struct time_stage* stage;
+    double real;
+    int i;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    getrusage(RUSAGE_SELF, &shell_end);
+    real = (end.tv_sec - report->start.tv_sec) + (end.tv_nsec - report->start.tv_nsec) / 1e9;
+
+    /********************************************************************
+    Start the total from the shell's own usage during the pipeline
+    ********************************************************************/
+    memset(&total, 0, sizeof(total));
+    timersub(&shell_end.ru_utime, &report->shell_start.ru_utime, &total.ru_utime);
+    timersub(&shell_end.ru_stime, &report->shell_start.ru_stime, &total.ru_stime);
+    total.ru_nvcsw = shell_end.ru_nvcsw - report->shell_start.ru_nvcsw;
+    total.ru_nivcsw = shell_end.ru_nivcsw - report->shell_start.ru_nivcsw;
+    total.ru_majflt = shell_end.ru_majflt - report->shell_start.ru_majflt;
+    total.ru_minflt = shell_end.ru_minflt - report->shell_start.ru_minflt;
+    for(i = 0; i < report->num_stages; i++){
+        add_usage(&total, &report->stages[i].usage);
+    }
+
+    fflush(stdout);
+
+    if(report->format == TIME_FORMAT_POSIX){
+        fprintf(stderr, "real %.2f\nuser %.2f\nsys %.2f\n",
+                real, seconds_of(&total.ru_utime), seconds_of(&total.ru_stime));
+        return;
+    }
+
+    if(report->format == TIME_FORMAT_JSON){
+        fprintf(stderr, "{\"status\":%d,\"real\":%.6f,", status, real);
+        print_json_usage(&total);
+        fprintf(stderr, ",\"stages\":[");
+        for(i = 0; i < report->num_stages; i++){
+            stage = &report->stages[i];
+            fprintf(stderr, "%s{\"command\":", (i > 0) ? "," : "");
+            print_json_string(stage->name);
+            fprintf(stderr, ",\"pid\":%d,\"status\":%d,\"real\":%.6f,\"exit_order\":%d,", (int)stage->pid,
+                    exit_status_of(stage->status), stage->real, stage->exit_order);
+            print_json_usage(&stage->usage);
+            fprintf(stderr, "}");
+        }
+        fprintf(stderr, "]}\n");
+        return;
+    }
+
+    fprintf(stderr, "real    %.3fs\n", real);
+    fprintf(stderr, "user    %.3fs\n", seconds_of(&total.ru_utime));
+    fprintf(stderr, "sys     %.3fs\n", seconds_of(&total.ru_stime));
+    fprintf(stderr, "maxrss  %ld KB\n", total.ru_maxrss);
+    fprintf(stderr, "ctxsw   %ld voluntary, %ld involuntary\n", total.ru_nvcsw, total.ru_nivcsw);
+    fprintf(stderr, "faults  %ld major, %ld minor\n", total.ru_majflt, total.ru_minflt);
+
+    /********************************************************************
+    A pipeline also gets one line per stage
+    ********************************************************************/
+    if(report->num_stages > 1){
+        for(i = 0; i < report->num_stages; i++){
+            stage = &report->stages[i];
+            fprintf(stderr, "  [%d] %-12s exit %-3d ended #%d real %.3fs user %.3fs sys %.3fs maxrss %ld KB ctxsw %ld/%ld faults %ld/%ld\n",
+                    i + 1, stage->name, exit_status_of(stage->status), stage->exit_order, stage->real,
+                    seconds_of(&stage->usage.ru_utime), seconds_of(&stage->usage.ru_stime),
+                    stage->usage.ru_maxrss, stage->usage.ru_nvcsw, stage->usage.ru_nivcsw,
+                    stage->usage.ru_majflt, stage->usage.ru_minflt);
+        }
+    }
+}
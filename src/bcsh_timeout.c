@@ -0,0 +1,151 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh_timeout.c
+ * * * * * * * * * * * * * * * * * * *
+ * The timeout keyword, which limits how
+ *  long a pipeline may run. The job table
+ *  enforces the limit while the shell
+ *  waits for the pipeline.
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <signal.h>
+
+#include "../include/bcsh_constants.h"
+#include "../include/bcsh_parser.h"
+#include "../include/bcsh_timeout.h"
+
+/**
+ * The signals timeout -s knows by name
+ */
+static struct {
+    char* name;
+    int number;
+} signal_names[] = {
+    {"HUP", SIGHUP}, {"INT", SIGINT}, {"QUIT", SIGQUIT}, {"KILL", SIGKILL},
+    {"USR1", SIGUSR1}, {"USR2", SIGUSR2}, {"PIPE", SIGPIPE}, {"ALRM", SIGALRM},
+    {"TERM", SIGTERM}, {"CONT", SIGCONT}, {"STOP", SIGSTOP}
+};
+
+/**
+ * Reads a duration: a number of seconds, which can have a fraction, followed by s, m,
+ *  h or d for seconds, minutes, hours or days
+ * @return The duration in nanoseconds, or -1 if text is not a duration
+ */
+static double parse_duration(char* text){
+    char* end;
+    double seconds = strtod(text, &end);
+
+    if(end == text || seconds < 0){
+        return -1;
+    }
+    if(*end != '\0' && end[1] != '\0'){
+        return -1;
+    }
+    switch(*end){
+        case '\0':
+        case 's':
+            break;
+        case 'm':
+            seconds *= 60;
+            break;
+        case 'h':
+            seconds *= 3600;
+            break;
+        case 'd':
+            seconds *= 86400;
+            break;
+        default:
+            return -1;
+    }
+    return seconds * 1e9;
+}
+
+/**
+ * Reads a signal, by number or by name, with or without SIG in front
+ * @return The signal, -1 if it is not known
+ */
+static int parse_signal(char* text){
+    char* end;
+    long number;
+    size_t i;
+
+    number = strtol(text, &end, 10);
+    if(end != text && *end == '\0'){
+        return (number > 0 && number < NSIG) ? number : -1;
+    }
+    if(strncasecmp(text, "SIG", 3) == 0){
+        text += 3;
+    }
+    for(i = 0; i < sizeof(signal_names) / sizeof(signal_names[0]); i++){
+        if(strcasecmp(text, signal_names[i].name) == 0){
+            return signal_names[i].number;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Reads the options and the duration of timeout and removes them, along with the word
+ *  timeout, from the first command of the pipeline.
+ *  timeout [-s signal] [-k duration] duration command...
+ *      -s  the signal sent when the time is up, SIGTERM by default
+ *      -k  sends SIGKILL as well if the pipeline is still running that long after
+ * @return 0 on success, -1 if the options or the duration are not valid
+ */
+int timeout_options(struct command* command, struct timeout_limit* limit){
+    double duration;
+
+    limit->signal = SIGTERM;
+    limit->kill_after = 0;
+
+    command->argv++;
+    command->argc--;
+    while(command->argc > 0 && command->argv[0][0] == '-'){
+        if(strcmp(command->argv[0], "--") == 0){
+            command->argv++;
+            command->argc--;
+            break;
+        }
+        if((strcmp(command->argv[0], "-s") != 0 && strcmp(command->argv[0], "-k") != 0) || command->argc < 2){
+            fprintf(stderr, "bcsh: timeout: usage: timeout [-s signal] [-k duration] duration command...\n");
+            return -1;
+        }
+        if(command->argv[0][1] == 's'){
+            limit->signal = parse_signal(command->argv[1]);
+            if(limit->signal == -1){
+                fprintf(stderr, "bcsh: timeout: %s: unknown signal\n", command->argv[1]);
+                return -1;
+            }
+        }else{
+            duration = parse_duration(command->argv[1]);
+            if(duration < 0){
+                fprintf(stderr, "bcsh: timeout: %s: invalid duration\n", command->argv[1]);
+                return -1;
+            }
+            limit->kill_after = duration;
+        }
+        command->argv += 2;
+        command->argc -= 2;
+    }
+
+    if(command->argc < 2){
+        fprintf(stderr, "bcsh: timeout: usage: timeout [-s signal] [-k duration] duration command...\n");
+        return -1;
+    }
+    duration = parse_duration(command->argv[0]);
+    if(duration < 0){
+        fprintf(stderr, "bcsh: timeout: %s: invalid duration\n", command->argv[0]);
+        return -1;
+    }
+    limit->duration = duration;
+    command->argv++;
+    command->argc--;
+    return 0;
+}
@@ -0,0 +1,256 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh_trace.c
+ * * * * * * * * * * * * * * * * * * *
+ * Trace points in the main loop, the
+ *  expansion and the execution of commands
+ *  record monotonic timestamps into a
+ *  fixed ring of events, which the trace
+ *  command writes out as JSON or in the
+ *  Chrome trace-event format. Tracing
+ *  costs one test of trace_enabled at
+ *  each point while it is off.
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../include/bcsh_constants.h"
+#include "../include/bcsh_trace.h"
+
+/**
+ * Set while events are recorded, by the trace command or $BCSH_TRACE
+ */
+int trace_enabled = 0;
+
+/**
+ * The ring, allocated the first time tracing is turned on, and the number of events
+ *  ever recorded into it. An event claims its slot with one atomic add before writing
+ *  it, so the SIGCHLD handler, which records the exits of children, can interrupt the
+ *  shell in the middle of an event without either of them taking a lock: they never
+ *  write the same slot.
+ */
+static struct trace_event* ring = NULL;
+static unsigned long ring_head = 0;
+static unsigned long ring_start = 0; //The first event since the last clear
+
+/**
+ * The shell's pid, the process of the events that are about the shell itself, and where
+ *  $BCSH_TRACE asked the ring to be written when the shell exits
+ */
+static pid_t shell_pid = 0;
+static char* exit_path = NULL;
+static int exit_format = TRACE_FORMAT_CHROME;
+
+/**
+ * Gives the time of CLOCK_MONOTONIC in nanoseconds. It can be called from a signal
+ *  handler.
+ */
+unsigned long long trace_now(){
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/**
+ * Records an event, overwriting the oldest one once the ring is full. Callers test
+ *  trace_enabled first, so nothing is done at all while tracing is off. It can be
+ *  called from a signal handler.
+ * @param ns When it happened, from trace_now()
+ * @param phase TRACE_BEGIN, TRACE_END or TRACE_INSTANT
+ * @param pid The child it is about, 0 for the shell
+ * @param detail The command, NULL if there is none
+ */
+void trace_record(unsigned long long ns, int phase, const char* name, pid_t pid, long value, const char* detail){
+    unsigned long index = __atomic_fetch_add(&ring_head, 1, __ATOMIC_RELAXED);
+    struct trace_event* event = &ring[index & (TRACE_RING_SIZE - 1)];
+    size_t length;
+
+    event->ns = ns;
+    event->name = name;
+    event->pid = (pid != 0) ? pid : shell_pid;
+    event->phase = phase;
+    event->value = value;
+    length = 0;
+    if(detail != NULL){
+        for(; length < TRACE_DETAIL_LENGTH - 1 && detail[length] != '\0'; length++){
+            event->detail[length] = detail[length];
+        }
+    }
+    event->detail[length] = '\0';
+}
+
+/**
+ * Turns tracing on, making the ring the first time
+ */
+void trace_start(){
+    if(ring == NULL){
+        ring = malloc(TRACE_RING_SIZE * sizeof(struct trace_event));
+        if(ring == NULL){
+            fprintf(stderr, "Error in trace_start() : Could not allocate space for the trace ring\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    shell_pid = getpid();
+    trace_enabled = 1;
+}
+
+/**
+ * Turns tracing off. The events recorded so far are kept.
+ */
+void trace_stop(){
+    trace_enabled = 0;
+}
+
+/**
+ * Forgets the events recorded so far
+ */
+void trace_clear(){
+    ring_start = ring_head;
+}
+
+/**
+ * Gives the number of events in the ring
+ * @param dropped Set to the number of events overwritten since the last clear
+ */
+unsigned long trace_count(unsigned long* dropped){
+    unsigned long count = ring_head - ring_start;
+
+    *dropped = (count > TRACE_RING_SIZE) ? count - TRACE_RING_SIZE : 0;
+    return count - *dropped;
+}
+
+/**
+ * Writes a string as a JSON string
+ */
+static void write_json_string(FILE* out, const char* string){
+    const unsigned char* c;
+
+    fputc('"', out);
+    for(c = (const unsigned char*) string; *c != '\0'; c++){
+        if(*c == '"' || *c == '\\'){
+            fputc('\\', out);
+            fputc(*c, out);
+        }else if(*c < 0x20){
+            fprintf(out, "\\u%04x", *c);
+        }else{
+            fputc(*c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+/**
+ * Writes the events of the ring, oldest first. In the Chrome format every process is a
+ *  thread of the shell's process: the shell's own spans on one, and each child on its
+ *  own from its spawn to its exit, with its exec in between.
+ * @param format TRACE_FORMAT_JSON or TRACE_FORMAT_CHROME
+ */
+void trace_write(FILE* out, int format){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct trace_event* event;
+    sigset_t mask;
+    sigset_t old_mask;
+    unsigned long dropped;
+    unsigned long count;
+    unsigned long index;
+    unsigned long end;
+
+    /********************************************************************
+    Children that exit meanwhile are recorded after the events being
+        written, not over them
+    ********************************************************************/
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, &old_mask);
+    count = trace_count(&dropped);
+    end = ring_head;
+
+    fputs((format == TRACE_FORMAT_CHROME) ? "{\"traceEvents\":[" : "{\"events\":[", out);
+    for(index = end - count; index != end; index++){
+        event = &ring[index & (TRACE_RING_SIZE - 1)];
+        if(index != end - count){
+            fputc(',', out);
+        }
+        fputs("\n{\"name\":", out);
+        write_json_string(out, event->name);
+        if(format == TRACE_FORMAT_CHROME){
+            fprintf(out, ",\"ph\":\"%c\",\"ts\":%llu.%03llu,\"pid\":%d,\"tid\":%d", event->phase,
+                    event->ns / 1000, event->ns % 1000, (int) shell_pid, (int) event->pid);
+            if(event->phase == TRACE_INSTANT){
+                fputs(",\"s\":\"t\"", out);
+            }
+            fprintf(out, ",\"args\":{\"value\":%ld,\"detail\":", event->value);
+            write_json_string(out, event->detail);
+            fputc('}', out);
+        }else{
+            fprintf(out, ",\"phase\":\"%c\",\"ns\":%llu,\"pid\":%d,\"value\":%ld,\"detail\":", event->phase,
+                    event->ns, (int) event->pid, event->value);
+            write_json_string(out, event->detail);
+        }
+        fputc('}', out);
+    }
+    if(format == TRACE_FORMAT_CHROME){
+        fprintf(out, "\n],\"displayTimeUnit\":\"ns\",\"otherData\":{\"dropped\":%lu}}\n", dropped);
+    }else{
+        fprintf(out, "\n],\"dropped\":%lu}\n", dropped);
+    }
+    fflush(out);
+
+    sigprocmask(SIG_SETMASK, &old_mask, NULL);
+}
+
+/**
+ * Turns tracing on at startup as $BCSH_TRACE asks:
+ *  on              records events, for the trace command
+ *  path            also writes them to path in the Chrome format when the shell exits
+ *  chrome:path     the same
+ *  json:path       writes them as JSON instead
+ * @param setting The value of $BCSH_TRACE, NULL if it is not set
+ */
+void trace_init(char* setting){
+    if(setting == NULL || setting[0] == '\0' || strcmp(setting, "off") == 0 || strcmp(setting, "0") == 0){
+        return;
+    }
+    trace_start();
+    if(strcmp(setting, "on") == 0 || strcmp(setting, "1") == 0){
+        return;
+    }
+    if(strncmp(setting, "json:", 5) == 0){
+        exit_format = TRACE_FORMAT_JSON;
+        setting += 5;
+    }else if(strncmp(setting, "chrome:", 7) == 0){
+        setting += 7;
+    }
+    exit_path = strdup(setting);
+}
+
+/**
+ * Writes the ring where $BCSH_TRACE asked, as the shell exits
+ */
+void trace_finish(){
+    FILE* out;
+
+    if(exit_path == NULL || ring == NULL){
+        return;
+    }
+    out = fopen(exit_path, "w");
+    if(out == NULL){
+        fprintf(stderr, "bcsh: trace: %s: %s\n", exit_path, strerror(errno));
+        return;
+    }
+    trace_write(out, exit_format);
+    fclose(out);
+}
@@ -4,8 +4,8 @@
  * * * * * * * * * * * * * * * * * * *
  * bcsh_utils.c
  * * * * * * * * * * * * * * * * * * *
- * All the functions I will use for I/O
- *  are declared here
+ * The working directory of the shell,
+ *  kept as state that only cd changes
  * * * * * * * * * * * * * * * * * * *
  */
 
@@ -14,231 +14,228 @@
 #include <errno.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/stat.h>
 
 #include "../include/bcsh_constants.h"
-#include "../include/bcsh_internals.h"
+#include "../include/bcsh_utils.h"
+#include "../include/bcsh_vars.h"
 
 /**
- * This function is given a reference to a string and will set the reference to point to the
- *  current working directory.
- * @param path_ref A reference to the current working directory string
+ * The logical working directory ($PWD): the path the user got there by, which may go
+ *  through symbolic links. Malloced.
  */
-void get_cwd_direct(char** path_ref){
+static char* shell_cwd = NULL;
+
+/**
+ * The directory before the last cd ($OLDPWD), NULL until the first cd. Malloced.
+ */
+static char* shell_oldpwd = NULL;
+
+/**
+ * Changes every time the working directory does, so that what depends on it (the
+ *  prompt) knows when to recompute
+ */
+unsigned long cwd_generation = 0;
+
+/**
+ * Asks the kernel for the physical working directory
+ * @return A malloced path, NULL if it cannot be found
+ */
+static char* physical_cwd(){
 
     /********************************************************************
     Declare variables
     ********************************************************************/
-    int offset = 1;
-    char* path;
-    size_t actual_space_needed;
+    size_t size = INITIAL_PATH_LENGTH;
+    char* path = NULL;
+    char* bigger;
 
     /********************************************************************
     Get the current working directory using getcwd()
         If the buffer isn't big enough, keep retrying with larger buffers
     ********************************************************************/
-    path = getcwd(NULL, INITIAL_PATH_LENGTH * sizeof(char));
-    while(path == NULL){
-        if(errno == ERANGE){
-            //Buffer was not big enough, we can come back from this.
-            offset = offset * 2;
-            path = getcwd(NULL, INITIAL_PATH_LENGTH * offset);
-        }else{
-            //A different error occured, we will not attempt to come back from this.
-            perror("Error in get_cwd_direct()");
-            exit(EXIT_FAILURE);
+    do{
+        bigger = realloc(path, size);
+        if(bigger == NULL){
+            free(path);
+            return NULL;
         }
-    }
-
-    /********************************************************************
-    Path now holds the current working directory, but it was probably
-        given too much space, so we'll reallocate it to only use what it
-        needs
-    ********************************************************************/
-    actual_space_needed = strlen(path) + 1;
-    path = realloc(path, actual_space_needed);
-    if(path == NULL){
-        fprintf(stderr, "Error in get_cwd_direct() : Failed to reallocate space for current working directory\n");
-        exit(EXIT_FAILURE);
-    }
+        path = bigger;
+        if(getcwd(path, size) != NULL){
+            return path;
+        }
+        size = size * 2;
+    }while(errno == ERANGE);
 
-    /********************************************************************
-    Now we need to make path_ref point to path
-        We know that *path_ref has been freed or is NULL at this point
-        because main() frees *path_ref at the end of the execution loop,
-        allowing us to do this.
-    ********************************************************************/
-    *path_ref = path;
+    free(path);
+    return NULL;
 }
 
 /**
- * This function takes a string whitespace separated tokens and will separate them using strtok_r. It will then
- *  populate and return an array of these tokens. It will exit() upon encountering memory allocation errors.
- * @param line A string containing all the tokens to be split up
- * @return An array of string tokens
+ * Works out the working directory once, when the shell starts. An inherited $PWD is
+ *  kept if it names the directory we are in, so the logical path survives.
  */
-char** get_tokens(char* line){
+void cwd_init(){
 
     /********************************************************************
     Declare variables
     ********************************************************************/
-    char** tokens;
-    char* token;
-    char* saveptr = NULL;
-    size_t buffer_position = 0;
-    size_t buffer_size = INITIAL_TOKEN_BUFFER;
-    size_t num_tokens = 0;
-
-    /********************************************************************
-    Allocate space for tokens
-    ********************************************************************/
-    tokens = malloc(buffer_size * sizeof(char*));
-    if(tokens == NULL){
-        fprintf(stderr, "Error in get_tokens() : Could not allocate space for tokens array\n");
-        exit(EXIT_FAILURE);
+    char* pwd = var_get("PWD");
+    struct stat pwd_stat;
+    struct stat dot_stat;
+
+    if(pwd != NULL && pwd[0] == '/' && stat(pwd, &pwd_stat) == 0 && stat(".", &dot_stat) == 0
+       && pwd_stat.st_dev == dot_stat.st_dev && pwd_stat.st_ino == dot_stat.st_ino){
+        shell_cwd = strdup(pwd);
+    }else{
+        shell_cwd = physical_cwd();
     }
 
-    /********************************************************************
-    Tokenize the string
-    ********************************************************************/
-    token = strtok_r(line, TOKEN_DELIM, &saveptr);
-    while(token != NULL){
-
-        tokens[buffer_position] = token;
-        buffer_position++;
-        num_tokens++;
-
-        //If there are more tokens than we allocated space for, reallocate more space
-        if(buffer_position >= buffer_size){
-            tokens = realloc(tokens, (buffer_size + INITIAL_TOKEN_BUFFER) * sizeof(char*));
-            if(tokens == NULL){
-                fprintf(stderr, "Error in get_tokens() : Could not reallocate space for tokens array\n");
-                exit(EXIT_FAILURE);
-            }
-        }
-
-        token = strtok_r(NULL, TOKEN_DELIM, &saveptr);
+    if(shell_cwd == NULL){
+        //The directory was removed from under us, or is not reachable
+        shell_cwd = strdup(".");
     }
-
-    /********************************************************************
-    Realloc the tokens array to only use what it needs
-    ********************************************************************/
-    tokens = realloc(tokens, (num_tokens + 1) * sizeof(char*));
-    if(tokens == NULL){
-        fprintf(stderr, "Error in get_tokens() : Could not reallocate space for tokens array\n");
-        exit(EXIT_FAILURE);
-    }
-
-    /********************************************************************
-    Null terminate the array to that we can traverse it without knowing
-        the size
-    ********************************************************************/
-    tokens[num_tokens] = NULL;
-
-    return tokens;
+    var_set("PWD", 3, shell_cwd, 1);
+    cwd_generation++;
 }
 
+/**
+ * The logical working directory. It is only valid until the next cd.
+ */
+char* get_cwd(){
+    return shell_cwd;
+}
 
 /**
- * This function parses the list of tokens, looking for a pipe
- * @param tokens A null-terminated list of string arguments
- * @return 1 if one or more pipes are found, 0 otherwise
+ * The previous working directory, NULL if cd was never used
  */
-int has_pipes(char** tokens){
-    int i = 0;
-    while(tokens[i] != NULL){
-        if(strncmp(tokens[i], "|", strlen("|")) == 0){
-            return 1;
-        }
-        i++;
-    }
-    return 0;
+char* get_oldpwd(){
+    return shell_oldpwd;
 }
 
 /**
- * This function takes an array of tokens separated by one or more pipes.
- *  It groups the tokens on each side of the pipes together and stores
- *  them all in an array of string arrays
- * ex. ls -l | grep a | more
- *  prepared_commands = {{ls, -l}, {grep, a}, {more}}
- * @param tokens A null-terminated list of string arguments
- * @return An array of prepared commands to be executed using execute_piped_commands(), NULL if there is an error.
+ * Removes . and .. components and repeated slashes from an absolute path, in place, as
+ *  cd -L does: dir/.. is dir's parent even if dir is a symbolic link
  */
-char*** prepare_commands(char** tokens){
+static void canonicalize_path(char* path){
+
     /********************************************************************
     Declare variables
     ********************************************************************/
-    char*** prepared_commands;
-    char** grouped_commands;
-    int num_commands = 0;
-    int num_commands_in_group = 0;
-    int i, j, n, m;
+    char* read = path;
+    char* write = path;
+    char* component;
+    size_t length;
+
+    while(*read != '\0'){
+        while(*read == '/'){
+            read++;
+        }
+        component = read;
+        while(*read != '\0' && *read != '/'){
+            read++;
+        }
+        length = read - component;
 
-    /********************************************************************
-    Find out how many actual commands there are
-        This works out to be the number of pipes plus one. So, count
-        the number of pipes, then add one when it's all done.
-    ********************************************************************/
-    i = 0;
-    while(tokens[i] != NULL){
-        if(strncmp(tokens[i], "|", strlen("|")) == 0){
-            num_commands++;
+        if(length == 0 || (length == 1 && component[0] == '.')){
+            continue;
+        }
+        if(length == 2 && component[0] == '.' && component[1] == '.'){
+            while(write > path && *--write != '/');
+            continue;
         }
-        i++;
+
+        *write++ = '/';
+        memmove(write, component, length);
+        write += length;
     }
-    num_commands++;
 
-    /********************************************************************
-    Allocate space for the list of command groups plus space for a null
-        terminator
-    ********************************************************************/
-    prepared_commands = malloc((num_commands + 1) * sizeof(char**));
-    if(prepared_commands == NULL){
-        fprintf(stderr, "Error in prepare_commands() : Could not allocate space for prepared_commands array\n");
-        return NULL;
+    if(write == path){
+        *write++ = '/';
     }
+    *write = '\0';
+}
+
+/**
+ * Changes the working directory of the shell, and $PWD and $OLDPWD with it
+ * @param target Where to go, relative to the current directory or absolute
+ * @param physical 1 to resolve symbolic links (cd -P), 0 for the logical path (cd -L),
+ *  which needs the current directory to be known
+ * @return 0 on success, -1 (with errno set) on failure
+ */
+int change_directory(char* target, int physical){
 
     /********************************************************************
-    Populate the prepared_commands list
+    Declare variables
     ********************************************************************/
-    n = 0;
-    for(i = 0; i < num_commands; i++){
-        num_commands_in_group = 0;
-        m = n;
+    char* path;
+    size_t cwd_length;
 
-        /********************************************************************
-        Count how many commands are in the command group
-            ex. ls -l would have two 'commands' (ls and -l)
-        ********************************************************************/
-        while(tokens[n] != NULL && strncmp(tokens[n], "|", strlen("|")) != 0){
-            num_commands_in_group++;
-            n++;
+    /********************************************************************
+    The logical path is the current one with target added, then
+        cleaned up; the physical one is whatever the kernel says after
+        the chdir()
+    ********************************************************************/
+    if(physical || shell_cwd[0] != '/'){
+        if(chdir(target) == -1){
+            return -1;
         }
-        n++;
-
-        /********************************************************************
-        Allocate space for the group of commands plus a null terminator
-        ********************************************************************/
-        grouped_commands = malloc((num_commands_in_group + 1) * sizeof(char*));
-        if(grouped_commands == NULL){
-            fprintf(stderr, "Error in prepare_commands() : Could not allocate space for grouped_commands array\n");
-            return NULL;
+        path = physical_cwd();
+        if(path == NULL){
+            path = strdup(target);
+        }
+    }else{
+        cwd_length = (target[0] == '/') ? 0 : strlen(shell_cwd);
+        path = malloc(cwd_length + strlen(target) + 2);
+        if(path == NULL){
+            fprintf(stderr, "Error in change_directory() : Could not allocate space for path\n");
+            return -1;
         }
+        if(cwd_length > 0){
+            memcpy(path, shell_cwd, cwd_length);
+            path[cwd_length++] = '/';
+        }
+        strcpy(path + cwd_length, target);
+        canonicalize_path(path);
 
         /********************************************************************
-        Put the commands into the group, null terminate it, then add that
-            group to the list
+        Like bash, fall back to the physical path if the logical one
+            does not exist (dir/.. through a link to a deeper directory)
         ********************************************************************/
-        for(j = 0; j < num_commands_in_group; j++){
-            grouped_commands[j] = tokens[m];
-            m++;
+        if(chdir(path) == -1){
+            free(path);
+            return change_directory(target, 1);
         }
-        grouped_commands[num_commands_in_group] = NULL;
-        prepared_commands[i] = grouped_commands;
     }
 
-    /*******************************************************************
-    Terminate the list with a null terminator then return it
-    ********************************************************************/
-    prepared_commands[num_commands] = NULL;
-    return prepared_commands;
+    free(shell_oldpwd);
+    shell_oldpwd = shell_cwd;
+    shell_cwd = path;
+    var_set("OLDPWD", 6, shell_oldpwd, 1);
+    var_set("PWD", 3, shell_cwd, 1);
+    cwd_generation++;
+
+    return 0;
+}
+
+/**
+ * Reads a size in bytes, which may end with k or m (KiB or MiB), like 65536, 64k or 1M
+ * @return The size, -1 if text is not one
+ */
+long parse_size(char* text){
+    char* end;
+    long size;
+
+    if(*text < '0' || *text > '9'){
+        return -1;
+    }
+    size = strtol(text, &end, 10);
+    if(*end == 'k' || *end == 'K'){
+        size *= 1024;
+        end++;
+    }else if(*end == 'm' || *end == 'M'){
+        size *= 1024 * 1024;
+        end++;
+    }
+    return (*end == '\0') ? size : -1;
 }
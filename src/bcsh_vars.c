@@ -0,0 +1,442 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh_vars.c
+ * * * * * * * * * * * * * * * * * * *
+ * Shell variables live in one open
+ *  addressing table. Each is stored as
+ *  the "NAME=value" string the
+ *  environment needs, so the envp
+ *  handed to every command is only an
+ *  array of pointers into the table,
+ *  rebuilt when an exported variable
+ *  changes
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/bcsh_constants.h"
+#include "../include/bcsh_arena.h"
+#include "../include/bcsh_vars.h"
+
+extern char** environ;
+
+struct var_entry {
+    char* string; //"NAME=value", just "NAME" for an exported variable without a value, NULL if the slot is empty
+    unsigned int hash;
+    unsigned int name_length;
+    int exported;
+};
+
+/**
+ * Marks the slot of a removed variable, so the lookups that went past it still do
+ */
+static char removed[] = "";
+
+static struct var_entry* table = NULL;
+static size_t capacity = 0; //Always a power of two
+static size_t num_used = 0; //Slots that are not empty, removed ones included
+
+/**
+ * The environment of the commands the shell runs, and whether an exported variable
+ *  changed since it was built
+ */
+static char** envp_cache = NULL;
+static size_t envp_capacity = 0;
+static int envp_stale = 1;
+
+/**
+ * $0, and the positional parameters $1, $2...: the arguments of the script, or of the
+ *  function being run. A function call points them at its own argv and puts them back
+ *  when it returns; shift moves past the first ones.
+ */
+char* shell_name = "bcsh";
+char** positional_params = NULL;
+int num_positional_params = 0;
+
+/**
+ * Hashes the first length bytes of a name (FNV-1a)
+ */
+static unsigned int hash_var_name(char* name, size_t length){
+    unsigned int hash = 2166136261u;
+    size_t i;
+
+    for(i = 0; i < length; i++){
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Finds the slot of a variable, or the slot it would go in
+ * @param found Set to 1 if the variable is there, 0 if not
+ */
+static size_t find_slot(char* name, size_t length, unsigned int hash, int* found){
+    size_t mask = capacity - 1;
+    size_t slot = hash & mask;
+    size_t first_removed = capacity;
+    struct var_entry* entry;
+
+    while(1){
+        entry = &table[slot];
+        if(entry->string == NULL){
+            *found = 0;
+            return (first_removed != capacity) ? first_removed : slot;
+        }
+        if(entry->string == removed){
+            if(first_removed == capacity){
+                first_removed = slot;
+            }
+        }else if(entry->hash == hash && entry->name_length == length
+                 && memcmp(entry->string, name, length) == 0){
+            *found = 1;
+            return slot;
+        }
+        slot = (slot + 1) & mask;
+    }
+}
+
+/**
+ * Moves every variable into a table of the given size, dropping the removed slots
+ */
+static void resize_table(size_t new_capacity){
+    struct var_entry* old_table = table;
+    size_t old_capacity = capacity;
+    size_t i;
+    size_t slot;
+
+    table = calloc(new_capacity, sizeof(struct var_entry));
+    if(table == NULL){
+        fprintf(stderr, "Error in resize_table() : Could not allocate space for variables\n");
+        exit(EXIT_FAILURE);
+    }
+    capacity = new_capacity;
+    num_used = 0;
+
+    for(i = 0; i < old_capacity; i++){
+        if(old_table[i].string == NULL || old_table[i].string == removed){
+            continue;
+        }
+        slot = old_table[i].hash & (capacity - 1);
+        while(table[slot].string != NULL){
+            slot = (slot + 1) & (capacity - 1);
+        }
+        table[slot] = old_table[i];
+        num_used++;
+    }
+    free(old_table);
+}
+
+/**
+ * Gives the length of the variable name text starts with: a letter or _, then letters,
+ *  digits and _
+ * @return 0 if text does not start with a name
+ */
+size_t var_name_length(char* text){
+    size_t length = 0;
+
+    if(!(text[0] == '_' || (text[0] >= 'a' && text[0] <= 'z') || (text[0] >= 'A' && text[0] <= 'Z'))){
+        return 0;
+    }
+    while(text[length] == '_' || (text[length] >= 'a' && text[length] <= 'z')
+          || (text[length] >= 'A' && text[length] <= 'Z') || (text[length] >= '0' && text[length] <= '9')){
+        length++;
+    }
+    return length;
+}
+
+/**
+ * Gives the value of a variable
+ * @return The value, which changes with the variable, NULL if it is not set
+ */
+char* var_get(char* name){
+    size_t length = strlen(name);
+    size_t slot;
+    int found;
+
+    if(capacity == 0){
+        return NULL;
+    }
+    slot = find_slot(name, length, hash_var_name(name, length), &found);
+    if(!found || table[slot].string[length] != '='){
+        return NULL;
+    }
+    return table[slot].string + length + 1;
+}
+
+/**
+ * Adds a variable, or replaces its value. Only the variables that are exported make
+ *  the environment stale.
+ * @param name The name, which does not need to be null terminated
+ * @param name_length Bytes of the name
+ * @param value The value, NULL to only export the variable
+ * @param export 1 to export the variable as well, 0 to leave it as it was (new
+ *  variables are not exported)
+ */
+void var_set(char* name, size_t name_length, char* value, int export){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct var_entry* entry;
+    unsigned int hash = hash_var_name(name, name_length);
+    size_t value_length;
+    size_t slot;
+    char* string;
+    int found;
+
+    /********************************************************************
+    Keep at most three quarters of the slots in use, so probe sequences
+        stay short
+    ********************************************************************/
+    if((num_used + 1) * 4 > capacity * 3){
+        resize_table((capacity == 0) ? VARS_INITIAL_CAPACITY : capacity * 2);
+    }
+    slot = find_slot(name, name_length, hash, &found);
+    entry = &table[slot];
+
+    if(value == NULL){
+        if(found){
+            if(export && !entry->exported){
+                entry->exported = 1;
+                envp_stale = 1;
+            }
+            return;
+        }
+        string = malloc(name_length + 1);
+        if(string == NULL){
+            fprintf(stderr, "Error in var_set() : Could not allocate space for variable\n");
+            exit(EXIT_FAILURE);
+        }
+        memcpy(string, name, name_length);
+        string[name_length] = '\0';
+    }else{
+        value_length = strlen(value);
+        string = malloc(name_length + value_length + 2);
+        if(string == NULL){
+            fprintf(stderr, "Error in var_set() : Could not allocate space for variable\n");
+            exit(EXIT_FAILURE);
+        }
+        memcpy(string, name, name_length);
+        string[name_length] = '=';
+        memcpy(string + name_length + 1, value, value_length + 1);
+    }
+
+    if(found){
+        free(entry->string);
+        entry->exported |= export;
+    }else{
+        if(entry->string == NULL){
+            num_used++;
+        }
+        entry->hash = hash;
+        entry->name_length = name_length;
+        entry->exported = export;
+    }
+    entry->string = string;
+    if(entry->exported){
+        envp_stale = 1;
+    }
+}
+
+/**
+ * Exports a variable; one that is not set is exported once it is
+ */
+void var_export(char* name){
+    var_set(name, strlen(name), NULL, 1);
+}
+
+/**
+ * Removes a variable
+ */
+void var_unset(char* name){
+    size_t length = strlen(name);
+    size_t slot;
+    int found;
+
+    if(capacity == 0){
+        return;
+    }
+    slot = find_slot(name, length, hash_var_name(name, length), &found);
+    if(!found){
+        return;
+    }
+    if(table[slot].exported){
+        envp_stale = 1;
+    }
+    free(table[slot].string);
+    table[slot].string = removed;
+}
+
+/**
+ * Removes every exported variable, keeping the shell's own ones
+ */
+void vars_unset_exported(){
+    size_t i;
+
+    for(i = 0; i < capacity; i++){
+        if(table[i].string != NULL && table[i].string != removed && table[i].exported){
+            free(table[i].string);
+            table[i].string = removed;
+            envp_stale = 1;
+        }
+    }
+}
+
+/**
+ * Sets a variable from an assignment, NAME=value
+ * @return 0 if it was set, -1 if the assignment does not start with a name and =
+ */
+int var_assign(char* assignment, int export){
+    size_t length = var_name_length(assignment);
+
+    if(length == 0 || assignment[length] != '='){
+        return -1;
+    }
+    var_set(assignment, length, assignment + length + 1, export);
+    return 0;
+}
+
+/**
+ * Fills the table with the environment the shell was started with, all exported
+ */
+void vars_init(char** envp){
+    int i;
+
+    for(i = 0; envp[i] != NULL; i++){
+        var_assign(envp[i], 1);
+    }
+    var_environ();
+}
+
+/**
+ * Gives the environment of the commands the shell runs: the exported variables that
+ *  have a value. It is only rebuilt after one of them changed, and then it only
+ *  collects pointers, so launching a command costs nothing here. environ is pointed at
+ *  it too, for the library functions that read it.
+ */
+char** var_environ(){
+    size_t count = 0;
+    size_t i;
+    char** envp;
+
+    if(!envp_stale){
+        return envp_cache;
+    }
+
+    for(i = 0; i < capacity; i++){
+        if(table[i].string != NULL && table[i].string != removed && table[i].exported){
+            count++;
+        }
+    }
+    if(count + 1 > envp_capacity){
+        envp = realloc(envp_cache, (count + 1) * sizeof(char*));
+        if(envp == NULL){
+            fprintf(stderr, "Error in var_environ() : Could not reallocate space for the environment\n");
+            exit(EXIT_FAILURE);
+        }
+        envp_cache = envp;
+        envp_capacity = count + 1;
+    }
+
+    count = 0;
+    for(i = 0; i < capacity; i++){
+        if(table[i].string != NULL && table[i].string != removed && table[i].exported
+           && table[i].string[table[i].name_length] == '='){
+            envp_cache[count++] = table[i].string;
+        }
+    }
+    envp_cache[count] = NULL;
+    environ = envp_cache;
+    envp_stale = 0;
+    return envp_cache;
+}
+
+/**
+ * Gives the environment of one command run with assignments in front of it, like
+ *  LANG=C sort: the shell's, with those variables added or replaced. It comes from the
+ *  line arena.
+ * @param assignments NAME=value strings
+ */
+char** var_environ_with(char** assignments, int num_assignments){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    char** shared = var_environ();
+    char** envp;
+    size_t count;
+    size_t length;
+    size_t i;
+    int j;
+    int replaced;
+
+    for(count = 0; shared[count] != NULL; count++);
+    envp = arena_alloc(&line_arena, (count + num_assignments + 1) * sizeof(char*));
+
+    count = 0;
+    for(i = 0; shared[i] != NULL; i++){
+        replaced = 0;
+        for(j = 0; j < num_assignments && !replaced; j++){
+            length = var_name_length(assignments[j]);
+            replaced = (strncmp(shared[i], assignments[j], length + 1) == 0);
+        }
+        if(!replaced){
+            envp[count++] = shared[i];
+        }
+    }
+    for(j = 0; j < num_assignments; j++){
+        envp[count++] = assignments[j];
+    }
+    envp[count] = NULL;
+    return envp;
+}
+
+/**
+ * Orders two variables by name, for qsort()
+ */
+static int compare_vars(const void* a, const void* b){
+    return strcmp(*(char**)a, *(char**)b);
+}
+
+/**
+ * Prints every exported variable as the export command that sets it again, sorted by
+ *  name
+ */
+void var_print_exported(){
+    char** strings = arena_alloc(&line_arena, (num_used + 1) * sizeof(char*));
+    size_t count = 0;
+    size_t i;
+    char* c;
+
+    for(i = 0; i < capacity; i++){
+        if(table[i].string != NULL && table[i].string != removed && table[i].exported){
+            strings[count++] = table[i].string;
+        }
+    }
+    qsort(strings, count, sizeof(char*), compare_vars);
+
+    for(i = 0; i < count; i++){
+        fputs("export ", stdout);
+        for(c = strings[i]; *c != '\0' && *c != '='; c++){
+            putchar(*c);
+        }
+        if(*c == '='){
+            fputs("='", stdout);
+            for(c++; *c != '\0'; c++){
+                if(*c == '\''){
+                    fputs("'\\''", stdout);
+                }else{
+                    putchar(*c);
+                }
+            }
+            putchar('\'');
+        }
+        putchar('\n');
+    }
+}
@@ -0,0 +1,529 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * bcsh_zygote.c
+ * * * * * * * * * * * * * * * * * * *
+ * The spawn helper. It is forked at
+ *  startup, while the shell is still
+ *  small, and launches external commands
+ *  the shell sends it over a socket, so
+ *  what a launch costs does not grow
+ *  with the shell's memory. Its children
+ *  are the shell's, not its own.
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+
+#include "../include/bcsh_constants.h"
+#include "../include/bcsh_zygote.h"
+
+/**
+ * What the shell sends to launch a command. The path, then argc arguments and envc
+ *  variables, each null terminated, follow in messages of at most ZYGOTE_CHUNK bytes.
+ *  The descriptors come with it: the sources of the command's descriptors, then the
+ *  working directory.
+ */
+struct zygote_request {
+    size_t length; //Bytes of the strings that follow
+    int argc;
+    int envc;
+    pid_t pgid; //-1 to stay in the shell's process group, 0 to lead a new one, or the group to join
+    int foreground; //Give the terminal to the command's process group
+    int num_targets;
+    int targets[ZYGOTE_MAX_FDS]; //The descriptors of the command
+    int sources[ZYGOTE_MAX_FDS]; //For each, the index of the descriptor sent that goes there, -1 to close it
+};
+
+/**
+ * What the helper answers
+ */
+struct zygote_reply {
+    pid_t pid; //The command, -1 if it could not be created
+    int err; //0 once it runs, the errno of its execve() or of clone() otherwise
+};
+
+/**
+ * The shell's end of the socket, -1 while there is no helper
+ */
+static int zygote_fd = -1;
+
+/**
+ * The helper's copy of the terminal, for commands started in the foreground
+ */
+static int terminal_fd = -1;
+
+/**
+ * Holds a message with descriptors in it
+ */
+union fd_message {
+    struct cmsghdr header;
+    char buffer[CMSG_SPACE((ZYGOTE_MAX_FDS + 1) * sizeof(int))];
+};
+
+/**
+ * Gives the signals of the terminal (SIGINT, SIGQUIT, SIGTSTP, SIGTTIN and SIGTTOU) the
+ *  disposition given with sigaction(), SIG_IGN or SIG_DFL, and SIGCHLD its default one
+ */
+static void set_terminal_signals(void (*disposition)(int signum)){
+    static int signums[] = {SIGINT, SIGQUIT, SIGTSTP, SIGTTIN, SIGTTOU};
+    struct sigaction action;
+    size_t i;
+
+    memset(&action, 0, sizeof(action));
+    sigemptyset(&action.sa_mask);
+    action.sa_handler = disposition;
+    for(i = 0; i < sizeof(signums) / sizeof(signums[0]); i++){
+        sigaction(signums[i], &action, NULL);
+    }
+    action.sa_handler = SIG_DFL;
+    sigaction(SIGCHLD, &action, NULL);
+}
+
+/**
+ * Sets up the command in the child of the helper, then runs it. Nothing here allocates:
+ *  the child is a raw copy of the helper.
+ * @param fds The descriptors sent with the request, the working directory last
+ * @param report Where to write the errno of execve() if it fails
+ */
+static void start_command(struct zygote_request* request, int* fds, int num_fds, char* path, char** argv,
+                          char** envp, int report){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    sigset_t mask;
+    int lowest = 3;
+    int exec_errno;
+    int i;
+
+    /********************************************************************
+    The process group and the terminal first, while SIGTTOU is still
+        ignored, then the signals the helper changed are put back
+    ********************************************************************/
+    if(request->pgid != -1){
+        setpgid(0, request->pgid);
+        if(request->foreground){
+            tcsetpgrp(terminal_fd, getpgrp());
+        }
+    }
+    set_terminal_signals(SIG_DFL);
+    sigemptyset(&mask);
+    sigprocmask(SIG_SETMASK, &mask, NULL);
+
+    if(fchdir(fds[num_fds - 1]) == -1){
+        exec_errno = errno;
+        if(write(report, &exec_errno, sizeof(exec_errno)) == -1){
+            _exit(EXIT_NOT_EXECUTABLE);
+        }
+        _exit(EXIT_NOT_EXECUTABLE);
+    }
+
+    /********************************************************************
+    Move what was sent, and the report pipe, above every descriptor of
+        the command, so that no copy lands on one still needed. The
+        copies are closed on exec; the descriptors of the command are not.
+    ********************************************************************/
+    for(i = 0; i < request->num_targets; i++){
+        if(request->targets[i] >= lowest){
+            lowest = request->targets[i] + 1;
+        }
+    }
+    for(i = 0; i < num_fds - 1; i++){
+        fds[i] = fcntl(fds[i], F_DUPFD_CLOEXEC, lowest);
+    }
+    report = fcntl(report, F_DUPFD_CLOEXEC, lowest);
+
+    for(i = 0; i < request->num_targets; i++){
+        if(request->sources[i] == -1){
+            close(request->targets[i]);
+        }else{
+            dup2(fds[request->sources[i]], request->targets[i]);
+        }
+    }
+
+    execve(path, argv, envp);
+
+    //Only reached if execve failed, tell the helper why
+    exec_errno = errno;
+    if(write(report, &exec_errno, sizeof(exec_errno)) == -1){
+        _exit(EXIT_NOT_FOUND);
+    }
+    _exit(EXIT_NOT_FOUND);
+}
+
+/**
+ * Receives one message, retrying when interrupted
+ * @return Its length, 0 once the shell is gone
+ */
+static ssize_t receive(int socket, struct msghdr* message){
+    ssize_t length;
+
+    do{
+        length = recvmsg(socket, message, MSG_CMSG_CLOEXEC);
+    }while(length == -1 && errno == EINTR);
+    return (length == -1) ? 0 : length;
+}
+
+/**
+ * The helper: launches a command for each request until the shell closes its end. The
+ *  commands are created with clone(CLONE_PARENT), so they are children of the shell,
+ *  which waits for them, stops and continues them as if it had launched them itself.
+ */
+static void zygote_serve(int socket){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    struct zygote_request request;
+    struct zygote_reply reply;
+    struct msghdr message;
+    struct iovec vector;
+    struct cmsghdr* control;
+    union fd_message fd_buffer;
+    char** pointers = NULL;
+    size_t pointers_capacity = 0;
+    char* strings = NULL;
+    size_t strings_capacity = 0;
+    size_t received;
+    ssize_t length;
+    int fds[ZYGOTE_MAX_FDS + 1];
+    int num_fds;
+    int report[2];
+    int exec_errno;
+    char* c;
+    int i;
+
+    while(1){
+
+        /********************************************************************
+        The request, with its descriptors
+        ********************************************************************/
+        memset(&message, 0, sizeof(message));
+        vector.iov_base = &request;
+        vector.iov_len = sizeof(request);
+        message.msg_iov = &vector;
+        message.msg_iovlen = 1;
+        message.msg_control = fd_buffer.buffer;
+        message.msg_controllen = sizeof(fd_buffer.buffer);
+        if(receive(socket, &message) != sizeof(request)){
+            _exit(EXIT_SUCCESS);
+        }
+        num_fds = 0;
+        for(control = CMSG_FIRSTHDR(&message); control != NULL; control = CMSG_NXTHDR(&message, control)){
+            if(control->cmsg_level == SOL_SOCKET && control->cmsg_type == SCM_RIGHTS){
+                num_fds = (control->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                memcpy(fds, CMSG_DATA(control), num_fds * sizeof(int));
+            }
+        }
+
+        /********************************************************************
+        Then its strings
+        ********************************************************************/
+        if(request.length > strings_capacity){
+            free(strings);
+            strings_capacity = request.length * 2;
+            strings = malloc(strings_capacity);
+        }
+        if((size_t) request.argc + request.envc + 2 > pointers_capacity){
+            free(pointers);
+            pointers_capacity = (request.argc + request.envc + 2) * 2;
+            pointers = malloc(pointers_capacity * sizeof(char*));
+        }
+        if(strings == NULL || pointers == NULL){
+            _exit(EXIT_FAILURE);
+        }
+        for(received = 0; received < request.length; received += length){
+            memset(&message, 0, sizeof(message));
+            vector.iov_base = strings + received;
+            vector.iov_len = request.length - received;
+            message.msg_iov = &vector;
+            message.msg_iovlen = 1;
+            length = receive(socket, &message);
+            if(length == 0){
+                _exit(EXIT_SUCCESS);
+            }
+        }
+        c = strings + strlen(strings) + 1;
+        for(i = 0; i < request.argc + request.envc; i++){
+            pointers[i + (i >= request.argc)] = c;
+            c += strlen(c) + 1;
+        }
+        pointers[request.argc] = NULL;
+        pointers[request.argc + request.envc + 1] = NULL;
+
+        /********************************************************************
+        Launch it, and answer once it runs or failed to
+        ********************************************************************/
+        reply.pid = -1;
+        reply.err = 0;
+        if(num_fds == 0 || pipe2(report, O_CLOEXEC) == -1){
+            reply.err = (num_fds == 0) ? EBADF : errno;
+        }else{
+            reply.pid = syscall(SYS_clone, CLONE_PARENT | SIGCHLD, 0, NULL, NULL, 0);
+            if(reply.pid == 0){
+                //We're in the command
+                close(report[0]);
+                start_command(&request, fds, num_fds, strings, pointers, pointers + request.argc + 1, report[1]);
+            }
+            if(reply.pid == -1){
+                reply.err = errno;
+            }
+            close(report[1]);
+            if(reply.pid != -1){
+                do{
+                    length = read(report[0], &exec_errno, sizeof(exec_errno));
+                }while(length == -1 && errno == EINTR);
+                if(length == sizeof(exec_errno)){
+                    reply.err = exec_errno;
+                }
+            }
+            close(report[0]);
+        }
+        for(i = 0; i < num_fds; i++){
+            close(fds[i]);
+        }
+        if(send(socket, &reply, sizeof(reply), MSG_NOSIGNAL) == -1){
+            _exit(EXIT_SUCCESS);
+        }
+    }
+}
+
+/**
+ * Forks the helper. It should be done early, as the helper is a copy of the shell as it
+ *  is then and never grows. The helper ignores the signals of the terminal and leaves
+ *  when the shell does.
+ * @param terminal The terminal of the shell, -1 if it has none
+ * @return 0 if the helper runs, -1 if it could not be started
+ */
+int zygote_start(int terminal){
+    int sockets[2];
+    pid_t pid;
+
+    if(socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sockets) == -1){
+        perror("bcsh: spawn helper ");
+        return -1;
+    }
+
+    fflush(stdout);
+    pid = fork();
+    if(pid == 0){
+        //We're in the helper
+        close(sockets[0]);
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        if(getppid() == 1){
+            _exit(EXIT_SUCCESS);
+        }
+        terminal_fd = terminal;
+        set_terminal_signals(SIG_IGN);
+        zygote_serve(sockets[1]);
+    }
+
+    close(sockets[1]);
+    if(pid == -1){
+        perror("bcsh: spawn helper ");
+        close(sockets[0]);
+        return -1;
+    }
+    zygote_fd = sockets[0];
+    return 0;
+}
+
+/**
+ * Tells whether commands can be launched through the helper
+ */
+int zygote_running(){
+    return zygote_fd != -1;
+}
+
+/**
+ * Stops using the helper, in a copy of the shell forked for a pipeline or a
+ *  substitution: the helper's commands are children of the shell itself, which the copy
+ *  could not wait for. The helper stays for the shell.
+ */
+void zygote_detach(){
+    if(zygote_fd != -1){
+        close(zygote_fd);
+        zygote_fd = -1;
+    }
+}
+
+/**
+ * Gives up on a helper that stopped answering; commands are launched without it from
+ *  now on
+ */
+static int zygote_lost(){
+    fprintf(stderr, "bcsh: the spawn helper is gone, launching commands with posix_spawn()\n");
+    zygote_detach();
+    return ZYGOTE_UNAVAILABLE;
+}
+
+/**
+ * Adds a string to the strings being sent, sending them once ZYGOTE_CHUNK bytes are
+ *  waiting
+ * @param chunk Where the strings wait, and how much of it is used
+ * @return 0 on success, -1 if the helper is gone
+ */
+static int send_string(char* chunk, size_t* used, char* string){
+    size_t length = strlen(string) + 1;
+    size_t part;
+
+    while(length > 0){
+        part = ZYGOTE_CHUNK - *used;
+        if(part > length){
+            part = length;
+        }
+        memcpy(chunk + *used, string, part);
+        *used += part;
+        string += part;
+        length -= part;
+        if(*used == ZYGOTE_CHUNK){
+            if(send(zygote_fd, chunk, *used, MSG_NOSIGNAL) == -1){
+                return -1;
+            }
+            *used = 0;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Launches a command through the helper, the way posix_spawn() would: the call returns
+ *  once it runs or failed to. Its working directory is the caller's.
+ * @param fds The descriptors of the command, in the order they are set up. Every other
+ *  descriptor it has is the helper's, as it was when the shell started.
+ * @param pgid -1 to stay in the shell's process group, 0 to lead a new one, or the group to join
+ * @param foreground Give the terminal to the command's process group
+ * @param pid Set to the pid of the command, a child of the caller
+ * @return 0 if the command runs, the errno of the failure otherwise, ZYGOTE_UNAVAILABLE
+ *  if there is no helper or there are too many descriptors (nothing was launched)
+ */
+int zygote_spawn(char* path, char** argv, char** envp, struct zygote_fd* fds, int num_fds,
+                 pid_t pgid, int foreground, pid_t* pid){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    static char* chunk = NULL;
+    struct zygote_request request;
+    struct zygote_reply reply;
+    struct msghdr message;
+    struct iovec vector;
+    struct cmsghdr* control;
+    union fd_message fd_buffer;
+    int sent[ZYGOTE_MAX_FDS + 1];
+    int num_sent = 0;
+    size_t used = 0;
+    ssize_t length;
+    int i;
+    int j;
+
+    if(zygote_fd == -1 || num_fds > ZYGOTE_MAX_FDS){
+        return ZYGOTE_UNAVAILABLE;
+    }
+    if(chunk == NULL){
+        chunk = malloc(ZYGOTE_CHUNK);
+        if(chunk == NULL){
+            fprintf(stderr, "Error in zygote_spawn() : Could not allocate space for the request\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    /********************************************************************
+    Each descriptor of the caller is sent once, however many of the
+        command's it goes to, and the working directory last
+    ********************************************************************/
+    memset(&request, 0, sizeof(request));
+    request.pgid = pgid;
+    request.foreground = foreground;
+    request.num_targets = num_fds;
+    for(i = 0; i < num_fds; i++){
+        request.targets[i] = fds[i].target;
+        request.sources[i] = -1;
+        if(fds[i].source == -1){
+            continue;
+        }
+        for(j = 0; j < num_sent && sent[j] != fds[i].source; j++);
+        if(j == num_sent){
+            sent[num_sent++] = fds[i].source;
+        }
+        request.sources[i] = j;
+    }
+    sent[num_sent] = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if(sent[num_sent] == -1){
+        return errno;
+    }
+
+    request.length = strlen(path) + 1;
+    for(request.argc = 0; argv[request.argc] != NULL; request.argc++){
+        request.length += strlen(argv[request.argc]) + 1;
+    }
+    for(request.envc = 0; envp[request.envc] != NULL; request.envc++){
+        request.length += strlen(envp[request.envc]) + 1;
+    }
+
+    memset(&message, 0, sizeof(message));
+    memset(&fd_buffer, 0, sizeof(fd_buffer));
+    vector.iov_base = &request;
+    vector.iov_len = sizeof(request);
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = fd_buffer.buffer;
+    message.msg_controllen = CMSG_SPACE((num_sent + 1) * sizeof(int));
+    control = CMSG_FIRSTHDR(&message);
+    control->cmsg_level = SOL_SOCKET;
+    control->cmsg_type = SCM_RIGHTS;
+    control->cmsg_len = CMSG_LEN((num_sent + 1) * sizeof(int));
+    memcpy(CMSG_DATA(control), sent, (num_sent + 1) * sizeof(int));
+
+    length = sendmsg(zygote_fd, &message, MSG_NOSIGNAL);
+    close(sent[num_sent]);
+    if(length == -1){
+        return zygote_lost();
+    }
+
+    /********************************************************************
+    The strings, then the answer
+    ********************************************************************/
+    if(send_string(chunk, &used, path) == -1){
+        return zygote_lost();
+    }
+    for(i = 0; i < request.argc; i++){
+        if(send_string(chunk, &used, argv[i]) == -1){
+            return zygote_lost();
+        }
+    }
+    for(i = 0; i < request.envc; i++){
+        if(send_string(chunk, &used, envp[i]) == -1){
+            return zygote_lost();
+        }
+    }
+    if(used > 0 && send(zygote_fd, chunk, used, MSG_NOSIGNAL) == -1){
+        return zygote_lost();
+    }
+
+    do{
+        length = recv(zygote_fd, &reply, sizeof(reply), 0);
+    }while(length == -1 && errno == EINTR);
+    if(length != sizeof(reply)){
+        return zygote_lost();
+    }
+
+    *pid = reply.pid;
+    if(reply.pid != -1 && reply.err != 0){
+        waitpid(reply.pid, NULL, 0);
+    }
+    return reply.err;
+}
@@ -0,0 +1,69 @@
+#!/bin/sh
+#
+# Brennan Couturier
+#
+# test_script.sh
+#
+# Runs bcsh ($BCSH) on small scripts and compares what they print, and
+#  the status they exit with, to what they should. Each failing case is
+#  reported; the script exits 1 if any failed.
+#
+
+BCSH=${BCSH:-../bin/bcsh}
+WORKDIR=$(mktemp -d)
+trap 'rm -rf "$WORKDIR"' EXIT
+failed=0
+
+# Runs the commands given with bcsh -c, and checks their output and exit
+#  status: check name 'commands' 'expected output' [expected status]
+check(){
+    output=$("$BCSH" -c "$2" 2>&1)
+    status=$?
+    expected_status=${4:-0}
+    if [ "$output" != "$3" ] || [ $status -ne $expected_status ]; then
+        echo "FAIL: $1"
+        echo "  expected status $expected_status and output: $3"
+        echo "  got status $status and output: $output"
+        failed=1
+    fi
+}
+
+# $! is the pid of the last background job, and nothing before there is one
+check 'last background pid' 'sh -c "exit 7" & p=$!; wait $p; echo $?' '7'
+check 'no background pid' 'echo "[$!]"' '[]'
+
+# jobs shows the commands as they were written, lines up its columns, and
+#  leaves out the pipeline it runs in
+check 'job text' "sleep 0.2 '1' & jobs" "[1]+  Running                sleep 0.2 '1' &"
+check 'job columns' 'for i in 1 2 3 4 5 6 7 8 9 10; do sleep 0.2 & done; jobs | sed -n "9p;10p"' \
+'[9]    Running                sleep 0.2 &
+[10]+  Running                sleep 0.2 &'
+check 'jobs in a pipeline' 'sleep 0.2 & jobs | wc -l' '1'
+
+# A script that is a directory cannot be run, one that is missing cannot be found
+check 'directory script' "$BCSH $WORKDIR; echo \$?" "bcsh: $WORKDIR: Is a directory
+126"
+check 'missing script' "$BCSH $WORKDIR/missing; echo \$?" "bcsh: $WORKDIR/missing: No such file or directory
+127"
+
+# A request to bcsh --serve starts with $? at 0, and one that runs nothing
+#  succeeds, whatever the server's own status
+"$BCSH" --serve "$WORKDIR/serve.sock" &
+server=$!
+i=0
+while [ ! -S "$WORKDIR/serve.sock" ] && [ $i -lt 50 ]; do
+    sleep 0.1
+    i=$((i + 1))
+done
+check 'serve status' "$BCSH --connect $WORKDIR/serve.sock 'echo \$?'" '0'
+check 'serve empty request' "$BCSH --connect $WORKDIR/serve.sock ''; echo \$?" '0'
+check 'serve comment request' "$BCSH --connect $WORKDIR/serve.sock '# nothing'; echo \$?" '0'
+check 'serve exit request' "$BCSH --connect $WORKDIR/serve.sock exit; echo \$?" '0'
+check 'serve failing request' "$BCSH --connect $WORKDIR/serve.sock false; echo \$?" '1'
+kill $server
+wait $server
+
+if [ $failed -eq 0 ]; then
+    echo "all tests passed"
+fi
+exit $failed
@@ -0,0 +1,96 @@
+/**
+ * * * * * * * * * * * * * * * * * * *
+ * Brennan Couturier
+ * * * * * * * * * * * * * * * * * * *
+ * gen_builtin_hash.c
+ * * * * * * * * * * * * * * * * * * *
+ * Generates the perfect hash table of
+ *  internal commands, and their count,
+ *  from the list in bcsh_builtins.def.
+ *  Run by the Makefile:
+ *  gen_builtin_hash output.h
+ * * * * * * * * * * * * * * * * * * *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/bcsh_builtins.h"
+
+#define BUILTIN(name, function) name,
+static const char* names[] = {
+#include "../include/bcsh_builtins.def"
+};
+#undef BUILTIN
+
+#define NUM_NAMES (sizeof(names) / sizeof(names[0]))
+
+#define MAX_SEED 1000000
+
+int main(int argc, char** argv){
+
+    /********************************************************************
+    Declare variables
+    ********************************************************************/
+    int table[256];
+    unsigned int size = 1;
+    unsigned int seed;
+    unsigned int slot;
+    size_t i;
+    FILE* output;
+
+    if(argc != 2){
+        fprintf(stderr, "usage: gen_builtin_hash output.h\n");
+        return EXIT_FAILURE;
+    }
+
+    /********************************************************************
+    Start with a table twice as big as the list, and try seeds until
+        every name gets a slot of its own. Grow the table if none works.
+    ********************************************************************/
+    while(size < NUM_NAMES * 2){
+        size *= 2;
+    }
+    for(; size <= 256; size *= 2){
+        for(seed = 0; seed < MAX_SEED; seed++){
+            memset(table, -1, sizeof(table));
+            for(i = 0; i < NUM_NAMES; i++){
+                slot = builtin_hash(names[i], seed) & (size - 1);
+                if(table[slot] != -1){
+                    break;
+                }
+                table[slot] = i;
+            }
+            if(i == NUM_NAMES){
+                break;
+            }
+        }
+        if(seed < MAX_SEED){
+            break;
+        }
+    }
+    if(size > 256){
+        fprintf(stderr, "gen_builtin_hash : no perfect hash found\n");
+        return EXIT_FAILURE;
+    }
+
+    output = fopen(argv[1], "w");
+    if(output == NULL){
+        perror("gen_builtin_hash : Could not open output ");
+        return EXIT_FAILURE;
+    }
+
+    fprintf(output, "/* Generated by tools/gen_builtin_hash.c from bcsh_builtins.def, do not edit */\n\n");
+    fprintf(output, "#define BUILTIN_HASH_SEED %uu\n\n", seed);
+    fprintf(output, "#define BUILTIN_HASH_SIZE %u\n\n", size);
+    fprintf(output, "#define NUM_INTERNAL_COMMANDS %zu\n\n", NUM_NAMES);
+    fprintf(output, "static const signed char builtin_hash_table[BUILTIN_HASH_SIZE] = {");
+    for(slot = 0; slot < size; slot++){
+        fprintf(output, "%s%s%d", (slot > 0) ? "," : "", (slot % 16 == 0) ? "\n    " : " ", table[slot]);
+    }
+    fprintf(output, "\n};\n");
+
+    fclose(output);
+    return EXIT_SUCCESS;
+}